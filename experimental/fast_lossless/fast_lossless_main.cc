@@ -10,7 +10,7 @@
 #include <chrono>
 #include <thread>
 
-#include "fast_lossless.h"
+#include "lib/jxl/enc_fast_lossless.h"
 #include "lodepng.h"
 #include "pam-input.h"
 
@@ -51,8 +51,12 @@ int main(int argc, char** argv) {
   auto start = std::chrono::high_resolution_clock::now();
   for (size_t _ = 0; _ < num_reps; _++) {
     free(encoded);
+    // PAM stores 16-bit samples big-endian. Without a runner, the groups are
+    // encoded with OpenMP.
     encoded_size = JxlFastLosslessEncode(png, width, stride, height, nb_chans,
-                                         bitdepth, effort, &encoded);
+                                         bitdepth, /*big_endian=*/1, effort,
+                                         &encoded, /*runner_opaque=*/nullptr,
+                                         /*runner=*/nullptr);
   }
   auto stop = std::chrono::high_resolution_clock::now();
   if (num_reps > 1) {
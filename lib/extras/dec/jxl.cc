@@ -117,6 +117,13 @@ bool DecodeImageJXL(const uint8_t* bytes, size_t bytes_size,
     fprintf(stderr, "JxlEncoderSetParallelRunner failed\n");
     return false;
   }
+  if (dparams.stage_stats_callback != nullptr &&
+      JXL_DEC_SUCCESS !=
+          JxlDecoderSetStageStatsCallback(dec, dparams.stage_stats_callback,
+                                          dparams.stage_stats_opaque)) {
+    fprintf(stderr, "JxlDecoderSetStageStatsCallback failed\n");
+    return false;
+  }
 
   JxlPixelFormat format;
   std::vector<JxlPixelFormat> accepted_formats = dparams.accepted_formats;
@@ -14,6 +14,7 @@
 #include <string>
 #include <vector>
 
+#include "jxl/decode.h"
 #include "jxl/parallel_runner.h"
 #include "jxl/types.h"
 #include "lib/extras/packed_image.h"
@@ -56,6 +57,11 @@ struct JXLDecompressParams {
 
   // Controls the effective bit depth of the output pixels.
   JxlBitDepth output_bitdepth = {JXL_BIT_DEPTH_FROM_PIXEL_FORMAT, 0, 0};
+
+  // If set, receives the time used by the stages of every decoded frame, see
+  // JxlDecoderSetStageStatsCallback.
+  JxlDecoderStageStatsCallback stage_stats_callback = nullptr;
+  void* stage_stats_opaque = nullptr;
 };
 
 bool DecodeImageJXL(const uint8_t* bytes, size_t bytes_size,
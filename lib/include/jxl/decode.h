@@ -361,21 +361,23 @@ typedef enum {
  * the beginning of the file and the decoder will emit events from the beginning
  * again. When rewinding (as opposed to @ref JxlDecoderReset), the decoder can
  * keep state about the image, which it can use to skip to a requested frame
- * more efficiently with @ref JxlDecoderSkipFrames. Settings such as parallel
- * runner or subscribed events are kept. After rewind, @ref
- * JxlDecoderSubscribeEvents can be used again, and it is feasible to leave out
- * events that were already handled before, such as @ref JXL_DEC_BASIC_INFO
- * and @ref JXL_DEC_COLOR_ENCODING, since they will provide the same information
- * as before.
+ * more efficiently with @ref JxlDecoderSkipFrames or @ref
+ * JxlDecoderSeekToFrame. Settings such as parallel runner or subscribed events
+ * are kept. After rewind, @ref JxlDecoderSubscribeEvents can be used again,
+ * and it is feasible to leave out events that were already handled before,
+ * such as @ref JXL_DEC_BASIC_INFO and @ref JXL_DEC_COLOR_ENCODING, since they
+ * will provide the same information as before.
  * The difference to @ref JxlDecoderReset is that some state is kept, namely
  * settings set by a call to
  *  - @ref JxlDecoderSetCoalescing,
  *  - @ref JxlDecoderSetDesiredIntensityTarget,
  *  - @ref JxlDecoderSetDecompressBoxes,
+ *  - @ref JxlDecoderSetInputPersistent,
  *  - @ref JxlDecoderSetKeepOrientation,
  *  - @ref JxlDecoderSetUnpremultiplyAlpha,
  *  - @ref JxlDecoderSetParallelRunner,
- *  - @ref JxlDecoderSetRenderSpotcolors, and
+ *  - @ref JxlDecoderSetRenderSpotcolors,
+ *  - @ref JxlDecoderSetReuseBuffers, and
  *  - @ref JxlDecoderSubscribeEvents.
  *
  * @param dec decoder object
@@ -416,6 +418,45 @@ JXL_EXPORT void JxlDecoderSkipFrames(JxlDecoder* dec, size_t amount);
  */
 JXL_EXPORT JxlDecoderStatus JxlDecoderSkipCurrentFrame(JxlDecoder* dec);
 
+/**
+ * Seeks to a frame using the frame index box (jxli) of the file, if it has
+ * one. Decoding continues at the last indexed frame at or before the
+ * requested frame, and the frames between the two are skipped as with @ref
+ * JxlDecoderSkipFrames, so that the next @ref JXL_DEC_FRAME and @ref
+ * JXL_DEC_FULL_IMAGE events are for the requested frame. Frames are counted
+ * from the start of the image, as in @ref JxlDecoderSkipFrames.
+ *
+ * The decoder must have seen the frame index box and the codestream box that
+ * contains the indexed frame, either in the current pass or before a @ref
+ * JxlDecoderRewind, and must have decoded the image headers, i.e. it must be
+ * past the @ref JXL_DEC_COLOR_ENCODING event. Since encoders usually store the
+ * frame index box after the codestream, a first pass subscribed only to @ref
+ * JXL_DEC_BOX events can be used to find it without decoding any frames.
+ *
+ * The input must be released with @ref JxlDecoderReleaseInput before calling
+ * this function. The next @ref JxlDecoderSetInput call must then provide the
+ * file starting from the returned offset, the bytes before it are not needed.
+ *
+ * Indexed frames, and the frames after them, must not depend on frames before
+ * the indexed frame. The encoder only allows indexing frames without cropping
+ * or blending, and rejects later frames that use a reference frame saved
+ * before an indexed frame. The frame counts of the index are in displayed
+ * frames, as seen with coalescing enabled.
+ *
+ * @param dec decoder object
+ * @param frame_index index of the frame to seek to, counted as in @ref
+ *     JxlDecoderSkipFrames.
+ * @param input_offset output value for the file position the next input must
+ *     start at.
+ * @return @ref JXL_DEC_SUCCESS if seeking succeeded, @ref JXL_DEC_ERROR if
+ *     there is no usable frame index or the decoder is not in a state where it
+ *     can seek. In the latter case the decoder is left unchanged and can still
+ *     be used, e.g. with @ref JxlDecoderSkipFrames.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSeekToFrame(JxlDecoder* dec,
+                                                  size_t frame_index,
+                                                  size_t* input_offset);
+
 /**
  * Get the default pixel format for this decoder.
  *
@@ -665,6 +706,57 @@ JXL_EXPORT size_t JxlDecoderReleaseInput(JxlDecoder* dec);
  */
 JXL_EXPORT void JxlDecoderCloseInput(JxlDecoder* dec);
 
+/**
+ * Enables or disables persistent input. By default, when the input set with
+ * @ref JxlDecoderSetInput ends in the middle of a part of the codestream that
+ * must be decoded at once, such as a frame header or a group, the decoder
+ * copies the available bytes of that part internally, so that all input can be
+ * released when returning @ref JXL_DEC_NEED_MORE_INPUT.
+ *
+ * With persistent input, the user guarantees that every next @ref
+ * JxlDecoderSetInput call provides all bytes not yet processed, as returned by
+ * @ref JxlDecoderReleaseInput, followed by the next bytes in a single buffer,
+ * e.g. when the whole file is memory mapped. The decoder then leaves such
+ * incomplete parts in the input unprocessed, and decodes them in place once
+ * they are complete, without copying. A copy is still made when the
+ * codestream of a container file continues in a next jxlp box, since it is not
+ * contiguous in the input then.
+ *
+ * By default, this option is disabled. This function must be called at the
+ * beginning, before decoding is performed.
+ *
+ * @param dec decoder object
+ * @param persistent JXL_TRUE to enable persistent input, JXL_FALSE to disable
+ *     it.
+ * @return @ref JXL_DEC_SUCCESS if no error, @ref JXL_DEC_ERROR otherwise.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetInputPersistent(JxlDecoder* dec,
+                                                         JXL_BOOL persistent);
+
+/**
+ * Enables or disables the reuse of buffers across images. By default, @ref
+ * JxlDecoderReset and @ref JxlDecoderRewind free all the memory used for
+ * decoding the previous image. With this option, the decoder instead keeps
+ * its buffers, such as the per-block images, the entropy decoding tables and
+ * the storage of the rendering pipeline, and reuses those that are large
+ * enough for the next image. This avoids most of the allocations when decoding
+ * many images of the same or decreasing dimensions, e.g. thumbnails, with one
+ * decoder. Buffers that are too small for the next image are replaced by
+ * larger ones, and larger buffers are kept until the decoder is destroyed or
+ * this option is disabled.
+ *
+ * By default, this option is disabled. Unlike other settings, it is not
+ * reset by @ref JxlDecoderReset, and it can be changed at any time. Disabling
+ * it frees the buffers kept from the previous image.
+ *
+ * @param dec decoder object
+ * @param reuse_buffers JXL_TRUE to keep and reuse buffers, JXL_FALSE to free
+ *     them when resetting.
+ * @return @ref JXL_DEC_SUCCESS if no error, @ref JXL_DEC_ERROR otherwise.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetReuseBuffers(JxlDecoder* dec,
+                                                      JXL_BOOL reuse_buffers);
+
 /**
  * Outputs the basic image information, such as image dimensions, bit depth and
  * all other JxlBasicInfo fields, if available.
@@ -1030,6 +1122,78 @@ JXL_DEPRECATED JXL_EXPORT JxlDecoderStatus JxlDecoderDCOutBufferSize(
 JXL_DEPRECATED JXL_EXPORT JxlDecoderStatus JxlDecoderSetDCOutBuffer(
     JxlDecoder* dec, const JxlPixelFormat* format, void* buffer, size_t size);
 
+/**
+ * Restricts the decoded image to a rectangular region, for example to decode a
+ * tile of a large image. The image out buffer or callback and the extra
+ * channel buffers then only receive the pixels of the region and have its
+ * dimensions: @ref JxlDecoderImageOutBufferSize and @ref
+ * JxlDecoderExtraChannelBufferSize return sizes for the region, and the
+ * positions given to the image out callback are relative to its top-left
+ * corner.
+ *
+ * Frames that cover the whole image and are not referenced by later frames,
+ * such as the frame of a single-layer still image, are only partially
+ * decoded: the DC and AC groups that do not contribute to the region are
+ * skipped, and once the DC global section of the frame is decoded, their
+ * input bytes are skipped without being read or copied. This does not apply
+ * if the modular data of the frame needs to be decoded as a whole, as with the
+ * squeeze transform, nor to the preview frame, which is always decoded
+ * entirely.
+ *
+ * The region is given in the orientation of the output, that is after
+ * applying the orientation unless @ref JxlDecoderSetKeepOrientation is
+ * enabled, and it applies to all the following frames. A region covering the
+ * whole image disables cropping. Requires coalescing, and can only be called
+ * once the @ref JXL_DEC_BASIC_INFO event occurred, while no image out buffer
+ * or callback is set.
+ *
+ * @param dec decoder object
+ * @param x0 horizontal position of the left column of the region
+ * @param y0 vertical position of the top row of the region
+ * @param xsize width of the region, must be at least 1
+ * @param ysize height of the region, must be at least 1
+ * @return @ref JXL_DEC_SUCCESS on success, @ref JXL_DEC_ERROR on error, such as
+ *     a region that is not inside the image.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetCropRegion(JxlDecoder* dec, size_t x0,
+                                                    size_t y0, size_t xsize,
+                                                    size_t ysize);
+
+/**
+ * Decodes the image at a reduced resolution, for example for thumbnails. The
+ * image out buffer or callback then receives an image of ceil(xsize / factor)
+ * by ceil(ysize / factor) pixels, as returned by @ref
+ * JxlDecoderImageOutBufferSize, and so do the extra channel buffers.
+ *
+ * With a factor of 8, frames that allow it are rendered from their DC (low
+ * frequency) image, which is 8 times smaller than the frame in each
+ * direction, and the AC sections of the frame are neither decoded nor read
+ * from the input. The restoration filters, noise, patches and splines of the
+ * frame are then not rendered. This requires a VarDCT frame without
+ * upsampling, chroma subsampling or subsampled extra channels, which replaces
+ * the whole image and is not referenced by later frames. The extra channels
+ * of such a frame, such as alpha, have no DC image: the AC sections are then
+ * read, only the extra channels are decoded from them and box-downsampled,
+ * and the frame is rendered once all of its sections are decoded.
+ *
+ * Other frames, and all frames with the factors 2 and 4, are decoded at full
+ * resolution into an internal float buffer, and each output pixel is the
+ * average of a box of factor by factor pixels, or of the part of the box that
+ * is inside the image on the right and bottom edges. This uses as much memory
+ * as a full resolution float output. The preview frame is always decoded at
+ * full resolution.
+ *
+ * Requires coalescing, can not be combined with @ref JxlDecoderSetCropRegion,
+ * and can not be called while an image out buffer or callback is set.
+ *
+ * @param dec decoder object
+ * @param factor downsampling factor in each direction, 1, 2, 4 or 8
+ * @return @ref JXL_DEC_SUCCESS on success, @ref JXL_DEC_ERROR on error, such as
+ *     an unsupported factor.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetOutputDownsampling(JxlDecoder* dec,
+                                                            uint32_t factor);
+
 /**
  * Returns the minimum size in bytes of the image output pixel buffer for the
  * given format. This is the buffer for @ref JxlDecoderSetImageOutBuffer.
@@ -1504,6 +1668,79 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderFlushImage(JxlDecoder* dec);
 JXL_EXPORT JxlDecoderStatus
 JxlDecoderSetImageOutBitDepth(JxlDecoder* dec, const JxlBitDepth* bit_depth);
 
+/**
+ * Stages of the decoding of a frame, reported with @ref
+ * JxlDecoderStageStatsCallback. Not every stage is entered for every frame,
+ * e.g. frames reconstructed to JPEG are not rendered.
+ */
+typedef enum {
+  /** Decoding of the global and DC sections of the frame, until the DC image
+   * is complete.
+   */
+  JXL_DEC_STAGE_DC = 0,
+
+  /** Decoding of the AC global and AC group sections of the frame: entropy
+   * decoding, dequantization and inverse transforms.
+   */
+  JXL_DEC_STAGE_AC = 1,
+
+  /** Rendering of the decoded frame: the render pipeline (filters,
+   * upsampling, color conversion, blending and writing of the output) and the
+   * undoing of the global modular transforms.
+   */
+  JXL_DEC_STAGE_RENDER = 2,
+} JxlDecoderStage;
+
+/** Time used by one stage of the decoding of a frame.
+ */
+typedef struct {
+  /** Elapsed real time in seconds on the thread that calls @ref
+   * JxlDecoderProcessInput. The groups of the AC stage are rendered while
+   * they are decoded on the parallel runner; that rendering is part of the
+   * wall time of @ref JXL_DEC_STAGE_AC.
+   */
+  double wall_seconds;
+
+  /** CPU time in seconds used by the thread that calls @ref
+   * JxlDecoderProcessInput during the stage, including the CPU time of the
+   * tasks it runs on the threads of the parallel runner. Each CPU second is
+   * counted in exactly one stage, rendering of the AC groups in @ref
+   * JXL_DEC_STAGE_RENDER.
+   */
+  double cpu_seconds;
+} JxlDecoderStageStats;
+
+/**
+ * Function receiving the time used by the stages of a frame, set with @ref
+ * JxlDecoderSetStageStatsCallback.
+ *
+ * @param opaque user supplied parameter, passed unchanged.
+ * @param frame_index index of the frame in the codestream, including frames
+ *     that are not displayed, starting at 0.
+ * @param stage the stage.
+ * @param stats the time used by the stage, only valid during the call.
+ */
+typedef void (*JxlDecoderStageStatsCallback)(void* opaque,
+                                             uint32_t frame_index,
+                                             JxlDecoderStage stage,
+                                             const JxlDecoderStageStats* stats);
+
+/**
+ * Sets a callback receiving the time used by each stage of the decoder. After
+ * each frame is decoded, the callback is called once for every stage that was
+ * entered for it, in the order of @ref JxlDecoderStage. Frames that are
+ * skipped and the preview frame are not reported. Nothing is measured while
+ * no callback is set.
+ *
+ * @param dec decoder object.
+ * @param callback function receiving the stats, or NULL to unset it.
+ * @param opaque user supplied parameter passed to the callback.
+ * @return @ref JXL_DEC_SUCCESS if the callback was set, @ref JXL_DEC_ERROR
+ *     otherwise.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetStageStatsCallback(
+    JxlDecoder* dec, JxlDecoderStageStatsCallback callback, void* opaque);
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }
 #endif
@@ -134,6 +134,14 @@ typedef enum {
    * values are, from faster to slower speed: 1:lightning 2:thunder 3:falcon
    * 4:cheetah 5:hare 6:wombat 7:squirrel 8:kitten 9:tortoise.
    * Default: squirrel (7).
+   *
+   * Lossless frames at effort 1 use a dedicated fast encoder if they are added
+   * with @ref JxlEncoderAddImageFrame from UINT8 or (up to 12-bit) UINT16
+   * samples of the bit depth of the image, have no other extra channel than
+   * alpha, and are not animated, cropped, blended, named or saved as
+   * reference. Such frames are encoded when added, and encoded again if
+   * their alpha channel is then replaced with @ref
+   * JxlEncoderSetExtraChannelBuffer.
    */
   JXL_ENC_FRAME_SETTING_EFFORT = 0,
 
@@ -328,7 +336,9 @@ typedef enum {
    * be indexed, too. If the first frame is not indexed, and
    * a later frame is attempted to be indexed, JXL_ENC_ERROR will occur.
    * If non-keyframes, i.e., frames with cropping, blending or patches are
-   * attempted to be indexed, JXL_ENC_ERROR will occur.
+   * attempted to be indexed, JXL_ENC_ERROR will occur. Likewise, the indexed
+   * frame and the frames after it must not crop or blend onto a reference
+   * frame that was saved before the indexed frame.
    */
   JXL_ENC_FRAME_INDEX_BOX = 31,
 
@@ -346,6 +356,15 @@ typedef enum {
    */
   JXL_ENC_FRAME_SETTING_JPEG_COMPRESS_BOXES = 33,
 
+  /** Bounds the memory used for the AC tokens of VarDCT frames. When enabled,
+   * the histograms are built from the tokens of a sample of the groups, and
+   * the other groups are tokenized again when they are written, which is
+   * slower and slightly less dense but keeps the tokens of only a few groups
+   * in memory at a time.
+   * -1 = default (disabled), 0 = disable, 1 = enable.
+   */
+  JXL_ENC_FRAME_SETTING_STREAMING_AC_TOKENS = 34,
+
   /** Enum value not to be used as an option. This value is added to force the
    * C compiler to have the enum to take a known size.
    */
@@ -448,6 +467,144 @@ JXL_EXPORT JxlEncoderStatus JxlEncoderProcessOutput(JxlEncoder* enc,
                                                     uint8_t** next_out,
                                                     size_t* avail_out);
 
+/**
+ * Function receiving encoded bytes, set with @ref JxlEncoderSetOutputCallback.
+ * The bytes are only valid during the call and must be fully consumed by it.
+ *
+ * @param opaque user supplied parameter, passed unchanged.
+ * @param data next encoded bytes of the JPEG XL file.
+ * @param size amount of bytes at data.
+ * @return JXL_TRUE on success, JXL_FALSE to abort encoding with an error.
+ */
+typedef JXL_BOOL (*JxlEncoderOutputCallback)(void* opaque, const uint8_t* data,
+                                             size_t size);
+
+/**
+ * Sets a callback receiving the encoded output, as an alternative to @ref
+ * JxlEncoderProcessOutput. The encoder then hands the encoded data to the
+ * callback in the chunks in which it was produced, e.g. whole encoded frames,
+ * without copying them to an intermediate output buffer. May only be set
+ * before any output was produced. When a callback is set, @ref
+ * JxlEncoderFlushOutput must be used instead of @ref JxlEncoderProcessOutput.
+ *
+ * @param enc encoder object.
+ * @param callback function receiving the output, or NULL to unset it.
+ * @param opaque user supplied parameter passed to the callback.
+ * @return JXL_ENC_SUCCESS if the callback was set, JXL_ENC_ERROR otherwise.
+ */
+JXL_EXPORT JxlEncoderStatus JxlEncoderSetOutputCallback(
+    JxlEncoder* enc, JxlEncoderOutputCallback callback, void* opaque);
+
+/**
+ * Encodes the frames and/or boxes added so far and passes all the encoded
+ * bytes to the callback set with @ref JxlEncoderSetOutputCallback. The same
+ * rules as for @ref JxlEncoderProcessOutput apply regarding @ref
+ * JxlEncoderCloseInput.
+ *
+ * @param enc encoder object.
+ * @return JXL_ENC_SUCCESS when all the input added so far was encoded and
+ * passed to the callback.
+ * @return JXL_ENC_ERROR when encoding failed, no callback is set or the
+ * callback returned JXL_FALSE.
+ */
+JXL_EXPORT JxlEncoderStatus JxlEncoderFlushOutput(JxlEncoder* enc);
+
+/**
+ * Stages of the encoding of a frame, reported with @ref
+ * JxlEncoderStageStatsCallback. Not every stage is entered for every frame,
+ * e.g. lossless frames have no AC strategy stage.
+ */
+typedef enum {
+  /** Conversion of the input to the internal (e.g. XYB) color space.
+   */
+  JXL_ENC_STAGE_COLOR_TRANSFORM = 0,
+
+  /** Search for repeated patches and dots, and their subtraction.
+   */
+  JXL_ENC_STAGE_PATCHES = 1,
+
+  /** Computation of the adaptive quantization field and of the quantizer.
+   */
+  JXL_ENC_STAGE_ADAPTIVE_QUANTIZATION = 2,
+
+  /** Selection of the DCT block sizes (AC strategy) and of the chroma from
+   * luma factors.
+   */
+  JXL_ENC_STAGE_AC_STRATEGY = 3,
+
+  /** Learning of the MA trees of modular images.
+   */
+  JXL_ENC_STAGE_MODULAR_TREE = 4,
+
+  /** Quantization of the coefficients or residuals into tokens.
+   */
+  JXL_ENC_STAGE_TOKENIZE = 5,
+
+  /** Clustering of the histograms and encoding of the entropy codes.
+   */
+  JXL_ENC_STAGE_HISTOGRAMS = 6,
+
+  /** Entropy coding of the groups and assembly of the frame.
+   */
+  JXL_ENC_STAGE_WRITE = 7,
+
+  /** Encoding of the lower resolution DC frame used when @ref
+   * JXL_ENC_FRAME_SETTING_PROGRESSIVE_DC is enabled, including all the stages
+   * of that frame.
+   */
+  JXL_ENC_STAGE_DC_FRAME = 8,
+} JxlEncoderStage;
+
+/** Resources used by one stage of the encoding of a frame.
+ */
+typedef struct {
+  /** Elapsed real time in seconds.
+   */
+  double wall_seconds;
+
+  /** CPU time in seconds used by the thread that encodes the frame during the
+   * stage, including the CPU time of the tasks it runs on the threads of the
+   * parallel runner.
+   */
+  double cpu_seconds;
+
+  /** Number of bytes of image memory allocated by this encoder during the
+   * stage, including by the threads of the parallel runner. Allocations that
+   * are not image buffers are not counted.
+   */
+  uint64_t allocated_bytes;
+} JxlEncoderStageStats;
+
+/**
+ * Function receiving the resources used by the stages of a frame, set with
+ * @ref JxlEncoderSetStageStatsCallback.
+ *
+ * @param opaque user supplied parameter, passed unchanged.
+ * @param frame_index index of the frame in the order in which frames were
+ * encoded, starting at 0.
+ * @param stage the stage.
+ * @param stats the resources used by the stage, only valid during the call.
+ */
+typedef void (*JxlEncoderStageStatsCallback)(void* opaque,
+                                             uint32_t frame_index,
+                                             JxlEncoderStage stage,
+                                             const JxlEncoderStageStats* stats);
+
+/**
+ * Sets a callback receiving the time and memory used by each stage of the
+ * encoder. After each frame is encoded, the callback is called once for every
+ * stage that was entered for it, in the order of @ref JxlEncoderStage. The
+ * measurements are always compiled in and have a negligible cost; nothing is
+ * measured while no callback is set.
+ *
+ * @param enc encoder object.
+ * @param callback function receiving the stats, or NULL to unset it.
+ * @param opaque user supplied parameter passed to the callback.
+ * @return JXL_ENC_SUCCESS if the callback was set, JXL_ENC_ERROR otherwise.
+ */
+JXL_EXPORT JxlEncoderStatus JxlEncoderSetStageStatsCallback(
+    JxlEncoder* enc, JxlEncoderStageStatsCallback callback, void* opaque);
+
 /**
  * Sets the frame information for this frame to the encoder. This includes
  * animation information such as frame duration to store in the frame header.
@@ -636,6 +793,67 @@ JXL_EXPORT JxlEncoderStatus JxlEncoderAddImageFrame(
     const JxlEncoderFrameSettings* frame_settings,
     const JxlPixelFormat* pixel_format, const void* buffer, size_t size);
 
+/**
+ * Source of the pixels of a frame added with @ref JxlEncoderAddChunkedFrame.
+ * The encoder requests the pixels in bands of rows, in increasing order, and
+ * releases each band before requesting the next one.
+ */
+typedef struct {
+  /** Opaque pointer passed to the callbacks. */
+  void* opaque;
+
+  /**
+   * Returns the pixels of rows [ypos, ypos + ysize) of the frame, interleaved
+   * in the pixel format given to @ref JxlEncoderAddChunkedFrame, and sets
+   * *row_offset to the distance in bytes between the start of consecutive
+   * rows. The returned buffer must remain valid until it is passed to
+   * release_buffer. Returning NULL makes adding the frame fail.
+   */
+  const void* (*get_color_channel_rows)(void* opaque, size_t ypos,
+                                         size_t ysize, size_t* row_offset);
+
+  /**
+   * Called once the encoder no longer needs a buffer returned by
+   * get_color_channel_rows.
+   */
+  void (*release_buffer)(void* opaque, const void* buffer);
+} JxlChunkedFrameInputSource;
+
+/**
+ * Same as @ref JxlEncoderAddImageFrame, but the pixels are pulled from the
+ * given source in bands of rows instead of being passed as a single buffer.
+ * All the bands are requested before this function returns; the source is not
+ * used afterwards.
+ *
+ * Each band is coded as its own frame, cropped to the rows of the band and
+ * blended onto the previous bands, and all bands but the last are encoded
+ * before the next one is requested, so the encoder only holds one band of
+ * the frame at a time. The output of these bands is available through @ref
+ * JxlEncoderProcessOutput, or passed to the output callback if one is set.
+ * The bands other than the last have a duration of 0 and no name, and are
+ * saved in the reference slot given by the save_as_reference of the frame
+ * header, which is therefore overwritten even if it is 0. Decoders that
+ * coalesce frames render the bands as a single frame; decoders that do not
+ * return one frame per band of 256 rows.
+ *
+ * Since the bands are independent frames, lossy bands have their own AC
+ * strategy, quantization and entropy codes, and the gaborish and edge
+ * preserving filters are disabled for them regardless of the frame settings,
+ * as they would otherwise leave a visible seam at every band boundary.
+ *
+ * The frame can not be indexed or already downsampled, and the only extra
+ * channel it can have is an alpha channel interleaved in the pixel format.
+ *
+ * @param frame_settings set of options and metadata for this frame. Also
+ * includes reference to the encoder object.
+ * @param pixel_format format for pixels returned by the source.
+ * @param source callbacks providing the pixels.
+ * @return JXL_ENC_SUCCESS on success, JXL_ENC_ERROR on error
+ */
+JXL_EXPORT JxlEncoderStatus JxlEncoderAddChunkedFrame(
+    const JxlEncoderFrameSettings* frame_settings,
+    const JxlPixelFormat* pixel_format, JxlChunkedFrameInputSource source);
+
 /**
  * Sets the buffer to read pixels from for an extra channel at a given index.
  * The index must be smaller than the num_extra_channels in the associated
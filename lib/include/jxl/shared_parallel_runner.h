@@ -0,0 +1,88 @@
+/* Copyright (c) the JPEG XL Project Authors. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/** @addtogroup libjxl_threads
+ * @{
+ * @file shared_parallel_runner.h
+ * @brief implementation using std::thread of a ::JxlParallelRunner sharing
+ * one set of worker threads between many decoder and encoder instances.
+ */
+
+/** A JxlSharedThreadPool owns a fixed set of worker threads. Any number of
+ * runners can be created on top of it with JxlSharedParallelRunnerCreate, for
+ * example one per JxlDecoder or JxlEncoder instance, and used concurrently
+ * from different threads.
+ *
+ * Every JxlSharedParallelRunner call runs tasks on the calling thread and on
+ * the shared workers. Workers pick the calls they help in round-robin order,
+ * one chunk of tasks at a time, so concurrent calls share the workers fairly.
+ * The number of threads concurrently running tasks of a call is limited by
+ * the max_threads value of its runner, which is also the number of threads
+ * passed to the JxlParallelRunInit function.
+ *
+ * Only one concurrent JxlSharedParallelRunner call per runner is allowed at a
+ * time, but different runners of the same pool may be used concurrently.
+ */
+
+#ifndef JXL_SHARED_PARALLEL_RUNNER_H_
+#define JXL_SHARED_PARALLEL_RUNNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jxl/jxl_threads_export.h"
+#include "jxl/memory_manager.h"
+#include "jxl/parallel_runner.h"
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/** Creates a thread pool with the given number of worker threads, to be
+ * shared by runners created with JxlSharedParallelRunnerCreate. The pool and
+ * its runners are allocated with memory_manager, which may be NULL to use
+ * malloc and free. Returns NULL if memory_manager has only one of alloc and
+ * free set, or if the allocation fails.
+ */
+JXL_THREADS_EXPORT void* JxlSharedThreadPoolCreate(
+    const JxlMemoryManager* memory_manager, size_t num_worker_threads);
+
+/** Destroys the pool created by JxlSharedThreadPoolCreate. All the runners
+ * created on this pool must be destroyed before.
+ */
+JXL_THREADS_EXPORT void JxlSharedThreadPoolDestroy(void* pool);
+
+/** Parallel runner using the workers of a shared pool. Use as
+ * JxlParallelRunner.
+ */
+JXL_THREADS_EXPORT JxlParallelRetCode JxlSharedParallelRunner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range);
+
+/** Creates a runner for JxlSharedParallelRunner on the given pool. Use as
+ * the opaque runner.
+ *
+ * @param pool pool created with JxlSharedThreadPoolCreate.
+ * @param max_threads maximum number of threads, including the calling thread,
+ *     running tasks of a single call. Zero means no limit besides the size of
+ *     the pool.
+ */
+JXL_THREADS_EXPORT void* JxlSharedParallelRunnerCreate(void* pool,
+                                                       size_t max_threads);
+
+/** Destroys the runner created by JxlSharedParallelRunnerCreate.
+ */
+JXL_THREADS_EXPORT void JxlSharedParallelRunnerDestroy(void* runner_opaque);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif /* JXL_SHARED_PARALLEL_RUNNER_H_ */
+
+/** @}*/
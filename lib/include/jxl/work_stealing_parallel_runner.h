@@ -0,0 +1,79 @@
+/* Copyright (c) the JPEG XL Project Authors. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/** @addtogroup libjxl_threads
+ * @{
+ * @file work_stealing_parallel_runner.h
+ * @brief implementation using std::thread of a work-stealing
+ * ::JxlParallelRunner that supports nested parallelism.
+ */
+
+/** Implementation of JxlParallelRunner than can be used to enable
+ * multithreading when using the JPEG XL library. This uses std::thread
+ * internally and related synchronization functions. The number of threads
+ * created is fixed at construction time and the threads are re-used for every
+ * JxlWorkStealingParallelRunner call.
+ *
+ * Each worker thread owns a queue of task chunks. A Run call splits its range
+ * into chunks and pushes them to the queue of the calling worker (or spreads
+ * them over all queues when called from outside the pool). Workers take chunks
+ * from the back of their own queue and, when it is empty, steal half of the
+ * oldest chunk of another worker's queue.
+ *
+ * Unlike @ref thread_parallel_runner.h, JxlWorkStealingParallelRunner may be
+ * called again from inside the JxlParallelRunFunction of an outer call on the
+ * same runner (nested parallelism). The calling thread then helps executing
+ * the inner tasks and, once none of them is left to start, queued tasks of
+ * any other call that does not already have a task running on that thread,
+ * until all the inner tasks completed. It only blocks when there is no such
+ * task. The thread ids passed to the JxlParallelRunFunction are unique among
+ * the threads concurrently running tasks of the same call.
+ *
+ * Only one concurrent top-level (non-nested) JxlWorkStealingParallelRunner
+ * call per instance is allowed at a time.
+ */
+
+#ifndef JXL_WORK_STEALING_PARALLEL_RUNNER_H_
+#define JXL_WORK_STEALING_PARALLEL_RUNNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jxl/jxl_threads_export.h"
+#include "jxl/memory_manager.h"
+#include "jxl/parallel_runner.h"
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/** Work-stealing parallel runner internally using std::thread. Use as
+ * JxlParallelRunner.
+ */
+JXL_THREADS_EXPORT JxlParallelRetCode JxlWorkStealingParallelRunner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range);
+
+/** Creates the runner for JxlWorkStealingParallelRunner. Use as the opaque
+ * runner. If num_worker_threads is zero, all tasks run on the calling thread.
+ */
+JXL_THREADS_EXPORT void* JxlWorkStealingParallelRunnerCreate(
+    const JxlMemoryManager* memory_manager, size_t num_worker_threads);
+
+/** Destroys the runner created by JxlWorkStealingParallelRunnerCreate.
+ */
+JXL_THREADS_EXPORT void JxlWorkStealingParallelRunnerDestroy(
+    void* runner_opaque);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif /* JXL_WORK_STEALING_PARALLEL_RUNNER_H_ */
+
+/** @}*/
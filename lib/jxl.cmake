@@ -43,6 +43,8 @@ set(JPEGXL_INTERNAL_SOURCES_DEC
   jxl/base/scope_guard.h
   jxl/base/span.h
   jxl/base/status.h
+  jxl/base/thread_cpu_time.cc
+  jxl/base/thread_cpu_time.h
   jxl/base/thread_pool_internal.h
   jxl/blending.cc
   jxl/blending.h
@@ -94,12 +96,14 @@ set(JPEGXL_INTERNAL_SOURCES_DEC
   jxl/dec_noise.h
   jxl/dec_patch_dictionary.cc
   jxl/dec_patch_dictionary.h
+  jxl/dec_stage_stats.h
   jxl/dec_tone_mapping-inl.h
   jxl/dec_transforms-inl.h
   jxl/dec_xyb-inl.h
   jxl/dec_xyb.cc
   jxl/dec_xyb.h
   jxl/decode.cc
+  jxl/decode_internal.h
   jxl/enc_bit_writer.cc
   jxl/enc_bit_writer.h
   jxl/entropy_coder.cc
@@ -187,6 +191,8 @@ set(JPEGXL_INTERNAL_SOURCES_DEC
   jxl/render_pipeline/stage_blending.h
   jxl/render_pipeline/stage_chroma_upsampling.cc
   jxl/render_pipeline/stage_chroma_upsampling.h
+  jxl/render_pipeline/stage_cms.cc
+  jxl/render_pipeline/stage_cms.h
   jxl/render_pipeline/stage_epf.cc
   jxl/render_pipeline/stage_epf.h
   jxl/render_pipeline/stage_from_linear.cc
@@ -289,8 +295,11 @@ set(JPEGXL_INTERNAL_SOURCES_ENC
   jxl/enc_dot_dictionary.h
   jxl/enc_entropy_coder.cc
   jxl/enc_entropy_coder.h
+  jxl/enc_external_image-inl.h
   jxl/enc_external_image.cc
   jxl/enc_external_image.h
+  jxl/enc_fast_lossless.cc
+  jxl/enc_fast_lossless.h
   jxl/enc_file.cc
   jxl/enc_file.h
   jxl/enc_frame.cc
@@ -320,6 +329,7 @@ set(JPEGXL_INTERNAL_SOURCES_ENC
   jxl/enc_quant_weights.h
   jxl/enc_splines.cc
   jxl/enc_splines.h
+  jxl/enc_stage_stats.h
   jxl/enc_toc.cc
   jxl/enc_toc.h
   jxl/enc_transforms-inl.h
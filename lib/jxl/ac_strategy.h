@@ -243,6 +243,14 @@ class AcStrategyImage {
   size_t xsize() const { return layers_.xsize(); }
   size_t ysize() const { return layers_.ysize(); }
 
+  // See PlaneBase; the rows keep their stride.
+  bool HasCapacity(size_t xsize, size_t ysize) const {
+    return layers_.HasCapacity(xsize, ysize);
+  }
+  void ReuseStorage(size_t xsize, size_t ysize) {
+    layers_.ReuseStorage(xsize, ysize);
+  }
+
   // Count the number of blocks of a given type.
   size_t CountBlocks(AcStrategy::Type type) const;
 
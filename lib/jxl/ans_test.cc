@@ -13,10 +13,12 @@
 #include "lib/jxl/aux_out_fwd.h"
 #include "lib/jxl/base/random.h"
 #include "lib/jxl/base/span.h"
+#include "lib/jxl/base/thread_pool_internal.h"
 #include "lib/jxl/dec_ans.h"
 #include "lib/jxl/dec_bit_reader.h"
 #include "lib/jxl/enc_ans.h"
 #include "lib/jxl/enc_bit_writer.h"
+#include "lib/jxl/enc_cluster.h"
 
 namespace jxl {
 namespace {
@@ -274,5 +276,38 @@ TEST(ANSTest, TestCheckpointingPrefixLZ77) {
   TestCheckpointing(/*ans=*/false, /*lz77=*/true);
 }
 
+// Clustering on a pool must give the same clusters as without one.
+TEST(ANSTest, ClusterHistogramsSameWithPool) {
+  Rng rng(0);
+  std::vector<Histogram> in(3000);
+  for (Histogram& histogram : in) {
+    const size_t alphabet_size = rng.UniformU(1, 30);
+    const size_t count = rng.UniformU(0, 200);
+    for (size_t i = 0; i < count; i++) {
+      histogram.Add(rng.UniformU(0, alphabet_size));
+    }
+  }
+  ThreadPoolInternal pool(4);
+  for (HistogramParams::ClusteringType clustering :
+       {HistogramParams::ClusteringType::kFast,
+        HistogramParams::ClusteringType::kBest}) {
+    HistogramParams params;
+    params.clustering = clustering;
+    std::vector<Histogram> out;
+    std::vector<uint32_t> histogram_symbols;
+    ClusterHistograms(params, in, 128, &out, &histogram_symbols);
+    params.pool = &pool;
+    std::vector<Histogram> pool_out;
+    std::vector<uint32_t> pool_histogram_symbols;
+    ClusterHistograms(params, in, 128, &pool_out, &pool_histogram_symbols);
+    EXPECT_GT(out.size(), 1u);
+    ASSERT_EQ(out.size(), pool_out.size());
+    EXPECT_EQ(histogram_symbols, pool_histogram_symbols);
+    for (size_t i = 0; i < out.size(); i++) {
+      EXPECT_EQ(out[i].data_, pool_out[i].data_);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace jxl
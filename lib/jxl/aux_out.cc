@@ -32,6 +32,14 @@ void AuxOut::Print(size_t num_inputs) const {
            100.0f * min_bitrate_error, 100.0f * max_bitrate_error);
   }
 
+  if (num_acs_estimates != 0) {
+    printf("AC strategy search: 8x8 %.3fs, merge %.3fs, unaligned %.3fs\n",
+           acs_8x8_seconds, acs_merge_seconds, acs_unaligned_seconds);
+    printf("AC strategy estimates: %" PRIuS " (%.2f%% cached)\n",
+           num_acs_estimates,
+           100.0 * num_acs_estimates_cached / num_acs_estimates);
+  }
+
   for (size_t i = 0; i < layers.size(); ++i) {
     if (layers[i].total_bits != 0) {
       printf("Total layer bits %-10s\t", LayerName(i));
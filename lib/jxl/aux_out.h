@@ -145,6 +145,11 @@ struct AuxOut {
     num_dct32x64_blocks += victim.num_dct32x64_blocks;
     num_dct64_blocks += victim.num_dct64_blocks;
     num_butteraugli_iters += victim.num_butteraugli_iters;
+    acs_8x8_seconds += victim.acs_8x8_seconds;
+    acs_merge_seconds += victim.acs_merge_seconds;
+    acs_unaligned_seconds += victim.acs_unaligned_seconds;
+    num_acs_estimates += victim.num_acs_estimates;
+    num_acs_estimates_cached += victim.num_acs_estimates_cached;
     for (size_t i = 0; i < dc_pred_usage.size(); ++i) {
       dc_pred_usage[i] += victim.dc_pred_usage[i];
       dc_pred_usage_xb[i] += victim.dc_pred_usage_xb[i];
@@ -274,6 +279,15 @@ struct AuxOut {
   size_t num_dct32x64_blocks = 0;
   size_t num_dct64_blocks = 0;
 
+  // Time spent in the phases of the AC strategy search, summed over threads
+  // (set by ac_strategy).
+  double acs_8x8_seconds = 0.0;
+  double acs_merge_seconds = 0.0;
+  double acs_unaligned_seconds = 0.0;
+  // Entropy estimates of merge candidates, and how many of them were reused.
+  size_t num_acs_estimates = 0;
+  size_t num_acs_estimates_cached = 0;
+
   std::array<uint32_t, 8> dc_pred_usage = {{0}};
   std::array<uint32_t, 8> dc_pred_usage_xb = {{0}};
 
@@ -37,6 +37,9 @@ struct AllocationHeader {
 std::atomic<uint64_t> num_allocations{0};
 std::atomic<uint64_t> bytes_in_use{0};
 std::atomic<uint64_t> max_bytes_in_use{0};
+std::atomic<uint64_t> total_bytes_allocated{0};
+
+thread_local std::atomic<uint64_t>* thread_allocation_counter = nullptr;
 
 }  // namespace
 
@@ -53,6 +56,22 @@ void CacheAligned::PrintStats() {
       static_cast<double>(max_bytes_in_use.load(std::memory_order_relaxed)));
 }
 
+uint64_t CacheAligned::TotalBytesAllocated() {
+  return total_bytes_allocated.load(std::memory_order_relaxed);
+}
+
+uint64_t CacheAligned::NumAllocations() {
+  return num_allocations.load(std::memory_order_relaxed);
+}
+
+std::atomic<uint64_t>* CacheAligned::ThreadAllocationCounter() {
+  return thread_allocation_counter;
+}
+
+void CacheAligned::SetThreadAllocationCounter(std::atomic<uint64_t>* counter) {
+  thread_allocation_counter = counter;
+}
+
 size_t CacheAligned::NextOffset() {
   static std::atomic<uint32_t> next{0};
   constexpr uint32_t kGroups = CacheAligned::kAlias / CacheAligned::kAlignment;
@@ -112,6 +131,11 @@ void* CacheAligned::Allocate(const size_t payload_size, size_t offset) {
 
   // Update statistics (#allocations and max bytes in use)
   num_allocations.fetch_add(1, std::memory_order_relaxed);
+  total_bytes_allocated.fetch_add(allocated_size, std::memory_order_relaxed);
+  if (thread_allocation_counter != nullptr) {
+    thread_allocation_counter->fetch_add(allocated_size,
+                                         std::memory_order_relaxed);
+  }
   const uint64_t prev_bytes =
       bytes_in_use.fetch_add(allocated_size, std::memory_order_acq_rel);
   uint64_t expected_max = max_bytes_in_use.load(std::memory_order_acquire);
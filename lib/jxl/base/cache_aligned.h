@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <memory>
 
 #include "lib/jxl/base/compiler_specific.h"
@@ -22,6 +23,21 @@ class CacheAligned {
  public:
   static void PrintStats();
 
+  // Returns the number of bytes allocated since the start of the process,
+  // including those that were freed since.
+  static uint64_t TotalBytesAllocated();
+
+  // Returns the number of allocations since the start of the process,
+  // including those that were freed since.
+  static uint64_t NumAllocations();
+
+  // Returns the counter to which the allocations of the current thread are
+  // added, in addition to the process-wide statistics, or null if there is
+  // none. Used to attribute allocations to one encoder rather than to all the
+  // encoders and decoders of the process.
+  static std::atomic<uint64_t>* ThreadAllocationCounter();
+  static void SetThreadAllocationCounter(std::atomic<uint64_t>* counter);
+
   static constexpr size_t kPointerSize = sizeof(void*);
   static constexpr size_t kCacheLineSize = 64;
   // To avoid RFOs, match L2 fill size (pairs of lines).
@@ -55,6 +71,29 @@ struct CacheAlignedDeleter {
 
 using CacheAlignedUniquePtr = std::unique_ptr<uint8_t[], CacheAlignedDeleter>;
 
+// Sets the allocation counter of the current thread for its lifetime and
+// restores the previous one afterwards. Does nothing if counter is null.
+class ScopedAllocationCounter {
+ public:
+  explicit ScopedAllocationCounter(std::atomic<uint64_t>* counter)
+      : counter_(counter) {
+    if (!counter_) return;
+    previous_ = CacheAligned::ThreadAllocationCounter();
+    CacheAligned::SetThreadAllocationCounter(counter_);
+  }
+
+  ScopedAllocationCounter(const ScopedAllocationCounter&) = delete;
+  ScopedAllocationCounter& operator=(const ScopedAllocationCounter&) = delete;
+
+  ~ScopedAllocationCounter() {
+    if (counter_) CacheAligned::SetThreadAllocationCounter(previous_);
+  }
+
+ private:
+  std::atomic<uint64_t>* counter_;
+  std::atomic<uint64_t>* previous_ = nullptr;
+};
+
 // Does not invoke constructors.
 static inline CacheAlignedUniquePtr AllocateArray(const size_t bytes) {
   return CacheAlignedUniquePtr(
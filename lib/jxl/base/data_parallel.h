@@ -14,7 +14,9 @@
 
 #include "jxl/parallel_runner.h"
 #include "lib/jxl/base/bits.h"
+#include "lib/jxl/base/cache_aligned.h"
 #include "lib/jxl/base/status.h"
+#include "lib/jxl/base/thread_cpu_time.h"
 #if JXL_COMPILER_MSVC
 // suppress warnings about the const & applied to function types
 #pragma warning(disable : 4180)
@@ -40,6 +42,9 @@ class ThreadPool {
   // "thread" is an integer smaller than num_threads.
   // Not thread-safe - no two calls to Run may overlap.
   // Subsequent calls will reuse the same threads.
+  // Allocations made by the functions and the CPU time they use are added to
+  // the counters of the calling thread, if any (see ScopedAllocationCounter
+  // and ScopedCpuTimeCounter).
   //
   // Precondition: begin <= end.
   template <class InitFunc, class DataFunc>
@@ -65,12 +70,17 @@ class ThreadPool {
   class RunCallState final {
    public:
     RunCallState(const InitFunc& init_func, const DataFunc& data_func)
-        : init_func_(init_func), data_func_(data_func) {}
+        : init_func_(init_func),
+          data_func_(data_func),
+          allocation_counter_(CacheAligned::ThreadAllocationCounter()),
+          cpu_time_counter_(ThreadCpuTimeCounter()) {}
 
     // JxlParallelRunInit interface.
     static int CallInitFunc(void* jpegxl_opaque, size_t num_threads) {
       const auto* self =
           static_cast<RunCallState<InitFunc, DataFunc>*>(jpegxl_opaque);
+      ScopedAllocationCounter counter(self->allocation_counter_);
+      ScopedCpuTimeCounter cpu_time(self->cpu_time_counter_);
       // Returns -1 when the internal init function returns false Status to
       // indicate an error.
       return self->init_func_(num_threads) ? 0 : -1;
@@ -81,12 +91,18 @@ class ThreadPool {
                              size_t thread_id) {
       const auto* self =
           static_cast<RunCallState<InitFunc, DataFunc>*>(jpegxl_opaque);
+      ScopedAllocationCounter counter(self->allocation_counter_);
+      ScopedCpuTimeCounter cpu_time(self->cpu_time_counter_);
       return self->data_func_(value, thread_id);
     }
 
    private:
     const InitFunc& init_func_;
     const DataFunc& data_func_;
+    // Allocation and CPU time counters of the thread that called Run(),
+    // installed on the worker threads while they run the functions.
+    std::atomic<uint64_t>* const allocation_counter_;
+    std::atomic<uint64_t>* const cpu_time_counter_;
   };
 
   // Default JxlParallelRunner used when no runner is provided by the
@@ -0,0 +1,84 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/jxl/base/thread_cpu_time.h"
+
+#include <time.h>
+
+#include "lib/jxl/base/os_macros.h"  // for JXL_OS_*
+
+#if JXL_OS_WIN
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif  // WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif  // NOMINMAX
+#include <windows.h>
+#endif  // JXL_OS_WIN
+
+namespace jxl {
+namespace {
+
+// Counter of the current thread and CPU time of the thread when it was last
+// charged to the counter.
+thread_local std::atomic<uint64_t>* thread_cpu_time_counter = nullptr;
+thread_local double thread_cpu_time_start = 0.0;
+
+// Adds the CPU time used since the last call to the counter of the thread.
+void ChargeThreadCpuTime() {
+  const double now = ThreadCpuSeconds();
+  if (thread_cpu_time_counter != nullptr && now > thread_cpu_time_start) {
+    thread_cpu_time_counter->fetch_add(
+        static_cast<uint64_t>((now - thread_cpu_time_start) * 1E9),
+        std::memory_order_relaxed);
+  }
+  thread_cpu_time_start = now;
+}
+
+}  // namespace
+
+double ThreadCpuSeconds() {
+#if JXL_OS_WIN
+  FILETIME creation, exit, kernel, user;
+  if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+    return 0.0;
+  }
+  // FILETIME counts units of 100 nanoseconds.
+  const uint64_t kernel_ticks =
+      (uint64_t(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+  const uint64_t user_ticks =
+      (uint64_t(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+  return double(kernel_ticks + user_ticks) * 1E-7;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+  timespec t;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) != 0) return 0.0;
+  return t.tv_sec + t.tv_nsec * 1E-9;
+#else
+  // No per-thread clock: falls back to the CPU time of the process.
+  return double(clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+std::atomic<uint64_t>* ThreadCpuTimeCounter() {
+  return thread_cpu_time_counter;
+}
+
+ScopedCpuTimeCounter::ScopedCpuTimeCounter(std::atomic<uint64_t>* counter) {
+  if (counter == nullptr || counter == thread_cpu_time_counter) return;
+  ChargeThreadCpuTime();
+  counter_ = counter;
+  previous_ = thread_cpu_time_counter;
+  thread_cpu_time_counter = counter_;
+}
+
+void ScopedCpuTimeCounter::Release() {
+  if (counter_ == nullptr) return;
+  ChargeThreadCpuTime();
+  thread_cpu_time_counter = previous_;
+  counter_ = nullptr;
+}
+
+}  // namespace jxl
@@ -0,0 +1,48 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef LIB_JXL_BASE_THREAD_CPU_TIME_H_
+#define LIB_JXL_BASE_THREAD_CPU_TIME_H_
+
+// CPU time used by threads, attributed to counters like the allocations in
+// cache_aligned.h so that the tasks run on a ThreadPool are included.
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace jxl {
+
+// Returns the CPU time in seconds used so far by the calling thread.
+double ThreadCpuSeconds();
+
+// Returns the counter that the CPU time of the current thread is added to, in
+// nanoseconds, or null if there is none.
+std::atomic<uint64_t>* ThreadCpuTimeCounter();
+
+// Adds the CPU time used by the current thread during its lifetime to counter,
+// and to no other counter: the time is taken away from the previous counter of
+// the thread, which is restored afterwards. Does nothing if counter is null or
+// already the counter of the thread.
+class ScopedCpuTimeCounter {
+ public:
+  explicit ScopedCpuTimeCounter(std::atomic<uint64_t>* counter);
+
+  ScopedCpuTimeCounter(const ScopedCpuTimeCounter&) = delete;
+  ScopedCpuTimeCounter& operator=(const ScopedCpuTimeCounter&) = delete;
+
+  ~ScopedCpuTimeCounter() { Release(); }
+
+  // Ends the measurement before the end of the scope.
+  void Release();
+
+ private:
+  std::atomic<uint64_t>* counter_ = nullptr;
+  std::atomic<uint64_t>* previous_ = nullptr;
+};
+
+}  // namespace jxl
+
+#endif  // LIB_JXL_BASE_THREAD_CPU_TIME_H_
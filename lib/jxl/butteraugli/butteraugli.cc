@@ -1856,6 +1856,54 @@ bool ButteraugliDiffmap(const Image3F& rgb0, const Image3F& rgb1,
   return true;
 }
 
+bool ButteraugliDiffmapTiled(const Image3F& rgb0, const Image3F& rgb1,
+                             const ButteraugliParams& params, ThreadPool* pool,
+                             size_t tile_size, ImageF& diffmap) {
+  PROFILER_FUNC;
+  const size_t xsize = rgb0.xsize();
+  const size_t ysize = rgb0.ysize();
+  if (!SameSize(rgb0, rgb1)) {
+    return JXL_FAILURE("Size mismatch");
+  }
+  // Tiles and borders must start at even coordinates, so that the half
+  // resolution comparison of each tile sees the same pixel pairs as that of
+  // the whole image.
+  if (tile_size == 0 || tile_size % 8 != 0) {
+    return JXL_FAILURE("Invalid tile size");
+  }
+  if (xsize <= tile_size && ysize <= tile_size) {
+    return ButteraugliDiffmap(rgb0, rgb1, params, diffmap);
+  }
+  const size_t xtiles = DivCeil(xsize, tile_size);
+  const size_t ytiles = DivCeil(ysize, tile_size);
+  diffmap = ImageF(xsize, ysize);
+  std::atomic<bool> ok{true};
+  const auto compare_tile = [&](const uint32_t task, size_t /*thread*/) {
+    const size_t x0 = (task % xtiles) * tile_size;
+    const size_t y0 = (task / xtiles) * tile_size;
+    const Rect tile(x0, y0, tile_size, tile_size, xsize, ysize);
+    const size_t bx0 = x0 - std::min(x0, kButteraugliTileBorder);
+    const size_t by0 = y0 - std::min(y0, kButteraugliTileBorder);
+    const Rect extended(bx0, by0, x0 - bx0 + tile_size + kButteraugliTileBorder,
+                        y0 - by0 + tile_size + kButteraugliTileBorder, xsize,
+                        ysize);
+    Image3F tile0(extended.xsize(), extended.ysize());
+    Image3F tile1(extended.xsize(), extended.ysize());
+    CopyImageTo(extended, rgb0, Rect(tile0), &tile0);
+    CopyImageTo(extended, rgb1, Rect(tile1), &tile1);
+    ImageF tile_diffmap;
+    if (!ButteraugliDiffmap(tile0, tile1, params, tile_diffmap)) {
+      ok.store(false, std::memory_order_relaxed);
+      return;
+    }
+    CopyImageTo(Rect(x0 - bx0, y0 - by0, tile.xsize(), tile.ysize()),
+                tile_diffmap, tile, &diffmap);
+  };
+  JXL_RETURN_IF_ERROR(RunOnPool(pool, 0, xtiles * ytiles, ThreadPool::NoInit,
+                                compare_tile, "ButteraugliTile"));
+  return ok.load(std::memory_order_relaxed);
+}
+
 bool ButteraugliInterface(const Image3F& rgb0, const Image3F& rgb1,
                           float hf_asymmetry, float xmul, ImageF& diffmap,
                           double& diffvalue) {
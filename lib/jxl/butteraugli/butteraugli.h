@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/common.h"
 #include "lib/jxl/image.h"
 #include "lib/jxl/image_ops.h"
@@ -197,6 +198,21 @@ bool ButteraugliDiffmap(const Image3F &rgb0, const Image3F &rgb1,
 bool ButteraugliDiffmap(const Image3F &rgb0, const Image3F &rgb1,
                         const ButteraugliParams &params, ImageF &diffmap);
 
+// Number of pixels of context that ButteraugliDiffmapTiled adds on each side
+// of a tile. This covers the support of the blurs and filters at both scales,
+// so that tiles match the full-image diffmap up to small differences in the
+// tails of the blur kernels.
+static const size_t kButteraugliTileBorder = 128;
+
+// Same as ButteraugliDiffmap, but compares tiles of tile_size x tile_size
+// pixels (a multiple of 8) independently and in parallel on the pool, each
+// extended with kButteraugliTileBorder pixels of context. The temporary images
+// only need memory proportional to the number of threads times the extended
+// tile area, instead of the image area.
+bool ButteraugliDiffmapTiled(const Image3F &rgb0, const Image3F &rgb1,
+                             const ButteraugliParams &params, ThreadPool *pool,
+                             size_t tile_size, ImageF &diffmap);
+
 double ButteraugliScoreFromDiffmap(const ImageF &diffmap,
                                    const ButteraugliParams *params = nullptr);
 
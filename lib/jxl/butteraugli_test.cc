@@ -5,8 +5,15 @@
 
 #include "jxl/butteraugli.h"
 
+#include <math.h>
+
+#include <algorithm>
+
 #include "gtest/gtest.h"
 #include "jxl/butteraugli_cxx.h"
+#include "lib/jxl/base/thread_pool_internal.h"
+#include "lib/jxl/butteraugli/butteraugli.h"
+#include "lib/jxl/image.h"
 #include "lib/jxl/test_utils.h"
 
 TEST(ButteraugliTest, Lossless) {
@@ -100,3 +107,52 @@ TEST(ButteraugliTest, Api) {
 
   EXPECT_NE(distance1, distance2);
 }
+
+namespace jxl {
+namespace {
+
+TEST(ButteraugliTest, TiledDiffmap) {
+  const size_t xsize = 613;
+  const size_t ysize = 530;
+  // Smooth gradients with some texture, and a distortion that varies over the
+  // image so that every tile has a different diffmap.
+  Image3F rgb0(xsize, ysize);
+  Image3F rgb1(xsize, ysize);
+  for (size_t c = 0; c < 3; c++) {
+    for (size_t y = 0; y < ysize; y++) {
+      float* JXL_RESTRICT row0 = rgb0.PlaneRow(c, y);
+      float* JXL_RESTRICT row1 = rgb1.PlaneRow(c, y);
+      for (size_t x = 0; x < xsize; x++) {
+        float v = 0.1f + 0.3f * x / xsize + 0.2f * y / ysize + 0.1f * c;
+        v += 0.05f * sinf(0.3f * x + 0.1f * c) * cosf(0.2f * y);
+        row0[x] = v;
+        row1[x] = v + 0.02f * sinf(0.05f * (x + 2 * y)) * ((x ^ y) & 1);
+      }
+    }
+  }
+  ButteraugliParams params;
+  ImageF diffmap;
+  ASSERT_TRUE(ButteraugliDiffmap(rgb0, rgb1, params, diffmap));
+  const double score = ButteraugliScoreFromDiffmap(diffmap);
+  ASSERT_GT(score, 0.0);
+
+  ThreadPoolInternal pool(4);
+  ImageF tiled_diffmap;
+  ASSERT_TRUE(ButteraugliDiffmapTiled(rgb0, rgb1, params, &pool,
+                                      /*tile_size=*/256, tiled_diffmap));
+  ASSERT_EQ(xsize, tiled_diffmap.xsize());
+  ASSERT_EQ(ysize, tiled_diffmap.ysize());
+  float max_error = 0.0f;
+  for (size_t y = 0; y < ysize; y++) {
+    const float* JXL_RESTRICT row = diffmap.ConstRow(y);
+    const float* JXL_RESTRICT tiled_row = tiled_diffmap.ConstRow(y);
+    for (size_t x = 0; x < xsize; x++) {
+      max_error = std::max(max_error, std::abs(row[x] - tiled_row[x]));
+    }
+  }
+  EXPECT_LE(max_error, 1e-3 * score);
+  EXPECT_NEAR(score, ButteraugliScoreFromDiffmap(tiled_diffmap), 1e-3 * score);
+}
+
+}  // namespace
+}  // namespace jxl
@@ -222,9 +222,14 @@ Status DecodeANSCodes(const size_t num_histograms,
     }
   } else {
     JXL_ASSERT(max_alphabet_size <= ANS_MAX_ALPHABET_SIZE);
-    result->alias_tables =
-        AllocateArray(num_histograms * (1 << result->log_alpha_size) *
-                      sizeof(AliasTable::Entry));
+    const size_t alias_tables_bytes = num_histograms *
+                                      (1 << result->log_alpha_size) *
+                                      sizeof(AliasTable::Entry);
+    if (!result->alias_tables ||
+        result->alias_tables_bytes < alias_tables_bytes) {
+      result->alias_tables = AllocateArray(alias_tables_bytes);
+      result->alias_tables_bytes = alias_tables_bytes;
+    }
     AliasTable::Entry* alias_tables =
         reinterpret_cast<AliasTable::Entry*>(result->alias_tables.get());
     for (size_t c = 0; c < num_histograms; ++c) {
@@ -330,6 +335,8 @@ void ANSCode::UpdateMaxNumBits(size_t ctx, size_t symbol) {
 Status DecodeHistograms(BitReader* br, size_t num_contexts, ANSCode* code,
                         std::vector<uint8_t>* context_map, bool disallow_lz77) {
   PROFILER_FUNC;
+  // The code may be reused from a previous frame.
+  code->max_num_bits = 0;
   JXL_RETURN_IF_ERROR(Bundle::Read(br, &code->lz77));
   if (code->lz77.enabled) {
     num_contexts++;
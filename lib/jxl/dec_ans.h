@@ -136,6 +136,8 @@ static constexpr int8_t kSpecialDistances[kNumSpecialDistances][2] = {
 
 struct ANSCode {
   CacheAlignedUniquePtr alias_tables;
+  // Allocated size of alias_tables in bytes, which is reused if large enough.
+  size_t alias_tables_bytes = 0;
   std::vector<HuffmanDecodingData> huffman_data;
   std::vector<HybridUintConfig> uint_config;
   std::vector<int> degenerate_symbols;
@@ -8,6 +8,7 @@
 #include "lib/jxl/blending.h"
 #include "lib/jxl/render_pipeline/stage_blending.h"
 #include "lib/jxl/render_pipeline/stage_chroma_upsampling.h"
+#include "lib/jxl/render_pipeline/stage_cms.h"
 #include "lib/jxl/render_pipeline/stage_epf.h"
 #include "lib/jxl/render_pipeline/stage_from_linear.h"
 #include "lib/jxl/render_pipeline/stage_gaborish.h"
@@ -27,8 +28,11 @@ namespace jxl {
 Status PassesDecoderState::PreparePipeline(ImageBundle* decoded,
                                            PipelineOptions options) {
   const FrameHeader& frame_header = shared->frame_header;
+  // Only the color transforms and the output apply to the DC image, whose
+  // frames have no extra channels, see FrameDecoder::SetRenderDC.
+  const bool render_dc = options.render_dc;
   size_t num_c = 3 + frame_header.nonserialized_metadata->m.num_extra_channels;
-  if ((frame_header.flags & FrameHeader::kNoise) != 0) {
+  if ((frame_header.flags & FrameHeader::kNoise) != 0 && !render_dc) {
     num_c += 3;
   }
 
@@ -54,11 +58,11 @@ Status PassesDecoderState::PreparePipeline(ImageBundle* decoded,
     }
   }
 
-  if (frame_header.loop_filter.gab) {
+  if (frame_header.loop_filter.gab && !render_dc) {
     builder.AddStage(GetGaborishStage(frame_header.loop_filter));
   }
 
-  {
+  if (!render_dc) {
     const LoopFilter& lf = frame_header.loop_filter;
     if (lf.epf_iters >= 3) {
       builder.AddStage(GetEPFStage(lf, sigma, 0));
@@ -91,12 +95,12 @@ Status PassesDecoderState::PreparePipeline(ImageBundle* decoded,
     }
   }
 
-  if ((frame_header.flags & FrameHeader::kPatches) != 0) {
+  if ((frame_header.flags & FrameHeader::kPatches) != 0 && !render_dc) {
     builder.AddStage(
         GetPatchesStage(&shared->image_features.patches,
                         3 + shared->metadata->m.num_extra_channels));
   }
-  if ((frame_header.flags & FrameHeader::kSplines) != 0) {
+  if ((frame_header.flags & FrameHeader::kSplines) != 0 && !render_dc) {
     builder.AddStage(GetSplineStage(&shared->image_features.splines));
   }
 
@@ -111,7 +115,7 @@ Status PassesDecoderState::PreparePipeline(ImageBundle* decoded,
     }
   }
 
-  if ((frame_header.flags & FrameHeader::kNoise) != 0) {
+  if ((frame_header.flags & FrameHeader::kNoise) != 0 && !render_dc) {
     builder.AddStage(GetConvolveNoiseStage(num_c - 3));
     builder.AddStage(GetAddNoiseStage(shared->image_features.noise_params,
                                       shared->cmap, num_c - 3));
@@ -213,17 +217,51 @@ Status PassesDecoderState::PreparePipeline(ImageBundle* decoded,
       linear = false;
     }
 
+    // Conversions to output color encodings that the stages above do not
+    // support go through the color management system.
+    auto cms_stage = GetCmsStage(output_encoding_info);
+    const ColorEncoding& output_color_encoding =
+        cms_stage ? output_encoding_info.cms_output_encoding
+                  : output_encoding_info.color_encoding;
+    if (cms_stage) builder.AddStage(std::move(cms_stage));
+
     if (main_output.callback.IsPresent() || main_output.buffer) {
-      builder.AddStage(GetWriteToOutputStage(main_output, width, height,
-                                             has_alpha, unpremul_alpha, alpha_c,
-                                             undo_orientation, extra_output));
+      builder.AddStage(GetWriteToOutputStage(
+          main_output, Rect(output_x0, output_y0, width, height), has_alpha,
+          unpremul_alpha, alpha_c, undo_orientation, extra_output));
     } else {
-      builder.AddStage(GetWriteToImageBundleStage(
-          decoded, output_encoding_info.color_encoding));
+      builder.AddStage(
+          GetWriteToImageBundleStage(decoded, output_color_encoding));
     }
   }
-  render_pipeline = std::move(builder).Finalize(shared->frame_dim);
+  FrameDimensions frame_dim = shared->frame_dim;
+  if (render_dc) {
+    frame_dim.Set(frame_dim.xsize_blocks, frame_dim.ysize_blocks,
+                  frame_header.group_size_shift, /*max_hshift=*/0,
+                  /*max_vshift=*/0, /*modular_mode=*/true, /*upsampling=*/1);
+  }
+  if (render_pipeline) render_pipeline->ReleaseBuffers(&pipeline_buffers);
+  render_pipeline = std::move(builder).Finalize(frame_dim, &pipeline_buffers);
   return render_pipeline->IsInitialized();
 }
 
+void PassesDecoderState::ReuseBuffersFrom(PassesDecoderState* previous) {
+  PassesSharedState& prev_shared = previous->shared_storage;
+  shared_storage.ac_strategy = std::move(prev_shared.ac_strategy);
+  shared_storage.raw_quant_field = std::move(prev_shared.raw_quant_field);
+  shared_storage.epf_sharpness = std::move(prev_shared.epf_sharpness);
+  shared_storage.quant_dc = std::move(prev_shared.quant_dc);
+  shared_storage.dc_storage = std::move(prev_shared.dc_storage);
+  shared_storage.coeff_orders = std::move(prev_shared.coeff_orders);
+  sigma = std::move(previous->sigma);
+  // The ANS codes keep their alias tables, see DecodeANSCodes.
+  code = std::move(previous->code);
+  context_map = std::move(previous->context_map);
+  group_dec_caches = std::move(previous->group_dec_caches);
+  pipeline_buffers = std::move(previous->pipeline_buffers);
+  if (previous->render_pipeline) {
+    previous->render_pipeline->ReleaseBuffers(&pipeline_buffers);
+  }
+}
+
 }  // namespace jxl
@@ -70,6 +70,78 @@ struct ImageOutput {
   size_t stride;
 };
 
+// Temp images required for decoding a single group. Reduces memory allocations
+// for large images because we only initialize min(#threads, #groups) instances.
+struct GroupDecCache {
+  void InitOnce(size_t num_passes, size_t used_acs) {
+    PROFILER_FUNC;
+
+    for (size_t i = 0; i < num_passes; i++) {
+      if (num_nzeroes[i].xsize() == 0) {
+        // Allocate enough for a whole group - partial groups on the
+        // right/bottom border just use a subset. The valid size is passed via
+        // Rect.
+
+        num_nzeroes[i] = Image3I(kGroupDimInBlocks, kGroupDimInBlocks);
+      }
+    }
+    size_t max_block_area = 0;
+
+    for (uint8_t o = 0; o < AcStrategy::kNumValidStrategies; ++o) {
+      AcStrategy acs = AcStrategy::FromRawStrategy(o);
+      if ((used_acs & (1 << o)) == 0) continue;
+      size_t area =
+          acs.covered_blocks_x() * acs.covered_blocks_y() * kDCTBlockSize;
+      max_block_area = std::max(area, max_block_area);
+    }
+
+    if (max_block_area > max_block_area_) {
+      max_block_area_ = max_block_area;
+      // We need 3x float blocks for dequantized coefficients and 1x for scratch
+      // space for transforms.
+      float_memory_ = hwy::AllocateAligned<float>(max_block_area_ * 4);
+      // We need 3x int32 or int16 blocks for quantized coefficients.
+      int32_memory_ = hwy::AllocateAligned<int32_t>(max_block_area_ * 3);
+      int16_memory_ = hwy::AllocateAligned<int16_t>(max_block_area_ * 3);
+    }
+
+    dec_group_block = float_memory_.get();
+    scratch_space = dec_group_block + max_block_area_ * 3;
+    dec_group_qblock = int32_memory_.get();
+    dec_group_qblock16 = int16_memory_.get();
+  }
+
+  void InitDCBufferOnce() {
+    if (dc_buffer.xsize() == 0) {
+      dc_buffer = ImageF(kGroupDimInBlocks + kRenderPipelineXOffset * 2,
+                         kGroupDimInBlocks + 4);
+    }
+  }
+
+  // Scratch space used by DecGroupImpl().
+  float* dec_group_block;
+  int32_t* dec_group_qblock;
+  int16_t* dec_group_qblock16;
+
+  // For TransformToPixels.
+  float* scratch_space;
+  // Note that scratch_space is never used at the same time as dec_group_qblock.
+  // Moreover, only one of dec_group_qblock16 is ever used.
+  // TODO(veluca): figure out if we can save allocations.
+
+  // AC decoding
+  Image3I num_nzeroes[kMaxNumPasses];
+
+  // Buffer for DC upsampling.
+  ImageF dc_buffer;
+
+ private:
+  hwy::AlignedFreeUniquePtr<float[]> float_memory_;
+  hwy::AlignedFreeUniquePtr<int32_t[]> int32_memory_;
+  hwy::AlignedFreeUniquePtr<int16_t[]> int16_memory_;
+  size_t max_block_area_ = 0;
+};
+
 // Per-frame decoder state. All the images here should be accessed through a
 // group rect (either with block units or pixel units).
 struct PassesDecoderState {
@@ -94,6 +166,10 @@ struct PassesDecoderState {
   // Image dimensions before applying undo_orientation.
   size_t width;
   size_t height;
+  // Position of the output in the image before applying undo_orientation,
+  // non-zero when only a crop region of the image is decoded.
+  size_t output_x0 = 0;
+  size_t output_y0 = 0;
   ImageOutput main_output;
   std::vector<ImageOutput> extra_output;
 
@@ -120,6 +196,11 @@ struct PassesDecoderState {
 
   // Rendering pipeline.
   std::unique_ptr<RenderPipeline> render_pipeline;
+  // Buffers of a previous rendering pipeline, reused by the next one.
+  std::vector<ImageF> pipeline_buffers;
+
+  // Scratch space for decoding groups, indexed by thread or task.
+  std::vector<GroupDecCache> group_dec_caches;
 
   // Storage for the current frame if it can be referenced by future frames.
   ImageBundle frame_storage_for_referencing;
@@ -128,6 +209,9 @@ struct PassesDecoderState {
     bool use_slow_render_pipeline;
     bool coalescing;
     bool render_spotcolors;
+    // Renders the DC image at 1/8 of the frame size, without the filters and
+    // the image features.
+    bool render_dc = false;
   };
 
   Status PreparePipeline(ImageBundle* decoded, PipelineOptions options);
@@ -154,8 +238,9 @@ struct PassesDecoderState {
 
     upsampler8x = GetUpsamplingStage(shared->metadata->transform_data, 0, 3);
     if (shared->frame_header.loop_filter.epf_iters > 0) {
-      sigma = ImageF(shared->frame_dim.xsize_blocks + 2 * kSigmaPadding,
-                     shared->frame_dim.ysize_blocks + 2 * kSigmaPadding);
+      ReuseOrAllocateImage(shared->frame_dim.xsize_blocks + 2 * kSigmaPadding,
+                           shared->frame_dim.ysize_blocks + 2 * kSigmaPadding,
+                           &sigma);
     }
     return true;
   }
@@ -178,84 +263,17 @@ struct PassesDecoderState {
     return true;
   }
 
+  // Moves the buffers of `previous`, the state of a codestream that was
+  // decoded before, to this new state, to reuse those large enough for
+  // the next codestream. Only storage is taken over, no decoding state.
+  void ReuseBuffersFrom(PassesDecoderState* previous);
+
   // Fills the `state->filter_weights.sigma` image with the precomputed sigma
   // values in the area inside `block_rect`. Accesses the AC strategy, quant
   // field and epf_sharpness fields in the corresponding positions.
   void ComputeSigma(const Rect& block_rect, PassesDecoderState* state);
 };
 
-// Temp images required for decoding a single group. Reduces memory allocations
-// for large images because we only initialize min(#threads, #groups) instances.
-struct GroupDecCache {
-  void InitOnce(size_t num_passes, size_t used_acs) {
-    PROFILER_FUNC;
-
-    for (size_t i = 0; i < num_passes; i++) {
-      if (num_nzeroes[i].xsize() == 0) {
-        // Allocate enough for a whole group - partial groups on the
-        // right/bottom border just use a subset. The valid size is passed via
-        // Rect.
-
-        num_nzeroes[i] = Image3I(kGroupDimInBlocks, kGroupDimInBlocks);
-      }
-    }
-    size_t max_block_area = 0;
-
-    for (uint8_t o = 0; o < AcStrategy::kNumValidStrategies; ++o) {
-      AcStrategy acs = AcStrategy::FromRawStrategy(o);
-      if ((used_acs & (1 << o)) == 0) continue;
-      size_t area =
-          acs.covered_blocks_x() * acs.covered_blocks_y() * kDCTBlockSize;
-      max_block_area = std::max(area, max_block_area);
-    }
-
-    if (max_block_area > max_block_area_) {
-      max_block_area_ = max_block_area;
-      // We need 3x float blocks for dequantized coefficients and 1x for scratch
-      // space for transforms.
-      float_memory_ = hwy::AllocateAligned<float>(max_block_area_ * 4);
-      // We need 3x int32 or int16 blocks for quantized coefficients.
-      int32_memory_ = hwy::AllocateAligned<int32_t>(max_block_area_ * 3);
-      int16_memory_ = hwy::AllocateAligned<int16_t>(max_block_area_ * 3);
-    }
-
-    dec_group_block = float_memory_.get();
-    scratch_space = dec_group_block + max_block_area_ * 3;
-    dec_group_qblock = int32_memory_.get();
-    dec_group_qblock16 = int16_memory_.get();
-  }
-
-  void InitDCBufferOnce() {
-    if (dc_buffer.xsize() == 0) {
-      dc_buffer = ImageF(kGroupDimInBlocks + kRenderPipelineXOffset * 2,
-                         kGroupDimInBlocks + 4);
-    }
-  }
-
-  // Scratch space used by DecGroupImpl().
-  float* dec_group_block;
-  int32_t* dec_group_qblock;
-  int16_t* dec_group_qblock16;
-
-  // For TransformToPixels.
-  float* scratch_space;
-  // Note that scratch_space is never used at the same time as dec_group_qblock.
-  // Moreover, only one of dec_group_qblock16 is ever used.
-  // TODO(veluca): figure out if we can save allocations.
-
-  // AC decoding
-  Image3I num_nzeroes[kMaxNumPasses];
-
-  // Buffer for DC upsampling.
-  ImageF dc_buffer;
-
- private:
-  hwy::AlignedFreeUniquePtr<float[]> float_memory_;
-  hwy::AlignedFreeUniquePtr<int32_t[]> int32_memory_;
-  hwy::AlignedFreeUniquePtr<int16_t[]> int16_memory_;
-  size_t max_block_area_ = 0;
-};
-
 }  // namespace jxl
 
 #endif  // LIB_JXL_DEC_CACHE_H_
@@ -75,6 +75,25 @@ Status DecodeGlobalDCInfo(BitReader* reader, bool is_jpeg,
   state->shared_storage.ac_strategy.FillInvalid();
   return true;
 }
+
+// Marks the groups of `group_dim` pixels, out of a grid of `xsize_groups` x
+// `ysize_groups`, that intersect `rect` extended by `borderx` and `bordery`
+// pixels on each side.
+std::vector<uint8_t> GroupsNearRect(const Rect& rect, size_t borderx,
+                                    size_t bordery, size_t group_dim,
+                                    size_t xsize_groups, size_t ysize_groups) {
+  std::vector<uint8_t> needed(xsize_groups * ysize_groups);
+  size_t gx0 = (rect.x0() - std::min(rect.x0(), borderx)) / group_dim;
+  size_t gy0 = (rect.y0() - std::min(rect.y0(), bordery)) / group_dim;
+  size_t gx1 = std::min(xsize_groups, DivCeil(rect.x1() + borderx, group_dim));
+  size_t gy1 = std::min(ysize_groups, DivCeil(rect.y1() + bordery, group_dim));
+  for (size_t gy = gy0; gy < gy1; gy++) {
+    for (size_t gx = gx0; gx < gx1; gx++) {
+      needed[gy * xsize_groups + gx] = 1;
+    }
+  }
+  return needed;
+}
 }  // namespace
 
 Status DecodeFrame(PassesDecoderState* dec_state, ThreadPool* JXL_RESTRICT pool,
@@ -246,6 +265,11 @@ Status FrameDecoder::InitFrame(BitReader* JXL_RESTRICT br, ImageBundle* decoded,
   processed_section_.clear();
   processed_section_.resize(toc_.size());
   allocated_ = false;
+  has_crop_ = false;
+  dc_group_needed_.clear();
+  ac_group_needed_.clear();
+  render_dc_ = false;
+  render_dc_extra_channels_ = false;
   return true;
 }
 
@@ -294,6 +318,15 @@ Status FrameDecoder::ProcessDCGlobal(BitReader* br) {
   if (dec_status.IsFatalError()) return dec_status;
   if (dec_status) {
     decoded_dc_global_ = true;
+    if (has_crop_ && CanSkipGroups()) {
+      // The AC groups needed for the crop region are known once the render
+      // pipeline is prepared, and are at most one group away from it. Keep
+      // another group around them for the filters and adaptive DC smoothing.
+      dc_group_needed_ = GroupsNearRect(
+          FrameCropRect(), 2 * frame_dim_.group_dim, 2 * frame_dim_.group_dim,
+          frame_dim_.dc_group_dim, frame_dim_.xsize_dc_groups,
+          frame_dim_.ysize_dc_groups);
+    }
   }
   return dec_status;
 }
@@ -324,6 +357,111 @@ Status FrameDecoder::ProcessDCGroup(size_t dc_group_id, BitReader* br) {
   return true;
 }
 
+bool FrameDecoder::CanSkipGroups() const {
+  // Frames that are referenced later need all their pixels, and with a full
+  // modular image, the groups are only rendered once they are all decoded.
+  return coalescing_ && !use_slow_rendering_pipeline_ &&
+         frame_dim_.num_groups > 1 && !decoded_->IsJPEG() &&
+         (frame_header_.frame_type == FrameType::kRegularFrame ||
+          frame_header_.frame_type == FrameType::kSkipProgressive) &&
+         !frame_header_.CanBeReferenced() &&
+         !frame_header_.custom_size_or_origin &&
+         modular_frame_decoder_.CanDropFullImage();
+}
+
+Rect FrameDecoder::FrameCropRect() const {
+  size_t upsampling = frame_header_.upsampling;
+  size_t x0 = crop_.x0() / upsampling;
+  size_t y0 = crop_.y0() / upsampling;
+  return Rect(x0, y0, DivCeil(crop_.x1(), upsampling) - x0,
+              DivCeil(crop_.y1(), upsampling) - y0);
+}
+
+void FrameDecoder::SkipDCGroup(size_t dc_group_id) {
+  // Adaptive DC smoothing reads the DC of the neighbouring groups, keep it
+  // deterministic.
+  if (frame_header_.encoding == FrameEncoding::kVarDCT &&
+      !(frame_header_.flags & FrameHeader::kUseDcFrame)) {
+    const size_t gx = dc_group_id % frame_dim_.xsize_dc_groups;
+    const size_t gy = dc_group_id / frame_dim_.xsize_dc_groups;
+    const size_t dc_group_blocks = frame_dim_.dc_group_dim / kBlockDim;
+    Rect rect(gx * dc_group_blocks, gy * dc_group_blocks, dc_group_blocks,
+              dc_group_blocks, frame_dim_.xsize_blocks,
+              frame_dim_.ysize_blocks);
+    FillImage(0.0f, &dec_state_->shared_storage.dc_storage, rect);
+  }
+  decoded_dc_groups_[dc_group_id] = uint8_t{true};
+}
+
+bool FrameDecoder::SectionNeeded(size_t id) const {
+  if (toc_.size() == 1 || id == 0) return true;
+  if (id <= frame_dim_.num_dc_groups) {
+    return dc_group_needed_.empty() || dc_group_needed_[id - 1];
+  }
+  if (render_dc_ && !render_dc_extra_channels_) return false;
+  size_t ac_global_index = frame_dim_.num_dc_groups + 1;
+  if (id == ac_global_index) return true;
+  size_t acg = (id - ac_global_index - 1) % frame_dim_.num_groups;
+  return ac_group_needed_.empty() || ac_group_needed_[acg];
+}
+
+bool FrameDecoder::CanRenderDC() const {
+  for (size_t ecups : frame_header_.extra_channel_upsampling) {
+    if (ecups != 1) return false;
+  }
+  return coalescing_ && !decoded_->IsJPEG() &&
+         frame_header_.encoding == FrameEncoding::kVarDCT &&
+         frame_header_.upsampling == 1 &&
+         frame_header_.chroma_subsampling.Is444() &&
+         !frame_header_.CanBeReferenced() && !NeedsBlending(dec_state_);
+}
+
+Status FrameDecoder::SetRenderDC() {
+  if (!CanRenderDC()) {
+    return JXL_FAILURE("Frame can not be rendered from its DC image");
+  }
+  render_dc_ = true;
+  render_dc_extra_channels_ =
+      frame_header_.nonserialized_metadata->m.num_extra_channels != 0;
+  return true;
+}
+
+Status FrameDecoder::RenderDC(const std::vector<ImageF>& extra_channels) {
+  if (modular_frame_decoder_.UsesFullImage() ||
+      extra_channels.size() !=
+          frame_header_.nonserialized_metadata->m.num_extra_channels) {
+    return JXL_FAILURE("Frame can not be rendered from its DC image");
+  }
+  const Image3F& dc = *dec_state_->shared->dc;
+  const size_t group_dim = frame_dim_.group_dim;
+  // The pipeline has the size of the DC image, so its groups are the DC
+  // groups.
+  return RunOnPool(
+      pool_, 0, frame_dim_.num_dc_groups,
+      [this](size_t num_threads) {
+        return dec_state_->render_pipeline->PrepareForThreads(
+            num_threads, /*use_group_ids=*/false);
+      },
+      [this, &dc, &extra_channels, group_dim](size_t g, size_t thread) {
+        RenderPipelineInput input =
+            dec_state_->render_pipeline->GetInputBuffers(g, thread);
+        const size_t gx = g % frame_dim_.xsize_dc_groups;
+        const size_t gy = g / frame_dim_.xsize_dc_groups;
+        const Rect rect(gx * group_dim, gy * group_dim, group_dim, group_dim,
+                        dc.xsize(), dc.ysize());
+        for (size_t c = 0; c < 3; c++) {
+          const std::pair<ImageF*, Rect>& buffer = input.GetBuffer(c);
+          CopyImageTo(rect, dc.Plane(c), buffer.second, buffer.first);
+        }
+        for (size_t ec = 0; ec < extra_channels.size(); ec++) {
+          const std::pair<ImageF*, Rect>& buffer = input.GetBuffer(3 + ec);
+          CopyImageTo(rect, extra_channels[ec], buffer.second, buffer.first);
+        }
+        input.Done();
+      },
+      "RenderDC");
+}
+
 void FrameDecoder::FinalizeDC() {
   // Do Adaptive DC smoothing if enabled. This *must* happen between all the
   // ProcessDCGroup and ProcessACGroup.
@@ -339,7 +477,9 @@ void FrameDecoder::FinalizeDC() {
 
 Status FrameDecoder::AllocateOutput() {
   if (allocated_) return true;
-  modular_frame_decoder_.MaybeDropFullImage();
+  // The extra channels rendered from the DC image are downsampled from the
+  // full image once it is complete.
+  if (!render_dc_extra_channels_) modular_frame_decoder_.MaybeDropFullImage();
   decoded_->origin = dec_state_->shared->frame_header.frame_origin;
   JXL_RETURN_IF_ERROR(dec_state_->InitForAC(nullptr));
   allocated_ = true;
@@ -390,7 +530,8 @@ Status FrameDecoder::ProcessACGlobal(BitReader* br) {
     // TODO(veluca): figure out the exact limit - 16 should still work with
     // 16-bit buffers, but we are excluding it for safety.
     bool use_16_bit = max_num_bits_ac < 16 && !decoded_->IsJPEG();
-    bool store = frame_header_.passes.num_passes > 1;
+    // The coefficients skipped by render_dc_ are not kept for later passes.
+    bool store = frame_header_.passes.num_passes > 1 && !render_dc_;
     size_t xs = store ? kGroupDim * kGroupDim : 0;
     size_t ys = store ? frame_dim_.num_groups : 0;
     if (use_16_bit) {
@@ -461,16 +602,19 @@ Status FrameDecoder::ProcessACGroup(size_t ac_group_id,
               ac_group_id, gx, gy, group_dim,
               decoded_passes_per_ac_group_[ac_group_id], num_passes);
 
+  if (render_dc_) return SkipACGroup(ac_group_id, br, num_passes, thread);
+
   RenderPipelineInput render_pipeline_input =
       dec_state_->render_pipeline->GetInputBuffers(ac_group_id, thread);
 
   bool should_run_pipeline = true;
 
   if (frame_header_.encoding == FrameEncoding::kVarDCT) {
-    group_dec_caches_[thread].InitOnce(frame_header_.passes.num_passes,
-                                       dec_state_->used_acs);
+    GroupDecCache* group_dec_cache = &dec_state_->group_dec_caches[thread];
+    group_dec_cache->InitOnce(frame_header_.passes.num_passes,
+                              dec_state_->used_acs);
     JXL_RETURN_IF_ERROR(DecodeGroup(br, num_passes, ac_group_id, dec_state_,
-                                    &group_dec_caches_[thread], thread,
+                                    group_dec_cache, thread,
                                     render_pipeline_input, decoded_,
                                     decoded_passes_per_ac_group_[ac_group_id],
                                     force_draw, dc_only, &should_run_pipeline));
@@ -532,6 +676,8 @@ Status FrameDecoder::ProcessACGroup(size_t ac_group_id,
 
   if (!modular_frame_decoder_.UsesFullImage() && !decoded_->IsJPEG()) {
     if (should_run_pipeline && modular_ready) {
+      ScopedCpuTimeCounter render_time(
+          DecoderStageCpuTime(stage_stats_, JXL_DEC_STAGE_RENDER));
       render_pipeline_input.Done();
     } else if (force_draw) {
       return JXL_FAILURE("Modular group decoding failed.");
@@ -540,6 +686,36 @@ Status FrameDecoder::ProcessACGroup(size_t ac_group_id,
   return true;
 }
 
+Status FrameDecoder::SkipACGroup(size_t ac_group_id,
+                                 BitReader* JXL_RESTRICT* br,
+                                 size_t num_passes, size_t thread) {
+  PROFILER_ZONE("skip_group");
+  JXL_ASSERT(render_dc_extra_channels_);
+  const size_t group_dim = frame_dim_.group_dim;
+  const size_t gx = ac_group_id % frame_dim_.xsize_groups;
+  const size_t gy = ac_group_id / frame_dim_.xsize_groups;
+  GroupDecCache* group_dec_cache = &dec_state_->group_dec_caches[thread];
+  group_dec_cache->InitOnce(frame_header_.passes.num_passes,
+                            dec_state_->used_acs);
+  const size_t pass0 = decoded_passes_per_ac_group_[ac_group_id];
+  JXL_RETURN_IF_ERROR(SkipGroup(br, num_passes, ac_group_id, dec_state_,
+                                group_dec_cache, pass0));
+  // The modular decoder keeps the full image, which is only rendered by
+  // FinalizeFrame.
+  const Rect mrect(gx * group_dim, gy * group_dim, group_dim, group_dim);
+  for (size_t i = pass0; i < pass0 + num_passes; ++i) {
+    int minShift, maxShift;
+    frame_header_.passes.GetDownsamplingBracket(i, minShift, maxShift);
+    JXL_RETURN_IF_ERROR(modular_frame_decoder_.DecodeGroup(
+        mrect, br[i - pass0], minShift, maxShift,
+        ModularStreamId::ModularAC(ac_group_id, i),
+        /*zerofill=*/false, dec_state_, /*render_pipeline_input=*/nullptr,
+        /*allow_truncated=*/false, /*should_run_pipeline=*/nullptr));
+  }
+  decoded_passes_per_ac_group_[ac_group_id] += num_passes;
+  return true;
+}
+
 void FrameDecoder::MarkSections(const SectionInfo* sections, size_t num,
                                 SectionStatus* section_status) {
   num_sections_done_ += num;
@@ -615,6 +791,7 @@ Status FrameDecoder::ProcessSections(const SectionInfo* sections, size_t num,
       desired_num_ac_passes[g] = j;
     }
   }
+  DecoderStageTimer dc_timer(stage_stats_, JXL_DEC_STAGE_DC);
   if (dc_global_sec != num) {
     Status dc_global_status = ProcessDCGlobal(sections[dc_global_sec].br);
     if (dc_global_status.IsFatalError()) return dc_global_status;
@@ -625,6 +802,15 @@ Status FrameDecoder::ProcessSections(const SectionInfo* sections, size_t num,
     }
   }
 
+  if (!dc_group_needed_.empty()) {
+    for (size_t i = 0; i < dc_group_sec.size(); i++) {
+      if (dc_group_sec[i] == num || dc_group_needed_[i]) continue;
+      SkipDCGroup(i);
+      section_status[dc_group_sec[i]] = SectionStatus::kDone;
+      dc_group_sec[i] = num;
+    }
+  }
+
   std::atomic<bool> has_error{false};
   if (decoded_dc_global_) {
     JXL_RETURN_IF_ERROR(RunOnPool(
@@ -649,18 +835,46 @@ Status FrameDecoder::ProcessSections(const SectionInfo* sections, size_t num,
     pipeline_options.use_slow_render_pipeline = use_slow_rendering_pipeline_;
     pipeline_options.coalescing = coalescing_;
     pipeline_options.render_spotcolors = render_spotcolors_;
+    pipeline_options.render_dc = render_dc_;
     JXL_RETURN_IF_ERROR(
         dec_state_->PreparePipeline(decoded_, pipeline_options));
     FinalizeDC();
     JXL_RETURN_IF_ERROR(AllocateOutput());
+    if (render_dc_ && !render_dc_extra_channels_) {
+      dc_timer.Stop();
+      DecoderStageTimer render_timer(stage_stats_, JXL_DEC_STAGE_RENDER);
+      JXL_RETURN_IF_ERROR(RenderDC(/*extra_channels=*/{}));
+      ac_group_needed_.assign(frame_dim_.num_groups, 0);
+    } else if (!dc_group_needed_.empty()) {
+      std::pair<size_t, size_t> border =
+          dec_state_->render_pipeline->GroupBorder();
+      JXL_ASSERT(2 * border.first <= frame_dim_.group_dim &&
+                 2 * border.second <= frame_dim_.group_dim);
+      ac_group_needed_ = GroupsNearRect(
+          FrameCropRect(), border.first, border.second, frame_dim_.group_dim,
+          frame_dim_.xsize_groups, frame_dim_.ysize_groups);
+    }
+    for (size_t i = 0; i < ac_group_needed_.size(); i++) {
+      if (!ac_group_needed_[i]) {
+        decoded_passes_per_ac_group_[i] = frame_header_.passes.num_passes;
+      }
+    }
     if (progressive_detail_ >= JxlProgressiveDetail::kDC) {
       MarkSections(sections, num, section_status);
       return true;
     }
   }
 
+  dc_timer.Stop();
+
+  DecoderStageTimer ac_timer(stage_stats_, JXL_DEC_STAGE_AC);
   if (finalized_dc_ && ac_global_sec != num && !decoded_ac_global_) {
-    JXL_RETURN_IF_ERROR(ProcessACGlobal(sections[ac_global_sec].br));
+    if (render_dc_ && !render_dc_extra_channels_) {
+      // Nothing in the AC global section is needed to render the DC.
+      decoded_ac_global_ = true;
+    } else {
+      JXL_RETURN_IF_ERROR(ProcessACGlobal(sections[ac_global_sec].br));
+    }
     section_status[ac_global_sec] = SectionStatus::kDone;
   }
 
@@ -674,9 +888,19 @@ Status FrameDecoder::ProcessSections(const SectionInfo* sections, size_t num,
     }
   }
 
-  if (decoded_ac_global_) {
+  if (!ac_group_needed_.empty()) {
+    for (size_t g = 0; g < ac_group_sec.size(); g++) {
+      if (ac_group_needed_[g]) continue;
+      for (size_t sec : ac_group_sec[g]) {
+        if (sec != num) section_status[sec] = SectionStatus::kDone;
+      }
+      desired_num_ac_passes[g] = 0;
+    }
+  }
+
+  if (decoded_ac_global_ && (!render_dc_ || render_dc_extra_channels_)) {
     // Mark all the AC groups that we received as not complete yet.
-    for (size_t i = 0; i < ac_group_sec.size(); i++) {
+    for (size_t i = 0; i < ac_group_sec.size() && !render_dc_; i++) {
       if (desired_num_ac_passes[i] != 0) {
         dec_state_->render_pipeline->ClearDone(i);
       }
@@ -741,6 +965,10 @@ Status FrameDecoder::Flush() {
     // Nothing to do.
     return true;
   }
+  // The DC image is rendered as soon as it is decoded, or by FinalizeFrame
+  // once the extra channels are decoded.
+  if (render_dc_) return true;
+  DecoderStageTimer render_timer(stage_stats_, JXL_DEC_STAGE_RENDER);
   JXL_RETURN_IF_ERROR(AllocateOutput());
 
   uint32_t completely_decoded_ac_pass = *std::min_element(
@@ -797,6 +1025,24 @@ int FrameDecoder::SavedAs(const FrameHeader& header) {
   return 0;
 }
 
+size_t FrameDecoder::NumCompleteRows() const {
+  if (!decoded_ac_global_ || render_dc_) return 0;
+  size_t num_group_rows = 0;
+  for (; num_group_rows < frame_dim_.ysize_groups; num_group_rows++) {
+    bool complete = true;
+    for (size_t gx = 0; gx < frame_dim_.xsize_groups; gx++) {
+      size_t g = num_group_rows * frame_dim_.xsize_groups + gx;
+      if ((!ac_group_needed_.empty() && !ac_group_needed_[g]) ||
+          decoded_passes_per_ac_group_[g] < frame_header_.passes.num_passes) {
+        complete = false;
+        break;
+      }
+    }
+    if (!complete) break;
+  }
+  return std::min(frame_dim_.ysize, num_group_rows * frame_dim_.group_dim);
+}
+
 bool FrameDecoder::HasEverything() const {
   if (!decoded_dc_global_) return false;
   if (!decoded_ac_global_) return false;
@@ -858,6 +1104,15 @@ Status FrameDecoder::FinalizeFrame() {
     return true;
   }
 
+  DecoderStageTimer render_timer(stage_stats_, JXL_DEC_STAGE_RENDER);
+  if (render_dc_extra_channels_) {
+    std::vector<ImageF> extra_channels;
+    JXL_RETURN_IF_ERROR(modular_frame_decoder_.DownsampleExtraChannels(
+        dec_state_, kBlockDim, pool_, &extra_channels));
+    JXL_RETURN_IF_ERROR(RenderDC(extra_channels));
+    return true;
+  }
+
   // undo global modular transforms and copy int pixel buffers to float ones
   JXL_RETURN_IF_ERROR(
       modular_frame_decoder_.FinalizeDecoding(dec_state_, pool_,
@@ -20,6 +20,7 @@
 #include "lib/jxl/dec_bit_reader.h"
 #include "lib/jxl/dec_cache.h"
 #include "lib/jxl/dec_modular.h"
+#include "lib/jxl/dec_stage_stats.h"
 #include "lib/jxl/frame_header.h"
 #include "lib/jxl/headers.h"
 #include "lib/jxl/image_bundle.h"
@@ -48,6 +49,39 @@ class FrameDecoder {
 
   void SetRenderSpotcolors(bool rsc) { render_spotcolors_ = rsc; }
   void SetCoalescing(bool c) { coalescing_ = c; }
+  // Measures the time used by the stages of the frame into `stats`, which
+  // must outlive the FrameDecoder. Nothing is measured if it is null.
+  void SetStageStats(DecoderStageStats* stats) { stage_stats_ = stats; }
+
+  // Restricts the image output to `rect`, in image pixels before applying the
+  // orientation. If the frame covers the whole image, is coalesced and is not
+  // referenced by later frames, the DC and AC groups that do not contribute to
+  // the rect are also skipped without being decoded. Must be called after
+  // InitFrame and before SetImageOutput and ProcessSections.
+  void SetCropRegion(const Rect& rect) {
+    crop_ = rect;
+    has_crop_ = true;
+  }
+
+  // Whether the frame can be rendered from its DC image: it must be a coalesced
+  // VarDCT frame without upsampling, chroma subsampling or subsampled extra
+  // channels that replaces the whole image and is not referenced by later
+  // frames. Must be called after InitFrame.
+  bool CanRenderDC() const;
+
+  // Renders the frame from its DC image, at 1/8 of the frame size in each
+  // direction, without the filters and image features, and skips the AC
+  // sections without decoding them. The extra channels, which have no DC
+  // image, are decoded from the AC sections and box-downsampled instead, so
+  // that frames with extra channels are only rendered by FinalizeFrame. Fails
+  // if CanRenderDC is false. Must be called after InitFrame and before
+  // SetImageOutput and ProcessSections.
+  Status SetRenderDC();
+
+  // Returns whether the section with the given id still needs to be read:
+  // once it is known that a group is skipped because of the crop region, its
+  // sections can be passed to ProcessSections without their data.
+  bool SectionNeeded(size_t id) const;
 
   // Read FrameHeader and table of contents from the given BitReader.
   // Also checks frame dimensions for their limits, and sets the output
@@ -56,6 +90,7 @@ class FrameDecoder {
                    bool is_preview, bool output_needed);
 
   struct SectionInfo {
+    // May be null for sections that are not needed, see SectionNeeded.
     BitReader* JXL_RESTRICT br;
     size_t id;
   };
@@ -120,6 +155,11 @@ class FrameDecoder {
                              decoded_passes_per_ac_group_.end());
   }
 
+  // Returns the number of rows at the top of the frame for which all the AC
+  // groups have been decoded with all their passes. Groups that are skipped
+  // because of the crop region are not counted as decoded.
+  size_t NumCompleteRows() const;
+
   // If enabled, ProcessSections will stop and return true when the DC
   // sections have been processed, instead of starting the AC sections. This
   // will only occur if supported (that is, flushing will produce a valid
@@ -189,6 +229,8 @@ class FrameDecoder {
     dec_state_->main_output.buffer = image_buffer;
     dec_state_->main_output.buffer_size = image_buffer_size;
     dec_state_->main_output.stride = GetStride(xsize, format);
+    dec_state_->output_x0 = has_crop_ ? crop_.x0() : 0;
+    dec_state_->output_y0 = has_crop_ ? crop_.y0() : 0;
     const jxl::ExtraChannelInfo* alpha =
         decoded_->metadata()->Find(jxl::ExtraChannel::kAlpha);
     if (alpha && alpha->alpha_associated && unpremul_alpha) {
@@ -204,10 +246,11 @@ class FrameDecoder {
 #if !JXL_HIGH_PRECISION
     if (dec_state_->main_output.buffer &&
         (format.data_type == JXL_TYPE_UINT8) && (format.num_channels >= 3) &&
-        !dec_state_->unpremul_alpha &&
+        !dec_state_->unpremul_alpha && !has_crop_ &&
         (dec_state_->undo_orientation == Orientation::kIdentity) &&
         decoded_->metadata()->xyb_encoded &&
         dec_state_->output_encoding_info.color_encoding.IsSRGB() &&
+        !dec_state_->output_encoding_info.use_cms &&
         dec_state_->output_encoding_info.all_default_opsin &&
         (dec_state_->output_encoding_info.desired_intensity_target ==
          dec_state_->output_encoding_info.orig_intensity_target) &&
@@ -239,6 +282,18 @@ class FrameDecoder {
                         bool dc_only);
   void MarkSections(const SectionInfo* sections, size_t num,
                     SectionStatus* section_status);
+  // Whether groups outside the crop region can be skipped for this frame.
+  bool CanSkipGroups() const;
+  // The crop region in frame pixels, that is before upsampling.
+  Rect FrameCropRect() const;
+  void SkipDCGroup(size_t dc_group_id);
+  // Reads the AC group of a frame rendered from its DC image, decoding only
+  // the extra channels, see SetRenderDC.
+  Status SkipACGroup(size_t ac_group_id, BitReader* JXL_RESTRICT* br,
+                     size_t num_passes, size_t thread);
+  // Feeds the DC image and the downsampled `extra_channels` to the render
+  // pipeline prepared for render_dc_.
+  Status RenderDC(const std::vector<ImageF>& extra_channels);
 
   // Allocates storage for parallel decoding using up to `num_threads` threads
   // of up to `num_tasks` tasks. The value of `thread` passed to
@@ -247,14 +302,15 @@ class FrameDecoder {
   // than the value of `num_tasks` passed here.
   Status PrepareStorage(size_t num_threads, size_t num_tasks) {
     size_t storage_size = std::min(num_threads, num_tasks);
-    if (storage_size > group_dec_caches_.size()) {
-      group_dec_caches_.resize(storage_size);
+    if (storage_size > dec_state_->group_dec_caches.size()) {
+      dec_state_->group_dec_caches.resize(storage_size);
     }
     use_task_id_ = num_threads > num_tasks;
     bool use_group_ids = (modular_frame_decoder_.UsesFullImage() &&
                           (frame_header_.encoding == FrameEncoding::kVarDCT ||
                            (frame_header_.flags & FrameHeader::kNoise)));
-    if (dec_state_->render_pipeline) {
+    // The pipeline of render_dc_ is fed by RenderDC on its own.
+    if (dec_state_->render_pipeline && !render_dc_) {
       JXL_RETURN_IF_ERROR(dec_state_->render_pipeline->PrepareForThreads(
           storage_size, use_group_ids));
     }
@@ -292,6 +348,17 @@ class FrameDecoder {
   ModularFrameDecoder modular_frame_decoder_;
   bool render_spotcolors_ = true;
   bool coalescing_ = true;
+  Rect crop_;
+  bool has_crop_ = false;
+  // Groups that contribute to the crop region; empty if all groups are
+  // decoded.
+  std::vector<uint8_t> dc_group_needed_;
+  std::vector<uint8_t> ac_group_needed_;
+  // Whether the frame is rendered from its DC image, see SetRenderDC.
+  bool render_dc_ = false;
+  // Whether render_dc_ also needs the AC sections, for the extra channels.
+  bool render_dc_extra_channels_ = false;
+  DecoderStageStats* stage_stats_ = nullptr;
 
   std::vector<uint8_t> processed_section_;
   std::vector<uint8_t> decoded_passes_per_ac_group_;
@@ -304,8 +371,6 @@ class FrameDecoder {
   bool is_finalized_ = true;
   bool allocated_ = false;
 
-  std::vector<GroupDecCache> group_dec_caches_;
-
   // Whether or not the task id should be used for storage indexing, instead of
   // the thread id.
   bool use_task_id_ = false;
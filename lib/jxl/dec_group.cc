@@ -775,6 +775,56 @@ Status DecodeGroup(BitReader* JXL_RESTRICT* JXL_RESTRICT readers,
   return true;
 }
 
+Status SkipGroup(BitReader* JXL_RESTRICT* JXL_RESTRICT readers,
+                 size_t num_passes, size_t group_idx,
+                 PassesDecoderState* JXL_RESTRICT dec_state,
+                 GroupDecCache* JXL_RESTRICT group_dec_cache,
+                 size_t first_pass) {
+  PROFILER_FUNC;
+  JXL_ASSERT(dec_state->shared->num_histograms > 0);
+  const size_t histo_selector_bits =
+      CeilLog2Nonzero(dec_state->shared->num_histograms);
+  const Rect block_rect = dec_state->shared->BlockGroupRect(group_idx);
+
+  GetBlockFromBitstream get_block;
+  JXL_RETURN_IF_ERROR(get_block.Init(readers, num_passes, group_idx,
+                                     histo_selector_bits, block_rect,
+                                     group_dec_cache, dec_state, first_pass));
+
+  // The coefficients only depend on the tokens of the same pass, so they can
+  // be read into the scratch block of the cache and dropped.
+  ACPtr qblock[3];
+  for (size_t by = 0; by < block_rect.ysize(); ++by) {
+    get_block.StartRow(by);
+    AcStrategyRow acs_row =
+        dec_state->shared->ac_strategy.ConstRow(block_rect, by);
+    for (size_t bx = 0; bx < block_rect.xsize();) {
+      AcStrategy acs = acs_row[bx];
+      if (!acs.IsFirstBlock()) {
+        bx += acs.covered_blocks_x();
+        continue;
+      }
+      const size_t log2_covered_blocks = acs.log2_covered_blocks();
+      const size_t size = (1 << log2_covered_blocks) * kDCTBlockSize;
+      memset(group_dec_cache->dec_group_qblock, 0, size * 3 * sizeof(int32_t));
+      for (size_t c = 0; c < 3; c++) {
+        qblock[c].ptr32 = group_dec_cache->dec_group_qblock + c * size;
+      }
+      JXL_RETURN_IF_ERROR(get_block.LoadBlock(bx, by, acs, size,
+                                              log2_covered_blocks, qblock,
+                                              ACType::k32));
+      bx += acs.covered_blocks_x();
+    }
+  }
+
+  for (size_t pass = 0; pass < num_passes; pass++) {
+    if (!get_block.decoders[pass].CheckANSFinalState()) {
+      return JXL_FAILURE("ANS checksum failure.");
+    }
+  }
+  return true;
+}
+
 Status DecodeGroupForRoundtrip(const std::vector<std::unique_ptr<ACImage>>& ac,
                                size_t group_idx,
                                PassesDecoderState* JXL_RESTRICT dec_state,
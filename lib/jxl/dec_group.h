@@ -35,6 +35,15 @@ Status DecodeGroup(BitReader* JXL_RESTRICT* JXL_RESTRICT readers,
                    ImageBundle* JXL_RESTRICT decoded, size_t first_pass,
                    bool force_draw, bool dc_only, bool* should_run_pipeline);
 
+// Reads the AC coefficients of `num_passes` passes of the group from
+// `readers` and discards them, so that the modular data that follows them in
+// the same sections can be decoded without rendering the group.
+Status SkipGroup(BitReader* JXL_RESTRICT* JXL_RESTRICT readers,
+                 size_t num_passes, size_t group_idx,
+                 PassesDecoderState* JXL_RESTRICT dec_state,
+                 GroupDecCache* JXL_RESTRICT group_dec_cache,
+                 size_t first_pass);
+
 Status DecodeGroupForRoundtrip(const std::vector<std::unique_ptr<ACImage>>& ac,
                                size_t group_idx,
                                PassesDecoderState* JXL_RESTRICT dec_state,
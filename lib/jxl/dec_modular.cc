@@ -282,7 +282,7 @@ Status ModularFrameDecoder::DecodeGlobalInfo(BitReader* reader,
 }
 
 void ModularFrameDecoder::MaybeDropFullImage() {
-  if (full_image.transform.empty() && !have_something && all_same_shift) {
+  if (CanDropFullImage()) {
     use_full_image = false;
     JXL_DEBUG_V(6, "Dropping full image");
     for (auto& ch : full_image.channel) {
@@ -726,6 +726,62 @@ Status ModularFrameDecoder::FinalizeDecoding(PassesDecoderState* dec_state,
   return true;
 }
 
+Status ModularFrameDecoder::DownsampleExtraChannels(
+    const PassesDecoderState* dec_state, size_t factor, jxl::ThreadPool* pool,
+    std::vector<ImageF>* extra_channels) {
+  JXL_ASSERT(use_full_image && !do_color);
+  const auto* metadata =
+      dec_state->shared->frame_header.nonserialized_metadata;
+  const size_t num_extra_channels = metadata->m.num_extra_channels;
+  Image gi = std::move(full_image);
+  gi.undo_transforms(global_header.wp_header, pool);
+  JXL_DASSERT(global_transform.empty());
+  if (gi.error) return JXL_FAILURE("Undoing transforms failed");
+  if (gi.channel.size() != num_extra_channels) {
+    return JXL_FAILURE("Unexpected number of extra channels");
+  }
+  extra_channels->clear();
+  for (size_t ec = 0; ec < num_extra_channels; ec++) {
+    const ExtraChannelInfo& eci = metadata->m.extra_channel_info[ec];
+    const int bits = eci.bit_depth.bits_per_sample;
+    const int exp_bits = eci.bit_depth.exponent_bits_per_sample;
+    const bool fp = eci.bit_depth.floating_point_sample;
+    JXL_ASSERT(fp || bits < 32);
+    const double scale = fp ? 0 : (1.0 / ((1u << bits) - 1));
+    const Channel& ch = gi.channel[ec];
+    if (ch.hshift != 0 || ch.vshift != 0) {
+      return JXL_FAILURE("Downsampling a subsampled extra channel");
+    }
+    ImageF out(DivCeil(ch.w, factor), DivCeil(ch.h, factor));
+    ZeroFillImage(&out);
+    std::vector<float> row(ch.w);
+    for (size_t y = 0; y < ch.h; ++y) {
+      const pixel_type* const JXL_RESTRICT row_in = ch.Row(y);
+      if (fp) {
+        int_to_float(row_in, row.data(), ch.w, bits, exp_bits);
+      } else {
+        SingleFromSingleAccurate(ch.w, row_in, scale, row.data());
+      }
+      float* const JXL_RESTRICT row_out = out.Row(y / factor);
+      for (size_t x = 0; x < ch.w; ++x) {
+        row_out[x / factor] += row[x];
+      }
+    }
+    // The boxes on the right and bottom edges only average the pixels inside
+    // the channel.
+    for (size_t oy = 0; oy < out.ysize(); ++oy) {
+      const size_t box_ysize = std::min(factor, ch.h - oy * factor);
+      float* const JXL_RESTRICT row_out = out.Row(oy);
+      for (size_t ox = 0; ox < out.xsize(); ++ox) {
+        const size_t box_xsize = std::min(factor, ch.w - ox * factor);
+        row_out[ox] /= box_xsize * box_ysize;
+      }
+    }
+    extra_channels->emplace_back(std::move(out));
+  }
+  return true;
+}
+
 static constexpr const float kAlmostZero = 1e-8f;
 
 Status ModularFrameDecoder::DecodeQuantTable(
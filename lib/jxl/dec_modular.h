@@ -9,6 +9,7 @@
 #include <stddef.h>
 
 #include <string>
+#include <vector>
 
 #include "lib/jxl/aux_out_fwd.h"
 #include "lib/jxl/base/data_parallel.h"
@@ -113,7 +114,20 @@ class ModularFrameDecoder {
   // steps)
   Status FinalizeDecoding(PassesDecoderState* dec_state, jxl::ThreadPool* pool,
                           bool inplace);
+  // Undoes the global transforms of the full image and box-downsamples its
+  // extra channels by `factor` in each direction into `extra_channels`, with
+  // the nominal range of the channels mapped to [0, 1]. Used instead of
+  // FinalizeDecoding for VarDCT frames rendered from their DC image, see
+  // FrameDecoder::SetRenderDC; can only be called once.
+  Status DownsampleExtraChannels(const PassesDecoderState* dec_state,
+                                 size_t factor, jxl::ThreadPool* pool,
+                                 std::vector<ImageF>* extra_channels);
   bool have_dc() const { return have_something; }
+  // Whether MaybeDropFullImage will drop the full image, so that groups are
+  // rendered as soon as they are decoded. Valid after DecodeGlobalInfo.
+  bool CanDropFullImage() const {
+    return full_image.transform.empty() && !have_something && all_same_shift;
+  }
   void MaybeDropFullImage();
   bool UsesFullImage() const { return use_full_image; }
 
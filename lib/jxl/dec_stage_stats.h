@@ -0,0 +1,89 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef LIB_JXL_DEC_STAGE_STATS_H_
+#define LIB_JXL_DEC_STAGE_STATS_H_
+
+// Time used by the stages of the decoder, reported to the application with
+// JxlDecoderSetStageStatsCallback.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "jxl/decode.h"
+#include "lib/jxl/base/thread_cpu_time.h"
+
+namespace jxl {
+
+constexpr size_t kNumDecoderStages = JXL_DEC_STAGE_RENDER + 1;
+
+// Stats of a single frame.
+struct DecoderStageStats {
+  struct Stage {
+    bool Entered() const {
+      return wall_seconds > 0.0 ||
+             cpu_nanoseconds.load(std::memory_order_relaxed) > 0;
+    }
+    JxlDecoderStageStats Stats() const {
+      return {wall_seconds,
+              cpu_nanoseconds.load(std::memory_order_relaxed) * 1E-9};
+    }
+
+    double wall_seconds = 0.0;
+    // Added to by all the threads that work on the stage.
+    std::atomic<uint64_t> cpu_nanoseconds{0};
+  };
+  Stage stages[kNumDecoderStages];
+};
+
+// Returns the CPU time counter of the given stage, or null if stats is null.
+static inline std::atomic<uint64_t>* DecoderStageCpuTime(
+    DecoderStageStats* stats, JxlDecoderStage stage) {
+  return stats ? &stats->stages[stage].cpu_nanoseconds : nullptr;
+}
+
+// Adds the time used between its construction and destruction to the given
+// stage of stats. Does nothing if stats is null, which is the case unless the
+// application asked for the stats. Must be used from the thread that calls
+// the FrameDecoder, for stages that are not nested in each other. Work done
+// on the worker threads of the ThreadPool can be moved to another stage with
+// a ScopedCpuTimeCounter of DecoderStageCpuTime.
+class DecoderStageTimer {
+ public:
+  DecoderStageTimer(DecoderStageStats* stats, JxlDecoderStage stage)
+      : stage_(stats ? &stats->stages[stage] : nullptr),
+        cpu_time_(DecoderStageCpuTime(stats, stage)) {
+    if (!stage_) return;
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  DecoderStageTimer(const DecoderStageTimer&) = delete;
+  DecoderStageTimer& operator=(const DecoderStageTimer&) = delete;
+
+  ~DecoderStageTimer() { Stop(); }
+
+  // Ends the measurement before the end of the scope.
+  void Stop() {
+    if (!stage_) return;
+    cpu_time_.Release();
+    stage_->wall_seconds +=
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      start_)
+            .count();
+    stage_ = nullptr;
+  }
+
+ private:
+  DecoderStageStats::Stage* stage_;
+  ScopedCpuTimeCounter cpu_time_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace jxl
+
+#endif  // LIB_JXL_DEC_STAGE_STATS_H_
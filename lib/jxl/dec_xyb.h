@@ -8,6 +8,7 @@
 
 // XYB -> linear sRGB.
 
+#include "jxl/cms_interface.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
@@ -56,6 +57,16 @@ struct OutputEncodingInfo {
   float luminances[3];
   // Used for the HLG inverse OOTF and PQ tone mapping.
   float desired_intensity_target;
+  //
+  // Fields set with JxlDecoderSetCms and JxlDecoderSetOutputColorProfile
+  //
+  bool cms_set = false;
+  JxlCmsInterface color_management_system;
+  // If true, the rendered pixels are converted from color_encoding to
+  // cms_output_encoding with color_management_system, for output encodings
+  // that the stages above can not produce directly.
+  bool use_cms = false;
+  ColorEncoding cms_output_encoding;
 
   Status SetFromMetadata(const CodecMetadata& metadata);
   Status MaybeSetColorEncoding(const ColorEncoding& c_desired);
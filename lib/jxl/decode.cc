@@ -15,6 +15,8 @@
 #include "lib/jxl/dec_external_image.h"
 #include "lib/jxl/dec_frame.h"
 #include "lib/jxl/dec_modular.h"
+#include "lib/jxl/dec_stage_stats.h"
+#include "lib/jxl/decode_internal.h"
 #if JPEGXL_ENABLE_TRANSCODE_JPEG
 #include "lib/jxl/decode_to_jpeg.h"
 #endif
@@ -23,6 +25,7 @@
 #include "lib/jxl/headers.h"
 #include "lib/jxl/icc_codec.h"
 #include "lib/jxl/image_bundle.h"
+#include "lib/jxl/image_ops.h"
 #include "lib/jxl/loop_filter.h"
 #include "lib/jxl/memory_manager_internal.h"
 #include "lib/jxl/sanitizers.h"
@@ -188,6 +191,7 @@ enum class BoxStage : uint32_t {
   kCodestream,  // Handling codestream box contents, or non-container stream
   kPartialCodestream,  // Handling the extra header of partial codestream box
   kJpegRecon,          // Handling jpeg reconstruction box
+  kFrameIndex,         // Handling frame index box
 };
 
 enum class JpegReconStage : uint32_t {
@@ -325,6 +329,54 @@ typedef struct JxlDecoderFrameIndexBoxStruct {
   }
 } JxlDecoderFrameIndexBox;
 
+namespace {
+
+// Parses the contents of a jxli box, returns false if they are invalid.
+bool ParseFrameIndexBox(const uint8_t* data, size_t size,
+                        JxlDecoderFrameIndexBox* frame_index_box) {
+  size_t pos = 0;
+  uint64_t NF = DecodeVarInt(data, size, &pos);
+  if (pos + 8 > size) return false;
+  frame_index_box->TNUM = LoadBE32(data + pos);
+  frame_index_box->TDEN = LoadBE32(data + pos + 4);
+  pos += 8;
+  // Each entry takes at least 3 bytes, this also bounds the allocation.
+  if (NF == 0 || NF > (size - pos) / 3) return false;
+  frame_index_box->entries.clear();
+  for (uint64_t i = 0; i < NF; ++i) {
+    uint64_t OFFi = DecodeVarInt(data, size, &pos);
+    uint64_t Ti = DecodeVarInt(data, size, &pos);
+    uint64_t Fi = DecodeVarInt(data, size, &pos);
+    if (pos > size || Ti > 0xFFFFFFFFu || Fi > 0xFFFFFFFFu) return false;
+    frame_index_box->AddFrame(OFFi, Ti, Fi);
+  }
+  return true;
+}
+
+}  // namespace
+
+// Location of the codestream bytes of a jxlc or jxlp box, or of the entire
+// stream if it is not in a container, used to find the file position of the
+// codestream offsets given in the frame index box.
+struct CodestreamBoxInfo {
+  // Offset of the first byte of the box in the concatenated codestream.
+  uint64_t codestream_begin;
+  // File position of the first codestream byte of the box, after the box
+  // header and the jxlp index.
+  uint64_t file_begin;
+  uint64_t contents_begin;
+  uint64_t contents_end;
+  bool unbounded;
+  // Whether this is the jxlc box or the last jxlp box.
+  bool last;
+
+  bool Contains(uint64_t codestream_pos) const {
+    return codestream_pos >= codestream_begin &&
+           (unbounded ||
+            codestream_pos - codestream_begin < contents_end - file_begin);
+  }
+};
+
 }  // namespace jxl
 
 // NOLINTNEXTLINE(clang-analyzer-optin.performance.Padding)
@@ -350,7 +402,12 @@ struct JxlDecoderStruct {
   bool got_all_headers;               // Codestream metadata headers.
   bool post_headers;                  // Already decoding pixels.
   jxl::ICCReader icc_reader;
+  // Frame index from the jxli box, and the codestream boxes seen so far. Both
+  // are kept when rewinding, to seek with JxlDecoderSeekToFrame.
   jxl::JxlDecoderFrameIndexBox frame_index_box;
+  std::vector<jxl::CodestreamBoxInfo> codestream_boxes;
+  // Contents of the jxli box while it is being read.
+  std::vector<uint8_t> frame_index_contents;
   // This means either we actually got the preview image, or determined we
   // cannot get it or there is none.
   bool got_preview_image;
@@ -395,6 +452,17 @@ struct JxlDecoderStruct {
   bool render_spotcolors;
   bool coalescing;
   float desired_intensity_target;
+  // Region set by JxlDecoderSetCropRegion, in the orientation of the output.
+  bool has_crop;
+  size_t crop_x0;
+  size_t crop_y0;
+  size_t crop_xsize;
+  size_t crop_ysize;
+  // Factor set by JxlDecoderSetOutputDownsampling, 1, 2, 4 or 8.
+  uint32_t output_downsampling;
+  // Color management system set by JxlDecoderSetCms.
+  bool cms_set;
+  JxlCmsInterface cms;
 
   // Bitfield, for which informative events (JXL_DEC_BASIC_INFO, etc...) the
   // decoder returns a status. By default, do not return for any of the events,
@@ -438,6 +506,14 @@ struct JxlDecoderStruct {
   // For extra channels. Empty if no extra channels are requested, and they are
   // reset each frame
   std::vector<ExtraChannelOutput> extra_channel_output;
+  // Whether the frame that receives the image output is decoded at full
+  // resolution into full_output and full_extra_channel_output, float pixels
+  // in the format of the output, and box-downsampled once decoded. Used with
+  // output downsampling for frames that can not be rendered from their DC
+  // image.
+  bool downsample_full_output;
+  std::vector<float> full_output;
+  std::vector<std::vector<float>> full_extra_channel_output;
 
   jxl::CodecMetadata metadata;
   // Same as metadata.m, except for the color_encoding, which is set to the
@@ -447,6 +523,11 @@ struct JxlDecoderStruct {
 
   std::unique_ptr<jxl::PassesDecoderState> passes_state;
   std::unique_ptr<jxl::FrameDecoder> frame_dec;
+  // Set with JxlDecoderSetStageStatsCallback.
+  JxlDecoderStageStatsCallback stage_stats_callback;
+  void* stage_stats_opaque;
+  // Stats of the current frame, only measured when there is a callback.
+  std::unique_ptr<jxl::DecoderStageStats> stage_stats;
   size_t next_section;
   std::vector<char> section_processed;
 
@@ -487,6 +568,12 @@ struct JxlDecoderStruct {
   // since non-visible frames (such as frames with patches, ...) are included.
   std::vector<size_t> frame_external_to_internal;
 
+  // Whether the internal and external frame indices of the frames being
+  // decoded match the vectors above. This is false after seeking past the
+  // frames seen so far, since the amount of internal frames before the
+  // seeked to frame is unknown then.
+  bool frame_history_tracked;
+
   // Whether the frame with internal index is required to decode the frame
   // being skipped to or any frames after that. If no skipping is active,
   // this vector is ignored. If the current internal frame index is beyond this
@@ -544,6 +631,34 @@ struct JxlDecoderStruct {
   const uint8_t* next_in;
   size_t avail_in;
   bool input_closed;
+  // Set with JxlDecoderSetInputPersistent: the user always provides all
+  // unprocessed input again together with the next bytes, so the decoder
+  // leaves incomplete codestream parts in the input instead of copying them.
+  bool input_persistent;
+  // Set with JxlDecoderSetReuseBuffers: the buffers of the previous image are
+  // kept in reused_passes_state on reset or rewind, for the next image.
+  bool reuse_buffers;
+  std::unique_ptr<jxl::PassesDecoderState> reused_passes_state;
+
+  // Records the codestream box that starts at file position file_begin, unless
+  // it was already seen before rewinding or seeking.
+  void RecordCodestreamBox(size_t file_begin, bool last) {
+    uint64_t codestream_begin = 0;
+    if (!codestream_boxes.empty()) {
+      const jxl::CodestreamBoxInfo& prev = codestream_boxes.back();
+      if (file_begin <= prev.file_begin || prev.unbounded) return;
+      codestream_begin =
+          prev.codestream_begin + prev.contents_end - prev.file_begin;
+    }
+    jxl::CodestreamBoxInfo info;
+    info.codestream_begin = codestream_begin;
+    info.file_begin = file_begin;
+    info.contents_begin = box_contents_begin;
+    info.contents_end = box_contents_end;
+    info.unbounded = box_contents_unbounded;
+    info.last = last;
+    codestream_boxes.push_back(info);
+  }
 
   void AdvanceInput(size_t size) {
     JXL_DASSERT(avail_in >= size);
@@ -584,8 +699,20 @@ struct JxlDecoderStruct {
     }
   }
 
+  // Whether the available input ends before the codestream bytes of the
+  // current box, so that more input continues the codestream contiguously.
+  bool CodestreamContinuesAfterInput() const {
+    return box_contents_unbounded || box_contents_end - file_pos > avail_in;
+  }
+
   JxlDecoderStatus RequestMoreInput() {
     if (codestream_copy.empty()) {
+      if (input_persistent && CodestreamContinuesAfterInput()) {
+        // Keep the bytes unprocessed, they will be provided again together
+        // with the next ones. The copy is only needed when the codestream
+        // continues in a next jxlp box, after a box header.
+        return JXL_DEC_NEED_MORE_INPUT;
+      }
       size_t avail_codestream = AvailableCodestream();
       codestream_copy.insert(codestream_copy.end(), next_in,
                              next_in + avail_codestream);
@@ -703,6 +830,7 @@ void JxlDecoderRewindDecodingState(JxlDecoder* dec) {
   dec->box_out_buffer_size = 0;
   dec->box_out_buffer_begin = 0;
   dec->box_out_buffer_pos = 0;
+  dec->frame_index_contents.clear();
 
 #if JPEGXL_ENABLE_TRANSCODE_JPEG
   dec->exif_metadata.clear();
@@ -729,13 +857,21 @@ void JxlDecoderRewindDecodingState(JxlDecoder* dec) {
   dec->image_out_size = 0;
   dec->image_out_bit_depth.type = JXL_BIT_DEPTH_FROM_PIXEL_FORMAT;
   dec->extra_channel_output.clear();
+  dec->downsample_full_output = false;
+  std::vector<float>().swap(dec->full_output);
+  dec->full_extra_channel_output.clear();
   dec->dec_pixels = 0;
   dec->next_in = 0;
   dec->avail_in = 0;
   dec->input_closed = false;
 
-  dec->passes_state.reset(nullptr);
   dec->frame_dec.reset(nullptr);
+  dec->stage_stats.reset();
+  if (dec->reuse_buffers && dec->passes_state) {
+    dec->reused_passes_state.reset(new jxl::PassesDecoderState());
+    dec->reused_passes_state->ReuseBuffersFrom(dec->passes_state.get());
+  }
+  dec->passes_state.reset(nullptr);
   dec->next_section = 0;
   dec->section_processed.clear();
 
@@ -757,23 +893,32 @@ void JxlDecoderRewindDecodingState(JxlDecoder* dec) {
   dec->skipping_frame = false;
   dec->internal_frames = 0;
   dec->external_frames = 0;
+  dec->frame_history_tracked = true;
 }
 
 void JxlDecoderReset(JxlDecoder* dec) {
   JxlDecoderRewindDecodingState(dec);
 
   dec->thread_pool.reset();
+  dec->input_persistent = false;
   dec->keep_orientation = false;
   dec->unpremul_alpha = false;
   dec->render_spotcolors = true;
   dec->coalescing = true;
   dec->desired_intensity_target = 0;
+  dec->has_crop = false;
+  dec->output_downsampling = 1;
+  dec->cms_set = false;
   dec->orig_events_wanted = 0;
   dec->frame_references.clear();
   dec->frame_saved_as.clear();
   dec->frame_external_to_internal.clear();
   dec->frame_required.clear();
+  dec->frame_index_box = jxl::JxlDecoderFrameIndexBox();
+  dec->codestream_boxes.clear();
   dec->decompress_boxes = false;
+  dec->stage_stats_callback = nullptr;
+  dec->stage_stats_opaque = nullptr;
 }
 
 JxlDecoder* JxlDecoderCreate(const JxlMemoryManager* memory_manager) {
@@ -787,6 +932,8 @@ JxlDecoder* JxlDecoderCreate(const JxlMemoryManager* memory_manager) {
   // Placement new constructor on allocated memory
   JxlDecoder* dec = new (alloc) JxlDecoder();
   dec->memory_manager = local_memory_manager;
+  // Not reset by JxlDecoderReset, like the memory manager.
+  dec->reuse_buffers = false;
 
 #ifdef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
   if (!memory_manager) {
@@ -828,7 +975,8 @@ void JxlDecoderSkipFrames(JxlDecoder* dec, size_t amount) {
   size_t next_frame = dec->external_frames + dec->skip_frames;
 
   // A frame that has been seen before a rewind
-  if (next_frame < dec->frame_external_to_internal.size()) {
+  if (dec->frame_history_tracked &&
+      next_frame < dec->frame_external_to_internal.size()) {
     size_t internal_index = dec->frame_external_to_internal[next_frame];
     if (internal_index < dec->frame_saved_as.size()) {
       std::vector<size_t> deps = GetFrameDependencies(
@@ -856,6 +1004,102 @@ JxlDecoderStatus JxlDecoderSkipCurrentFrame(JxlDecoder* dec) {
   return JXL_DEC_SUCCESS;
 }
 
+JxlDecoderStatus JxlDecoderSeekToFrame(JxlDecoder* dec, size_t frame_index,
+                                       size_t* input_offset) {
+  if (dec->stage != DecoderStage::kStarted || !dec->got_all_headers) {
+    return JXL_API_ERROR("must decode the image headers before seeking");
+  }
+  if (dec->next_in) {
+    return JXL_API_ERROR("must release the input before seeking");
+  }
+  if (!dec->coalescing) {
+    return JXL_API_ERROR("seeking requires coalescing");
+  }
+  if (dec->frame_index_box.entries.empty()) {
+    return JXL_API_ERROR("no frame index available");
+  }
+
+  // Find the last indexed frame at or before frame_index. The first entry is
+  // always the first frame, and indexed frames don't depend on any frame
+  // before them. Fi counts displayed frames, so several entries can start in
+  // the same displayed frame if they are layers of it; the first of them is
+  // used, since the later ones are blended onto it.
+  uint64_t offset = 0;
+  uint64_t frame = 0;
+  uint64_t key_offset = 0;
+  size_t key_frame = 0;
+  bool first_entry = true;
+  for (const auto& entry : dec->frame_index_box.entries) {
+    if (frame > frame_index) break;
+    if (SumOverflows(offset, entry.OFFi, 0)) {
+      return JXL_API_ERROR("invalid frame index offset");
+    }
+    offset += entry.OFFi;
+    if (first_entry || frame != key_frame) {
+      key_offset = offset;
+      key_frame = frame;
+    }
+    first_entry = false;
+    frame += entry.Fi;
+  }
+
+  const jxl::CodestreamBoxInfo* box = nullptr;
+  for (const auto& info : dec->codestream_boxes) {
+    if (info.Contains(key_offset)) {
+      box = &info;
+      break;
+    }
+  }
+  if (box == nullptr) {
+    return JXL_API_ERROR("codestream box of the frame not yet seen");
+  }
+
+  // Continue decoding at the start of the indexed frame.
+  if (dec->frame_stage != FrameStage::kHeader && dec->is_last_of_still) {
+    dec->image_out_buffer_set = false;
+  }
+  dec->frame_dec.reset(nullptr);
+  dec->frame_stage = FrameStage::kHeader;
+  dec->remaining_frame_size = 0;
+  dec->next_section = 0;
+  dec->section_processed.clear();
+  dec->is_last_of_still = false;
+  dec->is_last_total = false;
+  dec->got_preview_image = true;
+  dec->preview_frame = false;
+
+  dec->codestream_copy.clear();
+  dec->codestream_unconsumed = 0;
+  dec->codestream_pos = 0;
+  dec->codestream_bits_ahead = 0;
+
+  dec->file_pos = box->file_begin + (key_offset - box->codestream_begin);
+  dec->box_contents_begin = box->contents_begin;
+  dec->box_contents_end = box->contents_end;
+  dec->box_contents_size = box->contents_end - box->contents_begin;
+  dec->box_contents_unbounded = box->unbounded;
+  dec->header_size = 0;
+  dec->box_event = false;
+  dec->box_out_buffer_set_current_box = false;
+  dec->last_codestream_seen = box->last;
+  dec->box_stage = BoxStage::kCodestream;
+
+  dec->external_frames = key_frame;
+  if (key_frame < dec->frame_external_to_internal.size()) {
+    dec->internal_frames = dec->frame_external_to_internal[key_frame];
+    dec->frame_history_tracked = true;
+  } else {
+    dec->internal_frames = key_frame;
+    dec->frame_history_tracked = false;
+  }
+  dec->skip_frames = 0;
+  dec->skipping_frame = false;
+  JxlDecoderSkipFrames(dec, frame_index - key_frame);
+
+  *input_offset = dec->file_pos;
+  return JXL_DEC_SUCCESS;
+}
+
 JXL_EXPORT JxlDecoderStatus
 JxlDecoderSetParallelRunner(JxlDecoder* dec, JxlParallelRunner parallel_runner,
                             void* parallel_runner_opaque) {
@@ -929,6 +1173,12 @@ void GetCurrentDimensions(const JxlDecoder* dec, size_t& xsize, size_t& ysize) {
   }
   xsize = dec->metadata.oriented_xsize(dec->keep_orientation);
   ysize = dec->metadata.oriented_ysize(dec->keep_orientation);
+  if (dec->has_crop) {
+    xsize = dec->crop_xsize;
+    ysize = dec->crop_ysize;
+  }
+  xsize = jxl::DivCeil(xsize, dec->output_downsampling);
+  ysize = jxl::DivCeil(ysize, dec->output_downsampling);
   if (!dec->coalescing) {
     const auto frame_dim = dec->frame_header->ToFrameDimensions();
     xsize = frame_dim.xsize_upsampled;
@@ -939,6 +1189,133 @@ void GetCurrentDimensions(const JxlDecoder* dec, size_t& xsize, size_t& ysize) {
     }
   }
 }
+
+// Returns the crop region in image coordinates before applying the
+// orientation, which is what the frame decoder renders.
+jxl::Rect CropRegionBeforeOrientation(const JxlDecoder* dec) {
+  using jxl::Orientation;
+  size_t x0 = dec->crop_x0;
+  size_t y0 = dec->crop_y0;
+  size_t xsize = dec->crop_xsize;
+  size_t ysize = dec->crop_ysize;
+  Orientation orientation = dec->keep_orientation
+                                ? Orientation::kIdentity
+                                : dec->metadata.m.GetOrientation();
+  if (static_cast<uint32_t>(orientation) > 4) {
+    std::swap(x0, y0);
+    std::swap(xsize, ysize);
+  }
+  if (orientation == Orientation::kFlipHorizontal ||
+      orientation == Orientation::kRotate180 ||
+      orientation == Orientation::kRotate270 ||
+      orientation == Orientation::kAntiTranspose) {
+    x0 = dec->metadata.xsize() - x0 - xsize;
+  }
+  if (orientation == Orientation::kFlipVertical ||
+      orientation == Orientation::kRotate180 ||
+      orientation == Orientation::kRotate90 ||
+      orientation == Orientation::kAntiTranspose) {
+    y0 = dec->metadata.ysize() - y0 - ysize;
+  }
+  return jxl::Rect(x0, y0, xsize, ysize);
+}
+
+// Length in bytes of a row of xsize pixels of the given format.
+size_t RowSize(size_t xsize, const JxlPixelFormat& format) {
+  size_t row_size = jxl::DivCeil(
+      xsize * format.num_channels * BitsPerChannel(format.data_type),
+      jxl::kBitsPerByte);
+  if (format.align > 1) {
+    row_size = jxl::DivCeil(row_size, format.align) * format.align;
+  }
+  return row_size;
+}
+
+// Averages each channel of the interleaved pixels over boxes of factor by
+// factor pixels. Boxes that cross the right or bottom edge of the image are
+// averaged over their pixels inside the image.
+std::vector<jxl::ImageF> BoxDownsample(const std::vector<float>& pixels,
+                                       size_t xsize, size_t ysize,
+                                       size_t num_channels, size_t factor) {
+  const size_t out_xsize = jxl::DivCeil(xsize, factor);
+  const size_t out_ysize = jxl::DivCeil(ysize, factor);
+  std::vector<jxl::ImageF> planes;
+  for (size_t c = 0; c < num_channels; ++c) {
+    planes.emplace_back(out_xsize, out_ysize);
+    jxl::ZeroFillImage(&planes.back());
+  }
+  for (size_t y = 0; y < ysize; ++y) {
+    const float* JXL_RESTRICT row = &pixels[y * xsize * num_channels];
+    for (size_t c = 0; c < num_channels; ++c) {
+      float* JXL_RESTRICT out = planes[c].Row(y / factor);
+      for (size_t x = 0; x < xsize; ++x) {
+        out[x / factor] += row[x * num_channels + c];
+      }
+    }
+  }
+  for (size_t oy = 0; oy < out_ysize; ++oy) {
+    const size_t box_ysize = std::min(factor, ysize - oy * factor);
+    for (size_t c = 0; c < num_channels; ++c) {
+      float* JXL_RESTRICT out = planes[c].Row(oy);
+      for (size_t ox = 0; ox < out_xsize; ++ox) {
+        const size_t box_xsize = std::min(factor, xsize - ox * factor);
+        out[ox] /= box_xsize * box_ysize;
+      }
+    }
+  }
+  return planes;
+}
+
+// Box-downsamples the full resolution output of the frame, see
+// downsample_full_output, into the image out buffer or callback and the extra
+// channel buffers, and frees it.
+JxlDecoderStatus WriteDownsampledOutput(JxlDecoder* dec) {
+  const size_t factor = dec->output_downsampling;
+  const size_t xsize = dec->metadata.oriented_xsize(dec->keep_orientation);
+  const size_t ysize = dec->metadata.oriented_ysize(dec->keep_orientation);
+  const size_t out_xsize = jxl::DivCeil(xsize, factor);
+  const auto write = [&](const std::vector<float>& pixels,
+                         const JxlPixelFormat& format, size_t bits_per_sample,
+                         void* buffer, size_t buffer_size,
+                         const jxl::PixelCallback& callback) {
+    const bool float_out = format.data_type == JXL_TYPE_FLOAT ||
+                           format.data_type == JXL_TYPE_FLOAT16;
+    std::vector<jxl::ImageF> planes =
+        BoxDownsample(pixels, xsize, ysize, format.num_channels, factor);
+    const jxl::ImageF* channels[jxl::kConvertMaxChannels];
+    for (size_t c = 0; c < planes.size(); ++c) channels[c] = &planes[c];
+    return jxl::ConvertChannelsToExternal(
+        channels, planes.size(),
+        float_out ? BitsPerChannel(format.data_type) : bits_per_sample,
+        float_out, format.endianness, RowSize(out_xsize, format),
+        dec->thread_pool.get(), buffer, buffer_size, callback,
+        jxl::Orientation::kIdentity);
+  };
+  if (!write(dec->full_output, dec->image_out_format,
+             GetBitDepth(dec->image_out_bit_depth, dec->metadata.m,
+                         dec->image_out_format),
+             dec->image_out_buffer, dec->image_out_size,
+             jxl::PixelCallback{
+                 dec->image_out_init_callback, dec->image_out_run_callback,
+                 dec->image_out_destroy_callback,
+                 dec->image_out_init_opaque})) {
+    return JXL_API_ERROR("failed to write the downsampled image");
+  }
+  for (size_t i = 0; i < dec->extra_channel_output.size(); ++i) {
+    const ExtraChannelOutput& extra = dec->extra_channel_output[i];
+    if (!extra.buffer) continue;
+    if (!write(dec->full_extra_channel_output[i], extra.format,
+               GetBitDepth(dec->image_out_bit_depth,
+                           dec->metadata.m.extra_channel_info[i], extra.format),
+               extra.buffer, extra.buffer_size, jxl::PixelCallback())) {
+      return JXL_API_ERROR("failed to write a downsampled extra channel");
+    }
+  }
+  dec->downsample_full_output = false;
+  std::vector<float>().swap(dec->full_output);
+  dec->full_extra_channel_output.clear();
+  return JXL_DEC_SUCCESS;
+}
 }  // namespace
 
 namespace jxl {
@@ -1085,7 +1462,11 @@ JxlDecoderStatus JxlDecoderReadAllHeaders(JxlDecoder* dec) {
   dec->codestream_bits_ahead = 0;
 
   if (!dec->passes_state) {
-    dec->passes_state.reset(new jxl::PassesDecoderState());
+    if (dec->reused_passes_state) {
+      dec->passes_state = std::move(dec->reused_passes_state);
+    } else {
+      dec->passes_state.reset(new jxl::PassesDecoderState());
+    }
   }
 
   JXL_API_RETURN_IF_ERROR(
@@ -1094,27 +1475,70 @@ JxlDecoderStatus JxlDecoderReadAllHeaders(JxlDecoder* dec) {
     dec->passes_state->output_encoding_info.desired_intensity_target =
         dec->desired_intensity_target;
   }
+  dec->passes_state->output_encoding_info.cms_set = dec->cms_set;
+  dec->passes_state->output_encoding_info.color_management_system = dec->cms;
+  dec->passes_state->output_encoding_info.use_cms = false;
   dec->image_metadata = dec->metadata.m;
 
   return JXL_DEC_SUCCESS;
 }
 
+// Whether the next section of the frame belongs to a group skipped because of
+// the crop region, so that it can be processed without its data.
+bool NextSectionSkipped(const JxlDecoder* dec) {
+  const auto& toc = dec->frame_dec->Toc();
+  return dec->next_section < toc.size() &&
+         !dec->frame_dec->SectionNeeded(toc[dec->next_section].id);
+}
+
+#if JPEGXL_ENABLE_TRANSCODE_JPEG
+// Copies the Exif and XMP boxes needed for JPEG reconstruction into the JPEG
+// data. May only be called once these boxes are decoded, and may be called
+// several times.
+JxlDecoderStatus JxlDecoderSetJPEGReconMetadata(JxlDecoder* dec) {
+  jxl::jpeg::JPEGData* jpeg_data = dec->ib->jpeg_data.get();
+  if (dec->recon_exif_size) {
+    JxlDecoderStatus status = jxl::JxlToJpegDecoder::SetExif(
+        dec->exif_metadata.data(), dec->exif_metadata.size(), jpeg_data);
+    if (status != JXL_DEC_SUCCESS) return status;
+  }
+  if (dec->recon_xmp_size) {
+    JxlDecoderStatus status = jxl::JxlToJpegDecoder::SetXmp(
+        dec->xmp_metadata.data(), dec->xmp_metadata.size(), jpeg_data);
+    if (status != JXL_DEC_SUCCESS) return status;
+  }
+  return JXL_DEC_SUCCESS;
+}
+#endif
+
 JxlDecoderStatus JxlDecoderProcessSections(JxlDecoder* dec) {
   Span<const uint8_t> span;
-  JXL_API_RETURN_IF_ERROR(dec->GetCodestreamInput(&span));
+  JxlDecoderStatus input_status = dec->GetCodestreamInput(&span);
+  if (input_status == JXL_DEC_NEED_MORE_INPUT && NextSectionSkipped(dec)) {
+    span = Span<const uint8_t>();
+  } else if (input_status != JXL_DEC_SUCCESS) {
+    return input_status;
+  }
   const auto& toc = dec->frame_dec->Toc();
   size_t pos = 0;
   std::vector<jxl::FrameDecoder::SectionInfo> section_info;
   std::vector<jxl::FrameDecoder::SectionStatus> section_status;
   for (size_t i = dec->next_section; i < toc.size(); ++i) {
-    if (dec->section_processed[i]) continue;
+    if (dec->section_processed[i]) {
+      pos += toc[i].size;
+      continue;
+    }
     size_t id = toc[i].id;
     size_t size = toc[i].size;
-    if (OutOfBounds(pos, size, span.size())) {
+    jxl::BitReader* br = nullptr;
+    if (!OutOfBounds(pos, size, span.size())) {
+      br = new jxl::BitReader(
+          jxl::Span<const uint8_t>(span.data() + pos, size));
+    } else if (dec->frame_dec->SectionNeeded(id)) {
       break;
     }
-    auto br =
-        new jxl::BitReader(jxl::Span<const uint8_t>(span.data() + pos, size));
+    // Otherwise the section is skipped because of the crop region and its
+    // data does not need to be available.
     section_info.emplace_back(jxl::FrameDecoder::SectionInfo{br, id});
     section_status.emplace_back();
     pos += size;
@@ -1123,6 +1547,7 @@ JxlDecoderStatus JxlDecoderProcessSections(JxlDecoder* dec) {
       section_info.data(), section_info.size(), section_status.data());
   bool out_of_bounds = false;
   for (const auto& info : section_info) {
+    if (!info.br) continue;
     if (!info.br->AllReadsWithinBounds()) {
       // Mark out of bounds section, but keep closing and deleting the next
       // ones as well.
@@ -1314,13 +1739,15 @@ JxlDecoderStatus JxlDecoderProcessCodestream(JxlDecoder* dec) {
         dec->skipping_frame = false;
       }
 
-      if (external_frame_index >= dec->frame_external_to_internal.size()) {
+      if (dec->frame_history_tracked &&
+          external_frame_index >= dec->frame_external_to_internal.size()) {
         dec->frame_external_to_internal.push_back(internal_frame_index);
         JXL_ASSERT(dec->frame_external_to_internal.size() ==
                    external_frame_index + 1);
       }
 
-      if (internal_frame_index >= dec->frame_saved_as.size()) {
+      if (dec->frame_history_tracked &&
+          internal_frame_index >= dec->frame_saved_as.size()) {
         dec->frame_saved_as.push_back(saved_as);
         JXL_ASSERT(dec->frame_saved_as.size() == internal_frame_index + 1);
 
@@ -1365,8 +1792,13 @@ JxlDecoderStatus JxlDecoderProcessCodestream(JxlDecoder* dec) {
     if (dec->frame_stage == FrameStage::kTOC) {
       dec->frame_dec->SetRenderSpotcolors(dec->render_spotcolors);
       dec->frame_dec->SetCoalescing(dec->coalescing);
+      dec->stage_stats.reset();
+      if (dec->stage_stats_callback && !dec->preview_frame) {
+        dec->stage_stats.reset(new jxl::DecoderStageStats());
+      }
+      dec->frame_dec->SetStageStats(dec->stage_stats.get());
 
-      if (!dec->preview_frame &&
+      if (!dec->preview_frame && dec->output_downsampling == 1 &&
           (dec->events_wanted & JXL_DEC_FRAME_PROGRESSION)) {
         dec->frame_prog_detail =
             dec->frame_dec->SetPauseAtProgressive(dec->prog_detail);
@@ -1409,32 +1841,80 @@ JxlDecoderStatus JxlDecoderProcessCodestream(JxlDecoder* dec) {
         }
       }
 
-      if (dec->image_out_buffer_set) {
+      const bool downsampling =
+          dec->output_downsampling != 1 && !dec->preview_frame;
+      // With downsampling, frames that are only used by later frames are
+      // decoded at full resolution, and the output is not large enough for
+      // them.
+      if (dec->image_out_buffer_set &&
+          (!downsampling || dec->is_last_of_still)) {
         size_t xsize, ysize;
         GetCurrentDimensions(dec, xsize, ysize);
+        // Frames that can not be rendered from their DC image are decoded at
+        // full resolution and box-downsampled, see WriteDownsampledOutput.
+        dec->downsample_full_output =
+            downsampling && (dec->output_downsampling != 8 ||
+                             !dec->frame_dec->CanRenderDC());
+        if (downsampling && !dec->downsample_full_output &&
+            !dec->frame_dec->SetRenderDC()) {
+          return JXL_API_ERROR(
+              "frame can not be decoded with output downsampling");
+        }
         size_t bits_per_sample = GetBitDepth(
             dec->image_out_bit_depth, dec->metadata.m, dec->image_out_format);
-        dec->frame_dec->SetImageOutput(
-            PixelCallback{
-                dec->image_out_init_callback, dec->image_out_run_callback,
-                dec->image_out_destroy_callback, dec->image_out_init_opaque},
-            reinterpret_cast<uint8_t*>(dec->image_out_buffer),
-            dec->image_out_size, xsize, ysize, dec->image_out_format,
-            bits_per_sample, dec->unpremul_alpha, !dec->keep_orientation);
-        for (size_t i = 0; i < dec->extra_channel_output.size(); ++i) {
-          const auto& extra = dec->extra_channel_output[i];
-          size_t ec_bits_per_sample =
-              GetBitDepth(dec->image_out_bit_depth,
-                          dec->metadata.m.extra_channel_info[i], extra.format);
-          dec->frame_dec->AddExtraChannelOutput(extra.buffer, extra.buffer_size,
-                                                xsize, extra.format,
-                                                ec_bits_per_sample);
+        if (dec->has_crop && !dec->preview_frame) {
+          dec->frame_dec->SetCropRegion(CropRegionBeforeOrientation(dec));
+        }
+        if (dec->downsample_full_output) {
+          xsize = dec->metadata.oriented_xsize(dec->keep_orientation);
+          ysize = dec->metadata.oriented_ysize(dec->keep_orientation);
+          JxlPixelFormat format = {dec->image_out_format.num_channels,
+                                   JXL_TYPE_FLOAT, JXL_NATIVE_ENDIAN, 0};
+          dec->full_output.resize(xsize * ysize * format.num_channels);
+          dec->frame_dec->SetImageOutput(
+              PixelCallback(), dec->full_output.data(),
+              dec->full_output.size() * sizeof(float), xsize, ysize, format,
+              BitsPerChannel(format.data_type), dec->unpremul_alpha,
+              !dec->keep_orientation);
+          format.num_channels = 1;
+          dec->full_extra_channel_output.resize(
+              dec->extra_channel_output.size());
+          for (size_t i = 0; i < dec->extra_channel_output.size(); ++i) {
+            std::vector<float>& full = dec->full_extra_channel_output[i];
+            full.clear();
+            if (dec->extra_channel_output[i].buffer) full.resize(xsize * ysize);
+            dec->frame_dec->AddExtraChannelOutput(
+                full.empty() ? nullptr : full.data(),
+                full.size() * sizeof(float), xsize, format,
+                BitsPerChannel(format.data_type));
+          }
+        } else {
+          dec->frame_dec->SetImageOutput(
+              PixelCallback{
+                  dec->image_out_init_callback, dec->image_out_run_callback,
+                  dec->image_out_destroy_callback, dec->image_out_init_opaque},
+              reinterpret_cast<uint8_t*>(dec->image_out_buffer),
+              dec->image_out_size, xsize, ysize, dec->image_out_format,
+              bits_per_sample, dec->unpremul_alpha, !dec->keep_orientation);
+          for (size_t i = 0; i < dec->extra_channel_output.size(); ++i) {
+            const auto& extra = dec->extra_channel_output[i];
+            size_t ec_bits_per_sample = GetBitDepth(
+                dec->image_out_bit_depth, dec->metadata.m.extra_channel_info[i],
+                extra.format);
+            dec->frame_dec->AddExtraChannelOutput(
+                extra.buffer, extra.buffer_size, xsize, extra.format,
+                ec_bits_per_sample);
+          }
         }
       }
 
       size_t next_num_passes_to_pause = dec->frame_dec->NextNumPassesToPause();
 
-      JXL_API_RETURN_IF_ERROR(JxlDecoderProcessSections(dec));
+      // Processing sections tells which groups are skipped because of the crop
+      // region, their sections that follow can then be processed without data.
+      do {
+        JXL_API_RETURN_IF_ERROR(JxlDecoderProcessSections(dec));
+      } while (!dec->frame_dec->HasDecodedAll() && NextSectionSkipped(dec));
 
       bool all_sections_done = dec->frame_dec->HasDecodedAll();
       bool got_dc_only = !all_sections_done && dec->frame_dec->HasDecodedDC();
@@ -1458,12 +1938,31 @@ JxlDecoderStatus JxlDecoderProcessCodestream(JxlDecoder* dec) {
         return JXL_DEC_FRAME_PROGRESSION;
       }
 
+#if JPEGXL_ENABLE_TRANSCODE_JPEG
+      // Write the JPEG bytes of the rows that are already decoded, so that
+      // the output starts before the rest of the frame is decoded.
+      if (!all_sections_done && dec->jpeg_decoder.IsOutputSet() &&
+          dec->ib->jpeg_data != nullptr && !dec->JbrdNeedMoreBoxes()) {
+        size_t num_rows = dec->frame_dec->NumCompleteRows();
+        if (num_rows > 0) {
+          JxlDecoderStatus status = JxlDecoderSetJPEGReconMetadata(dec);
+          if (status != JXL_DEC_SUCCESS) return status;
+          status = dec->jpeg_decoder.WriteOutput(
+              *dec->ib->jpeg_data, num_rows, dec->thread_pool.get());
+          if (status == JXL_DEC_JPEG_NEED_MORE_OUTPUT ||
+              status == JXL_DEC_ERROR) {
+            return status;
+          }
+        }
+      }
+#endif
+
       if (!all_sections_done) {
         // Not all sections have been processed yet
         return dec->RequestMoreInput();
       }
 
-      if (!dec->preview_frame) {
+      if (!dec->preview_frame && dec->frame_history_tracked) {
         size_t internal_index = dec->internal_frames - 1;
         JXL_ASSERT(dec->frame_references.size() > internal_index);
         // Always fill this in, even if it was already written, it could be that
@@ -1475,6 +1974,17 @@ JxlDecoderStatus JxlDecoderProcessCodestream(JxlDecoder* dec) {
       if (!dec->frame_dec->FinalizeFrame()) {
         return JXL_API_ERROR("decoding frame failed");
       }
+      if (dec->stage_stats_callback && dec->stage_stats) {
+        for (size_t i = 0; i < jxl::kNumDecoderStages; i++) {
+          const jxl::DecoderStageStats::Stage& stage =
+              dec->stage_stats->stages[i];
+          if (!stage.Entered()) continue;
+          const JxlDecoderStageStats stats = stage.Stats();
+          dec->stage_stats_callback(dec->stage_stats_opaque,
+                                    dec->internal_frames - 1,
+                                    static_cast<JxlDecoderStage>(i), &stats);
+        }
+      }
 #if JPEGXL_ENABLE_TRANSCODE_JPEG
       // If jpeg output was requested, we merely return the JXL_DEC_FULL_IMAGE
       // status without outputting pixels.
@@ -1484,6 +1994,10 @@ JxlDecoderStatus JxlDecoderProcessCodestream(JxlDecoder* dec) {
         return JXL_DEC_FULL_IMAGE;
       }
 #endif
+      if (dec->downsample_full_output) {
+        JxlDecoderStatus status = WriteDownsampledOutput(dec);
+        if (status != JXL_DEC_SUCCESS) return status;
+      }
       if (dec->preview_frame || dec->is_last_of_still) {
         dec->image_out_buffer_set = false;
         dec->extra_channel_output.clear();
@@ -1538,6 +2052,28 @@ size_t JxlDecoderReleaseInput(JxlDecoder* dec) {
 
 void JxlDecoderCloseInput(JxlDecoder* dec) { dec->input_closed = true; }
 
+JxlDecoderStatus JxlDecoderSetInputPersistent(JxlDecoder* dec,
+                                              JXL_BOOL persistent) {
+  if (dec->stage != DecoderStage::kInited) {
+    return JXL_API_ERROR("Must set input persistent before starting");
+  }
+  dec->input_persistent = !!persistent;
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderSetReuseBuffers(JxlDecoder* dec,
+                                           JXL_BOOL reuse_buffers) {
+  dec->reuse_buffers = !!reuse_buffers;
+  if (!dec->reuse_buffers) dec->reused_passes_state.reset();
+  return JXL_DEC_SUCCESS;
+}
+
+namespace jxl {
+size_t DecoderCodestreamCopySizeForTest(const JxlDecoder* dec) {
+  return dec->codestream_copy.size();
+}
+}  // namespace jxl
+
 JxlDecoderStatus JxlDecoderSetJPEGBuffer(JxlDecoder* dec, uint8_t* data,
                                          size_t size) {
 #if JPEGXL_ENABLE_TRANSCODE_JPEG
@@ -1682,24 +2218,16 @@ static JxlDecoderStatus HandleBoxes(JxlDecoder* dec) {
 #if JPEGXL_ENABLE_TRANSCODE_JPEG
     if (dec->recon_output_jpeg == JpegReconStage::kSettingMetadata &&
         !dec->JbrdNeedMoreBoxes()) {
-      jxl::jpeg::JPEGData* jpeg_data = dec->ib->jpeg_data.get();
-      if (dec->recon_exif_size) {
-        JxlDecoderStatus status = jxl::JxlToJpegDecoder::SetExif(
-            dec->exif_metadata.data(), dec->exif_metadata.size(), jpeg_data);
-        if (status != JXL_DEC_SUCCESS) return status;
-      }
-      if (dec->recon_xmp_size) {
-        JxlDecoderStatus status = jxl::JxlToJpegDecoder::SetXmp(
-            dec->xmp_metadata.data(), dec->xmp_metadata.size(), jpeg_data);
-        if (status != JXL_DEC_SUCCESS) return status;
-      }
+      JxlDecoderStatus status = jxl::JxlDecoderSetJPEGReconMetadata(dec);
+      if (status != JXL_DEC_SUCCESS) return status;
       dec->recon_output_jpeg = JpegReconStage::kOutputting;
     }
 
     if (dec->recon_output_jpeg == JpegReconStage::kOutputting &&
         !dec->JbrdNeedMoreBoxes()) {
-      JxlDecoderStatus status =
-          dec->jpeg_decoder.WriteOutput(*dec->ib->jpeg_data);
+      const jxl::jpeg::JPEGData& jpeg_data = *dec->ib->jpeg_data;
+      JxlDecoderStatus status = dec->jpeg_decoder.WriteOutput(
+          jpeg_data, jpeg_data.height, dec->thread_pool.get());
       if (status != JXL_DEC_SUCCESS) return status;
       dec->recon_output_jpeg = JpegReconStage::kFinished;
       dec->ib.reset();
@@ -1718,6 +2246,7 @@ static JxlDecoderStatus HandleBoxes(JxlDecoder* dec) {
           return JXL_DEC_SUCCESS;
         dec->box_stage = BoxStage::kCodestream;
         dec->box_contents_unbounded = true;
+        dec->RecordCodestreamBox(dec->file_pos, /*last=*/true);
         continue;
       }
       if (dec->avail_in == 0) {
@@ -1846,6 +2375,7 @@ static JxlDecoderStatus HandleBoxes(JxlDecoder* dec) {
         }
         dec->last_codestream_seen = true;
         dec->box_stage = BoxStage::kCodestream;
+        dec->RecordCodestreamBox(dec->box_contents_begin, /*last=*/true);
       } else if (memcmp(dec->box_type, "jxlp", 4) == 0) {
         dec->box_stage = BoxStage::kPartialCodestream;
 #if JPEGXL_ENABLE_TRANSCODE_JPEG
@@ -1857,6 +2387,10 @@ static JxlDecoderStatus HandleBoxes(JxlDecoder* dec) {
         }
         dec->box_stage = BoxStage::kJpegRecon;
 #endif
+      } else if (memcmp(dec->box_type, "jxli", 4) == 0 &&
+                 !dec->box_contents_unbounded &&
+                 dec->frame_index_box.entries.empty()) {
+        dec->box_stage = BoxStage::kFrameIndex;
       } else {
         dec->box_stage = BoxStage::kSkip;
       }
@@ -1893,6 +2427,7 @@ static JxlDecoderStatus HandleBoxes(JxlDecoder* dec) {
       }
       dec->AdvanceInput(4);
       dec->box_stage = BoxStage::kCodestream;
+      dec->RecordCodestreamBox(dec->file_pos, dec->last_codestream_seen);
     } else if (dec->box_stage == BoxStage::kCodestream) {
       JxlDecoderStatus status = jxl::JxlDecoderProcessCodestream(dec);
 #if JPEGXL_ENABLE_TRANSCODE_JPEG
@@ -1978,6 +2513,22 @@ static JxlDecoderStatus HandleBoxes(JxlDecoder* dec) {
         return recon_result;
       }
 #endif
+    } else if (dec->box_stage == BoxStage::kFrameIndex) {
+      size_t remaining = dec->box_contents_end - dec->file_pos;
+      size_t amount = std::min(remaining, dec->avail_in);
+      dec->frame_index_contents.insert(dec->frame_index_contents.end(),
+                                       dec->next_in, dec->next_in + amount);
+      dec->AdvanceInput(amount);
+      if (amount < remaining) return JXL_DEC_NEED_MORE_INPUT;
+      if (!jxl::ParseFrameIndexBox(dec->frame_index_contents.data(),
+                                   dec->frame_index_contents.size(),
+                                   &dec->frame_index_box)) {
+        // The index is optional, an invalid one is ignored rather than
+        // failing the decoding of the image.
+        dec->frame_index_box.entries.clear();
+      }
+      dec->frame_index_contents.clear();
+      dec->box_stage = BoxStage::kHeader;
     } else if (dec->box_stage == BoxStage::kSkip) {
       if (dec->box_contents_unbounded) {
         if (dec->input_closed) {
@@ -2207,8 +2758,12 @@ JxlDecoderStatus GetColorEncodingForTarget(
     const jxl::ColorEncoding** encoding) {
   if (!dec->got_all_headers) return JXL_DEC_NEED_MORE_INPUT;
   *encoding = nullptr;
-  if (target == JXL_COLOR_PROFILE_TARGET_DATA && dec->metadata.m.xyb_encoded) {
-    *encoding = &dec->passes_state->output_encoding_info.color_encoding;
+  const auto& output_encoding = dec->passes_state->output_encoding_info;
+  if (target == JXL_COLOR_PROFILE_TARGET_DATA && output_encoding.use_cms) {
+    *encoding = &output_encoding.cms_output_encoding;
+  } else if (target == JXL_COLOR_PROFILE_TARGET_DATA &&
+             dec->metadata.m.xyb_encoded) {
+    *encoding = &output_encoding.color_encoding;
   } else {
     *encoding = &dec->metadata.m.color_encoding;
   }
@@ -2242,7 +2797,11 @@ JxlDecoderStatus JxlDecoderGetICCProfileSize(
       GetColorEncodingForTarget(dec, target, &jxl_color_encoding);
   if (status != JXL_DEC_SUCCESS) return status;
 
-  if (jxl_color_encoding->WantICC()) {
+  // The output profile of the color management system always has an ICC
+  // profile.
+  bool cms_output = target == JXL_COLOR_PROFILE_TARGET_DATA &&
+                    dec->passes_state->output_encoding_info.use_cms;
+  if (jxl_color_encoding->WantICC() && !cms_output) {
     jxl::ColorSpace color_space =
         dec->metadata.m.color_encoding.GetColorSpace();
     if (color_space == jxl::ColorSpace::kUnknown ||
@@ -2412,6 +2971,54 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderSetDCOutBuffer(
   return JXL_DEC_SUCCESS;
 }
 
+JxlDecoderStatus JxlDecoderSetCropRegion(JxlDecoder* dec, size_t x0, size_t y0,
+                                         size_t xsize, size_t ysize) {
+  if (!dec->got_basic_info) {
+    return JXL_API_ERROR("Basic info not yet available");
+  }
+  if (!dec->coalescing) {
+    return JXL_API_ERROR("Crop region requires coalescing");
+  }
+  if (dec->output_downsampling != 1) {
+    return JXL_API_ERROR("Cannot combine cropping with output downsampling");
+  }
+  if (dec->image_out_buffer_set) {
+    return JXL_API_ERROR("Cannot change crop region while image out is set");
+  }
+  size_t image_xsize = dec->metadata.oriented_xsize(dec->keep_orientation);
+  size_t image_ysize = dec->metadata.oriented_ysize(dec->keep_orientation);
+  if (xsize == 0 || ysize == 0 || x0 >= image_xsize || y0 >= image_ysize ||
+      xsize > image_xsize - x0 || ysize > image_ysize - y0) {
+    return JXL_API_ERROR("Crop region must be non-empty and within the image");
+  }
+  dec->has_crop = (xsize != image_xsize || ysize != image_ysize);
+  dec->crop_x0 = x0;
+  dec->crop_y0 = y0;
+  dec->crop_xsize = xsize;
+  dec->crop_ysize = ysize;
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderSetOutputDownsampling(JxlDecoder* dec,
+                                                 uint32_t factor) {
+  if (factor != 1 && factor != 2 && factor != 4 && factor != 8) {
+    return JXL_API_ERROR(
+        "Only the downsampling factors 1, 2, 4 and 8 are supported");
+  }
+  if (!dec->coalescing) {
+    return JXL_API_ERROR("Output downsampling requires coalescing");
+  }
+  if (dec->has_crop) {
+    return JXL_API_ERROR("Cannot combine output downsampling with cropping");
+  }
+  if (dec->image_out_buffer_set) {
+    return JXL_API_ERROR(
+        "Cannot change output downsampling while image out is set");
+  }
+  dec->output_downsampling = factor;
+  return JXL_DEC_SUCCESS;
+}
+
 JXL_EXPORT JxlDecoderStatus JxlDecoderImageOutBufferSize(
     const JxlDecoder* dec, const JxlPixelFormat* format, size_t* size) {
   size_t bits;
@@ -2676,32 +3283,90 @@ JxlDecoderStatus JxlDecoderGetFrameName(const JxlDecoder* dec, char* name,
 
 JxlDecoderStatus JxlDecoderSetPreferredColorProfile(
     JxlDecoder* dec, const JxlColorEncoding* color_encoding) {
+  return JxlDecoderSetOutputColorProfile(dec, color_encoding,
+                                         /*icc_data=*/nullptr, /*icc_size=*/0);
+}
+
+JxlDecoderStatus JxlDecoderSetOutputColorProfile(
+    JxlDecoder* dec, const JxlColorEncoding* color_encoding,
+    const uint8_t* icc_data, size_t icc_size) {
+  if ((color_encoding != nullptr) == (icc_data != nullptr)) {
+    return JXL_API_ERROR(
+        "exactly one of color_encoding and icc_data must be set");
+  }
+  if ((icc_data != nullptr) != (icc_size != 0)) {
+    return JXL_API_ERROR("icc_size must be 0 if and only if icc_data is NULL");
+  }
   if (!dec->got_all_headers) {
     return JXL_API_ERROR("color info not yet available");
   }
   if (dec->post_headers) {
     return JXL_API_ERROR("too late to set the color encoding");
   }
-  if (dec->image_metadata.color_encoding.IsGray() &&
-      color_encoding->color_space != JXL_COLOR_SPACE_GRAY &&
+  jxl::ColorEncoding c_out;
+  if (color_encoding) {
+    if (color_encoding->color_space == JXL_COLOR_SPACE_UNKNOWN) {
+      return JXL_API_ERROR("Unknown output colorspace");
+    }
+    JXL_API_RETURN_IF_ERROR(
+        ConvertExternalToInternalColorEncoding(*color_encoding, &c_out));
+    JXL_API_RETURN_IF_ERROR(!c_out.ICC().empty());
+  } else {
+    if (!dec->cms_set) {
+      return JXL_API_ERROR("a CMS must be set to output to an ICC profile");
+    }
+    // The profile is only parsed by the color management system, but its
+    // color space is needed here to know the number of output channels.
+    if (icc_size < 20) return JXL_API_ERROR("ICC profile too small");
+    if (memcmp(icc_data + 16, "GRAY", 4) == 0) {
+      c_out.SetColorSpace(jxl::ColorSpace::kGray);
+    } else if (memcmp(icc_data + 16, "RGB ", 4) == 0) {
+      c_out.SetColorSpace(jxl::ColorSpace::kRGB);
+    } else {
+      return JXL_API_ERROR("ICC profile is not an RGB or grayscale profile");
+    }
+    jxl::PaddedBytes icc;
+    icc.append(icc_data, icc_data + icc_size);
+    JXL_API_RETURN_IF_ERROR(c_out.SetICCRaw(std::move(icc)));
+  }
+  if (dec->image_metadata.color_encoding.IsGray() && !c_out.IsGray() &&
       dec->image_out_buffer_set && dec->image_out_format.num_channels < 3) {
     return JXL_API_ERROR("Number of channels is too low for color output");
   }
-  if (color_encoding->color_space == JXL_COLOR_SPACE_UNKNOWN) {
-    return JXL_API_ERROR("Unknown output colorspace");
-  }
-  jxl::ColorEncoding c_out;
-  JXL_API_RETURN_IF_ERROR(
-      ConvertExternalToInternalColorEncoding(*color_encoding, &c_out));
-  JXL_API_RETURN_IF_ERROR(!c_out.ICC().empty());
   auto& output_encoding = dec->passes_state->output_encoding_info;
-  if (!c_out.SameColorEncoding(output_encoding.color_encoding)) {
-    JXL_API_RETURN_IF_ERROR(output_encoding.MaybeSetColorEncoding(c_out));
-    dec->image_metadata.color_encoding = output_encoding.color_encoding;
+  output_encoding.use_cms = false;
+  if (c_out.HaveFields()) {
+    if (c_out.SameColorEncoding(output_encoding.color_encoding)) {
+      dec->image_metadata.color_encoding = output_encoding.color_encoding;
+      return JXL_DEC_SUCCESS;
+    }
+    // The XYB to RGB conversion can directly produce some color encodings.
+    if (output_encoding.MaybeSetColorEncoding(c_out)) {
+      dec->image_metadata.color_encoding = output_encoding.color_encoding;
+      return JXL_DEC_SUCCESS;
+    }
   }
+  if (!output_encoding.cms_set) {
+    return JXL_API_ERROR("output color encoding not supported without a CMS");
+  }
+  if (c_out.Channels() != output_encoding.color_encoding.Channels()) {
+    return JXL_API_ERROR("CMS can not change the number of color channels");
+  }
+  output_encoding.use_cms = true;
+  output_encoding.cms_output_encoding = c_out;
+  dec->image_metadata.color_encoding = c_out;
   return JXL_DEC_SUCCESS;
 }
 
+void JxlDecoderSetCms(JxlDecoder* dec, const JxlCmsInterface cms) {
+  dec->cms_set = true;
+  dec->cms = cms;
+  if (dec->passes_state) {
+    dec->passes_state->output_encoding_info.cms_set = true;
+    dec->passes_state->output_encoding_info.color_management_system = cms;
+  }
+}
+
 JxlDecoderStatus JxlDecoderSetDesiredIntensityTarget(
     JxlDecoder* dec, float desired_intensity_target) {
   if (desired_intensity_target < 0) {
@@ -2778,6 +3443,13 @@ JxlDecoderStatus JxlDecoderGetBoxSizeRaw(const JxlDecoder* dec,
   return JXL_DEC_SUCCESS;
 }
 
+JxlDecoderStatus JxlDecoderSetStageStatsCallback(
+    JxlDecoder* dec, JxlDecoderStageStatsCallback callback, void* opaque) {
+  dec->stage_stats_callback = callback;
+  dec->stage_stats_opaque = opaque;
+  return JXL_DEC_SUCCESS;
+}
+
 JxlDecoderStatus JxlDecoderSetProgressiveDetail(JxlDecoder* dec,
                                                 JxlProgressiveDetail detail) {
   if (detail != kDC && detail != kLastPasses && detail != kPasses) {
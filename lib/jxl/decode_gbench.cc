@@ -0,0 +1,131 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "jxl/decode.h"
+#include "jxl/decode_cxx.h"
+#include "jxl/encode.h"
+#include "jxl/encode_cxx.h"
+#include "lib/jxl/base/cache_aligned.h"
+#include "lib/jxl/base/status.h"
+
+namespace jxl {
+namespace {
+
+constexpr size_t kThumbnailSize = 256;
+constexpr size_t kNumThumbnails = 8;
+
+const JxlPixelFormat kFormat = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+
+// Encodes a smooth test pattern that differs for each seed.
+std::vector<uint8_t> EncodeThumbnail(size_t seed) {
+  std::vector<uint8_t> pixels(kThumbnailSize * kThumbnailSize * 3);
+  for (size_t y = 0; y < kThumbnailSize; ++y) {
+    for (size_t x = 0; x < kThumbnailSize; ++x) {
+      uint8_t* pixel = &pixels[(y * kThumbnailSize + x) * 3];
+      pixel[0] = static_cast<uint8_t>(x + seed * 31);
+      pixel[1] = static_cast<uint8_t>(y * 2 + seed * 17);
+      pixel[2] = static_cast<uint8_t>((x ^ y) + seed * 7);
+    }
+  }
+
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  JxlBasicInfo basic_info;
+  JxlEncoderInitBasicInfo(&basic_info);
+  basic_info.xsize = kThumbnailSize;
+  basic_info.ysize = kThumbnailSize;
+  JXL_CHECK(JXL_ENC_SUCCESS == JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/JXL_FALSE);
+  JXL_CHECK(JXL_ENC_SUCCESS ==
+            JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+  JXL_CHECK(JXL_ENC_SUCCESS ==
+            JxlEncoderAddImageFrame(frame_settings, &kFormat, pixels.data(),
+                                    pixels.size()));
+  JxlEncoderCloseInput(enc.get());
+
+  std::vector<uint8_t> compressed(64);
+  uint8_t* next_out = compressed.data();
+  size_t avail_out = compressed.size();
+  JxlEncoderStatus status;
+  while ((status = JxlEncoderProcessOutput(enc.get(), &next_out,
+                                           &avail_out)) ==
+         JXL_ENC_NEED_MORE_OUTPUT) {
+    size_t offset = next_out - compressed.data();
+    compressed.resize(compressed.size() * 2);
+    next_out = compressed.data() + offset;
+    avail_out = compressed.size() - offset;
+  }
+  JXL_CHECK(JXL_ENC_SUCCESS == status);
+  compressed.resize(next_out - compressed.data());
+  return compressed;
+}
+
+void DecodeThumbnail(JxlDecoder* dec, const std::vector<uint8_t>& compressed,
+                     std::vector<uint8_t>* pixels) {
+  JXL_CHECK(JXL_DEC_SUCCESS ==
+            JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+  JXL_CHECK(JXL_DEC_SUCCESS ==
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  JxlDecoderCloseInput(dec);
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec);
+    if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      JXL_CHECK(JXL_DEC_SUCCESS ==
+                JxlDecoderSetImageOutBuffer(dec, &kFormat, pixels->data(),
+                                            pixels->size()));
+    } else if (status == JXL_DEC_SUCCESS) {
+      break;
+    } else {
+      JXL_CHECK(JXL_DEC_FULL_IMAGE == status);
+    }
+  }
+  JxlDecoderReset(dec);
+}
+
+// Decodes a batch of thumbnails of the same size with one decoder, the way a
+// gallery does, and reports the image allocations per decoded thumbnail.
+// Arguments: whether the decoder reuses its buffers across images.
+void BM_DecodeThumbnails(benchmark::State& state) {
+  std::vector<std::vector<uint8_t>> thumbnails;
+  for (size_t i = 0; i < kNumThumbnails; ++i) {
+    thumbnails.push_back(EncodeThumbnail(i));
+  }
+  std::vector<uint8_t> pixels(kThumbnailSize * kThumbnailSize * 3);
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  const JXL_BOOL reuse_buffers = state.range(0) ? JXL_TRUE : JXL_FALSE;
+  JXL_CHECK(JXL_DEC_SUCCESS ==
+            JxlDecoderSetReuseBuffers(dec.get(), reuse_buffers));
+  // Warms up the decoder, so that a reusing decoder starts with buffers.
+  DecodeThumbnail(dec.get(), thumbnails.back(), &pixels);
+
+  const uint64_t allocations_before = CacheAligned::NumAllocations();
+  const uint64_t bytes_before = CacheAligned::TotalBytesAllocated();
+  for (auto _ : state) {
+    for (const std::vector<uint8_t>& compressed : thumbnails) {
+      DecodeThumbnail(dec.get(), compressed, &pixels);
+      benchmark::DoNotOptimize(pixels.data());
+    }
+  }
+  const double decodes =
+      static_cast<double>(state.iterations()) * thumbnails.size();
+  state.counters["allocs/decode"] =
+      (CacheAligned::NumAllocations() - allocations_before) / decodes;
+  state.counters["bytes allocated/decode"] =
+      (CacheAligned::TotalBytesAllocated() - bytes_before) / decodes;
+  state.SetItemsProcessed(decodes);
+}
+
+BENCHMARK(BM_DecodeThumbnails)->ArgName("reuse")->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace jxl
@@ -0,0 +1,23 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef LIB_JXL_DECODE_INTERNAL_H_
+#define LIB_JXL_DECODE_INTERNAL_H_
+
+// Internal functions of the decoder API, for tests.
+
+#include <stddef.h>
+
+#include "jxl/decode.h"
+
+namespace jxl {
+
+// Returns the number of codestream bytes the decoder currently holds in its
+// own copy because they were split across calls to JxlDecoderSetInput.
+size_t DecoderCodestreamCopySizeForTest(const JxlDecoder* dec);
+
+}  // namespace jxl
+
+#endif  // LIB_JXL_DECODE_INTERNAL_H_
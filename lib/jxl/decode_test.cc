@@ -8,6 +8,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -21,12 +24,14 @@
 #include "lib/extras/codec.h"
 #include "lib/extras/dec/color_description.h"
 #include "lib/jxl/base/byte_order.h"
+#include "lib/jxl/base/cache_aligned.h"
 #include "lib/jxl/base/file_io.h"
 #include "lib/jxl/base/padded_bytes.h"
 #include "lib/jxl/base/span.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/common.h"
 #include "lib/jxl/dec_external_image.h"
+#include "lib/jxl/decode_internal.h"
 #include "lib/jxl/enc_butteraugli_comparator.h"
 #include "lib/jxl/enc_color_management.h"
 #include "lib/jxl/enc_external_image.h"
@@ -1896,6 +1901,93 @@ TEST_P(DecodeAllEncodingsTest, SetPreferredColorProfileTest) {
   SetPreferredColorProfileTest(from);
 }
 
+namespace {
+// Decodes to RGB float, converted to the output profile given by either
+// color_encoding or icc with the CMS if use_cms is true.
+JxlDecoderStatus DecodeWithOutputProfile(const jxl::PaddedBytes& data,
+                                         bool use_cms,
+                                         const JxlColorEncoding* color_encoding,
+                                         const jxl::PaddedBytes* icc,
+                                         std::vector<float>* pixels) {
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  auto runner = JxlThreadParallelRunnerMake(nullptr, 4);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetParallelRunner(dec.get(), JxlThreadParallelRunner,
+                                        runner.get()));
+  if (use_cms) JxlDecoderSetCms(dec.get(), jxl::GetJxlCms());
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(
+                dec.get(), JXL_DEC_COLOR_ENCODING | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec.get(), data.data(), data.size()));
+  JxlDecoderCloseInput(dec.get());
+  JxlPixelFormat format = {3, JXL_TYPE_FLOAT, JXL_NATIVE_ENDIAN, 0};
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+    if (status == JXL_DEC_COLOR_ENCODING) {
+      if (color_encoding == nullptr && icc == nullptr) continue;
+      status = JxlDecoderSetOutputColorProfile(
+          dec.get(), color_encoding, icc ? icc->data() : nullptr,
+          icc ? icc->size() : 0);
+      if (status != JXL_DEC_SUCCESS) return status;
+    } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      size_t buffer_size;
+      EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderImageOutBufferSize(
+                                     dec.get(), &format, &buffer_size));
+      pixels->resize(buffer_size / sizeof(float));
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutBuffer(dec.get(), &format, pixels->data(),
+                                            buffer_size));
+    } else {
+      return status;
+    }
+  }
+}
+}  // namespace
+
+TEST(DecodeTest, OutputColorProfileWithCmsTest) {
+  size_t xsize = 300, ysize = 200;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::TestCodestreamParams params;
+  params.cparams.SetLossless();
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      params);
+
+  std::vector<float> srgb;
+  ASSERT_EQ(JXL_DEC_FULL_IMAGE,
+            DecodeWithOutputProfile(data, /*use_cms=*/false, nullptr, nullptr,
+                                    &srgb));
+  ASSERT_EQ(xsize * ysize * 3, srgb.size());
+
+  // Lossless images are not in XYB, so converting them to linear sRGB needs a
+  // CMS, given either the color encoding or the ICC profile.
+  JxlColorEncoding linear;
+  JxlColorEncodingSetToLinearSRGB(&linear, /*is_gray=*/JXL_FALSE);
+  const jxl::PaddedBytes& linear_icc = jxl::ColorEncoding::LinearSRGB().ICC();
+  EXPECT_EQ(JXL_DEC_ERROR, DecodeWithOutputProfile(data, /*use_cms=*/false,
+                                                   &linear, nullptr, &srgb));
+  EXPECT_EQ(JXL_DEC_ERROR, DecodeWithOutputProfile(data, /*use_cms=*/false,
+                                                   nullptr, &linear_icc,
+                                                   &srgb));
+  for (bool from_icc : {false, true}) {
+    std::vector<float> out;
+    ASSERT_EQ(JXL_DEC_FULL_IMAGE,
+              DecodeWithOutputProfile(data, /*use_cms=*/true,
+                                      from_icc ? nullptr : &linear,
+                                      from_icc ? &linear_icc : nullptr, &out));
+    ASSERT_EQ(srgb.size(), out.size());
+    float max_diff = 0;
+    for (size_t i = 0; i < srgb.size(); i++) {
+      float v = srgb[i];
+      float expected = v <= 0.04045f ? v / 12.92f
+                                     : std::pow((v + 0.055f) / 1.055f, 2.4f);
+      max_diff = std::max(max_diff, std::abs(out[i] - expected));
+    }
+    EXPECT_LT(max_diff, 1e-3) << "from_icc " << from_icc;
+  }
+}
+
 // Tests the case of lossy sRGB image without alpha channel, decoded to RGB8
 // and to RGBA8
 TEST(DecodeTest, PixelTestOpaqueSrgbLossy) {
@@ -1947,6 +2039,76 @@ TEST(DecodeTest, PixelTestOpaqueSrgbLossy) {
   }
 }
 
+TEST(DecodeTest, StageStatsTest) {
+  size_t xsize = 300, ysize = 270;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::PaddedBytes compressed = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      jxl::TestCodestreamParams());
+  jxl::Span<const uint8_t> span(compressed.data(), compressed.size());
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
+  std::vector<uint8_t> expected = jxl::DecodeWithAPI(
+      span, format, /*use_callback=*/false, /*set_buffer_early=*/false,
+      /*use_resizable_runner=*/false, /*require_boxes=*/false,
+      /*expect_success=*/true);
+
+  struct Report {
+    uint32_t frame_index;
+    JxlDecoderStage stage;
+    JxlDecoderStageStats stats;
+  };
+  std::vector<Report> reports;
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetStageStatsCallback(
+                dec.get(),
+                [](void* opaque, uint32_t frame_index, JxlDecoderStage stage,
+                   const JxlDecoderStageStats* stats) {
+                  static_cast<std::vector<Report>*>(opaque)->push_back(
+                      {frame_index, stage, *stats});
+                },
+                &reports));
+  const auto start = std::chrono::steady_clock::now();
+  // Measuring the stages does not change the output.
+  EXPECT_EQ(expected,
+            jxl::DecodeWithAPI(dec.get(), span, format, /*use_callback=*/false,
+                               /*set_buffer_early=*/false,
+                               /*use_resizable_runner=*/false,
+                               /*require_boxes=*/false,
+                               /*expect_success=*/true));
+  const double decode_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  std::vector<JxlDecoderStage> stages;
+  double wall_seconds = 0.0;
+  double cpu_seconds = 0.0;
+  for (const Report& report : reports) {
+    EXPECT_EQ(0u, report.frame_index);
+    EXPECT_GE(report.stats.wall_seconds, 0.0);
+    EXPECT_GE(report.stats.cpu_seconds, 0.0);
+    wall_seconds += report.stats.wall_seconds;
+    cpu_seconds += report.stats.cpu_seconds;
+    stages.push_back(report.stage);
+  }
+  EXPECT_EQ((std::vector<JxlDecoderStage>{
+                JXL_DEC_STAGE_DC, JXL_DEC_STAGE_AC, JXL_DEC_STAGE_RENDER}),
+            stages);
+  EXPECT_LE(wall_seconds, decode_seconds);
+  EXPECT_GT(cpu_seconds, 0.0);
+
+  // Resetting the decoder removes the callback.
+  JxlDecoderReset(dec.get());
+  reports.clear();
+  EXPECT_EQ(expected,
+            jxl::DecodeWithAPI(dec.get(), span, format, /*use_callback=*/false,
+                               /*set_buffer_early=*/false,
+                               /*use_resizable_runner=*/false,
+                               /*require_boxes=*/false,
+                               /*expect_success=*/true));
+  EXPECT_TRUE(reports.empty());
+}
+
 // Opaque image with noise enabled, decoded to RGB8 and RGBA8.
 TEST(DecodeTest, PixelTestOpaqueSrgbLossyNoise) {
   for (unsigned channels = 3; channels <= 4; channels++) {
@@ -2162,7 +2324,7 @@ TEST(DecodeTest, ConcatenatedCompressedStreams) {
   }
 }
 
-void TestPartialStream(bool reconstructible_jpeg) {
+void TestPartialStream(bool reconstructible_jpeg, bool persistent_input) {
   size_t xsize = 123, ysize = 77;
   uint32_t channels = 4;
   if (reconstructible_jpeg) {
@@ -2217,16 +2379,27 @@ void TestPartialStream(bool reconstructible_jpeg) {
                 JxlDecoderSubscribeEvents(
                     dec, JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE |
                              JXL_DEC_JPEG_RECONSTRUCTION));
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetInputPersistent(dec, persistent_input));
 
       bool seen_basic_info = false;
       bool seen_full_image = false;
       bool seen_jpeg_recon = false;
 
       size_t total_size = 0;
+      // With persistent input, the decoder only needs its own copy of the
+      // codestream where it continues in a next codestream box.
+      const bool expect_no_copy =
+          persistent_input &&
+          ((CodeStreamBoxFormat)i == CodeStreamBoxFormat::kCSBF_None ||
+           (CodeStreamBoxFormat)i == CodeStreamBoxFormat::kCSBF_Single);
 
       for (;;) {
         EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec, next_in, avail_in));
         JxlDecoderStatus status = JxlDecoderProcessInput(dec);
+        if (expect_no_copy) {
+          EXPECT_EQ(0u, jxl::DecoderCodestreamCopySizeForTest(dec));
+        }
         size_t remaining = JxlDecoderReleaseInput(dec);
         EXPECT_LE(remaining, avail_in);
         next_in += avail_in - remaining;
@@ -2312,12 +2485,75 @@ void TestPartialStream(bool reconstructible_jpeg) {
 
 // Tests the return status when trying to decode pixels on incomplete file: it
 // should return JXL_DEC_NEED_MORE_INPUT, not error.
-TEST(DecodeTest, PixelPartialTest) { TestPartialStream(false); }
+TEST(DecodeTest, PixelPartialTest) { TestPartialStream(false, false); }
+
+// Same as PixelPartialTest, but incomplete parts of the codestream are kept in
+// the input instead of being copied by the decoder.
+TEST(DecodeTest, PixelPartialTestPersistentInput) {
+  TestPartialStream(false, true);
+}
+
+// Decodes several images with one decoder that keeps its buffers across
+// JxlDecoderReset, and checks that the output matches that of a new decoder
+// and that decoding an image of the same or a smaller size allocates fewer
+// images.
+TEST(DecodeTest, ReuseBuffersTest) {
+  const size_t kSizes[][2] = {{200, 150}, {200, 150}, {90, 310},
+                              {200, 150}, {120, 100}};
+  const size_t kNumImages = sizeof(kSizes) / sizeof(*kSizes);
+  std::vector<jxl::PaddedBytes> codestreams;
+  for (size_t i = 0; i < kNumImages; ++i) {
+    std::vector<uint8_t> pixels =
+        jxl::test::GetSomeTestImage(kSizes[i][0], kSizes[i][1], 3, /*seed=*/i);
+    jxl::TestCodestreamParams params;
+    params.cparams.speed_tier = jxl::SpeedTier::kFalcon;
+    codestreams.push_back(jxl::CreateTestJXLCodestream(
+        jxl::Span<const uint8_t>(pixels.data(), pixels.size()), kSizes[i][0],
+        kSizes[i][1], 3, params));
+  }
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+
+  JxlDecoder* reusing_dec = JxlDecoderCreate(nullptr);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetReuseBuffers(reusing_dec, JXL_TRUE));
+  for (size_t i = 0; i < kNumImages; ++i) {
+    jxl::Span<const uint8_t> compressed(codestreams[i].data(),
+                                        codestreams[i].size());
+    JxlDecoder* dec = JxlDecoderCreate(nullptr);
+    uint64_t allocations_before = jxl::CacheAligned::NumAllocations();
+    std::vector<uint8_t> expected = jxl::DecodeWithAPI(
+        dec, compressed, format, /*use_callback=*/false,
+        /*set_buffer_early=*/false, /*use_resizable_runner=*/false,
+        /*require_boxes=*/false, /*expect_success=*/true);
+    uint64_t new_decoder_allocations =
+        jxl::CacheAligned::NumAllocations() - allocations_before;
+    JxlDecoderDestroy(dec);
+
+    allocations_before = jxl::CacheAligned::NumAllocations();
+    std::vector<uint8_t> pixels = jxl::DecodeWithAPI(
+        reusing_dec, compressed, format, /*use_callback=*/false,
+        /*set_buffer_early=*/false, /*use_resizable_runner=*/false,
+        /*require_boxes=*/false, /*expect_success=*/true);
+    uint64_t reusing_allocations =
+        jxl::CacheAligned::NumAllocations() - allocations_before;
+    JxlDecoderReset(reusing_dec);
+
+    EXPECT_EQ(expected, pixels);
+    if (i > 0 && kSizes[i][0] <= kSizes[i - 1][0] &&
+        kSizes[i][1] <= kSizes[i - 1][1]) {
+      EXPECT_LT(reusing_allocations, new_decoder_allocations);
+    }
+  }
+
+  // Disabling the reuse frees the buffers kept from the last image.
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetReuseBuffers(reusing_dec, JXL_FALSE));
+  JxlDecoderDestroy(reusing_dec);
+}
 
 #if JPEGXL_ENABLE_JPEG
 // Tests the return status when trying to decode JPEG bytes on incomplete file.
 TEST(DecodeTest, JXL_TRANSCODE_JPEG_TEST(JPEGPartialTest)) {
-  TestPartialStream(true);
+  TestPartialStream(true, false);
 }
 #endif  // JPEGXL_ENABLE_JPEG
 
@@ -3938,6 +4174,370 @@ TEST(DecodeTest, ProgressionTestLosslessAlpha) {
   VerifyProgression(xsize, ysize, num_channels, pixels, data, breakpoints);
 }
 
+// Decodes the image to 16-bit RGB, restricted to the given region if xsize and
+// ysize are not zero. Returns the number of pixels in *out_xsize and
+// *out_ysize.
+bool DecodeCropRegion(const uint8_t* data, size_t size, size_t x0, size_t y0,
+                      size_t xsize, size_t ysize, size_t* out_xsize,
+                      size_t* out_ysize, std::vector<uint8_t>* pixels) {
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  auto runner = JxlThreadParallelRunnerMake(nullptr, 4);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetParallelRunner(dec.get(), JxlThreadParallelRunner,
+                                        runner.get()));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(
+                dec.get(), JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), data, size));
+  JxlDecoderCloseInput(dec.get());
+  JxlPixelFormat format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+    if (status == JXL_DEC_BASIC_INFO) {
+      JxlBasicInfo info;
+      EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetBasicInfo(dec.get(), &info));
+      *out_xsize = info.xsize;
+      *out_ysize = info.ysize;
+      if (xsize != 0 && ysize != 0) {
+        EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetCropRegion(dec.get(), x0, y0,
+                                                           xsize, ysize));
+        *out_xsize = xsize;
+        *out_ysize = ysize;
+      }
+    } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      size_t buffer_size;
+      EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderImageOutBufferSize(
+                                     dec.get(), &format, &buffer_size));
+      EXPECT_EQ(*out_xsize * *out_ysize * 6, buffer_size);
+      pixels->resize(buffer_size);
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutBuffer(dec.get(), &format, pixels->data(),
+                                            pixels->size()));
+    } else if (status == JXL_DEC_FULL_IMAGE) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+}
+
+TEST(DecodeTest, CropRegionTest) {
+  size_t xsize = 508, ysize = 470;
+  uint32_t num_channels = 3;
+  std::vector<uint8_t> pixels =
+      jxl::test::GetSomeTestImage(xsize, ysize, num_channels, 0);
+  for (bool lossless : {false, true}) {
+    for (JxlOrientation orientation :
+         {JXL_ORIENT_IDENTITY, JXL_ORIENT_ROTATE_90_CW,
+          JXL_ORIENT_ANTI_TRANSPOSE}) {
+      jxl::TestCodestreamParams params;
+      if (lossless) params.cparams.SetLossless();
+      params.cparams.speed_tier = jxl::SpeedTier::kThunder;
+      params.orientation = orientation;
+      jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+          jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize,
+          num_channels, params);
+      size_t oxsize, oysize;
+      std::vector<uint8_t> full;
+      ASSERT_TRUE(DecodeCropRegion(data.data(), data.size(), 0, 0, 0, 0,
+                                   &oxsize, &oysize, &full));
+      ASSERT_EQ(orientation > 4 ? ysize : xsize, oxsize);
+
+      struct Region {
+        size_t x0, y0, xsize, ysize;
+      };
+      for (Region r : {Region{0, 0, 64, 64}, Region{200, 250, 100, 90},
+                       Region{oxsize - 30, oysize - 20, 30, 20},
+                       Region{0, 0, oxsize, oysize}}) {
+        size_t cxsize, cysize;
+        std::vector<uint8_t> crop;
+        ASSERT_TRUE(DecodeCropRegion(data.data(), data.size(), r.x0, r.y0,
+                                     r.xsize, r.ysize, &cxsize, &cysize,
+                                     &crop));
+        ASSERT_EQ(r.xsize, cxsize);
+        ASSERT_EQ(r.ysize, cysize);
+        for (size_t y = 0; y < r.ysize; y++) {
+          size_t row_size = r.xsize * 6;
+          ASSERT_EQ(0, memcmp(&crop[y * row_size],
+                              &full[((r.y0 + y) * oxsize + r.x0) * 6],
+                              row_size))
+              << "lossless " << lossless << " orientation " << orientation
+              << " region " << r.x0 << "," << r.y0 << " row " << y;
+        }
+      }
+
+      // Lossless images use modular transforms over the whole image, so their
+      // groups can not be skipped.
+      if (lossless || orientation != JXL_ORIENT_IDENTITY) continue;
+      // The groups outside of the region are not needed, so the decoding
+      // succeeds without the sections that follow the first AC group.
+      StreamPositions streampos;
+      AnalyzeCodestream(data, &streampos);
+      const std::vector<FramePositions>& fp = streampos.frames;
+      ASSERT_EQ(1, fp.size());
+      ASSERT_EQ(7, fp[0].section_end.size());
+      size_t cxsize, cysize;
+      std::vector<uint8_t> crop;
+      ASSERT_TRUE(DecodeCropRegion(data.data(), fp[0].section_end[3], 0, 0, 64,
+                                   64, &cxsize, &cysize, &crop));
+      for (size_t y = 0; y < 64; y++) {
+        ASSERT_EQ(0, memcmp(&crop[y * 64 * 6], &full[y * oxsize * 6], 64 * 6));
+      }
+    }
+  }
+}
+
+TEST(DecodeTest, CropRegionErrorTest) {
+  size_t xsize = 123, ysize = 77;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::TestCodestreamParams params;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      params);
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  // Basic info is not yet known.
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetCropRegion(dec.get(), 0, 0, 10, 10));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_BASIC_INFO));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec.get(), data.data(), data.size()));
+  EXPECT_EQ(JXL_DEC_BASIC_INFO, JxlDecoderProcessInput(dec.get()));
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetCropRegion(dec.get(), 0, 0, 0, 10));
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetCropRegion(dec.get(), 100, 0, 24, 10));
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetCropRegion(dec.get(), 0, 70, 10, 8));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetCropRegion(dec.get(), 100, 70, 23, 7));
+}
+
+// Decodes the image to float RGB, or RGBA with `num_channels` 4, with the
+// given output downsampling factor.
+bool DecodeDownsampled(const uint8_t* data, size_t size, uint32_t factor,
+                       size_t* xsize, size_t* ysize, std::vector<float>* pixels,
+                       uint32_t num_channels = 3) {
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  auto runner = JxlThreadParallelRunnerMake(nullptr, 4);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetParallelRunner(dec.get(), JxlThreadParallelRunner,
+                                        runner.get()));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(
+                dec.get(), JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetOutputDownsampling(dec.get(), factor));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), data, size));
+  JxlDecoderCloseInput(dec.get());
+  JxlPixelFormat format = {num_channels, JXL_TYPE_FLOAT, JXL_NATIVE_ENDIAN, 0};
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+    if (status == JXL_DEC_BASIC_INFO) {
+      JxlBasicInfo info;
+      EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetBasicInfo(dec.get(), &info));
+      *xsize = jxl::DivCeil(info.xsize, factor);
+      *ysize = jxl::DivCeil(info.ysize, factor);
+    } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      size_t buffer_size;
+      EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderImageOutBufferSize(
+                                     dec.get(), &format, &buffer_size));
+      EXPECT_EQ(*xsize * *ysize * num_channels * sizeof(float), buffer_size);
+      pixels->resize(*xsize * *ysize * num_channels);
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutBuffer(dec.get(), &format, pixels->data(),
+                                            buffer_size));
+    } else if (status == JXL_DEC_FULL_IMAGE) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+}
+
+TEST(DecodeTest, DownsampledOutputTest) {
+  size_t xsize = 508, ysize = 470;
+  // A smooth image, so that the DC is close to the average of the pixels.
+  std::vector<uint8_t> pixels(xsize * ysize * 3 * 2);
+  for (size_t y = 0; y < ysize; y++) {
+    for (size_t x = 0; x < xsize; x++) {
+      for (size_t c = 0; c < 3; c++) {
+        uint32_t v = 10000 + 50 * x + 30 * y + 5000 * c;
+        uint8_t* p = &pixels[((y * xsize + x) * 3 + c) * 2];
+        StoreBE16(v, p);
+      }
+    }
+  }
+  jxl::TestCodestreamParams params;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      params);
+
+  size_t full_xsize, full_ysize;
+  std::vector<float> full;
+  ASSERT_TRUE(DecodeDownsampled(data.data(), data.size(), 1, &full_xsize,
+                                &full_ysize, &full));
+  size_t dc_xsize, dc_ysize;
+  std::vector<float> dc;
+  ASSERT_TRUE(DecodeDownsampled(data.data(), data.size(), 8, &dc_xsize,
+                                &dc_ysize, &dc));
+  EXPECT_EQ(64, dc_xsize);
+  EXPECT_EQ(59, dc_ysize);
+  // Compare with the average of the 8x8 blocks that are inside the image.
+  double max_diff = 0;
+  for (size_t by = 0; by < ysize / 8; by++) {
+    for (size_t bx = 0; bx < xsize / 8; bx++) {
+      for (size_t c = 0; c < 3; c++) {
+        double sum = 0;
+        for (size_t iy = 0; iy < 8; iy++) {
+          for (size_t ix = 0; ix < 8; ix++) {
+            sum += full[((by * 8 + iy) * xsize + bx * 8 + ix) * 3 + c];
+          }
+        }
+        double diff = std::abs(sum / 64 - dc[(by * dc_xsize + bx) * 3 + c]);
+        max_diff = std::max(max_diff, diff);
+      }
+    }
+  }
+  EXPECT_LT(max_diff, 0.02);
+
+  // Only the DC sections are read.
+  StreamPositions streampos;
+  AnalyzeCodestream(data, &streampos);
+  const std::vector<FramePositions>& fp = streampos.frames;
+  ASSERT_EQ(1, fp.size());
+  ASSERT_EQ(7, fp[0].section_end.size());
+  std::vector<float> truncated;
+  ASSERT_TRUE(DecodeDownsampled(data.data(), fp[0].section_end[1], 8,
+                                &dc_xsize, &dc_ysize, &truncated));
+  EXPECT_EQ(dc, truncated);
+}
+
+TEST(DecodeTest, DownsampledOutputAlphaTest) {
+  // The alpha channel, which has no DC image, is decoded from the AC sections
+  // and box-downsampled, while the color is rendered from the DC image.
+  size_t xsize = 300, ysize = 200;
+  std::vector<uint8_t> pixels(xsize * ysize * 4 * 2);
+  for (size_t y = 0; y < ysize; y++) {
+    for (size_t x = 0; x < xsize; x++) {
+      for (size_t c = 0; c < 4; c++) {
+        uint32_t v = c == 3 ? ((x * 7 + y * 13) % 256) * 257
+                            : 10000 + 50 * x + 30 * y + 5000 * c;
+        uint8_t* p = &pixels[((y * xsize + x) * 4 + c) * 2];
+        StoreBE16(v, p);
+      }
+    }
+  }
+  jxl::TestCodestreamParams params;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 4,
+      params);
+
+  size_t full_xsize, full_ysize;
+  std::vector<float> full;
+  ASSERT_TRUE(DecodeDownsampled(data.data(), data.size(), 1, &full_xsize,
+                                &full_ysize, &full, 4));
+  size_t dc_xsize, dc_ysize;
+  std::vector<float> dc;
+  ASSERT_TRUE(DecodeDownsampled(data.data(), data.size(), 8, &dc_xsize,
+                                &dc_ysize, &dc, 4));
+  EXPECT_EQ(38, dc_xsize);
+  EXPECT_EQ(25, dc_ysize);
+  double max_color_diff = 0;
+  double max_alpha_diff = 0;
+  for (size_t by = 0; by < dc_ysize; by++) {
+    for (size_t bx = 0; bx < dc_xsize; bx++) {
+      for (size_t c = 0; c < 4; c++) {
+        double sum = 0;
+        size_t num = 0;
+        for (size_t y = by * 8; y < std::min(ysize, by * 8 + 8); y++) {
+          for (size_t x = bx * 8; x < std::min(xsize, bx * 8 + 8); x++) {
+            sum += full[(y * xsize + x) * 4 + c];
+            num++;
+          }
+        }
+        double diff = std::abs(sum / num - dc[(by * dc_xsize + bx) * 4 + c]);
+        if (c == 3) {
+          max_alpha_diff = std::max(max_alpha_diff, diff);
+        } else if (num == 64) {
+          max_color_diff = std::max(max_color_diff, diff);
+        }
+      }
+    }
+  }
+  EXPECT_LT(max_color_diff, 0.02);
+  // The alpha channel is lossless, its downsampling is exact.
+  EXPECT_LT(max_alpha_diff, 1e-5);
+}
+
+// Averages the float RGB pixels over boxes of factor by factor pixels, the
+// boxes on the right and bottom edges over their pixels inside the image.
+std::vector<float> BoxDownsampleRGB(const std::vector<float>& pixels,
+                                    size_t xsize, size_t ysize,
+                                    size_t factor) {
+  const size_t out_xsize = jxl::DivCeil(xsize, factor);
+  const size_t out_ysize = jxl::DivCeil(ysize, factor);
+  std::vector<float> out(out_xsize * out_ysize * 3);
+  for (size_t by = 0; by < out_ysize; by++) {
+    for (size_t bx = 0; bx < out_xsize; bx++) {
+      for (size_t c = 0; c < 3; c++) {
+        double sum = 0;
+        size_t num = 0;
+        for (size_t y = by * factor; y < std::min(ysize, (by + 1) * factor);
+             y++) {
+          for (size_t x = bx * factor; x < std::min(xsize, (bx + 1) * factor);
+               x++) {
+            sum += pixels[(y * xsize + x) * 3 + c];
+            num++;
+          }
+        }
+        out[(by * out_xsize + bx) * 3 + c] = sum / num;
+      }
+    }
+  }
+  return out;
+}
+
+TEST(DecodeTest, DownsampledOutputFallbackTest) {
+  // Lossless frames have no DC image, and the VarDCT frame is not rendered
+  // from its DC image with factors other than 8: both are decoded at full
+  // resolution and box-downsampled.
+  size_t xsize = 123, ysize = 77;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  for (bool lossless : {true, false}) {
+    jxl::TestCodestreamParams params;
+    if (lossless) params.cparams.SetLossless();
+    jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+        jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize,
+        3, params);
+    size_t full_xsize, full_ysize;
+    std::vector<float> full;
+    ASSERT_TRUE(DecodeDownsampled(data.data(), data.size(), 1, &full_xsize,
+                                  &full_ysize, &full));
+    for (uint32_t factor : {2, 4, 8}) {
+      if (!lossless && factor == 8) continue;
+      size_t ds_xsize, ds_ysize;
+      std::vector<float> downsampled;
+      ASSERT_TRUE(DecodeDownsampled(data.data(), data.size(), factor,
+                                    &ds_xsize, &ds_ysize, &downsampled));
+      EXPECT_EQ(jxl::DivCeil(xsize, factor), ds_xsize);
+      EXPECT_EQ(jxl::DivCeil(ysize, factor), ds_ysize);
+      std::vector<float> expected =
+          BoxDownsampleRGB(full, xsize, ysize, factor);
+      ASSERT_EQ(expected.size(), downsampled.size());
+      for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_NEAR(expected[i], downsampled[i], 1e-5)
+            << "factor " << factor << " lossless " << lossless << " at " << i;
+      }
+    }
+  }
+}
+
+TEST(DecodeTest, DownsampledOutputErrorTest) {
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetOutputDownsampling(dec.get(), 3));
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetOutputDownsampling(dec.get(), 0));
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetOutputDownsampling(dec.get(), 16));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetCoalescing(dec.get(), JXL_FALSE));
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetOutputDownsampling(dec.get(), 2));
+}
+
 void VerifyFilePosition(size_t expected_pos, const jxl::PaddedBytes& data,
                         JxlDecoder* dec) {
   size_t remaining = JxlDecoderReleaseInput(dec);
@@ -4832,9 +5432,9 @@ TEST(DecodeTest, JXL_TRANSCODE_JPEG_TEST(JPEGReconstructTestCodestream)) {
 }
 #endif  // JPEGXL_ENABLE_JPEG
 
-TEST(DecodeTest, JXL_TRANSCODE_JPEG_TEST(JPEGReconstructionTest)) {
-  const std::string jpeg_path = "jxl/flower/flower.png.im_q85_420.jpg";
-  const jxl::PaddedBytes orig = jxl::ReadTestData(jpeg_path);
+// Creates a container with the JPEG reconstruction box and the codestream of
+// the recompressed JPEG.
+void RecompressJPEG(const jxl::PaddedBytes& orig, jxl::PaddedBytes* result) {
   jxl::CodecInOut orig_io;
   ASSERT_TRUE(
       jxl::jpeg::DecodeImageJPG(jxl::Span<const uint8_t>(orig), &orig_io));
@@ -4862,9 +5462,71 @@ TEST(DecodeTest, JXL_TRANSCODE_JPEG_TEST(JPEGReconstructionTest)) {
   jxl::AppendBoxHeader(jxl::MakeBoxType("jxlc"), 0, true, &container);
   jxl::PaddedBytes codestream = std::move(writer).TakeBytes();
   container.append(codestream.data(), codestream.data() + codestream.size());
+  *result = std::move(container);
+}
+
+TEST(DecodeTest, JXL_TRANSCODE_JPEG_TEST(JPEGReconstructionTest)) {
+  const std::string jpeg_path = "jxl/flower/flower.png.im_q85_420.jpg";
+  const jxl::PaddedBytes orig = jxl::ReadTestData(jpeg_path);
+  jxl::PaddedBytes container;
+  RecompressJPEG(orig, &container);
   VerifyJPEGReconstruction(container, orig);
 }
 
+TEST(DecodeTest, JXL_TRANSCODE_JPEG_TEST(JPEGReconstructionStreamingTest)) {
+  const std::string jpeg_path = "jxl/flower/flower.png.im_q85_420.jpg";
+  const jxl::PaddedBytes orig = jxl::ReadTestData(jpeg_path);
+  jxl::PaddedBytes container;
+  RecompressJPEG(orig, &container);
+
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(
+                dec.get(), JXL_DEC_JPEG_RECONSTRUCTION | JXL_DEC_FULL_IMAGE));
+  // Give the input in a few steps, and check that the JPEG bytes of the first
+  // rows are output before the last step.
+  const size_t kNumSteps = 16;
+  const size_t step = jxl::DivCeil(container.size(), kNumSteps);
+  size_t input_end = step;
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec.get(), container.data(), input_end));
+  std::vector<uint8_t> reconstructed(orig.size());
+  size_t used = 0;
+  size_t used_before_last_step = 0;
+  bool jpeg_buffer_set = false;
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+    if (status == JXL_DEC_JPEG_RECONSTRUCTION) {
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetJPEGBuffer(dec.get(), reconstructed.data(),
+                                        reconstructed.size()));
+      jpeg_buffer_set = true;
+    } else if (status == JXL_DEC_NEED_MORE_INPUT) {
+      ASSERT_LT(input_end, container.size());
+      size_t remaining = JxlDecoderReleaseInput(dec.get());
+      size_t input_begin = input_end - remaining;
+      input_end = std::min(container.size(), input_end + step);
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetInput(dec.get(), container.data() + input_begin,
+                                   input_end - input_begin));
+      if (jpeg_buffer_set) {
+        used = reconstructed.size() - JxlDecoderReleaseJPEGBuffer(dec.get());
+        EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetJPEGBuffer(
+                                       dec.get(), reconstructed.data() + used,
+                                       reconstructed.size() - used));
+        if (input_end == container.size()) used_before_last_step = used;
+      }
+    } else {
+      ASSERT_EQ(JXL_DEC_FULL_IMAGE, status);
+      break;
+    }
+  }
+  used = reconstructed.size() - JxlDecoderReleaseJPEGBuffer(dec.get());
+  ASSERT_EQ(orig.size(), used);
+  EXPECT_EQ(0, memcmp(reconstructed.data(), orig.data(), used));
+  EXPECT_GT(used_before_last_step, orig.size() / 4);
+}
+
 TEST(DecodeTest, JXL_TRANSCODE_JPEG_TEST(JPEGReconstructionMetadataTest)) {
   const std::string jpeg_path = "jxl/jpeg_reconstruction/1x1_exif_xmp.jpg";
   const std::string jxl_path = "jxl/jpeg_reconstruction/1x1_exif_xmp.jxl";
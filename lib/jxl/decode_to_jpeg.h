@@ -17,6 +17,7 @@
 #include <vector>
 
 #include "jxl/decode.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/common.h"  // JPEGXL_ENABLE_TRANSCODE_JPEG
 #include "lib/jxl/image_bundle.h"
@@ -56,6 +57,7 @@ class JxlToJpegDecoder {
   void StartBox(bool box_until_eof, size_t contents_size) {
     // A new box implies that we clear the buffer.
     buffer_.clear();
+    write_state_.reset();
     inside_box_ = true;
     if (box_until_eof) {
       box_until_eof_ = true;
@@ -110,31 +112,37 @@ class JxlToJpegDecoder {
         return false;
       }
       ib->jpeg_data.reset(jpeg_data_.release());
+      write_state_.reset();
     }
     return true;
   }
 
-  JxlDecoderStatus WriteOutput(const jpeg::JPEGData& jpeg_data) {
-    // Copy JPEG bytestream if desired.
-    uint8_t* tmp_next_out = next_out_;
-    size_t tmp_avail_size = avail_size_;
-    auto write = [&tmp_next_out, &tmp_avail_size](const uint8_t* buf,
-                                                  size_t len) {
-      size_t to_write = std::min<size_t>(tmp_avail_size, len);
-      if (to_write != 0) memcpy(tmp_next_out, buf, to_write);
-      tmp_next_out += to_write;
-      tmp_avail_size -= to_write;
+  // Writes the JPEG bytestream of the first num_ready_rows rows of the image
+  // to the output buffer, continuing where the previous call stopped. Returns
+  // JXL_DEC_SUCCESS once the whole JPEG is written, JXL_DEC_NEED_MORE_INPUT if
+  // the remaining bytes need more rows, and JXL_DEC_JPEG_NEED_MORE_OUTPUT if
+  // the output buffer is full.
+  JxlDecoderStatus WriteOutput(const jpeg::JPEGData& jpeg_data,
+                               size_t num_ready_rows, ThreadPool* pool) {
+    if (!write_state_) write_state_.reset(new jpeg::SerializationState());
+    auto write = [this](const uint8_t* buf, size_t len) {
+      size_t to_write = std::min<size_t>(avail_size_, len);
+      if (to_write != 0) memcpy(next_out_, buf, to_write);
+      next_out_ += to_write;
+      avail_size_ -= to_write;
       return to_write;
     };
-    Status write_result = jpeg::WriteJpeg(jpeg_data, write);
+    Status write_result = jpeg::WriteJpeg(jpeg_data, num_ready_rows, pool,
+                                          write, write_state_.get());
     if (!write_result) {
-      if (tmp_avail_size == 0) {
+      if (write_result.code() == StatusCode::kNotEnoughBytes) {
         return JXL_DEC_JPEG_NEED_MORE_OUTPUT;
       }
       return JXL_DEC_ERROR;
     }
-    next_out_ = tmp_next_out;
-    avail_size_ = tmp_avail_size;
+    if (write_state_->stage != jpeg::SerializationState::DONE) {
+      return JXL_DEC_NEED_MORE_INPUT;
+    }
     return JXL_DEC_SUCCESS;
   }
 
@@ -146,6 +154,10 @@ class JxlToJpegDecoder {
   // stored here.
   std::unique_ptr<jpeg::JPEGData> jpeg_data_;
 
+  // Progress of writing the JPEG bytestream, which may be written over several
+  // calls to WriteOutput.
+  std::unique_ptr<jpeg::SerializationState> write_state_;
+
   // True if the decoder is currently reading bytes inside a JPEG reconstruction
   // box.
   bool inside_box_ = false;
@@ -205,7 +217,9 @@ class JxlToJpegDecoder {
     return JXL_DEC_ERROR;
   }
 
-  JxlDecoderStatus WriteOutput(const jpeg::JPEGData& /* jpeg_data */) {
+  JxlDecoderStatus WriteOutput(const jpeg::JPEGData& /* jpeg_data */,
+                               size_t /* num_ready_rows */,
+                               ThreadPool* /* pool */) {
     return JXL_DEC_SUCCESS;
   }
 };
@@ -9,6 +9,7 @@
 #include <string.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 
@@ -548,16 +549,70 @@ uint8_t FindBest8x8Transform(size_t x, size_t y, int encoding_speed_tier,
   return best_tx;
 }
 
+// Entropy estimates of the transforms tried by the merge phases of one
+// 64x64 rect, by transform type and top-left 8x8 block. The estimate only
+// depends on the pixels under the candidate, and the same candidate is often
+// tried more than once: the unaligned 16x16 search retries most of the
+// DCT16X8 and DCT8X16 of the aligned search and of its own earlier passes.
+class EntropyCache {
+ public:
+  // bx, by addresses the 64x64 block at 8x8 subresolution.
+  EntropyCache(size_t bx, size_t by, const ACSConfig& config,
+               const float* JXL_RESTRICT cmap_factors, float* block,
+               float* scratch_space, uint32_t* quantized)
+      : bx_(bx),
+        by_(by),
+        config_(config),
+        cmap_factors_(cmap_factors),
+        block_(block),
+        scratch_space_(scratch_space),
+        quantized_(quantized) {}
+
+  // Returns EstimateEntropy of the transform whose left, upper 8x8 block is
+  // at cx, cy in the rect, computing it only the first time.
+  float Get(AcStrategy::Type acs_raw, size_t cx, size_t cy) {
+    JXL_DASSERT(cx < 8 && cy < 8);
+    num_lookups_++;
+    const uint64_t bit = uint64_t{1} << (cy * 8 + cx);
+    float& entropy = entropy_[acs_raw][cy * 8 + cx];
+    if (computed_[acs_raw] & bit) {
+      num_hits_++;
+      return entropy;
+    }
+    entropy = EstimateEntropy(AcStrategy::FromRawStrategy(acs_raw),
+                              (bx_ + cx) * 8, (by_ + cy) * 8, config_,
+                              cmap_factors_, block_, scratch_space_,
+                              quantized_);
+    computed_[acs_raw] |= bit;
+    return entropy;
+  }
+
+  size_t num_lookups() const { return num_lookups_; }
+  size_t num_hits() const { return num_hits_; }
+
+ private:
+  const size_t bx_;
+  const size_t by_;
+  const ACSConfig& config_;
+  const float* JXL_RESTRICT cmap_factors_;
+  float* block_;
+  float* scratch_space_;
+  uint32_t* quantized_;
+  // One bit per 8x8 block of the rect.
+  uint64_t computed_[AcStrategy::kNumValidStrategies] = {};
+  float entropy_[AcStrategy::kNumValidStrategies][64];
+  size_t num_lookups_ = 0;
+  size_t num_hits_ = 0;
+};
+
 // bx, by addresses the 64x64 block at 8x8 subresolution
 // cx, cy addresses the left, upper 8x8 block position of the candidate
 // transform.
 void TryMergeAcs(AcStrategy::Type acs_raw, size_t bx, size_t by, size_t cx,
-                 size_t cy, const ACSConfig& config,
-                 const float* JXL_RESTRICT cmap_factors,
-                 AcStrategyImage* JXL_RESTRICT ac_strategy,
+                 size_t cy, AcStrategyImage* JXL_RESTRICT ac_strategy,
                  const float entropy_mul, const uint8_t candidate_priority,
                  uint8_t* priority, float* JXL_RESTRICT entropy_estimate,
-                 float* block, float* scratch_space, uint32_t* quantized) {
+                 EntropyCache* cache) {
   AcStrategy acs = AcStrategy::FromRawStrategy(acs_raw);
   float entropy_current = 0;
   for (size_t iy = 0; iy < acs.covered_blocks_y(); ++iy) {
@@ -571,10 +626,7 @@ void TryMergeAcs(AcStrategy::Type acs_raw, size_t bx, size_t by, size_t cx,
       entropy_current += entropy_estimate[(cy + iy) * 8 + (cx + ix)];
     }
   }
-  float entropy_candidate =
-      entropy_mul * EstimateEntropy(acs, (bx + cx) * 8, (by + cy) * 8, config,
-                                    cmap_factors, block, scratch_space,
-                                    quantized);
+  float entropy_candidate = entropy_mul * cache->Get(acs_raw, cx, cy);
   if (entropy_candidate >= entropy_current) return;
   // Accept the candidate.
   for (size_t iy = 0; iy < acs.covered_blocks_y(); iy++) {
@@ -638,19 +690,15 @@ AcStrategy::Type AcsHorizontalSplit(size_t blocks) {
 // of blocks X blocks size, where a block is 8x8 pixels.
 void FindBestFirstLevelDivisionForSquare(
     size_t blocks, bool allow_square_transform, size_t bx, size_t by, size_t cx,
-    size_t cy, const ACSConfig& config, const float* JXL_RESTRICT cmap_factors,
-    AcStrategyImage* JXL_RESTRICT ac_strategy, const float entropy_mul_JXK,
-    const float entropy_mul_JXJ, float* JXL_RESTRICT entropy_estimate,
-    float* block, float* scratch_space, uint32_t* quantized) {
+    size_t cy, AcStrategyImage* JXL_RESTRICT ac_strategy,
+    const float entropy_mul_JXK, const float entropy_mul_JXJ,
+    float* JXL_RESTRICT entropy_estimate, EntropyCache* cache) {
   // We denote J for the larger dimension here, and K for the smaller.
   // For example, for 32x32 block splitting, J would be 32, K 16.
   const size_t blocks_half = blocks / 2;
   const AcStrategy::Type acs_rawJXK = AcsVerticalSplit(blocks);
   const AcStrategy::Type acs_rawKXJ = AcsHorizontalSplit(blocks);
   const AcStrategy::Type acs_rawJXJ = AcsSquare(blocks);
-  const AcStrategy acsJXK = AcStrategy::FromRawStrategy(acs_rawJXK);
-  const AcStrategy acsKXJ = AcStrategy::FromRawStrategy(acs_rawKXJ);
-  const AcStrategy acsJXJ = AcStrategy::FromRawStrategy(acs_rawJXJ);
   AcStrategyRow row0 = ac_strategy->ConstRow(by + cy + 0);
   AcStrategyRow row1 = ac_strategy->ConstRow(by + cy + blocks_half);
   // Let's check if we can consider a JXJ block here at all.
@@ -690,42 +738,27 @@ void FindBestFirstLevelDivisionForSquare(
   float entropy_JXJ = std::numeric_limits<float>::max();
   if (allow_JXK) {
     if (row0[bx + cx + 0].RawStrategy() != acs_rawJXK) {
-      entropy_JXK_left =
-          entropy_mul_JXK *
-          EstimateEntropy(acsJXK, (bx + cx + 0) * 8, (by + cy + 0) * 8, config,
-                          cmap_factors, block, scratch_space, quantized);
+      entropy_JXK_left = entropy_mul_JXK * cache->Get(acs_rawJXK, cx, cy);
     }
     if (row0[bx + cx + blocks_half].RawStrategy() != acs_rawJXK) {
       entropy_JXK_right =
-          entropy_mul_JXK * EstimateEntropy(acsJXK, (bx + cx + blocks_half) * 8,
-                                            (by + cy + 0) * 8, config,
-                                            cmap_factors, block, scratch_space,
-                                            quantized);
+          entropy_mul_JXK * cache->Get(acs_rawJXK, cx + blocks_half, cy);
     }
   }
   if (allow_KXJ) {
     if (row0[bx + cx].RawStrategy() != acs_rawKXJ) {
-      entropy_KXJ_top =
-          entropy_mul_JXK *
-          EstimateEntropy(acsKXJ, (bx + cx + 0) * 8, (by + cy + 0) * 8, config,
-                          cmap_factors, block, scratch_space, quantized);
+      entropy_KXJ_top = entropy_mul_JXK * cache->Get(acs_rawKXJ, cx, cy);
     }
     if (row1[bx + cx].RawStrategy() != acs_rawKXJ) {
       entropy_KXJ_bottom =
-          entropy_mul_JXK * EstimateEntropy(acsKXJ, (bx + cx + 0) * 8,
-                                            (by + cy + blocks_half) * 8, config,
-                                            cmap_factors, block, scratch_space,
-                                            quantized);
+          entropy_mul_JXK * cache->Get(acs_rawKXJ, cx, cy + blocks_half);
     }
   }
   if (allow_square_transform) {
     // We control the exploration of the square transform separately so that
     // we can turn it off at high decoding speeds for 32x32, but still allow
     // exploring 16x32 and 32x16.
-    entropy_JXJ = entropy_mul_JXJ * EstimateEntropy(acsJXJ, (bx + cx + 0) * 8,
-                                                    (by + cy + 0) * 8, config,
-                                                    cmap_factors, block,
-                                                    scratch_space, quantized);
+    entropy_JXJ = entropy_mul_JXJ * cache->Get(acs_rawJXJ, cx, cy);
   }
 
   // Test if this block should have JXK or KXJ transforms,
@@ -763,7 +796,8 @@ void FindBestFirstLevelDivisionForSquare(
 }
 
 void ProcessRectACS(PassesEncoderState* JXL_RESTRICT enc_state,
-                    const ACSConfig& config, const Rect& rect) {
+                    const ACSConfig& config, const Rect& rect,
+                    ACSSearchStats* stats) {
   // Main philosophy here:
   // 1. First find best 8x8 transform for each area.
   // 2. Merging them into larger transforms where possibly, but
@@ -808,6 +842,7 @@ void ProcessRectACS(PassesEncoderState* JXL_RESTRICT enc_state,
   static const float k8x8mul2 = 1.0735757687292623f;
   static const float k8x8base = 1.4;
   const float mul8x8 = k8x8mul2 + k8x8mul1 / (butteraugli_target + k8x8base);
+  auto phase_start = std::chrono::steady_clock::now();
   for (size_t iy = 0; iy < rect.ysize(); iy++) {
     for (size_t ix = 0; ix < rect.xsize(); ix++) {
       float entropy = 0.0;
@@ -820,6 +855,9 @@ void ProcessRectACS(PassesEncoderState* JXL_RESTRICT enc_state,
       entropy_estimate[iy * 8 + ix] = entropy * mul8x8;
     }
   }
+  stats->AddTime(&stats->nanos_8x8, &phase_start);
+  EntropyCache cache(bx, by, config, cmap_factors, block, scratch_space,
+                     quantized);
   // Merge when a larger transform is better than the previously
   // searched best combination of 8x8 transforms.
   struct MergeTry {
@@ -906,9 +944,8 @@ void ProcessRectACS(PassesEncoderState* JXL_RESTRICT enc_state,
             // We handle both DCT8X16 and DCT16X8 at the same time.
             if ((cy | cx) % 8 == 0) {
               FindBestFirstLevelDivisionForSquare(
-                  8, true, bx, by, cx, cy, config, cmap_factors, ac_strategy,
-                  tx.entropy_mul, entropy_mul64X64, entropy_estimate, block,
-                  scratch_space, quantized);
+                  8, true, bx, by, cx, cy, ac_strategy, tx.entropy_mul,
+                  entropy_mul64X64, entropy_estimate, &cache);
             }
             continue;
           } else if (tx.type == AcStrategy::Type::DCT32X16) {
@@ -931,9 +968,8 @@ void ProcessRectACS(PassesEncoderState* JXL_RESTRICT enc_state,
             bool enable_32x32 = cparams.decoding_speed_tier < 4;
             if ((cy | cx) % 4 == 0) {
               FindBestFirstLevelDivisionForSquare(
-                  4, enable_32x32, bx, by, cx, cy, config, cmap_factors,
-                  ac_strategy, tx.entropy_mul, entropy_mul32X32,
-                  entropy_estimate, block, scratch_space, quantized);
+                  4, enable_32x32, bx, by, cx, cy, ac_strategy, tx.entropy_mul,
+                  entropy_mul32X32, entropy_estimate, &cache);
             }
             continue;
           } else if (tx.type == AcStrategy::Type::DCT32X16) {
@@ -954,9 +990,8 @@ void ProcessRectACS(PassesEncoderState* JXL_RESTRICT enc_state,
             // We handle both DCT8X16 and DCT16X8 at the same time.
             if ((cy | cx) % 2 == 0) {
               FindBestFirstLevelDivisionForSquare(
-                  2, true, bx, by, cx, cy, config, cmap_factors, ac_strategy,
-                  tx.entropy_mul, entropy_mul16X16, entropy_estimate, block,
-                  scratch_space, quantized);
+                  2, true, bx, by, cx, cy, ac_strategy, tx.entropy_mul,
+                  entropy_mul16X16, entropy_estimate, &cache);
             }
             continue;
           } else if (tx.type == AcStrategy::Type::DCT16X8) {
@@ -977,27 +1012,29 @@ void ProcessRectACS(PassesEncoderState* JXL_RESTRICT enc_state,
         // when there is an odd number of 8x8 blocks, then the last row
         // and column will get their DCT16X8s and DCT8X16s through the
         // normal integral transform merging process.
-        TryMergeAcs(tx.type, bx, by, cx, cy, config, cmap_factors, ac_strategy,
-                    tx.entropy_mul, tx.priority, &priority[0], entropy_estimate,
-                    block, scratch_space, quantized);
+        TryMergeAcs(tx.type, bx, by, cx, cy, ac_strategy, tx.entropy_mul,
+                    tx.priority, &priority[0], entropy_estimate, &cache);
       }
     }
   }
+  stats->AddTime(&stats->nanos_merge, &phase_start);
   // Here we still try to do some non-aligned matching, find a few more
   // 16X8, 8X16 and 16X16s between the non-2-aligned blocks.
   if (cparams.speed_tier >= SpeedTier::kHare) {
+    stats->AddLookups(cache.num_lookups(), cache.num_hits());
     return;
   }
   for (int ii = 0; ii < 3; ++ii) {
     for (size_t cy = 1 - (ii == 1); cy + 1 < rect.ysize(); cy += 2) {
       for (size_t cx = 1 - (ii == 2); cx + 1 < rect.xsize(); cx += 2) {
         FindBestFirstLevelDivisionForSquare(
-            2, true, bx, by, cx, cy, config, cmap_factors, ac_strategy,
-            entropy_mul16X8, entropy_mul16X16, entropy_estimate, block,
-            scratch_space, quantized);
+            2, true, bx, by, cx, cy, ac_strategy, entropy_mul16X8,
+            entropy_mul16X16, entropy_estimate, &cache);
       }
     }
   }
+  stats->AddTime(&stats->nanos_unaligned, &phase_start);
+  stats->AddLookups(cache.num_lookups(), cache.num_hits());
 }
 
 // NOLINTNEXTLINE(google-readability-namespace-comments)
@@ -1074,7 +1111,7 @@ void AcStrategyHeuristics::ProcessRect(const Rect& rect) {
     return;
   }
   HWY_DYNAMIC_DISPATCH(ProcessRectACS)
-  (enc_state, config, rect);
+  (enc_state, config, rect, &stats);
 }
 
 void AcStrategyHeuristics::Finalize(AuxOut* aux_out) {
@@ -1111,6 +1148,11 @@ void AcStrategyHeuristics::Finalize(AuxOut* aux_out) {
         ac_strategy.CountBlocks(AcStrategy::Type::DCT64X32);
     aux_out->num_dct64_blocks =
         ac_strategy.CountBlocks(AcStrategy::Type::DCT64X64);
+    aux_out->acs_8x8_seconds = stats.nanos_8x8 * 1e-9;
+    aux_out->acs_merge_seconds = stats.nanos_merge * 1e-9;
+    aux_out->acs_unaligned_seconds = stats.nanos_unaligned * 1e-9;
+    aux_out->num_acs_estimates = stats.num_lookups;
+    aux_out->num_acs_estimates_cached = stats.num_hits;
   }
 
   if (WantDebugOutput(aux_out)) {
@@ -8,6 +8,9 @@
 
 #include <stdint.h>
 
+#include <atomic>
+#include <chrono>
+
 #include "lib/jxl/ac_strategy.h"
 #include "lib/jxl/aux_out.h"
 #include "lib/jxl/aux_out_fwd.h"
@@ -58,12 +61,42 @@ struct ACSConfig {
   }
 };
 
+// Time spent in the phases of the AC strategy search and the number of
+// entropy estimates of candidate transforms, summed over all the rects (and
+// threads). Reported in AuxOut.
+struct ACSSearchStats {
+  // Adds the time since *start to *nanos, and restarts *start.
+  void AddTime(std::atomic<uint64_t>* nanos,
+               std::chrono::steady_clock::time_point* start) {
+    const auto now = std::chrono::steady_clock::now();
+    *nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(now - *start)
+                  .count();
+    *start = now;
+  }
+  void AddLookups(size_t lookups, size_t hits) {
+    num_lookups += lookups;
+    num_hits += hits;
+  }
+
+  // Best 8x8 transform of each block.
+  std::atomic<uint64_t> nanos_8x8{0};
+  // Merging into larger transforms, aligned to their size.
+  std::atomic<uint64_t> nanos_merge{0};
+  // Unaligned 16x16, 16x8 and 8x16 search.
+  std::atomic<uint64_t> nanos_unaligned{0};
+  // Entropy estimates requested by the last two phases, and how many of them
+  // were computed before for the same transform at the same position.
+  std::atomic<uint64_t> num_lookups{0};
+  std::atomic<uint64_t> num_hits{0};
+};
+
 struct AcStrategyHeuristics {
   void Init(const Image3F& src, PassesEncoderState* enc_state);
   void ProcessRect(const Rect& rect);
   void Finalize(AuxOut* aux_out);
   ACSConfig config;
   PassesEncoderState* enc_state;
+  ACSSearchStats stats;
 };
 
 // Debug.
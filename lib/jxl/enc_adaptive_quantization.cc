@@ -38,6 +38,7 @@
 #include "lib/jxl/enc_group.h"
 #include "lib/jxl/enc_modular.h"
 #include "lib/jxl/enc_params.h"
+#include "lib/jxl/enc_stage_stats.h"
 #include "lib/jxl/enc_transforms-inl.h"
 #include "lib/jxl/epf.h"
 #include "lib/jxl/fast_math-inl.h"
@@ -1093,8 +1094,13 @@ ImageBundle RoundtripImage(const Image3F& opsin, PassesEncoderState* enc_state,
   std::unique_ptr<ModularFrameEncoder> modular_frame_encoder =
       jxl::make_unique<ModularFrameEncoder>(enc_state->shared.frame_header,
                                             enc_state->cparams);
+  // The roundtrip is measured as part of the adaptive quantization stage, the
+  // stages it runs are not reported on their own.
+  EncoderStageStats* stage_stats = enc_state->stage_stats;
+  enc_state->stage_stats = nullptr;
   JXL_CHECK(InitializePassesEncoder(opsin, cms, pool, enc_state,
                                     modular_frame_encoder.get(), nullptr));
+  enc_state->stage_stats = stage_stats;
   JXL_CHECK(dec_state->Init());
   JXL_CHECK(dec_state->InitForAC(pool));
 
@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/enc_params.h"
 
 namespace jxl {
@@ -69,6 +70,8 @@ struct HistogramParams {
   std::vector<size_t> image_widths;
   size_t max_histograms = ~0;
   bool force_huffman = false;
+  // If not null, large numbers of histograms are clustered on this pool.
+  ThreadPool* pool = nullptr;
 };
 
 }  // namespace jxl
@@ -14,8 +14,9 @@
 namespace jxl {
 
 JxlButteraugliComparator::JxlButteraugliComparator(
-    const ButteraugliParams& params, const JxlCmsInterface& cms)
-    : params_(params), cms_(cms) {}
+    const ButteraugliParams& params, const JxlCmsInterface& cms,
+    ThreadPool* pool, size_t tile_size)
+    : params_(params), cms_(cms), pool_(pool), tile_size_(tile_size) {}
 
 Status JxlButteraugliComparator::SetReferenceImage(const ImageBundle& ref) {
   const ImageBundle* ref_linear_srgb;
@@ -26,8 +27,13 @@ Status JxlButteraugliComparator::SetReferenceImage(const ImageBundle& ref) {
     return false;
   }
 
-  comparator_.reset(
-      new ButteraugliComparator(ref_linear_srgb->color(), params_));
+  if (tile_size_ != 0) {
+    comparator_.reset();
+    reference_ = CopyImage(ref_linear_srgb->color());
+  } else {
+    comparator_.reset(
+        new ButteraugliComparator(ref_linear_srgb->color(), params_));
+  }
   xsize_ = ref.xsize();
   ysize_ = ref.ysize();
   return true;
@@ -35,7 +41,7 @@ Status JxlButteraugliComparator::SetReferenceImage(const ImageBundle& ref) {
 
 Status JxlButteraugliComparator::CompareWith(const ImageBundle& actual,
                                              ImageF* diffmap, float* score) {
-  if (!comparator_) {
+  if (!comparator_ && reference_.xsize() == 0) {
     return JXL_FAILURE("Must set reference image first");
   }
   if (xsize_ != actual.xsize() || ysize_ != actual.ysize()) {
@@ -52,7 +58,13 @@ Status JxlButteraugliComparator::CompareWith(const ImageBundle& actual,
   }
 
   ImageF temp_diffmap(xsize_, ysize_);
-  comparator_->Diffmap(actual_linear_srgb->color(), temp_diffmap);
+  if (tile_size_ != 0) {
+    JXL_RETURN_IF_ERROR(ButteraugliDiffmapTiled(
+        reference_, actual_linear_srgb->color(), params_, pool_, tile_size_,
+        temp_diffmap));
+  } else {
+    comparator_->Diffmap(actual_linear_srgb->color(), temp_diffmap);
+  }
 
   if (score != nullptr) {
     *score = ButteraugliScoreFromDiffmap(temp_diffmap, &params_);
@@ -75,16 +87,16 @@ float JxlButteraugliComparator::BadQualityScore() const {
 float ButteraugliDistance(const ImageBundle& rgb0, const ImageBundle& rgb1,
                           const ButteraugliParams& params,
                           const JxlCmsInterface& cms, ImageF* distmap,
-                          ThreadPool* pool) {
-  JxlButteraugliComparator comparator(params, cms);
+                          ThreadPool* pool, size_t tile_size) {
+  JxlButteraugliComparator comparator(params, cms, pool, tile_size);
   return ComputeScore(rgb0, rgb1, &comparator, cms, distmap, pool);
 }
 
 float ButteraugliDistance(const CodecInOut& rgb0, const CodecInOut& rgb1,
                           const ButteraugliParams& params,
                           const JxlCmsInterface& cms, ImageF* distmap,
-                          ThreadPool* pool) {
-  JxlButteraugliComparator comparator(params, cms);
+                          ThreadPool* pool, size_t tile_size) {
+  JxlButteraugliComparator comparator(params, cms, pool, tile_size);
   JXL_ASSERT(rgb0.frames.size() == rgb1.frames.size());
   float max_dist = 0.0f;
   for (size_t i = 0; i < rgb0.frames.size(); ++i) {
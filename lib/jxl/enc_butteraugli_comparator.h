@@ -22,8 +22,13 @@ namespace jxl {
 
 class JxlButteraugliComparator : public Comparator {
  public:
+  // If tile_size is not 0, the comparisons are done with
+  // ButteraugliDiffmapTiled on the pool, and only the reference image is kept
+  // between them instead of its full-image decomposition.
   explicit JxlButteraugliComparator(const ButteraugliParams& params,
-                                    const JxlCmsInterface& cms);
+                                    const JxlCmsInterface& cms,
+                                    ThreadPool* pool = nullptr,
+                                    size_t tile_size = 0);
 
   Status SetReferenceImage(const ImageBundle& ref) override;
 
@@ -36,22 +41,28 @@ class JxlButteraugliComparator : public Comparator {
  private:
   ButteraugliParams params_;
   JxlCmsInterface cms_;
+  ThreadPool* pool_;
+  size_t tile_size_;
   std::unique_ptr<ButteraugliComparator> comparator_;
+  // Linear sRGB reference image, only in tiled mode.
+  Image3F reference_;
   size_t xsize_ = 0;
   size_t ysize_ = 0;
 };
 
 // Returns the butteraugli distance between rgb0 and rgb1.
 // If distmap is not null, it must be the same size as rgb0 and rgb1.
+// If tile_size is not 0, the images are compared in tiles of that size on the
+// pool, see ButteraugliDiffmapTiled.
 float ButteraugliDistance(const ImageBundle& rgb0, const ImageBundle& rgb1,
                           const ButteraugliParams& params,
                           const JxlCmsInterface& cms, ImageF* distmap = nullptr,
-                          ThreadPool* pool = nullptr);
+                          ThreadPool* pool = nullptr, size_t tile_size = 0);
 
 float ButteraugliDistance(const CodecInOut& rgb0, const CodecInOut& rgb1,
                           const ButteraugliParams& params,
                           const JxlCmsInterface& cms, ImageF* distmap = nullptr,
-                          ThreadPool* pool = nullptr);
+                          ThreadPool* pool = nullptr, size_t tile_size = 0);
 
 }  // namespace jxl
 
@@ -26,6 +26,7 @@
 #include "lib/jxl/enc_group.h"
 #include "lib/jxl/enc_modular.h"
 #include "lib/jxl/enc_quant_weights.h"
+#include "lib/jxl/enc_stage_stats.h"
 #include "lib/jxl/frame_header.h"
 #include "lib/jxl/image.h"
 #include "lib/jxl/image_bundle.h"
@@ -43,6 +44,8 @@ Status InitializePassesEncoder(const Image3F& opsin, const JxlCmsInterface& cms,
 
   PassesSharedState& JXL_RESTRICT shared = enc_state->shared;
 
+  EncoderStageTimer coeffs_timer(enc_state->stage_stats,
+                                 JXL_ENC_STAGE_TOKENIZE);
   enc_state->histogram_idx.resize(shared.frame_dim.num_groups);
 
   enc_state->x_qm_multiplier =
@@ -75,8 +78,13 @@ Status InitializePassesEncoder(const Image3F& opsin, const JxlCmsInterface& cms,
         ComputeCoefficients(group_idx, enc_state, opsin, &dc);
       },
       "Compute coeffs"));
+  coeffs_timer.Stop();
 
   if (shared.frame_header.flags & FrameHeader::kUseDcFrame) {
+    // The DC frame is encoded without stats of its own, all its stages are
+    // charged to this one.
+    EncoderStageTimer dc_frame_timer(enc_state->stage_stats,
+                                     JXL_ENC_STAGE_DC_FRAME);
     CompressParams cparams = enc_state->cparams;
     cparams.dots = Override::kOff;
     cparams.noise = Override::kOff;
@@ -179,6 +187,7 @@ Status InitializePassesEncoder(const Image3F& opsin, const JxlCmsInterface& cms,
     shared.dc = &shared.dc_storage;
     JXL_CHECK(encoded_size == 0);
   } else {
+    EncoderStageTimer dc_timer(enc_state->stage_stats, JXL_ENC_STAGE_TOKENIZE);
     auto compute_dc_coeffs = [&](int group_index, int /* thread */) {
       modular_frame_encoder->AddVarDCTDC(
           dc, group_index, enc_state->cparams.speed_tier < SpeedTier::kFalcon,
@@ -192,6 +201,8 @@ Status InitializePassesEncoder(const Image3F& opsin, const JxlCmsInterface& cms,
       AdaptiveDCSmoothing(shared.quantizer.MulDC(), &shared.dc_storage, pool);
     }
   }
+  EncoderStageTimer ac_meta_timer(enc_state->stage_stats,
+                                  JXL_ENC_STAGE_TOKENIZE);
   auto compute_ac_meta = [&](int group_index, int /* thread */) {
     modular_frame_encoder->AddACMetadata(group_index, /*jpeg_transcode=*/false,
                                          enc_state);
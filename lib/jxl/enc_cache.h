@@ -22,6 +22,7 @@
 #include "lib/jxl/enc_ans.h"
 #include "lib/jxl/enc_heuristics.h"
 #include "lib/jxl/enc_params.h"
+#include "lib/jxl/enc_stage_stats.h"
 #include "lib/jxl/frame_header.h"
 #include "lib/jxl/image.h"
 #include "lib/jxl/image_bundle.h"
@@ -69,6 +70,9 @@ struct PassesEncoderState {
   // Heuristics to be used by the encoder.
   std::unique_ptr<EncoderHeuristics> heuristics =
       make_unique<DefaultEncoderHeuristics>();
+
+  // Receives the time and memory used by the stages of the frame, if not null.
+  EncoderStageStats* stage_stats = nullptr;
 };
 
 // Initialize per-frame information.
@@ -20,6 +20,7 @@
 #include <hwy/highway.h>
 
 #include "lib/jxl/ac_context.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/profiler.h"
 #include "lib/jxl/fast_math-inl.h"
 HWY_BEFORE_NAMESPACE();
@@ -82,9 +83,16 @@ float HistogramDistance(const Histogram& a, const Histogram& b) {
   return total_distance - a.entropy_ - b.entropy_;
 }
 
+// Number of histograms processed by one task of the pool.
+constexpr size_t kClusterChunkSize = 256;
+
 // First step of a k-means clustering with a fancy distance metric.
+// The entropies of the input histograms and their distances to each new
+// cluster are computed in parallel on the pool, in chunks of
+// kClusterChunkSize histograms, which does not change the result.
 void FastClusterHistograms(const std::vector<Histogram>& in,
-                           size_t max_histograms, std::vector<Histogram>* out,
+                           size_t max_histograms, ThreadPool* pool,
+                           std::vector<Histogram>* out,
                            std::vector<uint32_t>* histogram_symbols) {
   PROFILER_FUNC;
   out->clear();
@@ -92,15 +100,27 @@ void FastClusterHistograms(const std::vector<Histogram>& in,
   histogram_symbols->clear();
   histogram_symbols->resize(in.size(), max_histograms);
 
+  const size_t num_chunks = DivCeil(in.size(), kClusterChunkSize);
+  // Dispatching a single chunk to the pool is not worth it.
+  if (num_chunks == 1) pool = nullptr;
+
   std::vector<float> dists(in.size(), std::numeric_limits<float>::max());
+  JXL_CHECK(RunOnPool(
+      pool, 0, num_chunks, ThreadPool::NoInit,
+      [&](const uint32_t chunk, size_t /* thread */) {
+        const size_t end = std::min(in.size(), (chunk + 1) * kClusterChunkSize);
+        for (size_t i = chunk * kClusterChunkSize; i < end; i++) {
+          if (in[i].total_count_ == 0) {
+            (*histogram_symbols)[i] = 0;
+            dists[i] = 0.0f;
+            continue;
+          }
+          HistogramEntropy(in[i]);
+        }
+      },
+      "HistogramEntropy"));
   size_t largest_idx = 0;
   for (size_t i = 0; i < in.size(); i++) {
-    if (in[i].total_count_ == 0) {
-      (*histogram_symbols)[i] = 0;
-      dists[i] = 0.0f;
-      continue;
-    }
-    HistogramEntropy(in[i]);
     if (in[i].total_count_ > in[largest_idx].total_count_) {
       largest_idx = i;
     }
@@ -111,15 +131,27 @@ void FastClusterHistograms(const std::vector<Histogram>& in,
     (*histogram_symbols)[largest_idx] = out->size();
     out->push_back(in[largest_idx]);
     dists[largest_idx] = 0.0f;
+    const Histogram& cluster = out->back();
+    JXL_CHECK(RunOnPool(
+        pool, 0, num_chunks, ThreadPool::NoInit,
+        [&](const uint32_t chunk, size_t /* thread */) {
+          const size_t end =
+              std::min(in.size(), (chunk + 1) * kClusterChunkSize);
+          for (size_t i = chunk * kClusterChunkSize; i < end; i++) {
+            if (dists[i] == 0.0f) continue;
+            dists[i] = std::min(HistogramDistance(in[i], cluster), dists[i]);
+          }
+        },
+        "HistogramDistance"));
     largest_idx = 0;
     for (size_t i = 0; i < in.size(); i++) {
-      if (dists[i] == 0.0f) continue;
-      dists[i] = std::min(HistogramDistance(in[i], out->back()), dists[i]);
       if (dists[i] > dists[largest_idx]) largest_idx = i;
     }
     if (dists[largest_idx] < kMinDistanceForDistinct) break;
   }
 
+  // Every histogram is compared to the clusters as they are after the
+  // previous histograms were added to them, so this part stays serial.
   for (size_t i = 0; i < in.size(); i++) {
     if ((*histogram_symbols)[i] != max_histograms) continue;
     size_t best = 0;
@@ -156,6 +188,9 @@ namespace {
 // -----------------------------------------------------------------------------
 // Histogram refinement
 
+// Below this number of clusters, the merge costs are computed serially.
+constexpr size_t kMinClustersForPool = 16;
+
 // Reorder histograms in *out so that the new symbols in *symbols come in
 // increasing order.
 void HistogramReindex(std::vector<Histogram>* out,
@@ -185,6 +220,7 @@ void ClusterHistograms(const HistogramParams params,
                        const std::vector<Histogram>& in, size_t max_histograms,
                        std::vector<Histogram>* out,
                        std::vector<uint32_t>* histogram_symbols) {
+  ThreadPool* pool = params.pool;
   max_histograms = std::min(max_histograms, params.max_histograms);
   max_histograms = std::min(max_histograms, in.size());
   if (params.clustering == HistogramParams::ClusteringType::kFastest) {
@@ -192,13 +228,20 @@ void ClusterHistograms(const HistogramParams params,
   }
 
   HWY_DYNAMIC_DISPATCH(FastClusterHistograms)
-  (in, max_histograms, out, histogram_symbols);
+  (in, max_histograms, pool, out, histogram_symbols);
 
   if (params.clustering == HistogramParams::ClusteringType::kBest) {
-    for (size_t i = 0; i < out->size(); i++) {
-      (*out)[i].entropy_ =
-          ANSPopulationCost((*out)[i].data_.data(), (*out)[i].data_.size());
-    }
+    // The costs of the merge candidates are computed on the pool, unless
+    // there are too few clusters for it to pay off. They are queued in a
+    // fixed order, so the result does not depend on the pool.
+    if (out->size() < kMinClustersForPool) pool = nullptr;
+    JXL_CHECK(RunOnPool(
+        pool, 0, out->size(), ThreadPool::NoInit,
+        [&](const uint32_t i, size_t /* thread */) {
+          (*out)[i].entropy_ =
+              ANSPopulationCost((*out)[i].data_.data(), (*out)[i].data_.size());
+        },
+        "ClusterEntropy"));
     uint32_t next_version = 2;
     std::vector<uint32_t> version(out->size(), 1);
     std::vector<uint32_t> renumbering(out->size());
@@ -221,15 +264,30 @@ void ClusterHistograms(const HistogramParams params,
       }
     };
 
+    // Returns the change of cost from merging clusters i and j.
+    const auto merge_cost = [&](uint32_t i, uint32_t j) -> float {
+      Histogram histo;
+      histo.AddHistogram((*out)[i]);
+      histo.AddHistogram((*out)[j]);
+      return ANSPopulationCost(histo.data_.data(), histo.data_.size()) -
+             (*out)[i].entropy_ - (*out)[j].entropy_;
+    };
+
     // Create list of all pairs by increasing merging cost.
     std::priority_queue<HistogramPair> pairs_to_merge;
-    for (uint32_t i = 0; i < out->size(); i++) {
-      for (uint32_t j = i + 1; j < out->size(); j++) {
-        Histogram histo;
-        histo.AddHistogram((*out)[i]);
-        histo.AddHistogram((*out)[j]);
-        float cost = ANSPopulationCost(histo.data_.data(), histo.data_.size()) -
-                     (*out)[i].entropy_ - (*out)[j].entropy_;
+    const size_t num_clusters = out->size();
+    std::vector<float> costs(num_clusters * num_clusters);
+    JXL_CHECK(RunOnPool(
+        pool, 0, num_clusters, ThreadPool::NoInit,
+        [&](const uint32_t i, size_t /* thread */) {
+          for (uint32_t j = i + 1; j < num_clusters; j++) {
+            costs[i * num_clusters + j] = merge_cost(i, j);
+          }
+        },
+        "ClusterPairCost"));
+    for (uint32_t i = 0; i < num_clusters; i++) {
+      for (uint32_t j = i + 1; j < num_clusters; j++) {
+        float cost = costs[i * num_clusters + j];
         // Avoid enqueueing pairs that are not advantageous to merge.
         if (cost >= 0) continue;
         pairs_to_merge.push(
@@ -258,14 +316,17 @@ void ClusterHistograms(const HistogramParams params,
       }
       version[second] = 0;
       version[first] = next_version++;
-      for (uint32_t j = 0; j < out->size(); j++) {
+      JXL_CHECK(RunOnPool(
+          pool, 0, num_clusters, ThreadPool::NoInit,
+          [&](const uint32_t j, size_t /* thread */) {
+            if (j == first || version[j] == 0) return;
+            costs[j] = merge_cost(first, j);
+          },
+          "ClusterPairCost"));
+      for (uint32_t j = 0; j < num_clusters; j++) {
         if (j == first) continue;
         if (version[j] == 0) continue;
-        Histogram histo;
-        histo.AddHistogram((*out)[first]);
-        histo.AddHistogram((*out)[j]);
-        float cost = ANSPopulationCost(histo.data_.data(), histo.data_.size()) -
-                     (*out)[first].entropy_ - (*out)[j].entropy_;
+        float cost = costs[j];
         // Avoid enqueueing pairs that are not advantageous to merge.
         if (cost >= 0) continue;
         pairs_to_merge.push(
@@ -0,0 +1,94 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "lib/jxl/base/random.h"
+#include "lib/jxl/base/thread_pool_internal.h"
+#include "lib/jxl/common.h"
+#include "lib/jxl/enc_ans_params.h"
+#include "lib/jxl/enc_cluster.h"
+#include "lib/jxl/enc_context_map.h"
+
+namespace jxl {
+namespace {
+
+// Histograms of residual tokens, roughly geometric with a decay that depends
+// on the context. The contexts are noisy variations of a few dozen typical
+// distributions, like the leaves of a large MA tree.
+std::vector<Histogram> GenerateHistograms(size_t num_contexts) {
+  Rng rng(num_contexts);
+  const size_t kNumPrototypes = 48;
+  const size_t kAlphabetSize = 40;
+  std::vector<float> decays(kNumPrototypes);
+  for (float& decay : decays) decay = rng.UniformF(0.2f, 0.95f);
+  std::vector<Histogram> histograms(num_contexts);
+  for (Histogram& histogram : histograms) {
+    const float decay =
+        std::min(0.98f, decays[rng.UniformU(0, kNumPrototypes)] *
+                            rng.UniformF(0.95f, 1.05f));
+    // Most leaves have few samples, some have many.
+    const size_t count = 1 << rng.UniformU(4, 14);
+    float p = 1.0f - decay;
+    for (size_t symbol = 0; symbol < kAlphabetSize; symbol++) {
+      const size_t n = std::lround(count * p * rng.UniformF(0.8f, 1.2f));
+      for (size_t i = 0; i < n; i++) histogram.Add(symbol);
+      p *= decay;
+    }
+    if (histogram.total_count_ == 0) histogram.Add(0);
+  }
+  return histograms;
+}
+
+// Arguments: number of contexts, clustering type, number of worker threads
+// (or -1 to run without a pool).
+void BM_ClusterHistograms(benchmark::State& state) {
+  const size_t num_contexts = state.range(0);
+  HistogramParams params;
+  params.clustering =
+      static_cast<HistogramParams::ClusteringType>(state.range(1));
+  std::unique_ptr<ThreadPoolInternal> pool;
+  if (state.range(2) >= 0) {
+    pool = jxl::make_unique<ThreadPoolInternal>(state.range(2));
+    params.pool = pool.get();
+  }
+  const std::vector<Histogram> in = GenerateHistograms(num_contexts);
+
+  size_t num_clusters = 0;
+  for (auto _ : state) {
+    std::vector<Histogram> out;
+    std::vector<uint32_t> histogram_symbols;
+    ClusterHistograms(params, in, kClustersLimit, &out, &histogram_symbols);
+    num_clusters = out.size();
+  }
+  state.counters["clusters"] = num_clusters;
+  state.SetItemsProcessed(state.iterations() * num_contexts);
+}
+
+void ClusterArgs(benchmark::internal::Benchmark* b) {
+  // The AC contexts of a VarDCT pass with a single block context, and the
+  // leaves of large modular trees.
+  for (int num_contexts : {495, 2000, 8000}) {
+    for (HistogramParams::ClusteringType clustering :
+         {HistogramParams::ClusteringType::kFast,
+          HistogramParams::ClusteringType::kBest}) {
+      for (int threads : {-1, 4}) {
+        b->Args({num_contexts, static_cast<int>(clustering), threads});
+      }
+    }
+  }
+  b->ArgNames({"contexts", "clustering", "threads"});
+}
+
+BENCHMARK(BM_ClusterHistograms)->Apply(ClusterArgs)->UseRealTime();
+
+}  // namespace
+}  // namespace jxl
@@ -0,0 +1,280 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Conversion of rows of interleaved external pixels to float planes.
+
+#if defined(LIB_JXL_ENC_EXTERNAL_IMAGE_INL_H_) == defined(HWY_TARGET_TOGGLE)
+#ifdef LIB_JXL_ENC_EXTERNAL_IMAGE_INL_H_
+#undef LIB_JXL_ENC_EXTERNAL_IMAGE_INL_H_
+#else
+#define LIB_JXL_ENC_EXTERNAL_IMAGE_INL_H_
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <hwy/highway.h>
+#include <type_traits>
+
+#include "jxl/types.h"
+#include "lib/jxl/base/compiler_specific.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace jxl {
+namespace HWY_NAMESPACE {
+
+// These templates are not found via ADL.
+using hwy::HWY_NAMESPACE::And;
+using hwy::HWY_NAMESPACE::BitCast;
+using hwy::HWY_NAMESPACE::ConvertTo;
+using hwy::HWY_NAMESPACE::Mul;
+using hwy::HWY_NAMESPACE::Or;
+using hwy::HWY_NAMESPACE::PromoteTo;
+using hwy::HWY_NAMESPACE::Rebind;
+using hwy::HWY_NAMESPACE::ShiftLeft;
+using hwy::HWY_NAMESPACE::ShiftRight;
+using hwy::HWY_NAMESPACE::Vec;
+
+// Lane type in which samples of each data type are loaded; floating-point
+// samples are loaded as integers so that their bytes can be swapped.
+template <JxlDataType kType>
+struct ExternalSample;
+template <>
+struct ExternalSample<JXL_TYPE_UINT8> {
+  using T = uint8_t;
+};
+template <>
+struct ExternalSample<JXL_TYPE_UINT16> {
+  using T = uint16_t;
+};
+template <>
+struct ExternalSample<JXL_TYPE_FLOAT16> {
+  using T = uint16_t;
+};
+template <>
+struct ExternalSample<JXL_TYPE_FLOAT> {
+  using T = uint32_t;
+};
+
+template <JxlDataType kType>
+using ExternalDataTypeTag = std::integral_constant<JxlDataType, kType>;
+
+template <class D, class V>
+HWY_INLINE V SwapBytes(D /* d */, V v, hwy::SizeTag<1> /* tag */) {
+  return v;
+}
+
+template <class D, class V>
+HWY_INLINE V SwapBytes(D /* d */, V v, hwy::SizeTag<2> /* tag */) {
+  return Or(ShiftLeft<8>(v), ShiftRight<8>(v));
+}
+
+template <class D, class V>
+HWY_INLINE V SwapBytes(D d, V v, hwy::SizeTag<4> /* tag */) {
+  const auto mask = Set(d, 0xFF00u);
+  return Or(Or(ShiftLeft<24>(v), ShiftRight<24>(v)),
+            Or(ShiftLeft<8>(And(v, mask)), And(ShiftRight<8>(v), mask)));
+}
+
+// Integer samples are scaled by mul, floating-point samples are not.
+template <class DF, class V>
+HWY_INLINE Vec<DF> SampleToFloat(
+    DF df, V v, Vec<DF> mul, ExternalDataTypeTag<JXL_TYPE_UINT8> /* tag */) {
+  const Rebind<uint32_t, DF> du32;
+  const Rebind<int32_t, DF> di32;
+  return Mul(ConvertTo(df, BitCast(di32, PromoteTo(du32, v))), mul);
+}
+
+template <class DF, class V>
+HWY_INLINE Vec<DF> SampleToFloat(
+    DF df, V v, Vec<DF> mul, ExternalDataTypeTag<JXL_TYPE_UINT16> /* tag */) {
+  const Rebind<uint32_t, DF> du32;
+  const Rebind<int32_t, DF> di32;
+  return Mul(ConvertTo(df, BitCast(di32, PromoteTo(du32, v))), mul);
+}
+
+template <class DF, class V>
+HWY_INLINE Vec<DF> SampleToFloat(
+    DF df, V v, Vec<DF> /* mul */,
+    ExternalDataTypeTag<JXL_TYPE_FLOAT16> /* tag */) {
+  const Rebind<hwy::float16_t, DF> df16;
+  return PromoteTo(df, BitCast(df16, v));
+}
+
+template <class DF, class V>
+HWY_INLINE Vec<DF> SampleToFloat(
+    DF df, V v, Vec<DF> /* mul */,
+    ExternalDataTypeTag<JXL_TYPE_FLOAT> /* tag */) {
+  return BitCast(df, v);
+}
+
+template <JxlDataType kType, class DF, class DT, class V>
+HWY_INLINE void StoreSamples(DF df, DT dt, V v, bool swap_bytes, Vec<DF> mul,
+                             float* JXL_RESTRICT out) {
+  if (out == nullptr) return;
+  using T = typename ExternalSample<kType>::T;
+  if (swap_bytes) v = SwapBytes(dt, v, hwy::SizeTag<sizeof(T)>());
+  StoreU(SampleToFloat(df, v, mul, ExternalDataTypeTag<kType>()), df, out);
+}
+
+// Converts Lanes(df) pixels of kChannels interleaved samples each.
+template <JxlDataType kType, class DF, class DT>
+HWY_INLINE void LoadExternalPixels(DF df, DT dt,
+                                   const typename ExternalSample<kType>::T* in,
+                                   bool swap_bytes, Vec<DF> mul,
+                                   float* const* out,
+                                   std::integral_constant<size_t, 1> /* c */) {
+  StoreSamples<kType>(df, dt, LoadU(dt, in), swap_bytes, mul, out[0]);
+}
+
+// LoadInterleaved* of partial vectors of any lane type needs Highway 1.0,
+// older versions deinterleave through an aligned copy below.
+#if HWY_MAJOR >= 1
+
+template <JxlDataType kType, class DF, class DT>
+HWY_INLINE void LoadExternalPixels(DF df, DT dt,
+                                   const typename ExternalSample<kType>::T* in,
+                                   bool swap_bytes, Vec<DF> mul,
+                                   float* const* out,
+                                   std::integral_constant<size_t, 2> /* c */) {
+  Vec<DT> v0, v1;
+  LoadInterleaved2(dt, in, v0, v1);
+  StoreSamples<kType>(df, dt, v0, swap_bytes, mul, out[0]);
+  StoreSamples<kType>(df, dt, v1, swap_bytes, mul, out[1]);
+}
+
+template <JxlDataType kType, class DF, class DT>
+HWY_INLINE void LoadExternalPixels(DF df, DT dt,
+                                   const typename ExternalSample<kType>::T* in,
+                                   bool swap_bytes, Vec<DF> mul,
+                                   float* const* out,
+                                   std::integral_constant<size_t, 3> /* c */) {
+  Vec<DT> v0, v1, v2;
+  LoadInterleaved3(dt, in, v0, v1, v2);
+  StoreSamples<kType>(df, dt, v0, swap_bytes, mul, out[0]);
+  StoreSamples<kType>(df, dt, v1, swap_bytes, mul, out[1]);
+  StoreSamples<kType>(df, dt, v2, swap_bytes, mul, out[2]);
+}
+
+template <JxlDataType kType, class DF, class DT>
+HWY_INLINE void LoadExternalPixels(DF df, DT dt,
+                                   const typename ExternalSample<kType>::T* in,
+                                   bool swap_bytes, Vec<DF> mul,
+                                   float* const* out,
+                                   std::integral_constant<size_t, 4> /* c */) {
+  Vec<DT> v0, v1, v2, v3;
+  LoadInterleaved4(dt, in, v0, v1, v2, v3);
+  StoreSamples<kType>(df, dt, v0, swap_bytes, mul, out[0]);
+  StoreSamples<kType>(df, dt, v1, swap_bytes, mul, out[1]);
+  StoreSamples<kType>(df, dt, v2, swap_bytes, mul, out[2]);
+  StoreSamples<kType>(df, dt, v3, swap_bytes, mul, out[3]);
+}
+
+#else  // HWY_MAJOR >= 1
+
+template <JxlDataType kType, class DF, class DT, size_t kChannels>
+HWY_INLINE void LoadExternalPixels(
+    DF df, DT dt, const typename ExternalSample<kType>::T* in, bool swap_bytes,
+    Vec<DF> mul, float* const* out,
+    std::integral_constant<size_t, kChannels> /* c */) {
+  using T = typename ExternalSample<kType>::T;
+  const size_t N = Lanes(df);
+  HWY_ALIGN T planes[kChannels][MaxLanes(df)];
+  for (size_t i = 0; i < N; ++i) {
+    for (size_t c = 0; c < kChannels; ++c) {
+      planes[c][i] = in[i * kChannels + c];
+    }
+  }
+  for (size_t c = 0; c < kChannels; ++c) {
+    StoreSamples<kType>(df, dt, Load(dt, planes[c]), swap_bytes, mul, out[c]);
+  }
+}
+
+#endif  // HWY_MAJOR >= 1
+
+template <JxlDataType kType, size_t kChannels>
+void LoadExternalRowT(const uint8_t* JXL_RESTRICT in, size_t xsize,
+                      bool swap_bytes, float mul, float* const* out) {
+  using T = typename ExternalSample<kType>::T;
+  const HWY_FULL(float) df;
+  const Rebind<T, decltype(df)> dt;
+  const std::integral_constant<size_t, kChannels> channels;
+  const size_t N = Lanes(df);
+  const auto vmul = Set(df, mul);
+  const size_t pixel_size = kChannels * sizeof(T);
+  size_t x = 0;
+  for (; x + N <= xsize; x += N) {
+    float* row_out[kChannels];
+    for (size_t c = 0; c < kChannels; ++c) {
+      row_out[c] = out[c] ? out[c] + x : nullptr;
+    }
+    LoadExternalPixels<kType>(df, dt,
+                              reinterpret_cast<const T*>(in + x * pixel_size),
+                              swap_bytes, vmul, row_out, channels);
+  }
+  if (x == xsize) return;
+  // Converts the last pixels from a zero-padded copy, to not read past the
+  // end of the input.
+  HWY_ALIGN T tail_in[MaxLanes(df) * kChannels] = {};
+  HWY_ALIGN float tail_out[kChannels][MaxLanes(df)];
+  memcpy(tail_in, in + x * pixel_size, (xsize - x) * pixel_size);
+  float* row_out[kChannels];
+  for (size_t c = 0; c < kChannels; ++c) {
+    row_out[c] = out[c] ? tail_out[c] : nullptr;
+  }
+  LoadExternalPixels<kType>(df, dt, tail_in, swap_bytes, vmul, row_out,
+                            channels);
+  for (size_t c = 0; c < kChannels; ++c) {
+    if (out[c] == nullptr) continue;
+    memcpy(out[c] + x, tail_out[c], (xsize - x) * sizeof(float));
+  }
+}
+
+template <JxlDataType kType>
+void LoadExternalRowOfType(const uint8_t* JXL_RESTRICT in, size_t xsize,
+                           size_t num_channels, bool swap_bytes, float mul,
+                           float* const* out) {
+  switch (num_channels) {
+    case 1:
+      return LoadExternalRowT<kType, 1>(in, xsize, swap_bytes, mul, out);
+    case 2:
+      return LoadExternalRowT<kType, 2>(in, xsize, swap_bytes, mul, out);
+    case 3:
+      return LoadExternalRowT<kType, 3>(in, xsize, swap_bytes, mul, out);
+    default:
+      return LoadExternalRowT<kType, 4>(in, xsize, swap_bytes, mul, out);
+  }
+}
+
+// Converts a row of xsize pixels of 1 to 4 interleaved samples each to
+// floats, and stores sample c of every pixel to out[c], or skips it if out[c]
+// is null. Integer samples are multiplied by mul. swap_bytes tells whether
+// the byte order of the samples differs from the native one.
+static inline HWY_MAYBE_UNUSED void LoadExternalRow(
+    const uint8_t* JXL_RESTRICT in, size_t xsize, JxlDataType data_type,
+    size_t num_channels, bool swap_bytes, float mul, float* const* out) {
+  switch (data_type) {
+    case JXL_TYPE_UINT8:
+      return LoadExternalRowOfType<JXL_TYPE_UINT8>(in, xsize, num_channels,
+                                                   swap_bytes, mul, out);
+    case JXL_TYPE_UINT16:
+      return LoadExternalRowOfType<JXL_TYPE_UINT16>(in, xsize, num_channels,
+                                                    swap_bytes, mul, out);
+    case JXL_TYPE_FLOAT16:
+      return LoadExternalRowOfType<JXL_TYPE_FLOAT16>(in, xsize, num_channels,
+                                                     swap_bytes, mul, out);
+    default:
+      return LoadExternalRowOfType<JXL_TYPE_FLOAT>(in, xsize, num_channels,
+                                                   swap_bytes, mul, out);
+  }
+}
+
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace jxl
+HWY_AFTER_NAMESPACE();
+
+#endif  // LIB_JXL_ENC_EXTERNAL_IMAGE_INL_H_
@@ -13,76 +13,54 @@
 #include <utility>
 #include <vector>
 
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "lib/jxl/enc_external_image.cc"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
 #include "jxl/types.h"
 #include "lib/jxl/alpha.h"
 #include "lib/jxl/base/byte_order.h"
 #include "lib/jxl/base/printf_macros.h"
 #include "lib/jxl/color_management.h"
 #include "lib/jxl/common.h"
+#include "lib/jxl/enc_external_image-inl.h"
+#include "lib/jxl/enc_xyb.h"
+#include "lib/jxl/image_ops.h"
 
+HWY_BEFORE_NAMESPACE();
 namespace jxl {
-namespace {
-
-// Based on highway scalar implementation, for testing
-float LoadFloat16(uint16_t bits16) {
-  const uint32_t sign = bits16 >> 15;
-  const uint32_t biased_exp = (bits16 >> 10) & 0x1F;
-  const uint32_t mantissa = bits16 & 0x3FF;
-
-  // Subnormal or zero
-  if (biased_exp == 0) {
-    const float subnormal = (1.0f / 16384) * (mantissa * (1.0f / 1024));
-    return sign ? -subnormal : subnormal;
-  }
-
-  // Normalized: convert the representation directly (faster than ldexp/tables).
-  const uint32_t biased_exp32 = biased_exp + (127 - 15);
-  const uint32_t mantissa32 = mantissa << (23 - 10);
-  const uint32_t bits32 = (sign << 31) | (biased_exp32 << 23) | mantissa32;
-
-  float result;
-  memcpy(&result, &bits32, 4);
-  return result;
-}
-
-float LoadLEFloat16(const uint8_t* p) {
-  uint16_t bits16 = LoadLE16(p);
-  return LoadFloat16(bits16);
-}
-
-float LoadBEFloat16(const uint8_t* p) {
-  uint16_t bits16 = LoadBE16(p);
-  return LoadFloat16(bits16);
-}
-
-// Loads a float in big endian
-float LoadBEFloat(const uint8_t* p) {
-  float value;
-  const uint32_t u = LoadBE32(p);
-  memcpy(&value, &u, 4);
-  return value;
-}
+namespace HWY_NAMESPACE {
 
-// Loads a float in little endian
-float LoadLEFloat(const uint8_t* p) {
-  float value;
-  const uint32_t u = LoadLE32(p);
-  memcpy(&value, &u, 4);
-  return value;
+// Converts rows [y0, y0 + ysize) of every channel c of the interleaved pixels
+// for which planes[c] is not null, reading each input row only once.
+Status ConvertRowsToPlanes(const uint8_t* JXL_RESTRICT in, size_t xsize,
+                          size_t ysize, size_t row_size,
+                          const JxlPixelFormat& format, bool swap_bytes,
+                          float mul, size_t y0, ImageF* const* planes,
+                          ThreadPool* pool) {
+  return RunOnPool(
+      pool, 0, static_cast<uint32_t>(ysize), ThreadPool::NoInit,
+      [&](const uint32_t task, size_t /*thread*/) {
+        const size_t y = task;
+        float* rows_out[4] = {};
+        for (size_t c = 0; c < format.num_channels; ++c) {
+          if (planes[c] != nullptr) rows_out[c] = planes[c]->Row(y0 + y);
+        }
+        LoadExternalRow(in + row_size * y, xsize, format.data_type,
+                        format.num_channels, swap_bytes, mul, rows_out);
+      },
+      "ConvertFromExternal");
 }
 
-typedef uint32_t(LoadFuncType)(const uint8_t* p);
-template <LoadFuncType LoadFunc>
-void JXL_INLINE LoadFloatRow(float* JXL_RESTRICT row_out, const uint8_t* in,
-                             float mul, size_t xsize, size_t bytes_per_pixel) {
-  size_t i = 0;
-  for (size_t x = 0; x < xsize; ++x) {
-    row_out[x] = mul * LoadFunc(in + i);
-    i += bytes_per_pixel;
-  }
-}
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace jxl
+HWY_AFTER_NAMESPACE();
 
-uint32_t JXL_INLINE Load8(const uint8_t* p) { return *p; }
+#if HWY_ONCE
+namespace jxl {
+namespace {
 
 size_t JxlDataTypeBytes(JxlDataType data_type) {
   switch (data_type) {
@@ -99,12 +77,13 @@ size_t JxlDataTypeBytes(JxlDataType data_type) {
   }
 }
 
-}  // namespace
+HWY_EXPORT(ConvertRowsToPlanes);
 
-Status ConvertFromExternal(Span<const uint8_t> bytes, size_t xsize,
-                           size_t ysize, size_t bits_per_sample,
-                           JxlPixelFormat format, size_t c, ThreadPool* pool,
-                           ImageF* channel) {
+// Checks that bytes holds ysize rows of xsize pixels in the given format,
+// consecutive rows being row_size bytes apart.
+Status CheckExternalRows(Span<const uint8_t> bytes, size_t xsize, size_t ysize,
+                         size_t row_size, size_t bits_per_sample,
+                         const JxlPixelFormat& format) {
   if (format.data_type == JXL_TYPE_UINT8) {
     JXL_RETURN_IF_ERROR(bits_per_sample > 0 && bits_per_sample <= 8);
   } else if (format.data_type == JXL_TYPE_UINT16) {
@@ -114,18 +93,19 @@ Status ConvertFromExternal(Span<const uint8_t> bytes, size_t xsize,
   } else if (format.data_type == JXL_TYPE_FLOAT) {
     JXL_RETURN_IF_ERROR(bits_per_sample == 32);
   } else {
-    JXL_FAILURE("unsupported pixel format data type %d", format.data_type);
+    return JXL_FAILURE("unsupported pixel format data type %d",
+                       format.data_type);
+  }
+  if (format.num_channels == 0 || format.num_channels > 4) {
+    return JXL_FAILURE("Invalid number of channels: %u", format.num_channels);
   }
   size_t bytes_per_channel = JxlDataTypeBytes(format.data_type);
   size_t bytes_per_pixel = format.num_channels * bytes_per_channel;
-  size_t pixel_offset = c * bytes_per_channel;
 
   const size_t last_row_size = xsize * bytes_per_pixel;
-  const size_t align = format.align;
-  const size_t row_size =
-      (align > 1 ? jxl::DivCeil(last_row_size, align) * align : last_row_size);
-  const size_t bytes_to_read = row_size * (ysize - 1) + last_row_size;
   if (xsize == 0 || ysize == 0) return JXL_FAILURE("Empty image");
+  if (row_size < last_row_size) return JXL_FAILURE("Row size is too small");
+  const size_t bytes_to_read = row_size * (ysize - 1) + last_row_size;
   if (bytes.size() < bytes_to_read) {
     return JXL_FAILURE("Buffer size is too small, expected: %" PRIuS
                        " got: %" PRIuS " (Image: %" PRIuS "x%" PRIuS
@@ -133,79 +113,87 @@ Status ConvertFromExternal(Span<const uint8_t> bytes, size_t xsize,
                        bytes_to_read, bytes.size(), xsize, ysize,
                        format.num_channels, bytes_per_channel);
   }
-  JXL_ASSERT(channel->xsize() == xsize);
-  JXL_ASSERT(channel->ysize() == ysize);
-  // Too large buffer is likely an application bug, so also fail for that.
-  // Do allow padding to stride in last row though.
-  if (bytes.size() > row_size * ysize) {
-    return JXL_FAILURE("Buffer size is too large");
-  }
+  return true;
+}
 
+// Whether the byte order of the samples differs from the native one.
+bool NeedsByteSwap(const JxlPixelFormat& format) {
   const bool little_endian =
       format.endianness == JXL_LITTLE_ENDIAN ||
       (format.endianness == JXL_NATIVE_ENDIAN && IsLittleEndian());
+  return little_endian != IsLittleEndian();
+}
 
-  const uint8_t* const in = bytes.data();
-  if (format.data_type == JXL_TYPE_FLOAT ||
-      format.data_type == JXL_TYPE_FLOAT16) {
-    JXL_RETURN_IF_ERROR(RunOnPool(
-        pool, 0, static_cast<uint32_t>(ysize), ThreadPool::NoInit,
-        [&](const uint32_t task, size_t /*thread*/) {
-          const size_t y = task;
-          size_t i = row_size * task + pixel_offset;
-          float* JXL_RESTRICT row_out = channel->Row(y);
-          if (format.data_type == JXL_TYPE_FLOAT16) {
-            if (little_endian) {
-              for (size_t x = 0; x < xsize; ++x) {
-                row_out[x] = LoadLEFloat16(in + i);
-                i += bytes_per_pixel;
-              }
-            } else {
-              for (size_t x = 0; x < xsize; ++x) {
-                row_out[x] = LoadBEFloat16(in + i);
-                i += bytes_per_pixel;
-              }
-            }
-          } else {
-            if (little_endian) {
-              for (size_t x = 0; x < xsize; ++x) {
-                row_out[x] = LoadLEFloat(in + i);
-                i += bytes_per_pixel;
-              }
-            } else {
-              for (size_t x = 0; x < xsize; ++x) {
-                row_out[x] = LoadBEFloat(in + i);
-                i += bytes_per_pixel;
-              }
-            }
-          }
-        },
-        "ConvertExtraChannelFloat"));
-  } else {
-    float mul = 1. / ((1ull << bits_per_sample) - 1);
-    JXL_RETURN_IF_ERROR(RunOnPool(
-        pool, 0, static_cast<uint32_t>(ysize), ThreadPool::NoInit,
-        [&](const uint32_t task, size_t /*thread*/) {
-          const size_t y = task;
-          size_t i = row_size * task + pixel_offset;
-          float* JXL_RESTRICT row_out = channel->Row(y);
-          if (format.data_type == JXL_TYPE_UINT8) {
-            LoadFloatRow<Load8>(row_out, in + i, mul, xsize, bytes_per_pixel);
-          } else {
-            if (little_endian) {
-              LoadFloatRow<LoadLE16>(row_out, in + i, mul, xsize,
-                                     bytes_per_pixel);
-            } else {
-              LoadFloatRow<LoadBE16>(row_out, in + i, mul, xsize,
-                                     bytes_per_pixel);
-            }
-          }
-        },
-        "ConvertExtraChannelUint"));
+// Factor that maps integer samples to [0, 1]. Floating point samples are not
+// scaled.
+float SampleScale(const JxlPixelFormat& format, size_t bits_per_sample) {
+  if (format.data_type != JXL_TYPE_UINT8 &&
+      format.data_type != JXL_TYPE_UINT16) {
+    return 1.0f;
   }
+  return 1. / ((1ull << bits_per_sample) - 1);
+}
 
-  return true;
+// Converts rows [y0, y0 + ysize) of the channels c of an interleaved pixel
+// buffer for which planes[c] is not null to the same rows of *planes[c].
+Status ConvertRowsToPlanes(Span<const uint8_t> bytes, size_t xsize,
+                           size_t ysize, size_t row_size,
+                           size_t bits_per_sample, const JxlPixelFormat& format,
+                           size_t y0, ThreadPool* pool, ImageF* const* planes) {
+  JXL_RETURN_IF_ERROR(CheckExternalRows(bytes, xsize, ysize, row_size,
+                                        bits_per_sample, format));
+  for (size_t c = 0; c < format.num_channels; ++c) {
+    if (planes[c] == nullptr) continue;
+    JXL_ASSERT(planes[c]->xsize() == xsize);
+    JXL_ASSERT(planes[c]->ysize() >= y0 + ysize);
+  }
+  return HWY_DYNAMIC_DISPATCH(ConvertRowsToPlanes)(
+      bytes.data(), xsize, ysize, row_size, format, NeedsByteSwap(format),
+      SampleScale(format, bits_per_sample), y0, planes, pool);
+}
+
+// Returns the distance in bytes between consecutive rows of a buffer passed
+// to ConvertFromExternal.
+size_t ExternalRowSize(size_t xsize, const JxlPixelFormat& format) {
+  const size_t last_row_size =
+      xsize * format.num_channels * JxlDataTypeBytes(format.data_type);
+  const size_t align = format.align;
+  return align > 1 ? jxl::DivCeil(last_row_size, align) * align
+                   : last_row_size;
+}
+
+}  // namespace
+
+Status ConvertRowsFromExternal(Span<const uint8_t> bytes, size_t xsize,
+                               size_t ysize, size_t row_size,
+                               size_t bits_per_sample, JxlPixelFormat format,
+                               size_t c, size_t y0, ThreadPool* pool,
+                               ImageF* channel) {
+  if (c >= format.num_channels) {
+    return JXL_FAILURE("Invalid channel %" PRIuS, c);
+  }
+  ImageF* planes[4] = {};
+  planes[c] = channel;
+  return ConvertRowsToPlanes(bytes, xsize, ysize, row_size, bits_per_sample,
+                             format, y0, pool, planes);
 }
+
+Status ConvertFromExternal(Span<const uint8_t> bytes, size_t xsize,
+                           size_t ysize, size_t bits_per_sample,
+                           JxlPixelFormat format, size_t c, ThreadPool* pool,
+                           ImageF* channel) {
+  const size_t row_size = ExternalRowSize(xsize, format);
+  JXL_ASSERT(channel->ysize() == ysize);
+  // Too large buffer is likely an application bug, so also fail for that.
+  // Do allow padding to stride in last row though.
+  if (bytes.size() > row_size * ysize) {
+    return JXL_FAILURE("Buffer size is too large");
+  }
+  return ConvertRowsFromExternal(bytes, xsize, ysize, row_size,
+                                 bits_per_sample, format, c, /*y0=*/0, pool,
+                                 channel);
+}
+
 Status ConvertFromExternal(Span<const uint8_t> bytes, size_t xsize,
                            size_t ysize, const ColorEncoding& c_current,
                            bool alpha_is_premultiplied, size_t bits_per_sample,
@@ -218,35 +206,155 @@ Status ConvertFromExternal(Span<const uint8_t> bytes, size_t xsize,
                        " color channels, received only %u channels",
                        color_channels, format.num_channels);
   }
+  if (format.num_channels > 4) {
+    return JXL_FAILURE("Invalid number of channels: %u", format.num_channels);
+  }
 
+  const size_t row_size = ExternalRowSize(xsize, format);
+  // Too large buffer is likely an application bug, so also fail for that.
+  // Do allow padding to stride in last row though.
+  if (bytes.size() > row_size * ysize) {
+    return JXL_FAILURE("Buffer size is too large");
+  }
+
+  // Color and alpha are converted in a single pass over the input.
   Image3F color(xsize, ysize);
-  for (size_t c = 0; c < color_channels; ++c) {
-    JXL_RETURN_IF_ERROR(ConvertFromExternal(bytes, xsize, ysize,
-                                            bits_per_sample, format, c, pool,
-                                            &color.Plane(c)));
+  ImageF alpha;
+  ImageF* planes[4] = {};
+  for (size_t c = 0; c < color_channels; ++c) planes[c] = &color.Plane(c);
+  // Passing an interleaved image with an alpha channel to an image that doesn't
+  // have alpha channel just discards the passed alpha channel.
+  if (ib->HasAlpha()) {
+    alpha = ImageF(xsize, ysize);
+    if (has_alpha) {
+      planes[format.num_channels - 1] = &alpha;
+    } else {
+      // if alpha is not passed, but it is expected, then assume
+      // it is all-opaque
+      FillImage(1.0f, &alpha);
+    }
   }
+  JXL_RETURN_IF_ERROR(ConvertRowsToPlanes(bytes, xsize, ysize, row_size,
+                                          bits_per_sample, format, /*y0=*/0,
+                                          pool, planes));
   if (color_channels == 1) {
     CopyImageTo(color.Plane(0), &color.Plane(1));
     CopyImageTo(color.Plane(0), &color.Plane(2));
   }
   ib->SetFromImage(std::move(color), c_current);
-
-  // Passing an interleaved image with an alpha channel to an image that doesn't
-  // have alpha channel just discards the passed alpha channel.
-  if (has_alpha && ib->HasAlpha()) {
-    ImageF alpha(xsize, ysize);
-    JXL_RETURN_IF_ERROR(
-        ConvertFromExternal(bytes, xsize, ysize, bits_per_sample, format,
-                            format.num_channels - 1, pool, &alpha));
+  if (ib->HasAlpha()) {
     ib->SetAlpha(std::move(alpha), alpha_is_premultiplied);
-  } else if (!has_alpha && ib->HasAlpha()) {
-    // if alpha is not passed, but it is expected, then assume
-    // it is all-opaque
+  }
+
+  return true;
+}
+
+Status ConvertFromExternalToXYB(Span<const uint8_t> bytes, size_t xsize,
+                                size_t ysize, const ColorEncoding& c_current,
+                                bool alpha_is_premultiplied,
+                                size_t bits_per_sample, JxlPixelFormat format,
+                                ThreadPool* pool, ImageBundle* ib) {
+  if (!c_current.IsSRGB() || c_current.IsGray()) {
+    return JXL_FAILURE("Only sRGB input can be converted to XYB directly");
+  }
+  if (format.data_type != JXL_TYPE_UINT8 &&
+      format.data_type != JXL_TYPE_UINT16) {
+    return JXL_FAILURE("Only integer input can be converted to XYB directly");
+  }
+  if (format.num_channels != 3 && format.num_channels != 4) {
+    return JXL_FAILURE("Expected 3 color channels, received %u channels",
+                       format.num_channels);
+  }
+  const bool has_alpha = format.num_channels == 4;
+  const size_t row_size = ExternalRowSize(xsize, format);
+  // Too large buffer is likely an application bug, so also fail for that.
+  // Do allow padding to stride in last row though.
+  if (bytes.size() > row_size * ysize) {
+    return JXL_FAILURE("Buffer size is too large");
+  }
+  JXL_RETURN_IF_ERROR(CheckExternalRows(bytes, xsize, ysize, row_size,
+                                        bits_per_sample, format));
+
+  Image3F xyb(xsize, ysize);
+  JXL_RETURN_IF_ERROR(ExternalSRGBToXYB(
+      bytes.data(), row_size, xsize, ysize, format.data_type,
+      format.num_channels, NeedsByteSwap(format),
+      SampleScale(format, bits_per_sample), ib->metadata()->IntensityTarget(),
+      pool, &xyb));
+  // As for the XYB images of patches, there is no way to express that ib is
+  // in XYB, so it claims the color encoding of the metadata.
+  ib->SetFromImage(std::move(xyb), ib->metadata()->color_encoding);
+
+  if (ib->HasAlpha()) {
     ImageF alpha(xsize, ysize);
-    FillImage(1.0f, &alpha);
+    if (has_alpha) {
+      ImageF* planes[4] = {nullptr, nullptr, nullptr, &alpha};
+      JXL_RETURN_IF_ERROR(ConvertRowsToPlanes(bytes, xsize, ysize, row_size,
+                                              bits_per_sample, format,
+                                              /*y0=*/0, pool, planes));
+    } else {
+      // if alpha is not passed, but it is expected, then assume
+      // it is all-opaque
+      FillImage(1.0f, &alpha);
+    }
     ib->SetAlpha(std::move(alpha), alpha_is_premultiplied);
   }
+  return true;
+}
 
+Status ConvertFromExternalInRows(const ExternalRowsFunc& get_rows,
+                                 const ReleaseExternalRowsFunc& release_rows,
+                                 size_t rows_per_call, size_t xsize,
+                                 size_t ysize, const ColorEncoding& c_current,
+                                 bool alpha_is_premultiplied,
+                                 size_t bits_per_sample, JxlPixelFormat format,
+                                 ThreadPool* pool, ImageBundle* ib) {
+  const size_t color_channels = c_current.Channels();
+  bool has_alpha = format.num_channels == 2 || format.num_channels == 4;
+  if (format.num_channels < color_channels) {
+    return JXL_FAILURE("Expected %" PRIuS
+                       " color channels, received only %u channels",
+                       color_channels, format.num_channels);
+  }
+  if (format.num_channels > 4) {
+    return JXL_FAILURE("Invalid number of channels: %u", format.num_channels);
+  }
+  if (rows_per_call == 0) return JXL_FAILURE("Invalid number of rows");
+
+  Image3F color(xsize, ysize);
+  ImageF alpha;
+  if (ib->HasAlpha()) {
+    alpha = ImageF(xsize, ysize);
+    // If alpha is not passed, but it is expected, then assume it is
+    // all-opaque.
+    if (!has_alpha) FillImage(1.0f, &alpha);
+  }
+  for (size_t y0 = 0; y0 < ysize; y0 += rows_per_call) {
+    const size_t num_rows = std::min(rows_per_call, ysize - y0);
+    size_t row_size = 0;
+    const Span<const uint8_t> rows = get_rows(y0, num_rows, &row_size);
+    if (rows.data() == nullptr) {
+      return JXL_FAILURE("No pixels for rows %" PRIuS "-%" PRIuS, y0,
+                         y0 + num_rows);
+    }
+    ImageF* planes[4] = {};
+    for (size_t c = 0; c < color_channels; ++c) planes[c] = &color.Plane(c);
+    if (has_alpha && ib->HasAlpha()) planes[format.num_channels - 1] = &alpha;
+    const Status status =
+        ConvertRowsToPlanes(rows, xsize, num_rows, row_size, bits_per_sample,
+                            format, y0, pool, planes);
+    // The caller may free or reuse the rows as soon as they are converted.
+    release_rows(rows.data());
+    JXL_RETURN_IF_ERROR(status);
+  }
+  if (color_channels == 1) {
+    CopyImageTo(color.Plane(0), &color.Plane(1));
+    CopyImageTo(color.Plane(0), &color.Plane(2));
+  }
+  ib->SetFromImage(std::move(color), c_current);
+  if (ib->HasAlpha()) {
+    ib->SetAlpha(std::move(alpha), alpha_is_premultiplied);
+  }
   return true;
 }
 
@@ -275,3 +383,4 @@ Status BufferToImageBundle(const JxlPixelFormat& pixel_format, uint32_t xsize,
 }
 
 }  // namespace jxl
+#endif  // HWY_ONCE
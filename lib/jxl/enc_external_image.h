@@ -11,6 +11,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <functional>
+
 #include "jxl/types.h"
 #include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/padded_bytes.h"
@@ -33,6 +35,48 @@ Status ConvertFromExternal(Span<const uint8_t> bytes, size_t xsize,
                            bool alpha_is_premultiplied, size_t bits_per_sample,
                            JxlPixelFormat format, ThreadPool* pool,
                            ImageBundle* ib);
+
+// Same as the ImageBundle version of ConvertFromExternal followed by ToXYB,
+// for nonlinear sRGB input with 8 or 16 bit integer samples, but without the
+// intermediate float copy of the input. ib receives the XYB image with the
+// color encoding of its metadata, so the encoder must be told that no color
+// transform is needed (FrameInfo::ib_needs_color_transform).
+Status ConvertFromExternalToXYB(Span<const uint8_t> bytes, size_t xsize,
+                                size_t ysize, const ColorEncoding& c_current,
+                                bool alpha_is_premultiplied,
+                                size_t bits_per_sample, JxlPixelFormat format,
+                                ThreadPool* pool, ImageBundle* ib);
+
+// Converts rows [y0, y0 + ysize) of channel c of an interleaved pixel buffer,
+// where consecutive rows start row_size bytes apart, to the same rows of
+// *channel.
+Status ConvertRowsFromExternal(Span<const uint8_t> bytes, size_t xsize,
+                               size_t ysize, size_t row_size,
+                               size_t bits_per_sample, JxlPixelFormat format,
+                               size_t c, size_t y0, ThreadPool* pool,
+                               ImageF* channel);
+
+// Returns the interleaved pixels of rows [y0, y0 + ysize) and sets *row_size
+// to the distance in bytes between consecutive rows. A span with a null data
+// pointer indicates an error.
+using ExternalRowsFunc = std::function<Span<const uint8_t>(
+    size_t y0, size_t ysize, size_t* row_size)>;
+// Called with the data pointer returned by ExternalRowsFunc once these rows
+// are no longer needed.
+using ReleaseExternalRowsFunc = std::function<void(const uint8_t* rows)>;
+
+// Same as the ImageBundle version of ConvertFromExternal, but gets the pixels
+// from get_rows in bands of rows_per_call rows, so that the caller never needs
+// to hold the whole frame as an interleaved buffer. ib still receives planes
+// for all the rows.
+Status ConvertFromExternalInRows(const ExternalRowsFunc& get_rows,
+                                 const ReleaseExternalRowsFunc& release_rows,
+                                 size_t rows_per_call, size_t xsize,
+                                 size_t ysize, const ColorEncoding& c_current,
+                                 bool alpha_is_premultiplied,
+                                 size_t bits_per_sample, JxlPixelFormat format,
+                                 ThreadPool* pool, ImageBundle* ib);
+
 Status BufferToImageF(const JxlPixelFormat& pixel_format, size_t xsize,
                       size_t ysize, const void* buffer, size_t size,
                       ThreadPool* pool, ImageF* channel);
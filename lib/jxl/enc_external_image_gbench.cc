@@ -4,24 +4,28 @@
 // license that can be found in the LICENSE file.
 
 #include "benchmark/benchmark.h"
+#include "lib/jxl/enc_color_management.h"
 #include "lib/jxl/enc_external_image.h"
+#include "lib/jxl/enc_xyb.h"
 #include "lib/jxl/image_ops.h"
 
 namespace jxl {
 namespace {
 
-// Encoder case, deinterleaves a buffer.
-void BM_EncExternalImage_ConvertImageRGBA(benchmark::State& state) {
+// Encoder case, deinterleaves a buffer of uint8 RGB (range(1) == 3) or RGBA
+// (range(1) == 4) pixels.
+void BM_EncExternalImage_ConvertImageU8(benchmark::State& state) {
   const size_t kNumIter = 5;
-  size_t xsize = state.range();
-  size_t ysize = state.range();
+  size_t xsize = state.range(0);
+  size_t ysize = state.range(0);
+  const uint32_t num_channels = state.range(1);
 
   ImageMetadata im;
-  im.SetAlphaBits(8);
+  if (num_channels == 4) im.SetAlphaBits(8);
   ImageBundle ib(&im);
 
-  std::vector<uint8_t> interleaved(xsize * ysize * 4);
-  JxlPixelFormat format = {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  std::vector<uint8_t> interleaved(xsize * ysize * num_channels);
+  JxlPixelFormat format = {num_channels, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
   for (auto _ : state) {
     for (size_t i = 0; i < kNumIter; ++i) {
       JXL_CHECK(ConvertFromExternal(
@@ -39,9 +43,62 @@ void BM_EncExternalImage_ConvertImageRGBA(benchmark::State& state) {
   state.SetBytesProcessed(kNumIter * state.iterations() * interleaved.size());
 }
 
-BENCHMARK(BM_EncExternalImage_ConvertImageRGBA)
-    ->RangeMultiplier(2)
-    ->Range(256, 2048);
+BENCHMARK(BM_EncExternalImage_ConvertImageU8)
+    ->Args({256, 3})
+    ->Args({256, 4})
+    ->Args({512, 3})
+    ->Args({512, 4})
+    ->Args({1024, 3})
+    ->Args({1024, 4})
+    ->Args({2048, 3})
+    ->Args({2048, 4})
+    ->ArgNames({"size", "channels"});
+
+// Encoder case at default effort, converts sRGB pixels to XYB, either through
+// a float sRGB image (range(1) == 0) or directly (range(1) == 1).
+void BM_EncExternalImage_ConvertImageRGBToXYB(benchmark::State& state) {
+  const size_t xsize = state.range(0);
+  const size_t ysize = state.range(0);
+  const bool direct = state.range(1) != 0;
+
+  ImageMetadata im;
+  std::vector<uint8_t> interleaved(xsize * ysize * 3);
+  for (size_t i = 0; i < interleaved.size(); ++i) {
+    interleaved[i] = static_cast<uint8_t>(i * 7);
+  }
+  const Span<const uint8_t> bytes(interleaved.data(), interleaved.size());
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  for (auto _ : state) {
+    ImageBundle ib(&im);
+    if (direct) {
+      JXL_CHECK(ConvertFromExternalToXYB(bytes, xsize, ysize,
+                                         /*c_current=*/ColorEncoding::SRGB(),
+                                         /*alpha_is_premultiplied=*/false,
+                                         /*bits_per_sample=*/8, format,
+                                         /*pool=*/nullptr, &ib));
+      benchmark::DoNotOptimize(ib.color()->PlaneRow(0, 0));
+    } else {
+      JXL_CHECK(ConvertFromExternal(bytes, xsize, ysize,
+                                    /*c_current=*/ColorEncoding::SRGB(),
+                                    /*alpha_is_premultiplied=*/false,
+                                    /*bits_per_sample=*/8, format,
+                                    /*pool=*/nullptr, &ib));
+      Image3F xyb(xsize, ysize);
+      (void)ToXYB(ib, /*pool=*/nullptr, &xyb, GetJxlCms());
+      benchmark::DoNotOptimize(xyb.PlaneRow(0, 0));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * xsize * ysize);
+  state.SetBytesProcessed(state.iterations() * interleaved.size());
+}
+
+BENCHMARK(BM_EncExternalImage_ConvertImageRGBToXYB)
+    ->Args({256, 0})
+    ->Args({256, 1})
+    ->Args({2048, 0})
+    ->Args({2048, 1})
+    ->ArgNames({"size", "direct"});
 
 }  // namespace
 }  // namespace jxl
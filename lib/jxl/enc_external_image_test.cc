@@ -5,14 +5,21 @@
 
 #include "lib/jxl/enc_external_image.h"
 
+#include <string.h>
+
 #include <array>
 #include <new>
+#include <vector>
 
 #include "gtest/gtest.h"
+#include "lib/jxl/base/byte_order.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/random.h"
 #include "lib/jxl/base/thread_pool_internal.h"
 #include "lib/jxl/color_encoding_internal.h"
+#include "lib/jxl/enc_color_management.h"
+#include "lib/jxl/enc_xyb.h"
 #include "lib/jxl/image_ops.h"
 #include "lib/jxl/image_test_utils.h"
 
@@ -65,5 +72,155 @@ TEST(ExternalImageTest, AlphaMissing) {
   EXPECT_FALSE(ib.HasAlpha());
 }
 
+// Scalar reference for the conversion of half floats.
+float Float16ToFloat(uint16_t bits16) {
+  const uint32_t sign = bits16 >> 15;
+  const uint32_t biased_exp = (bits16 >> 10) & 0x1F;
+  const uint32_t mantissa = bits16 & 0x3FF;
+  if (biased_exp == 0) {
+    const float subnormal = (1.0f / 16384) * (mantissa * (1.0f / 1024));
+    return sign ? -subnormal : subnormal;
+  }
+  const uint32_t bits32 =
+      (sign << 31) | ((biased_exp + (127 - 15)) << 23) | (mantissa << 13);
+  float result;
+  memcpy(&result, &bits32, 4);
+  return result;
+}
+
+// Fills bytes with random samples of the given format and returns the value
+// that ConvertFromExternal is expected to produce for each of them.
+std::vector<float> RandomExternalSamples(const JxlPixelFormat& format,
+                                         size_t bits_per_sample,
+                                         size_t num_samples, Rng* rng,
+                                         std::vector<uint8_t>* bytes) {
+  const bool big_endian =
+      format.endianness == JXL_BIG_ENDIAN ||
+      (format.endianness == JXL_NATIVE_ENDIAN && !IsLittleEndian());
+  std::vector<float> expected(num_samples);
+  const size_t max_value = (1u << bits_per_sample) - 1;
+  for (size_t i = 0; i < num_samples; ++i) {
+    uint32_t bits;
+    switch (format.data_type) {
+      case JXL_TYPE_UINT8:
+      case JXL_TYPE_UINT16:
+        bits = rng->UniformU(0, max_value + 1);
+        expected[i] = bits * (1.0f / max_value);
+        break;
+      case JXL_TYPE_FLOAT16:
+        // Any sign and mantissa, and exponents without infinities and NaN.
+        bits = rng->UniformU(0, 0x7C00) | (rng->Bernoulli(0.5f) ? 0x8000 : 0);
+        expected[i] = Float16ToFloat(bits);
+        break;
+      default:
+        expected[i] = rng->UniformF(-2.0f, 2.0f);
+        memcpy(&bits, &expected[i], 4);
+        break;
+    }
+    uint8_t* p = bytes->data() + i * bits_per_sample / kBitsPerByte;
+    if (format.data_type == JXL_TYPE_UINT8) {
+      bytes->at(i) = bits;
+    } else if (format.data_type == JXL_TYPE_FLOAT) {
+      big_endian ? StoreBE32(bits, p) : StoreLE32(bits, p);
+    } else {
+      big_endian ? StoreBE16(bits, p) : StoreLE16(bits, p);
+    }
+  }
+  return expected;
+}
+
+TEST(ExternalImageTest, ConvertsAllFormats) {
+  ThreadPoolInternal pool(4);
+  Rng rng(0);
+  // Not a multiple of any vector size, to also convert partial vectors.
+  const size_t xsize = 67;
+  const size_t ysize = 9;
+  const JxlDataType data_types[] = {JXL_TYPE_UINT8, JXL_TYPE_UINT16,
+                                    JXL_TYPE_FLOAT16, JXL_TYPE_FLOAT};
+  const size_t bits_per_sample[] = {8, 16, 16, 32};
+  for (size_t t = 0; t < 4; ++t) {
+    for (JxlEndianness endianness : {JXL_LITTLE_ENDIAN, JXL_BIG_ENDIAN}) {
+      for (uint32_t num_channels = 1; num_channels <= 4; ++num_channels) {
+        JxlPixelFormat format = {num_channels, data_types[t], endianness, 0};
+        const size_t num_samples = xsize * ysize * num_channels;
+        std::vector<uint8_t> bytes(num_samples * bits_per_sample[t] /
+                                   kBitsPerByte);
+        const std::vector<float> expected = RandomExternalSamples(
+            format, bits_per_sample[t], num_samples, &rng, &bytes);
+        for (size_t c = 0; c < num_channels; ++c) {
+          ImageF channel(xsize, ysize);
+          ASSERT_TRUE(ConvertFromExternal(
+              Span<const uint8_t>(bytes.data(), bytes.size()), xsize, ysize,
+              bits_per_sample[t], format, c, &pool, &channel));
+          for (size_t y = 0; y < ysize; ++y) {
+            for (size_t x = 0; x < xsize; ++x) {
+              ASSERT_EQ(expected[(y * xsize + x) * num_channels + c],
+                        channel.Row(y)[x])
+                  << "type " << t << " endianness " << endianness
+                  << " channels " << num_channels << " c " << c;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(ExternalImageTest, ConvertToXYBMatchesToXYB) {
+  ThreadPoolInternal pool(4);
+  Rng rng(0);
+  const size_t xsize = 67;
+  const size_t ysize = 19;
+  for (uint32_t num_channels : {3u, 4u}) {
+    for (JxlDataType data_type : {JXL_TYPE_UINT8, JXL_TYPE_UINT16}) {
+      const size_t bits_per_sample = data_type == JXL_TYPE_UINT8 ? 8 : 16;
+      JxlPixelFormat format = {num_channels, data_type, JXL_BIG_ENDIAN, 0};
+      std::vector<uint8_t> bytes(xsize * ysize * num_channels *
+                                 bits_per_sample / kBitsPerByte);
+      RandomExternalSamples(format, bits_per_sample,
+                            xsize * ysize * num_channels, &rng, &bytes);
+      const Span<const uint8_t> span(bytes.data(), bytes.size());
+
+      ImageMetadata im;
+      im.SetAlphaBits(8);
+      ImageBundle ib(&im);
+      ASSERT_TRUE(ConvertFromExternal(span, xsize, ysize, ColorEncoding::SRGB(),
+                                      /*alpha_is_premultiplied=*/false,
+                                      bits_per_sample, format, &pool, &ib));
+      Image3F expected(xsize, ysize);
+      (void)ToXYB(ib, &pool, &expected, GetJxlCms());
+
+      ImageBundle xyb(&im);
+      ASSERT_TRUE(ConvertFromExternalToXYB(
+          span, xsize, ysize, ColorEncoding::SRGB(),
+          /*alpha_is_premultiplied=*/false, bits_per_sample, format, &pool,
+          &xyb));
+      VerifyEqual(expected, *xyb.color());
+      VerifyEqual(*ib.alpha(), *xyb.alpha());
+    }
+  }
+}
+
+#if !defined(JXL_CRASH_ON_ERROR)
+TEST(ExternalImageTest, ConvertToXYBRequiresSRGB) {
+  ImageMetadata im;
+  ImageBundle ib(&im);
+  const size_t xsize = 10;
+  const size_t ysize = 20;
+  const uint8_t buf[xsize * ysize * 3] = {};
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  EXPECT_FALSE(ConvertFromExternalToXYB(
+      Span<const uint8_t>(buf, sizeof(buf)), xsize, ysize,
+      /*c_current=*/ColorEncoding::LinearSRGB(),
+      /*alpha_is_premultiplied=*/false, /*bits_per_sample=*/8, format, nullptr,
+      &ib));
+  EXPECT_TRUE(ConvertFromExternalToXYB(
+      Span<const uint8_t>(buf, sizeof(buf)), xsize, ysize,
+      /*c_current=*/ColorEncoding::SRGB(),
+      /*alpha_is_premultiplied=*/false, /*bits_per_sample=*/8, format, nullptr,
+      &ib));
+}
+#endif
+
 }  // namespace
 }  // namespace jxl
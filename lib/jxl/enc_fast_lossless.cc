@@ -3,7 +3,9 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
-#include "fast_lossless.h"
+#ifndef FJXL_SELF_INCLUDE
+
+#include "lib/jxl/enc_fast_lossless.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -12,21 +14,76 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <memory>
 #include <queue>
 #include <vector>
 
-#if (!defined(__BYTE_ORDER__) || (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__))
-#error "system not known to be little endian"
+// The prediction, tokenization and prefix coding loops are compiled once for
+// each SIMD target below, in the same way as Highway's foreach_target.h: this
+// file includes itself with FJXL_SELF_INCLUDE defined, inside a namespace per
+// target and with the target's instruction sets enabled for all the functions
+// it defines. JxlFastLosslessPrepareFrame then picks the best target the CPU
+// supports, so that no -m flags are needed. The AVX2 and AVX-512 targets can
+// be left out by defining FJXL_ENABLE_AVX2=0 or FJXL_ENABLE_AVX512=0.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && \
+    !defined(_MSC_VER)
+#define FJXL_HAVE_X86_DISPATCH 1
+#else
+#define FJXL_HAVE_X86_DISPATCH 0
 #endif
 
+#if !defined(FJXL_ENABLE_AVX2)
+#define FJXL_ENABLE_AVX2 FJXL_HAVE_X86_DISPATCH
+#endif
+#if !defined(FJXL_ENABLE_AVX512)
+#define FJXL_ENABLE_AVX512 FJXL_HAVE_X86_DISPATCH
+#endif
+
+// NEON is part of the aarch64 baseline, so it replaces the scalar target when
+// enabled at compile time.
+#if defined(FASTLL_ENABLE_NEON_INTRINSICS) && FASTLL_ENABLE_NEON_INTRINSICS
+#define FJXL_ENABLE_NEON 1
+#else
+#define FJXL_ENABLE_NEON 0
+#endif
+
+#if FJXL_ENABLE_AVX2 || FJXL_ENABLE_AVX512
+#include <immintrin.h>
+#endif
+#if FJXL_ENABLE_NEON
+#include <arm_neon.h>
+#endif
+
+// The encoder reads 16-bit samples and writes the bitstream assuming a
+// little-endian system; elsewhere JxlFastLosslessPrepareFrame returns NULL and
+// libjxl uses its regular encoder instead.
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define FJXL_LITTLE_ENDIAN 1
+#else
+#define FJXL_LITTLE_ENDIAN 0
+#endif
+
+#if FJXL_LITTLE_ENDIAN
+
 namespace {
 
 struct BitWriter {
   void Allocate(size_t maximum_bit_size) {
     assert(data == nullptr);
     // Leave some padding.
-    data.reset((uint8_t*)malloc(maximum_bit_size / 8 + 32));
+    data.reset((uint8_t*)malloc(MaxBytes(maximum_bit_size)));
+  }
+
+  // Writes to a caller-owned buffer of at least MaxBytes(maximum_bit_size)
+  // bytes instead.
+  void Wrap(uint8_t* output) {
+    assert(data == nullptr);
+    data = {output, [](void*) {}};
+  }
+
+  static size_t MaxBytes(size_t maximum_bit_size) {
+    return maximum_bit_size / 8 + 32;
   }
 
   void Write(uint32_t count, uint64_t bits) {
@@ -39,6 +96,32 @@ struct BitWriter {
     bytes_written += bytes_in_buffer;
   }
 
+  // Writes bits[i] with nbits[i] <= 64 for all i in [0, n). Used by the SIMD
+  // code paths, whose lanes can hold more than the 56 bits Write() supports.
+  // Trying to SIMD-fy this code results in slower speed (and definitely less
+  // clarity).
+  void WriteMultiple(const uint64_t* nbits, const uint64_t* bits, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      buffer |= bits[i] << bits_in_buffer;
+      memcpy(data.get() + bytes_written, &buffer, 8);
+      // bits[i] >> (64 - bits_in_buffer), but also defined (and 0) if
+      // bits_in_buffer is 0.
+      uint64_t next_buffer = (bits[i] >> 1) >> (63 - bits_in_buffer);
+      bits_in_buffer += nbits[i];
+      // This `if` seems to be faster than using ternaries.
+      if (bits_in_buffer >= 64) {
+        buffer = next_buffer;
+        bits_in_buffer -= 64;
+        bytes_written += 8;
+      }
+    }
+    memcpy(data.get() + bytes_written, &buffer, 8);
+    size_t bytes_in_buffer = bits_in_buffer / 8;
+    bits_in_buffer -= bytes_in_buffer * 8;
+    buffer >>= bytes_in_buffer * 8;
+    bytes_written += bytes_in_buffer;
+  }
+
   void ZeroPadToByte() {
     if (bits_in_buffer != 0) {
       Write(8 - bits_in_buffer, 0);
@@ -263,9 +346,14 @@ struct PrefixCode {
 
 constexpr size_t kChunkSize = 16;
 
+// Floor of log2(value), or 0 if value is 0; __builtin_clz(0) is undefined.
+inline uint32_t FloorLog2(uint32_t value) {
+  return 31 - __builtin_clz(value | 1);
+}
+
 void EncodeHybridUint000(uint32_t value, uint32_t* token, uint32_t* nbits,
                          uint32_t* bits) {
-  uint32_t n = 31 - __builtin_clz(value);
+  uint32_t n = FloorLog2(value);
   *token = value ? n + 1 : 0;
   *nbits = value ? n : 0;
   *bits = value ? value - (1 << n) : 0;
@@ -273,8 +361,11 @@ void EncodeHybridUint000(uint32_t value, uint32_t* token, uint32_t* nbits,
 
 void AppendWriter(BitWriter* dest, const BitWriter* src) {
   if (dest->bits_in_buffer == 0) {
-    memcpy(dest->data.get() + dest->bytes_written, src->data.get(),
-           src->bytes_written);
+    // src->data is null if nothing was written to it.
+    if (src->bytes_written != 0) {
+      memcpy(dest->data.get() + dest->bytes_written, src->data.get(),
+             src->bytes_written);
+    }
     dest->bytes_written += src->bytes_written;
   } else {
     size_t i = 0;
@@ -298,24 +389,26 @@ void AppendWriter(BitWriter* dest, const BitWriter* src) {
   dest->Write(src->bits_in_buffer, src->buffer);
 }
 
-void AssembleFrame(size_t width, size_t height, size_t nb_chans,
-                   size_t bitdepth,
-                   const std::vector<std::array<BitWriter, 4>>& group_data,
-                   BitWriter* output) {
+size_t GroupSize(const std::array<BitWriter, 4>& group, size_t nb_chans) {
+  size_t sz = 0;
+  for (size_t j = 0; j < nb_chans; j++) {
+    sz += group[j].bytes_written * 8 + group[j].bits_in_buffer;
+  }
+  return (sz + 7) / 8;
+}
+
+// Upper bound on the size in bits of a frame and its image header.
+size_t MaxFrameBits(size_t nb_chans,
+                    const std::vector<std::array<BitWriter, 4>>& group_data) {
   size_t total_size_groups = 0;
-  std::vector<size_t> group_sizes(group_data.size());
   for (size_t i = 0; i < group_data.size(); i++) {
-    size_t sz = 0;
-    for (size_t j = 0; j < nb_chans; j++) {
-      const auto& writer = group_data[i][j];
-      sz += writer.bytes_written * 8 + writer.bits_in_buffer;
-    }
-    sz = (sz + 7) / 8;
-    group_sizes[i] = sz;
-    total_size_groups += sz * 8;
+    total_size_groups += GroupSize(group_data[i], nb_chans) * 8;
   }
-  output->Allocate(1000 + group_data.size() * 32 + total_size_groups);
+  return 1000 + group_data.size() * 32 + total_size_groups;
+}
 
+void WriteImageHeader(size_t width, size_t height, size_t nb_chans,
+                      size_t bitdepth, BitWriter* output) {
   // Signature
   output->Write(16, 0x0AFF);
 
@@ -387,22 +480,12 @@ void AssembleFrame(size_t width, size_t height, size_t nb_chans,
 
   // No ICC, no preview. Frame should start at byte boundery.
   output->ZeroPadToByte();
+}
 
-  auto wsz_fh = [output](size_t size) {
-    if (size < (1 << 8)) {
-      output->Write(2, 0b00);
-      output->Write(8, size);
-    } else if (size - 256 < (1 << 11)) {
-      output->Write(2, 0b01);
-      output->Write(11, size - 256);
-    } else if (size - 2304 < (1 << 14)) {
-      output->Write(2, 0b10);
-      output->Write(14, size - 2304);
-    } else {
-      output->Write(2, 0b11);
-      output->Write(30, size - 18688);
-    }
-  };
+void AssembleFrame(size_t width, size_t height, size_t nb_chans,
+                   const std::vector<std::array<BitWriter, 4>>& group_data,
+                   bool is_last, BitWriter* output) {
+  bool have_alpha = (nb_chans == 2 || nb_chans == 4);
 
   // Handcrafted frame header.
   output->Write(1, 0);     // all_default
@@ -416,21 +499,18 @@ void AssembleFrame(size_t width, size_t height, size_t nb_chans,
   }
   output->Write(2, 0b01);  // default group size
   output->Write(2, 0b00);  // exactly one pass
-  if (width % kChunkSize == 0) {
-    output->Write(1, 0);  // no custom size or origin
-  } else {
-    output->Write(1, 1);  // custom size
-    wsz_fh(0);            // x0 = 0
-    wsz_fh(0);            // y0 = 0
-    wsz_fh((width + kChunkSize - 1) / kChunkSize *
-           kChunkSize);  // xsize rounded up to chunk size
-    wsz_fh(height);      // ysize same
-  }
+  output->Write(1, 0);     // no custom size or origin
   output->Write(2, 0b00);  // kReplace blending mode
   if (have_alpha) {
     output->Write(2, 0b00);  // kReplace blending mode for alpha channel
   }
-  output->Write(1, 1);     // is_last
+  if (is_last) {
+    output->Write(1, 1);  // is_last
+  } else {
+    output->Write(1, 0);     // not is_last
+    output->Write(2, 0b00);  // save_as_reference = 0
+    output->Write(1, 0);     // save after color transform
+  }
   output->Write(2, 0b00);  // a frame has no name
   output->Write(1, 0);     // loop filter is not all_default
   output->Write(1, 0);     // no gaborish
@@ -441,7 +521,7 @@ void AssembleFrame(size_t width, size_t height, size_t nb_chans,
   output->Write(1, 0);      // No TOC permutation
   output->ZeroPadToByte();  // TOC is byte-aligned.
   for (size_t i = 0; i < group_data.size(); i++) {
-    size_t sz = group_sizes[i];
+    size_t sz = GroupSize(group_data[i], nb_chans);
     if (sz < (1 << 10)) {
       output->Write(2, 0b00);
       output->Write(10, sz);
@@ -540,16 +620,295 @@ void PrepareDCGlobal(bool is_single_group, size_t width, size_t height,
 void EncodeHybridUint404_Mul16(uint32_t value, uint32_t* token_div16,
                                uint32_t* nbits, uint32_t* bits) {
   // NOTE: token in libjxl is actually << 4.
-  uint32_t n = 31 - __builtin_clz(value);
+  uint32_t n = FloorLog2(value);
   *token_div16 = value < 16 ? 0 : n - 3;
   *nbits = value < 16 ? 0 : n - 4;
   *bits = value < 16 ? 0 : (value >> 4) - (1 << *nbits);
 }
 
-#ifdef FASTLL_ENABLE_AVX2_INTRINSICS
-#include <immintrin.h>
-void EncodeChunk(const uint16_t* residuals, const PrefixCode& prefix_code,
-                 BitWriter& output) {
+constexpr uint16_t PackSigned(int16_t value) {
+  return (static_cast<uint16_t>(value) << 1) ^
+         ((static_cast<uint16_t>(~value) >> 15) - 1);
+}
+
+constexpr int kHashExp = 16;
+constexpr uint32_t kHashSize = 1 << kHashExp;
+constexpr uint32_t kHashMultiplier = 2654435761;
+constexpr int kMaxColors = 512;
+
+// can be any function that returns a value in 0 .. kHashSize-1
+// has to map 0 to 0
+inline uint32_t pixel_hash(uint32_t p) {
+  return (p * kHashMultiplier) >> (32 - kHashExp);
+}
+
+// Calls fun(i) for all i in [0, count) on the runner, or with OpenMP if there
+// is no runner.
+template <typename Fun>
+void RunOnRunner(void* runner_opaque, FJxlParallelRunner* runner, size_t count,
+                 const Fun& fun) {
+  if (runner == nullptr) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (size_t i = 0; i < count; i++) {
+      fun(i);
+    }
+    return;
+  }
+  runner(
+      runner_opaque, const_cast<void*>(static_cast<const void*>(&fun)),
+      [](void* opaque, size_t i) { (*static_cast<const Fun*>(opaque))(i); },
+      count);
+}
+
+}  // namespace
+
+struct JxlFastLosslessFrameState {
+  size_t width;
+  size_t height;
+  size_t nb_chans;
+  size_t bitdepth;
+  std::vector<std::array<BitWriter, 4>> group_data;
+};
+
+#define FJXL_SELF_INCLUDE
+
+namespace {
+
+#if FJXL_ENABLE_AVX512
+#if defined(__clang__)
+#pragma clang attribute push(                                             \
+    __attribute__((target("avx512f,avx512bw,avx512vl,avx512cd,avx2"))), \
+    apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512vl,avx512cd,avx2")
+// Some GCC versions warn about _mm512_undefined_epi32 in the intrinsics.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+namespace AVX512 {
+#define FJXL_AVX512 1
+#include "lib/jxl/enc_fast_lossless.cc"
+#undef FJXL_AVX512
+}  // namespace AVX512
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+#endif  // FJXL_ENABLE_AVX512
+
+#if FJXL_ENABLE_AVX2
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), \
+                             apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace AVX2 {
+#define FJXL_AVX2 1
+#include "lib/jxl/enc_fast_lossless.cc"
+#undef FJXL_AVX2
+}  // namespace AVX2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif  // FJXL_ENABLE_AVX2
+
+// Scalar, or NEON if enabled.
+namespace default_implementation {
+#if FJXL_ENABLE_NEON
+#define FJXL_NEON 1
+#endif
+#include "lib/jxl/enc_fast_lossless.cc"
+#undef FJXL_NEON
+}  // namespace default_implementation
+
+}  // namespace
+
+#undef FJXL_SELF_INCLUDE
+
+namespace {
+
+constexpr int kDefaultTarget = FJXL_ENABLE_NEON
+                                   ? JXL_FAST_LOSSLESS_TARGET_NEON
+                                   : JXL_FAST_LOSSLESS_TARGET_SCALAR;
+
+int DetectTargets() {
+  int targets = kDefaultTarget;
+#if FJXL_ENABLE_AVX2 || FJXL_ENABLE_AVX512
+  __builtin_cpu_init();
+#endif
+#if FJXL_ENABLE_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    targets |= JXL_FAST_LOSSLESS_TARGET_AVX2;
+  }
+#endif
+#if FJXL_ENABLE_AVX512
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vl") &&
+      __builtin_cpu_supports("avx512cd")) {
+    targets |= JXL_FAST_LOSSLESS_TARGET_AVX512;
+  }
+#endif
+  return targets;
+}
+
+// Set by JxlFastLosslessSetTargetsForTest, 0 if not restricted.
+std::atomic<int> allowed_targets{0};
+
+// Returns the best supported target that is allowed.
+int ChooseTarget() {
+  int targets = JxlFastLosslessSupportedTargets();
+  int allowed = allowed_targets.load(std::memory_order_relaxed);
+  if (allowed != 0) targets &= allowed;
+  if (targets & JXL_FAST_LOSSLESS_TARGET_AVX512) {
+    return JXL_FAST_LOSSLESS_TARGET_AVX512;
+  }
+  if (targets & JXL_FAST_LOSSLESS_TARGET_AVX2) {
+    return JXL_FAST_LOSSLESS_TARGET_AVX2;
+  }
+  return kDefaultTarget;
+}
+
+}  // namespace
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+JxlFastLosslessFrameState* JxlFastLosslessPrepareFrame(
+    const unsigned char* rgba, size_t width, size_t stride, size_t height,
+    size_t nb_chans, size_t bitdepth, int big_endian, int effort,
+    void* runner_opaque, FJxlParallelRunner runner) {
+  assert(bitdepth <= 12);
+  assert(bitdepth > 0);
+  assert(nb_chans <= 4);
+  assert(nb_chans != 0);
+  switch (ChooseTarget()) {
+#if FJXL_ENABLE_AVX512
+    case JXL_FAST_LOSSLESS_TARGET_AVX512:
+      return AVX512::PrepareFrame(rgba, width, stride, height, nb_chans,
+                                  bitdepth, big_endian, effort, runner_opaque,
+                                  runner);
+#endif
+#if FJXL_ENABLE_AVX2
+    case JXL_FAST_LOSSLESS_TARGET_AVX2:
+      return AVX2::PrepareFrame(rgba, width, stride, height, nb_chans,
+                                bitdepth, big_endian, effort, runner_opaque,
+                                runner);
+#endif
+    default:
+      return default_implementation::PrepareFrame(
+          rgba, width, stride, height, nb_chans, bitdepth, big_endian, effort,
+          runner_opaque, runner);
+  }
+}
+
+int JxlFastLosslessSupportedTargets(void) {
+  static const int targets = DetectTargets();
+  return targets;
+}
+
+void JxlFastLosslessSetTargetsForTest(int targets) {
+  allowed_targets.store(targets, std::memory_order_relaxed);
+}
+
+size_t JxlFastLosslessMaxRequiredOutput(
+    const JxlFastLosslessFrameState* frame) {
+  return BitWriter::MaxBytes(MaxFrameBits(frame->nb_chans, frame->group_data));
+}
+
+size_t JxlFastLosslessWriteFrame(const JxlFastLosslessFrameState* frame,
+                                 int add_image_header, int is_last,
+                                 unsigned char* output) {
+  BitWriter writer;
+  writer.Wrap(output);
+  if (add_image_header) {
+    WriteImageHeader(frame->width, frame->height, frame->nb_chans,
+                     frame->bitdepth, &writer);
+  }
+  AssembleFrame(frame->width, frame->height, frame->nb_chans,
+                frame->group_data, is_last, &writer);
+  return writer.bytes_written;
+}
+
+void JxlFastLosslessFreeFrameState(JxlFastLosslessFrameState* frame) {
+  delete frame;
+}
+
+#else  // FJXL_LITTLE_ENDIAN
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+JxlFastLosslessFrameState* JxlFastLosslessPrepareFrame(
+    const unsigned char* rgba, size_t width, size_t stride, size_t height,
+    size_t nb_chans, size_t bitdepth, int big_endian, int effort,
+    void* runner_opaque, FJxlParallelRunner runner) {
+  return nullptr;
+}
+
+int JxlFastLosslessSupportedTargets(void) { return 0; }
+
+void JxlFastLosslessSetTargetsForTest(int targets) {}
+
+size_t JxlFastLosslessMaxRequiredOutput(
+    const JxlFastLosslessFrameState* frame) {
+  return 0;
+}
+
+size_t JxlFastLosslessWriteFrame(const JxlFastLosslessFrameState* frame,
+                                 int add_image_header, int is_last,
+                                 unsigned char* output) {
+  return 0;
+}
+
+void JxlFastLosslessFreeFrameState(JxlFastLosslessFrameState* frame) {}
+
+#endif  // FJXL_LITTLE_ENDIAN
+
+size_t JxlFastLosslessEncode(const unsigned char* rgba, size_t width,
+                             size_t stride, size_t height, size_t nb_chans,
+                             size_t bitdepth, int big_endian, int effort,
+                             unsigned char** output, void* runner_opaque,
+                             FJxlParallelRunner runner) {
+  JxlFastLosslessFrameState* frame = JxlFastLosslessPrepareFrame(
+      rgba, width, stride, height, nb_chans, bitdepth, big_endian, effort,
+      runner_opaque, runner);
+  if (frame == nullptr) {
+    *output = nullptr;
+    return 0;
+  }
+  *output = (unsigned char*)malloc(JxlFastLosslessMaxRequiredOutput(frame));
+  size_t size = JxlFastLosslessWriteFrame(frame, /*add_image_header=*/1,
+                                          /*is_last=*/1, *output);
+  JxlFastLosslessFreeFrameState(frame);
+  return size;
+}
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#else  // FJXL_SELF_INCLUDE
+
+// Code compiled for each target, see above. FJXL_AVX512, FJXL_AVX2 or
+// FJXL_NEON is defined to 1 for the SIMD targets.
+
+#ifdef FJXL_AVX2
+// Encodes a chunk of residuals of 8-bit input, whose codes fit in 16 bits.
+void EncodeChunkAVX2(const uint16_t* residuals, const PrefixCode& prefix_code,
+                     BitWriter& output) {
   static_assert(kChunkSize == 16, "Chunk size must be 16");
   auto value = _mm256_load_si256((__m256i*)residuals);
 
@@ -643,36 +1002,191 @@ void EncodeChunk(const uint16_t* residuals, const PrefixCode& prefix_code,
   _mm256_store_si256((__m256i*)nbits_simd, nbits);
   _mm256_store_si256((__m256i*)bits_simd, bits);
 
-  // Manually merge the buffer bits with the SIMD bits.
-  // Necessary because Write() is only guaranteed to work with <=56 bits.
-  // Trying to SIMD-fy this code results in slower speed (and definitely less
-  // clarity).
-  {
-    for (size_t i = 0; i < 4; i++) {
-      output.buffer |= bits_simd[i] << output.bits_in_buffer;
-      memcpy(output.data.get() + output.bytes_written, &output.buffer, 8);
-      // If >> 64, next_buffer is unused.
-      uint64_t next_buffer = bits_simd[i] >> (64 - output.bits_in_buffer);
-      output.bits_in_buffer += nbits_simd[i];
-      // This `if` seems to be faster than using ternaries.
-      if (output.bits_in_buffer >= 64) {
-        output.buffer = next_buffer;
-        output.bits_in_buffer -= 64;
-        output.bytes_written += 8;
-      }
-    }
-    memcpy(output.data.get() + output.bytes_written, &output.buffer, 8);
-    size_t bytes_in_buffer = output.bits_in_buffer / 8;
-    output.bits_in_buffer -= bytes_in_buffer * 8;
-    output.buffer >>= bytes_in_buffer * 8;
-    output.bytes_written += bytes_in_buffer;
+  output.WriteMultiple(nbits_simd, bits_simd, 4);
+}
+#endif
+
+#if defined(FJXL_AVX2) || defined(FJXL_AVX512)
+// Computes the gradient / clamped gradient residuals of a chunk and returns
+// whether they are all equal to last.
+inline bool PredictChunk(const int16_t* row, const int16_t* row_left,
+                         const int16_t* row_top, const int16_t* row_topleft,
+                         uint16_t last, uint16_t* residuals) {
+  auto px = _mm256_loadu_si256((const __m256i*)row);
+  auto left = _mm256_loadu_si256((const __m256i*)row_left);
+  auto top = _mm256_loadu_si256((const __m256i*)row_top);
+  auto topleft = _mm256_loadu_si256((const __m256i*)row_topleft);
+  auto ac = _mm256_sub_epi16(left, topleft);
+  auto ab = _mm256_sub_epi16(left, top);
+  auto bc = _mm256_sub_epi16(top, topleft);
+  auto grad = _mm256_add_epi16(ac, top);
+  auto d = _mm256_xor_si256(ab, bc);
+  auto clamp = _mm256_blendv_epi8(left, top, _mm256_srai_epi16(d, 15));
+  auto s = _mm256_xor_si256(ac, bc);
+  auto pred = _mm256_blendv_epi8(clamp, grad, _mm256_srai_epi16(s, 15));
+  auto res = _mm256_sub_epi16(px, pred);
+  // PackSigned.
+  res = _mm256_xor_si256(_mm256_slli_epi16(res, 1), _mm256_srai_epi16(res, 15));
+  _mm256_store_si256((__m256i*)residuals, res);
+  auto eq = _mm256_cmpeq_epi16(res, _mm256_set1_epi16(last));
+  return _mm256_movemask_epi8(eq) == -1;
+}
+#endif
+
+#ifdef FJXL_AVX2
+// Stores the hybrid uint tokens of a chunk of residuals.
+inline void TokenizeChunk(const uint16_t* residuals, uint32_t* tokens) {
+  for (size_t i = 0; i < kChunkSize; i += 8) {
+    // Bit length of the residual, from the exponent of the float.
+    auto value = _mm256_cvtepu16_epi32(
+        _mm_load_si128((const __m128i*)(residuals + i)));
+    auto exponent = _mm256_srli_epi32(
+        _mm256_castps_si256(_mm256_cvtepi32_ps(value)), 23);
+    auto token = _mm256_max_epi32(
+        _mm256_sub_epi32(exponent, _mm256_set1_epi32(126)),
+        _mm256_setzero_si256());
+    _mm256_storeu_si256((__m256i*)(tokens + i), token);
   }
 }
 #endif
 
-#ifdef FASTLL_ENABLE_NEON_INTRINSICS
-#include <arm_neon.h>
+#ifdef FJXL_AVX512
+// Encodes a chunk of residuals. 32-bit lanes leave enough room for residuals
+// of 12-bit input too.
+template <size_t bytedepth>
+void EncodeChunkAVX512(const uint16_t* residuals, const PrefixCode& code,
+                       BitWriter& output) {
+  const __m512i one = _mm512_set1_epi32(1);
+  auto value =
+      _mm512_cvtepu16_epi32(_mm256_load_si256((const __m256i*)residuals));
+  auto token =
+      _mm512_sub_epi32(_mm512_set1_epi32(32), _mm512_lzcnt_epi32(value));
+  auto nbits = _mm512_max_epi32(_mm512_sub_epi32(token, one),
+                                _mm512_setzero_si512());
+  auto bits = _mm512_and_si512(
+      value, _mm512_sub_epi32(_mm512_sllv_epi32(one, nbits), one));
+
+  auto huff_nbits = _mm512_permutexvar_epi32(
+      token,
+      _mm512_cvtepu8_epi32(_mm_load_si128((const __m128i*)code.raw_nbits)));
+  auto huff_bits = _mm512_permutexvar_epi32(
+      token,
+      _mm512_cvtepu8_epi32(_mm_load_si128((const __m128i*)code.raw_bits)));
+  bits = _mm512_or_si512(_mm512_sllv_epi32(bits, huff_nbits), huff_bits);
+  nbits = _mm512_add_epi32(nbits, huff_nbits);
+
+  // Merge 32 -> 64 bit lanes.
+  auto lo32 = _mm512_set1_epi64(0xFFFFFFFF);
+  auto nbits_lo32 = _mm512_and_si512(nbits, lo32);
+  nbits = _mm512_add_epi64(_mm512_srli_epi64(nbits, 32), nbits_lo32);
+  bits = _mm512_or_si512(
+      _mm512_sllv_epi64(_mm512_srli_epi64(bits, 32), nbits_lo32),
+      _mm512_and_si512(bits, lo32));
+
+  if (bytedepth == 1) {
+    // Residuals have at most 10 bits and codes at most 7 bits, so 4 of them
+    // fit in 64 bits: merge even and odd 64-bit lanes as well.
+    auto even = _mm512_setr_epi64(0, 2, 4, 6, 0, 0, 0, 0);
+    auto odd = _mm512_setr_epi64(1, 3, 5, 7, 0, 0, 0, 0);
+    auto nbits_even =
+        _mm512_castsi512_si256(_mm512_permutexvar_epi64(even, nbits));
+    auto nbits_odd =
+        _mm512_castsi512_si256(_mm512_permutexvar_epi64(odd, nbits));
+    auto bits_even =
+        _mm512_castsi512_si256(_mm512_permutexvar_epi64(even, bits));
+    auto bits_odd = _mm512_castsi512_si256(_mm512_permutexvar_epi64(odd, bits));
+    alignas(32) uint64_t nbits_simd[4];
+    alignas(32) uint64_t bits_simd[4];
+    _mm256_store_si256((__m256i*)nbits_simd,
+                       _mm256_add_epi64(nbits_even, nbits_odd));
+    _mm256_store_si256(
+        (__m256i*)bits_simd,
+        _mm256_or_si256(bits_even, _mm256_sllv_epi64(bits_odd, nbits_even)));
+    output.WriteMultiple(nbits_simd, bits_simd, 4);
+  } else {
+    alignas(64) uint64_t nbits_simd[8];
+    alignas(64) uint64_t bits_simd[8];
+    _mm512_store_si512((__m512i*)nbits_simd, nbits);
+    _mm512_store_si512((__m512i*)bits_simd, bits);
+    output.WriteMultiple(nbits_simd, bits_simd, 8);
+  }
+}
+
+// Computes the residuals of two chunks like PredictChunk, and returns a mask of
+// the residuals that are equal to the previous one, or to last for the first.
+inline uint32_t PredictChunkPair(const int16_t* row, const int16_t* row_left,
+                                 const int16_t* row_top,
+                                 const int16_t* row_topleft, uint16_t last,
+                                 uint16_t* residuals) {
+  auto px = _mm512_loadu_si512((const void*)row);
+  auto left = _mm512_loadu_si512((const void*)row_left);
+  auto top = _mm512_loadu_si512((const void*)row_top);
+  auto topleft = _mm512_loadu_si512((const void*)row_topleft);
+  auto ac = _mm512_sub_epi16(left, topleft);
+  auto ab = _mm512_sub_epi16(left, top);
+  auto bc = _mm512_sub_epi16(top, topleft);
+  auto grad = _mm512_add_epi16(ac, top);
+  auto d = _mm512_xor_si512(ab, bc);
+  auto clamp = _mm512_mask_blend_epi16(_mm512_movepi16_mask(d), left, top);
+  auto s = _mm512_xor_si512(ac, bc);
+  auto pred = _mm512_mask_blend_epi16(_mm512_movepi16_mask(s), clamp, grad);
+  auto res = _mm512_sub_epi16(px, pred);
+  // PackSigned.
+  res = _mm512_xor_si512(_mm512_slli_epi16(res, 1), _mm512_srai_epi16(res, 15));
+  _mm512_store_si512((__m512i*)residuals, res);
+  // Lane i of previous is residual i - 1, lane 0 is last.
+  alignas(64) static const uint16_t kPrevious[2 * kChunkSize] = {
+      32, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14,
+      15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30};
+  auto previous = _mm512_permutex2var_epi16(
+      res, _mm512_load_si512((const void*)kPrevious), _mm512_set1_epi16(last));
+  return _mm512_cmpeq_epi16_mask(res, previous);
+}
 
+// Stores the hybrid uint tokens of a chunk of residuals.
+inline void TokenizeChunk(const uint16_t* residuals, uint32_t* tokens) {
+  auto value =
+      _mm512_cvtepu16_epi32(_mm256_load_si256((const __m256i*)residuals));
+  _mm512_storeu_si512(
+      (void*)tokens,
+      _mm512_sub_epi32(_mm512_set1_epi32(32), _mm512_lzcnt_epi32(value)));
+}
+#endif
+
+#if !defined(FJXL_AVX2) && !defined(FJXL_AVX512)
+inline bool PredictChunk(const int16_t* row, const int16_t* row_left,
+                         const int16_t* row_top, const int16_t* row_topleft,
+                         uint16_t last, uint16_t* residuals) {
+  bool continue_rle = true;
+  for (size_t ix = 0; ix < kChunkSize; ix++) {
+    int16_t px = row[ix];
+    int16_t left = row_left[ix];
+    int16_t top = row_top[ix];
+    int16_t topleft = row_topleft[ix];
+    int16_t ac = left - topleft;
+    int16_t ab = left - top;
+    int16_t bc = top - topleft;
+    int16_t grad = static_cast<int16_t>(static_cast<uint16_t>(ac) +
+                                        static_cast<uint16_t>(top));
+    int16_t d = ab ^ bc;
+    int16_t clamp = d < 0 ? top : left;
+    int16_t s = ac ^ bc;
+    int16_t pred = s < 0 ? grad : clamp;
+    residuals[ix] = PackSigned(px - pred);
+    continue_rle &= residuals[ix] == last;
+  }
+  return continue_rle;
+}
+
+inline void TokenizeChunk(const uint16_t* residuals, uint32_t* tokens) {
+  for (size_t ix = 0; ix < kChunkSize; ix++) {
+    unsigned nbits, bits;
+    EncodeHybridUint000(residuals[ix], &tokens[ix], &nbits, &bits);
+  }
+}
+#endif
+
+#ifdef FJXL_NEON
 void EncodeChunk(const uint16_t* residuals, const PrefixCode& code,
                  BitWriter& output) {
   uint16x8_t res = vld1q_u16(residuals);
@@ -725,12 +1239,15 @@ struct ChunkEncoder {
 
   inline void Chunk(size_t run, uint16_t* residuals) {
     EncodeRle(run, *code, *output);
-#if defined(FASTLL_ENABLE_AVX2_INTRINSICS) && FASTLL_ENABLE_AVX2_INTRINSICS
+#if defined(FJXL_AVX512)
+    EncodeChunkAVX512<bytedepth>(residuals, *code, *output);
+    return;
+#elif defined(FJXL_AVX2)
     if (bytedepth == 1) {
-      EncodeChunk(residuals, *code, *output);
+      EncodeChunkAVX2(residuals, *code, *output);
       return;
     }
-#elif defined(FASTLL_ENABLE_NEON_INTRINSICS) && FASTLL_ENABLE_NEON_INTRINSICS
+#elif defined(FJXL_NEON)
     if (bytedepth == 1) {
       EncodeChunk(residuals, *code, *output);
       if (kChunkSize > 8) {
@@ -739,7 +1256,12 @@ struct ChunkEncoder {
       return;
     }
 #endif
-    for (size_t ix = 0; ix < kChunkSize; ix++) {
+    PartialChunk(/*run=*/0, residuals, kChunkSize);
+  }
+
+  inline void PartialChunk(size_t run, const uint16_t* residuals, size_t n) {
+    EncodeRle(run, *code, *output);
+    for (size_t ix = 0; ix < n; ix++) {
       unsigned token, nbits, bits;
       EncodeHybridUint000(residuals[ix], &token, &nbits, &bits);
       output->Write(code->raw_nbits[token] + nbits,
@@ -763,12 +1285,16 @@ struct ChunkSampleCollector {
   }
 
   inline void Chunk(size_t run, uint16_t* residuals) {
+    PartialChunk(run, residuals, kChunkSize);
+  }
+
+  inline void PartialChunk(size_t run, const uint16_t* residuals, size_t n) {
     // Run is broken. Encode the run and encode the individual vector.
     Rle(run, lz77_counts);
-    for (size_t ix = 0; ix < kChunkSize; ix++) {
-      unsigned token, nbits, bits;
-      EncodeHybridUint000(residuals[ix], &token, &nbits, &bits);
-      raw_counts[token]++;
+    alignas(64) uint32_t tokens[kChunkSize];
+    TokenizeChunk(residuals, tokens);
+    for (size_t ix = 0; ix < n; ix++) {
+      raw_counts[tokens[ix]]++;
     }
   }
 
@@ -779,35 +1305,17 @@ struct ChunkSampleCollector {
   uint64_t* lz77_counts;
 };
 
-constexpr uint16_t PackSigned(int16_t value) {
-  return (static_cast<uint16_t>(value) << 1) ^
-         ((static_cast<uint16_t>(~value) >> 15) - 1);
-}
-
 template <typename T>
 struct ChannelRowProcessor {
   T* t;
   inline void ProcessChunk(const int16_t* row, const int16_t* row_left,
                            const int16_t* row_top, const int16_t* row_topleft) {
-    bool continue_rle = true;
     alignas(32) uint16_t residuals[kChunkSize] = {};
-    for (size_t ix = 0; ix < kChunkSize; ix++) {
-      int16_t px = row[ix];
-      int16_t left = row_left[ix];
-      int16_t top = row_top[ix];
-      int16_t topleft = row_topleft[ix];
-      int16_t ac = left - topleft;
-      int16_t ab = left - top;
-      int16_t bc = top - topleft;
-      int16_t grad = static_cast<int16_t>(static_cast<uint16_t>(ac) +
-                                          static_cast<uint16_t>(top));
-      int16_t d = ab ^ bc;
-      int16_t clamp = d < 0 ? top : left;
-      int16_t s = ac ^ bc;
-      int16_t pred = s < 0 ? grad : clamp;
-      residuals[ix] = PackSigned(px - pred);
-      continue_rle &= residuals[ix] == last;
-    }
+    bool continue_rle =
+        PredictChunk(row, row_left, row_top, row_topleft, last, residuals);
+    ProcessResiduals(continue_rle, residuals);
+  }
+  inline void ProcessResiduals(bool continue_rle, uint16_t* residuals) {
     // Run continues, nothing to do.
     if (continue_rle) {
       run += kChunkSize;
@@ -818,12 +1326,45 @@ struct ChannelRowProcessor {
     }
     last = residuals[kChunkSize - 1];
   }
+  // Codes the first n < kChunkSize pixels of the chunk, the last ones of a
+  // row. The rest of the chunk is padding, which is predicted but not coded.
+  inline void ProcessPartialChunk(const int16_t* row, const int16_t* row_left,
+                                  const int16_t* row_top,
+                                  const int16_t* row_topleft, size_t n) {
+    alignas(32) uint16_t residuals[kChunkSize] = {};
+    PredictChunk(row, row_left, row_top, row_topleft, last, residuals);
+    bool continue_rle = true;
+    for (size_t ix = 0; ix < n; ix++) continue_rle &= residuals[ix] == last;
+    if (continue_rle) {
+      run += n;
+    } else {
+      t->PartialChunk(run, residuals, n);
+      run = 0;
+    }
+    last = residuals[n - 1];
+  }
+  // Codes the first xs pixels of the row; the row must be padded to a
+  // multiple of kChunkSize.
   void ProcessRow(const int16_t* row, const int16_t* row_left,
                   const int16_t* row_top, const int16_t* row_topleft,
                   size_t xs) {
-    for (size_t x = 0; x + kChunkSize <= xs; x += kChunkSize) {
+    size_t x = 0;
+#ifdef FJXL_AVX512
+    for (; x + 2 * kChunkSize <= xs; x += 2 * kChunkSize) {
+      alignas(64) uint16_t residuals[2 * kChunkSize];
+      uint32_t equal = PredictChunkPair(row + x, row_left + x, row_top + x,
+                                        row_topleft + x, last, residuals);
+      ProcessResiduals((equal & 0xFFFF) == 0xFFFF, residuals);
+      ProcessResiduals((equal >> 16) == 0xFFFF, residuals + kChunkSize);
+    }
+#endif
+    for (; x + kChunkSize <= xs; x += kChunkSize) {
       ProcessChunk(row + x, row_left + x, row_top + x, row_topleft + x);
     }
+    if (x < xs) {
+      ProcessPartialChunk(row + x, row_left + x, row_top + x, row_topleft + x,
+                          xs - x);
+    }
   }
 
   void Finalize() { t->Finalize(run); }
@@ -834,21 +1375,20 @@ struct ChannelRowProcessor {
 template <typename Processor, size_t nb_chans, size_t bytedepth>
 void ProcessImageArea(const unsigned char* rgba, size_t x0, size_t y0,
                       size_t oxs, size_t xs, size_t yskip, size_t ys,
-                      size_t row_stride, Processor* processors) {
+                      size_t row_stride, bool big_endian,
+                      Processor* processors) {
   constexpr size_t kPadding = 16;
 
   int16_t group_data[nb_chans][2][256 + kPadding * 2] = {};
   int16_t allzero[nb_chans] = {};
   int16_t allone[nb_chans];
   auto get_pixel = [&](size_t x, size_t y, size_t channel) {
-    int16_t p = rgba[row_stride * (y0 + y) + (x0 + x) * nb_chans * bytedepth +
-                     channel * bytedepth];
-    if (bytedepth == 2) {
-      p <<= 8;
-      p |= rgba[row_stride * (y0 + y) + (x0 + x) * nb_chans * 2 + channel * 2 +
-                1];
-    }
-    return p;
+    const unsigned char* p8 = rgba + row_stride * (y0 + y) +
+                              (x0 + x) * nb_chans * bytedepth +
+                              channel * bytedepth;
+    if (bytedepth == 1) return static_cast<int16_t>(p8[0]);
+    return static_cast<int16_t>(big_endian ? (p8[0] << 8) | p8[1]
+                                           : (p8[1] << 8) | p8[0]);
   };
 
   for (size_t i = 0; i < nb_chans; i++) allone[i] = 0xffff;
@@ -905,7 +1445,7 @@ void ProcessImageArea(const unsigned char* rgba, size_t x0, size_t y0,
     if (y < yskip) continue;
     for (size_t c = 0; c < nb_chans; c++) {
       if (y > 0 && (allzero[c] == 0 || (allone[c] == 0xff && bytedepth == 1))) {
-        processors[c].run += xs;
+        processors[c].run += oxs;
         continue;
       }
 
@@ -917,7 +1457,7 @@ void ProcessImageArea(const unsigned char* rgba, size_t x0, size_t y0,
       const int16_t* row_topleft =
           y == 0 ? row_left : &group_data[c][(y - 1) & 1][kPadding - 1];
 
-      processors[c].ProcessRow(row, row_left, row_top, row_topleft, xs);
+      processors[c].ProcessRow(row, row_left, row_top, row_topleft, oxs);
     }
   }
   for (size_t c = 0; c < nb_chans; c++) {
@@ -927,8 +1467,9 @@ void ProcessImageArea(const unsigned char* rgba, size_t x0, size_t y0,
 
 template <size_t nb_chans, size_t bytedepth>
 void WriteACSection(const unsigned char* rgba, size_t x0, size_t y0, size_t oxs,
-                    size_t ys, size_t row_stride, bool is_single_group,
-                    const PrefixCode& code, std::array<BitWriter, 4>& output) {
+                    size_t ys, size_t row_stride, bool big_endian,
+                    bool is_single_group, const PrefixCode& code,
+                    std::array<BitWriter, 4>& output) {
   size_t xs = (oxs + kChunkSize - 1) / kChunkSize * kChunkSize;
   for (size_t i = 0; i < nb_chans; i++) {
     if (is_single_group && i == 0) continue;
@@ -952,18 +1493,7 @@ void WriteACSection(const unsigned char* rgba, size_t x0, size_t y0, size_t oxs,
   }
   ProcessImageArea<ChannelRowProcessor<ChunkEncoder<bytedepth>>, nb_chans,
                    bytedepth>(rgba, x0, y0, oxs, xs, 0, ys, row_stride,
-                              row_encoders);
-}
-
-constexpr int kHashExp = 16;
-constexpr uint32_t kHashSize = 1 << kHashExp;
-constexpr uint32_t kHashMultiplier = 2654435761;
-constexpr int kMaxColors = 512;
-
-// can be any function that returns a value in 0 .. kHashSize-1
-// has to map 0 to 0
-inline uint32_t pixel_hash(uint32_t p) {
-  return (p * kHashMultiplier) >> (32 - kHashExp);
+                              big_endian, row_encoders);
 }
 
 template <typename Processor, size_t nb_chans>
@@ -1002,7 +1532,7 @@ void ProcessImageAreaPalette(const unsigned char* rgba, size_t x0, size_t y0,
     const int16_t* row_topleft =
         y == 0 ? row_left : &group_data[(y - 1) & 1][kPadding - 1];
 
-    row_encoder.ProcessRow(row, row_left, row_top, row_topleft, xs);
+    row_encoder.ProcessRow(row, row_left, row_top, row_topleft, oxs);
   }
   row_encoder.Finalize();
 }
@@ -1036,8 +1566,8 @@ void WriteACSectionPalette(const unsigned char* rgba, size_t x0, size_t y0,
 
 template <size_t nb_chans, size_t bytedepth>
 void CollectSamples(const unsigned char* rgba, size_t x0, size_t y0, size_t xs,
-                    size_t row_stride, size_t row_count, uint64_t* raw_counts,
-                    uint64_t* lz77_counts, bool palette,
+                    size_t row_stride, bool big_endian, size_t row_count,
+                    uint64_t* raw_counts, uint64_t* lz77_counts, bool palette,
                     const int16_t* lookup) {
   ChunkSampleCollector sample_collectors[nb_chans];
   ChannelRowProcessor<ChunkSampleCollector> row_sample_collectors[nb_chans];
@@ -1055,7 +1585,7 @@ void CollectSamples(const unsigned char* rgba, size_t x0, size_t y0, size_t xs,
   } else {
     ProcessImageArea<ChannelRowProcessor<ChunkSampleCollector>, nb_chans,
                      bytedepth>(rgba, x0, y0, xs, xs, 1, 1 + row_count,
-                                row_stride, row_sample_collectors);
+                                row_stride, big_endian, row_sample_collectors);
   }
 }
 
@@ -1121,9 +1651,11 @@ void PrepareDCGlobalPalette(bool is_single_group, size_t width, size_t height,
 }
 
 template <size_t nb_chans, size_t bytedepth>
-size_t LLEnc(const unsigned char* rgba, size_t width, size_t stride,
-             size_t height, size_t bitdepth, int effort,
-             unsigned char** output) {
+JxlFastLosslessFrameState* LLEnc(const unsigned char* rgba, size_t width,
+                                 size_t stride, size_t height, size_t bitdepth,
+                                 bool big_endian, int effort,
+                                 void* runner_opaque,
+                                 FJxlParallelRunner* runner) {
   size_t bytes_per_sample = (bitdepth > 8 ? 2 : 1);
   assert(bytedepth == bytes_per_sample);
   assert(width != 0);
@@ -1227,8 +1759,6 @@ size_t LLEnc(const unsigned char* rgba, size_t width, size_t stride,
     }
   }
 
-  // Width gets padded to kChunkSize, but this computation doesn't change
-  // because of that.
   size_t num_groups_x = (width + 255) / 256;
   size_t num_groups_y = (height + 255) / 256;
   size_t num_dc_groups_x = (width + 2047) / 2048;
@@ -1249,8 +1779,8 @@ size_t LLEnc(const unsigned char* rgba, size_t width, size_t stride,
     int x_max =
         std::min<size_t>(width - xg * 256, 256) / kChunkSize * kChunkSize;
     CollectSamples<nb_chans, bytedepth>(rgba, xg * 256, y_begin, x_max, stride,
-                                        y_count, raw_counts, lz77_counts,
-                                        !collided, lookup);
+                                        big_endian, y_count, raw_counts,
+                                        lz77_counts, !collided, lookup);
   }
 
   uint64_t base_raw_counts[16] = {3843, 852, 1270, 1214, 1014, 727, 481, 300,
@@ -1283,15 +1813,16 @@ size_t LLEnc(const unsigned char* rgba, size_t width, size_t stride,
   }
   alignas(32) PrefixCode hcode(raw_counts, lz77_counts);
 
-  BitWriter writer;
-
   bool onegroup = num_groups_x == 1 && num_groups_y == 1;
 
   size_t num_groups = onegroup ? 1
                                : (2 + num_dc_groups_x * num_dc_groups_y +
                                   num_groups_x * num_groups_y);
 
-  std::vector<std::array<BitWriter, 4>> group_data(num_groups);
+  JxlFastLosslessFrameState* frame = new JxlFastLosslessFrameState{
+      width, height, nb_chans, bitdepth,
+      std::vector<std::array<BitWriter, 4>>(num_groups)};
+  auto& group_data = frame->group_data;
   if (collided) {
     PrepareDCGlobal(onegroup, width, height, nb_chans, bitdepth, hcode,
                     &group_data[0][0]);
@@ -1299,10 +1830,7 @@ size_t LLEnc(const unsigned char* rgba, size_t width, size_t stride,
     PrepareDCGlobalPalette(onegroup, width, height, hcode, palette, pcolors,
                            &group_data[0][0]);
   }
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-  for (size_t g = 0; g < num_groups_y * num_groups_x; g++) {
+  const auto encode_group = [&](size_t g) {
     size_t xg = g % num_groups_x;
     size_t yg = g / num_groups_x;
     size_t group_id =
@@ -1314,64 +1842,62 @@ size_t LLEnc(const unsigned char* rgba, size_t width, size_t stride,
     auto& gd = group_data[group_id];
     if (collided) {
       WriteACSection<nb_chans, bytedepth>(rgba, x0, y0, xs, ys, stride,
-                                          onegroup, hcode, gd);
+                                          big_endian, onegroup, hcode, gd);
 
     } else {
       WriteACSectionPalette<nb_chans>(rgba, x0, y0, xs, ys, stride, onegroup,
                                       hcode, lookup, gd[0]);
     }
-  }
-
-  AssembleFrame(width, height, nb_chans, bitdepth, group_data, &writer);
+  };
+  RunOnRunner(runner_opaque, runner, num_groups_y * num_groups_x,
+              encode_group);
 
-  *output = writer.data.release();
-  return writer.bytes_written;
+  return frame;
 }
 
-}  // namespace
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-size_t JxlFastLosslessEncode(const unsigned char* rgba, size_t width,
-                             size_t stride, size_t height, size_t nb_chans,
-                             size_t bitdepth, int effort,
-                             unsigned char** output) {
-  assert(bitdepth <= 12);
-  assert(bitdepth > 0);
-  assert(nb_chans <= 4);
-  assert(nb_chans != 0);
+// Encodes the frame with this target, see JxlFastLosslessPrepareFrame.
+JxlFastLosslessFrameState* PrepareFrame(const unsigned char* rgba, size_t width,
+                                        size_t stride, size_t height,
+                                        size_t nb_chans, size_t bitdepth,
+                                        bool big_endian, int effort,
+                                        void* runner_opaque,
+                                        FJxlParallelRunner* runner) {
   if (bitdepth <= 8) {
     if (nb_chans == 1) {
-      return LLEnc<1, 1>(rgba, width, stride, height, bitdepth, effort, output);
+      return LLEnc<1, 1>(rgba, width, stride, height, bitdepth, big_endian,
+                         effort, runner_opaque, runner);
     }
     if (nb_chans == 2) {
-      return LLEnc<2, 1>(rgba, width, stride, height, bitdepth, effort, output);
+      return LLEnc<2, 1>(rgba, width, stride, height, bitdepth, big_endian,
+                         effort, runner_opaque, runner);
     }
     if (nb_chans == 3) {
-      return LLEnc<3, 1>(rgba, width, stride, height, bitdepth, effort, output);
+      return LLEnc<3, 1>(rgba, width, stride, height, bitdepth, big_endian,
+                         effort, runner_opaque, runner);
     }
     if (nb_chans == 4) {
-      return LLEnc<4, 1>(rgba, width, stride, height, bitdepth, effort, output);
+      return LLEnc<4, 1>(rgba, width, stride, height, bitdepth, big_endian,
+                         effort, runner_opaque, runner);
     }
   } else {
     if (nb_chans == 1) {
-      return LLEnc<1, 2>(rgba, width, stride, height, bitdepth, effort, output);
+      return LLEnc<1, 2>(rgba, width, stride, height, bitdepth, big_endian,
+                         effort, runner_opaque, runner);
     }
     if (nb_chans == 2) {
-      return LLEnc<2, 2>(rgba, width, stride, height, bitdepth, effort, output);
+      return LLEnc<2, 2>(rgba, width, stride, height, bitdepth, big_endian,
+                         effort, runner_opaque, runner);
     }
     if (nb_chans == 3) {
-      return LLEnc<3, 2>(rgba, width, stride, height, bitdepth, effort, output);
+      return LLEnc<3, 2>(rgba, width, stride, height, bitdepth, big_endian,
+                         effort, runner_opaque, runner);
     }
     if (nb_chans == 4) {
-      return LLEnc<4, 2>(rgba, width, stride, height, bitdepth, effort, output);
+      return LLEnc<4, 2>(rgba, width, stride, height, bitdepth, big_endian,
+                         effort, runner_opaque, runner);
     }
   }
-  return 0;
+  return nullptr;
 }
 
-#ifdef __cplusplus
-}  // extern "C"
-#endif
+#endif  // FJXL_SELF_INCLUDE
@@ -0,0 +1,87 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef LIB_JXL_ENC_FAST_LOSSLESS_H_
+#define LIB_JXL_ENC_FAST_LOSSLESS_H_
+
+// Fast lossless encoder for 8-bit and up to 12-bit interleaved RGBA, RGB,
+// grayscale and grayscale + alpha images, used for effort 1 by libjxl. It is
+// also built standalone by experimental/fast_lossless, so it depends on the C
+// and C++ standard libraries only.
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Calls fun(opaque, i) for all i in [0, count), possibly in parallel. Must
+// return only once all the calls have returned. runner_opaque is passed
+// through from the functions below.
+typedef void(FJxlParallelRunner)(void* runner_opaque, void* opaque,
+                                 void fun(void*, size_t), size_t count);
+
+// Encoded groups of a single frame, not yet assembled into a bitstream.
+typedef struct JxlFastLosslessFrameState JxlFastLosslessFrameState;
+
+// Encodes the image in rgba, with row_stride bytes between rows and bitdepth
+// bits per sample stored in 1 byte (bitdepth <= 8) or 2 bytes in the byte
+// order given by big_endian. The groups are encoded in parallel by runner, or
+// with OpenMP if runner is NULL. Returns NULL if the encoder is not supported
+// on this system.
+JxlFastLosslessFrameState* JxlFastLosslessPrepareFrame(
+    const unsigned char* rgba, size_t width, size_t row_stride, size_t height,
+    size_t nb_chans, size_t bitdepth, int big_endian, int effort,
+    void* runner_opaque, FJxlParallelRunner runner);
+
+// Implementations of the encoder for different instruction sets, as bit flags.
+// JxlFastLosslessPrepareFrame uses the best one that is supported.
+typedef enum {
+  JXL_FAST_LOSSLESS_TARGET_SCALAR = 1,
+  JXL_FAST_LOSSLESS_TARGET_NEON = 2,
+  JXL_FAST_LOSSLESS_TARGET_AVX2 = 4,
+  JXL_FAST_LOSSLESS_TARGET_AVX512 = 8,
+} JxlFastLosslessTarget;
+
+// Returns the targets that are compiled in and supported by the CPU. Exactly
+// one of SCALAR and NEON is always included, except on big-endian systems
+// where this returns 0.
+int JxlFastLosslessSupportedTargets(void);
+
+// Restricts JxlFastLosslessPrepareFrame to the given targets, for tests and
+// benchmarks that compare them on the same input. If none of them is
+// supported, SCALAR (or NEON) is used. 0 removes the restriction.
+void JxlFastLosslessSetTargetsForTest(int targets);
+
+// Upper bound on the number of bytes written by JxlFastLosslessWriteFrame,
+// including padding the writer may touch beyond the end of the frame.
+size_t JxlFastLosslessMaxRequiredOutput(const JxlFastLosslessFrameState* frame);
+
+// Writes the frame to output, which must have room for
+// JxlFastLosslessMaxRequiredOutput bytes, and returns the number of bytes of
+// the frame. If add_image_header is true, the signature and an image header
+// for an sRGB (or gray) image are written first, so that the output is a
+// complete codestream. Otherwise the frame is meant to follow an image header
+// written by the caller, which must have matching dimensions, bit depth,
+// alpha channel and no animation.
+size_t JxlFastLosslessWriteFrame(const JxlFastLosslessFrameState* frame,
+                                 int add_image_header, int is_last,
+                                 unsigned char* output);
+
+void JxlFastLosslessFreeFrameState(JxlFastLosslessFrameState* frame);
+
+// Encodes a complete single-frame codestream into a buffer allocated with
+// malloc, which is returned in *output. Returns the size of the codestream.
+size_t JxlFastLosslessEncode(const unsigned char* rgba, size_t width,
+                             size_t row_stride, size_t height, size_t nb_chans,
+                             size_t bitdepth, int big_endian, int effort,
+                             unsigned char** output, void* runner_opaque,
+                             FJxlParallelRunner runner);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // LIB_JXL_ENC_FAST_LOSSLESS_H_
@@ -0,0 +1,95 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "lib/jxl/enc_fast_lossless.h"
+
+namespace jxl {
+namespace {
+
+// Runs the groups one after the other, so that the targets are compared on a
+// single core.
+void RunSerially(void* runner_opaque, void* opaque, void fun(void*, size_t),
+                 size_t count) {
+  for (size_t i = 0; i < count; i++) fun(opaque, i);
+}
+
+// Smooth gradients with some noise, so that neither the prefix coding of
+// large residuals nor the RLE of zero residuals dominates.
+std::vector<uint8_t> GenerateImage(size_t xsize, size_t ysize,
+                                   size_t nb_chans, size_t bitdepth) {
+  const size_t bytes_per_sample = bitdepth > 8 ? 2 : 1;
+  std::vector<uint8_t> pixels(xsize * ysize * nb_chans * bytes_per_sample);
+  uint32_t rng = 1;
+  size_t i = 0;
+  for (size_t y = 0; y < ysize; y++) {
+    for (size_t x = 0; x < xsize; x++) {
+      for (size_t c = 0; c < nb_chans; c++) {
+        rng = rng * 1103515245 + 12345;
+        uint32_t v = (x * (c + 1) + y * (3 - c % 3)) + ((rng >> 16) & 7);
+        v = (v << (bitdepth - 8)) & ((1u << bitdepth) - 1);
+        if (c == 3) v = (1u << bitdepth) - 1;
+        if (bytes_per_sample == 1) {
+          pixels[i++] = v;
+        } else {
+          pixels[i++] = v & 0xFF;
+          pixels[i++] = v >> 8;
+        }
+      }
+    }
+  }
+  return pixels;
+}
+
+// Arguments: target, number of channels, bit depth.
+void BM_FastLosslessEncode(benchmark::State& state) {
+  const int target = state.range(0);
+  const size_t nb_chans = state.range(1);
+  const size_t bitdepth = state.range(2);
+  const size_t xsize = 2048;
+  const size_t ysize = 1024;
+  if (!(JxlFastLosslessSupportedTargets() & target)) {
+    state.SkipWithError("Target not supported");
+    return;
+  }
+  std::vector<uint8_t> pixels = GenerateImage(xsize, ysize, nb_chans, bitdepth);
+  const size_t row_stride = pixels.size() / ysize;
+
+  JxlFastLosslessSetTargetsForTest(target);
+  size_t encoded_size = 0;
+  for (auto _ : state) {
+    unsigned char* encoded = nullptr;
+    encoded_size = JxlFastLosslessEncode(
+        pixels.data(), xsize, row_stride, ysize, nb_chans, bitdepth,
+        /*big_endian=*/0, /*effort=*/2, &encoded, nullptr, &RunSerially);
+    free(encoded);
+  }
+  JxlFastLosslessSetTargetsForTest(0);
+
+  state.counters["bpp"] = encoded_size * 8.0 / (xsize * ysize);
+  state.SetItemsProcessed(state.iterations() * xsize * ysize);
+  state.SetBytesProcessed(state.iterations() * pixels.size());
+}
+
+void FastLosslessArgs(benchmark::internal::Benchmark* b) {
+  for (int target :
+       {JXL_FAST_LOSSLESS_TARGET_SCALAR, JXL_FAST_LOSSLESS_TARGET_NEON,
+        JXL_FAST_LOSSLESS_TARGET_AVX2, JXL_FAST_LOSSLESS_TARGET_AVX512}) {
+    b->Args({target, 3, 8});
+    b->Args({target, 4, 8});
+    b->Args({target, 3, 12});
+  }
+  b->ArgNames({"target", "channels", "bits"});
+}
+
+BENCHMARK(BM_FastLosslessEncode)->Apply(FastLosslessArgs)->UseRealTime();
+
+}  // namespace
+}  // namespace jxl
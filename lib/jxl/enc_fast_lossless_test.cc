@@ -0,0 +1,99 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/jxl/enc_fast_lossless.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/jxl/test_utils.h"
+
+namespace jxl {
+namespace {
+
+struct FastLosslessTestCase {
+  size_t xsize;
+  size_t nb_chans;
+  size_t bitdepth;
+  bool few_colors;
+};
+
+std::vector<uint8_t> GenerateImage(const FastLosslessTestCase& c,
+                                   size_t ysize) {
+  const size_t bytes_per_sample = c.bitdepth > 8 ? 2 : 1;
+  std::vector<uint8_t> pixels(c.xsize * ysize * c.nb_chans * bytes_per_sample);
+  std::mt19937 rng(c.xsize * 16 + c.nb_chans * 4 + c.bitdepth);
+  for (size_t i = 0; i < pixels.size(); i += bytes_per_sample) {
+    uint32_t v;
+    if (c.few_colors) {
+      // Also exercises the palette path for 8-bit RGBA.
+      v = ((i / (c.nb_chans * bytes_per_sample) / 13) % 5) * 40 + 7;
+    } else {
+      // Smooth part with noise, and some pure noise for large residuals.
+      v = (i / 7) + (rng() & 3);
+      if (i > pixels.size() / 2) v = rng();
+    }
+    v &= (1u << c.bitdepth) - 1;
+    pixels[i] = v & 0xFF;
+    if (bytes_per_sample == 2) pixels[i + 1] = v >> 8;
+  }
+  return pixels;
+}
+
+class FastLosslessTargetTest
+    : public ::testing::TestWithParam<FastLosslessTestCase> {};
+
+// All the SIMD targets must produce the same codestream as the default one.
+TEST_P(FastLosslessTargetTest, SameOutputForAllTargets) {
+  const FastLosslessTestCase& c = GetParam();
+  const size_t ysize = 300;
+  std::vector<uint8_t> pixels = GenerateImage(c, ysize);
+  const size_t row_stride = pixels.size() / ysize;
+  const int supported = JxlFastLosslessSupportedTargets();
+  if (supported == 0) return;  // Big-endian system.
+  const int default_target = supported & (JXL_FAST_LOSSLESS_TARGET_SCALAR |
+                                          JXL_FAST_LOSSLESS_TARGET_NEON);
+  ASSERT_NE(0, default_target);
+
+  for (int effort = 1; effort <= 2; effort++) {
+    std::vector<uint8_t> expected;
+    for (int target = 1; target <= JXL_FAST_LOSSLESS_TARGET_AVX512;
+         target <<= 1) {
+      if (!(supported & target)) continue;
+      JxlFastLosslessSetTargetsForTest(target);
+      unsigned char* encoded = nullptr;
+      size_t encoded_size = JxlFastLosslessEncode(
+          pixels.data(), c.xsize, row_stride, ysize, c.nb_chans, c.bitdepth,
+          /*big_endian=*/0, effort, &encoded, nullptr, nullptr);
+      JxlFastLosslessSetTargetsForTest(0);
+      ASSERT_NE(nullptr, encoded);
+      std::vector<uint8_t> output(encoded, encoded + encoded_size);
+      free(encoded);
+      if (target == default_target) {
+        expected = output;
+      } else {
+        EXPECT_EQ(expected, output) << "target " << target;
+      }
+    }
+  }
+}
+
+const FastLosslessTestCase kFastLosslessTestCases[] = {
+    {300, 1, 8, false},  {300, 2, 8, false},  {300, 3, 8, false},
+    {300, 4, 8, false},  {1000, 4, 8, false}, {17, 3, 8, false},
+    {300, 1, 10, false}, {300, 3, 12, false}, {300, 4, 12, false},
+    {300, 4, 8, true},   {300, 3, 8, true},
+};
+
+JXL_GTEST_INSTANTIATE_TEST_SUITE_P(FastLosslessTargetTestInstantiation,
+                                   FastLosslessTargetTest,
+                                   testing::ValuesIn(kFastLosslessTestCases));
+
+}  // namespace
+}  // namespace jxl
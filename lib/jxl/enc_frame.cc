@@ -52,6 +52,7 @@
 #include "lib/jxl/enc_photon_noise.h"
 #include "lib/jxl/enc_quant_weights.h"
 #include "lib/jxl/enc_splines.h"
+#include "lib/jxl/enc_stage_stats.h"
 #include "lib/jxl/enc_toc.h"
 #include "lib/jxl/enc_xyb.h"
 #include "lib/jxl/fields.h"
@@ -541,6 +542,7 @@ class LossyFrameEncoder {
     JXL_RETURN_IF_ERROR(InitializePassesEncoder(
         *opsin, cms, pool_, enc_state_, modular_frame_encoder, aux_out_));
 
+    EncoderStageTimer timer(enc_state_->stage_stats, JXL_ENC_STAGE_TOKENIZE);
     enc_state_->passes.resize(enc_state_->progressive_splitter.GetNumPasses());
     for (PassesEncoderState::PassData& pass : enc_state_->passes) {
       pass.ac_tokens.resize(shared.frame_dim.num_groups);
@@ -549,36 +551,7 @@ class LossyFrameEncoder {
     ComputeAllCoeffOrders(shared.frame_dim);
     shared.num_histograms = 1;
 
-    const auto tokenize_group_init = [&](const size_t num_threads) {
-      group_caches_.resize(num_threads);
-      return true;
-    };
-    const auto tokenize_group = [&](const uint32_t group_index,
-                                    const size_t thread) {
-      // Tokenize coefficients.
-      const Rect rect = shared.BlockGroupRect(group_index);
-      for (size_t idx_pass = 0; idx_pass < enc_state_->passes.size();
-           idx_pass++) {
-        JXL_ASSERT(enc_state_->coeffs[idx_pass]->Type() == ACType::k32);
-        const int32_t* JXL_RESTRICT ac_rows[3] = {
-            enc_state_->coeffs[idx_pass]->PlaneRow(0, group_index, 0).ptr32,
-            enc_state_->coeffs[idx_pass]->PlaneRow(1, group_index, 0).ptr32,
-            enc_state_->coeffs[idx_pass]->PlaneRow(2, group_index, 0).ptr32,
-        };
-        // Ensure group cache is initialized.
-        group_caches_[thread].InitOnce();
-        TokenizeCoefficients(
-            &shared.coeff_orders[idx_pass * shared.coeff_order_size], rect,
-            ac_rows, shared.ac_strategy, frame_header->chroma_subsampling,
-            &group_caches_[thread].num_nzeroes,
-            &enc_state_->passes[idx_pass].ac_tokens[group_index],
-            enc_state_->shared.quant_dc, enc_state_->shared.raw_quant_field,
-            enc_state_->shared.block_ctx_map);
-      }
-    };
-    JXL_RETURN_IF_ERROR(RunOnPool(pool_, 0, shared.frame_dim.num_groups,
-                                  tokenize_group_init, tokenize_group,
-                                  "TokenizeGroup"));
+    JXL_RETURN_IF_ERROR(TokenizeAllGroups());
 
     *frame_header = shared.frame_header;
     return true;
@@ -899,39 +872,11 @@ class LossyFrameEncoder {
     JXL_CHECK(enc_state_->passes.size() ==
               1);  // skipping coeff splitting so need to have only one pass
 
+    EncoderStageTimer timer(enc_state_->stage_stats, JXL_ENC_STAGE_TOKENIZE);
     ComputeAllCoeffOrders(frame_dim);
     shared.num_histograms = 1;
 
-    const auto tokenize_group_init = [&](const size_t num_threads) {
-      group_caches_.resize(num_threads);
-      return true;
-    };
-    const auto tokenize_group = [&](const uint32_t group_index,
-                                    const size_t thread) {
-      // Tokenize coefficients.
-      const Rect rect = shared.BlockGroupRect(group_index);
-      for (size_t idx_pass = 0; idx_pass < enc_state_->passes.size();
-           idx_pass++) {
-        JXL_ASSERT(enc_state_->coeffs[idx_pass]->Type() == ACType::k32);
-        const int32_t* JXL_RESTRICT ac_rows[3] = {
-            enc_state_->coeffs[idx_pass]->PlaneRow(0, group_index, 0).ptr32,
-            enc_state_->coeffs[idx_pass]->PlaneRow(1, group_index, 0).ptr32,
-            enc_state_->coeffs[idx_pass]->PlaneRow(2, group_index, 0).ptr32,
-        };
-        // Ensure group cache is initialized.
-        group_caches_[thread].InitOnce();
-        TokenizeCoefficients(
-            &shared.coeff_orders[idx_pass * shared.coeff_order_size], rect,
-            ac_rows, shared.ac_strategy, frame_header->chroma_subsampling,
-            &group_caches_[thread].num_nzeroes,
-            &enc_state_->passes[idx_pass].ac_tokens[group_index],
-            enc_state_->shared.quant_dc, enc_state_->shared.raw_quant_field,
-            enc_state_->shared.block_ctx_map);
-      }
-    };
-    JXL_RETURN_IF_ERROR(RunOnPool(pool_, 0, shared.frame_dim.num_groups,
-                                  tokenize_group_init, tokenize_group,
-                                  "TokenizeGroup"));
+    JXL_RETURN_IF_ERROR(TokenizeAllGroups());
     *frame_header = shared.frame_header;
     doing_jpeg_recompression = true;
     return true;
@@ -953,7 +898,9 @@ class LossyFrameEncoder {
     JXL_RETURN_IF_ERROR(DequantMatricesEncode(&enc_state_->shared.matrices,
                                               writer, kLayerQuant, aux_out_,
                                               modular_frame_encoder));
-    if (enc_state_->cparams.speed_tier <= SpeedTier::kTortoise) {
+    // Clustering the groups needs the tokens of all of them.
+    if (enc_state_->cparams.speed_tier <= SpeedTier::kTortoise &&
+        streaming_sample_stride_ == 0) {
       if (!doing_jpeg_recompression) ClusterGroups(enc_state_);
     }
     size_t num_histo_bits =
@@ -983,18 +930,29 @@ class LossyFrameEncoder {
       HistogramParams hist_params(
           enc_state_->cparams.speed_tier,
           enc_state_->shared.block_ctx_map.NumACContexts());
+      hist_params.pool = pool_;
       if (enc_state_->cparams.speed_tier > SpeedTier::kTortoise) {
         hist_params.lz77_method = HistogramParams::LZ77Method::kNone;
       }
       if (enc_state_->cparams.decoding_speed_tier >= 1) {
         hist_params.max_histograms = 6;
       }
+      std::vector<std::vector<Token>>& ac_tokens =
+          enc_state_->passes[i].ac_tokens;
+      if (streaming_sample_stride_ != 0) {
+        // The tokens that are not in the sample are only known to be covered
+        // by the default HybridUintConfig, and LZ77 can't refer to them.
+        hist_params.uint_method = HistogramParams::HybridUintMethod::kNone;
+        hist_params.lz77_method = HistogramParams::LZ77Method::kNone;
+        ac_tokens.push_back(std::move(coverage_tokens_[i]));
+      }
       BuildAndEncodeHistograms(
           hist_params,
           enc_state_->shared.num_histograms *
               enc_state_->shared.block_ctx_map.NumACContexts(),
-          enc_state_->passes[i].ac_tokens, &enc_state_->passes[i].codes,
+          ac_tokens, &enc_state_->passes[i].codes,
           &enc_state_->passes[i].context_map, writer, kLayerAC, aux_out_);
+      if (streaming_sample_stride_ != 0) ac_tokens.pop_back();
     }
 
     return true;
@@ -1002,14 +960,126 @@ class LossyFrameEncoder {
 
   Status EncodeACGroup(size_t pass, size_t group_index, BitWriter* group_code,
                        AuxOut* local_aux_out) {
-    return EncodeGroupTokenizedCoefficients(
+    std::vector<Token>& tokens =
+        enc_state_->passes[pass].ac_tokens[group_index];
+    if (streaming_sample_stride_ != 0 &&
+        group_index % streaming_sample_stride_ != 0) {
+      EncCache cache;
+      cache.InitOnce();
+      TokenizeGroup(group_index, pass, &cache, &tokens);
+    }
+    JXL_RETURN_IF_ERROR(EncodeGroupTokenizedCoefficients(
         group_index, pass, enc_state_->histogram_idx[group_index], *enc_state_,
-        group_code, local_aux_out);
+        group_code, local_aux_out));
+    if (streaming_sample_stride_ != 0) {
+      // Release the memory of the tokens of this group right away.
+      std::vector<Token>().swap(tokens);
+    }
+    return true;
   }
 
   PassesEncoderState* State() { return enc_state_; }
 
  private:
+  void TokenizeGroup(size_t group_index, size_t idx_pass, EncCache* cache,
+                     std::vector<Token>* tokens) const {
+    const PassesSharedState& shared = enc_state_->shared;
+    const Rect rect = shared.BlockGroupRect(group_index);
+    JXL_ASSERT(enc_state_->coeffs[idx_pass]->Type() == ACType::k32);
+    const int32_t* JXL_RESTRICT ac_rows[3] = {
+        enc_state_->coeffs[idx_pass]->PlaneRow(0, group_index, 0).ptr32,
+        enc_state_->coeffs[idx_pass]->PlaneRow(1, group_index, 0).ptr32,
+        enc_state_->coeffs[idx_pass]->PlaneRow(2, group_index, 0).ptr32,
+    };
+    TokenizeCoefficients(
+        &shared.coeff_orders[idx_pass * shared.coeff_order_size], rect, ac_rows,
+        shared.ac_strategy, shared.frame_header.chroma_subsampling,
+        &cache->num_nzeroes, tokens, shared.quant_dc, shared.raw_quant_field,
+        shared.block_ctx_map);
+  }
+
+  // Tokenizes the AC coefficients of all the groups. In streaming mode, only
+  // the tokens of every streaming_sample_stride_-th group are kept, and the
+  // largest value seen in each context is used to add to coverage_tokens_ one
+  // token per symbol that the other groups may use, so that the histograms
+  // built from the sample can encode them.
+  Status TokenizeAllGroups() {
+    const PassesSharedState& shared = enc_state_->shared;
+    const size_t num_groups = shared.frame_dim.num_groups;
+    const size_t num_passes = enc_state_->passes.size();
+    const size_t num_contexts = shared.block_ctx_map.NumACContexts();
+    streaming_sample_stride_ =
+        enc_state_->cparams.streaming_ac_tokens
+            ? DivCeil(num_groups, kMaxStreamingSampleGroups)
+            : 0;
+    const bool streaming = streaming_sample_stride_ != 0;
+
+    // Per thread, one more than the largest token value of each context.
+    std::vector<std::vector<uint64_t>> value_limits;
+    std::vector<std::vector<Token>> scratch;
+    const auto tokenize_group_init = [&](const size_t num_threads) {
+      group_caches_.resize(num_threads);
+      if (streaming) {
+        value_limits.assign(num_threads,
+                            std::vector<uint64_t>(num_passes * num_contexts));
+        scratch.resize(num_threads);
+      }
+      return true;
+    };
+    const auto tokenize_group = [&](const uint32_t group_index,
+                                    const size_t thread) {
+      // Ensure group cache is initialized.
+      group_caches_[thread].InitOnce();
+      for (size_t idx_pass = 0; idx_pass < num_passes; idx_pass++) {
+        std::vector<Token>* tokens =
+            &enc_state_->passes[idx_pass].ac_tokens[group_index];
+        if (!streaming) {
+          TokenizeGroup(group_index, idx_pass, &group_caches_[thread], tokens);
+          continue;
+        }
+        std::vector<Token>& group_tokens = scratch[thread];
+        group_tokens.clear();
+        TokenizeGroup(group_index, idx_pass, &group_caches_[thread],
+                      &group_tokens);
+        uint64_t* JXL_RESTRICT limits =
+            &value_limits[thread][idx_pass * num_contexts];
+        for (const Token& token : group_tokens) {
+          limits[token.context] =
+              std::max<uint64_t>(limits[token.context], token.value + 1ull);
+        }
+        if (group_index % streaming_sample_stride_ == 0) {
+          *tokens = group_tokens;
+        }
+      }
+    };
+    JXL_RETURN_IF_ERROR(RunOnPool(pool_, 0, num_groups, tokenize_group_init,
+                                  tokenize_group, "TokenizeGroup"));
+    if (!streaming) return true;
+
+    // In streaming mode the histograms use the default HybridUintConfig, see
+    // EncodeGlobalACInfo. Each of its symbols is a contiguous range of values,
+    // so adding the first value of each range up to the limit covers all the
+    // symbols that can appear.
+    const HybridUintConfig uint_config;
+    coverage_tokens_.clear();
+    coverage_tokens_.resize(num_passes);
+    for (size_t idx_pass = 0; idx_pass < num_passes; idx_pass++) {
+      for (size_t ctx = 0; ctx < num_contexts; ctx++) {
+        uint64_t limit = 0;
+        for (const std::vector<uint64_t>& limits : value_limits) {
+          limit = std::max(limit, limits[idx_pass * num_contexts + ctx]);
+        }
+        for (uint64_t value = 0; value < limit;) {
+          coverage_tokens_[idx_pass].emplace_back(ctx, value);
+          uint32_t tok, nbits, bits;
+          uint_config.Encode(value, &tok, &nbits, &bits);
+          value += uint64_t{1} << nbits;
+        }
+      }
+    }
+    return true;
+  }
+
   void ComputeAllCoeffOrders(const FrameDimensions& frame_dim) {
     PROFILER_FUNC;
     // No coefficient reordering in Falcon or faster.
@@ -1055,6 +1125,13 @@ class LossyFrameEncoder {
   AuxOut* aux_out_;
   std::vector<EncCache> group_caches_;
   bool doing_jpeg_recompression = false;
+  // Maximum number of groups whose tokens are kept in streaming mode.
+  static constexpr size_t kMaxStreamingSampleGroups = 16;
+  // Every streaming_sample_stride_-th group is in the sample of the streaming
+  // mode, or 0 if the tokens of all the groups are kept.
+  size_t streaming_sample_stride_ = 0;
+  // Per pass, tokens that only contribute to the histograms.
+  std::vector<std::vector<Token>> coverage_tokens_;
 };
 
 Status ParamsPostInit(CompressParams* p) {
@@ -1267,7 +1344,8 @@ Status EncodeFrame(const CompressParams& cparams_orig,
   if (ib.IsJPEG()) {
     JXL_RETURN_IF_ERROR(lossy_frame_encoder.ComputeJPEGTranscodingData(
         *ib.jpeg_data, modular_frame_encoder.get(), frame_header.get()));
-  } else if (!lossy_frame_encoder.State()->heuristics->HandlesColorConversion(
+  } else if (!frame_info.ib_needs_color_transform ||
+             !lossy_frame_encoder.State()->heuristics->HandlesColorConversion(
                  cparams, ib) ||
              frame_header->encoding != FrameEncoding::kVarDCT) {
     // Allocating a large enough image avoids a copy when padding.
@@ -1284,6 +1362,8 @@ Status EncodeFrame(const CompressParams& cparams_orig,
       // linear_storage would only be used by the Butteraugli loop (passing
       // linear sRGB avoids a color conversion there). Otherwise, don't
       // fill it to reduce memory usage.
+      EncoderStageTimer timer(passes_enc_state->stage_stats,
+                              JXL_ENC_STAGE_COLOR_TRANSFORM);
       ib_or_linear =
           ToXYB(ib, pool, &opsin, cms, want_linear ? &linear_storage : nullptr);
     } else {  // RGB or YCbCr: don't do anything (forward YCbCr is not
@@ -1337,6 +1417,8 @@ Status EncodeFrame(const CompressParams& cparams_orig,
       lossy_frame_encoder.State(), cms, pool, aux_out,
       /* do_color=*/frame_header->encoding == FrameEncoding::kModular));
 
+  EncoderStageStats* stage_stats = passes_enc_state->stage_stats;
+  EncoderStageTimer header_timer(stage_stats, JXL_ENC_STAGE_WRITE);
   writer->AppendByteAligned(lossy_frame_encoder.State()->special_frames);
   frame_header->UpdateFlag(
       lossy_frame_encoder.State()->shared.image_features.patches.HasAny(),
@@ -1398,8 +1480,13 @@ Status EncodeFrame(const CompressParams& cparams_orig,
     JXL_RETURN_IF_ERROR(
         lossy_frame_encoder.EncodeGlobalDCInfo(*frame_header, get_output(0)));
   }
-  JXL_RETURN_IF_ERROR(
-      modular_frame_encoder->EncodeGlobalInfo(get_output(0), aux_out));
+  header_timer.Stop();
+  {
+    EncoderStageTimer timer(stage_stats, JXL_ENC_STAGE_HISTOGRAMS);
+    JXL_RETURN_IF_ERROR(
+        modular_frame_encoder->EncodeGlobalInfo(get_output(0), aux_out, pool));
+  }
+  EncoderStageTimer dc_timer(stage_stats, JXL_ENC_STAGE_WRITE);
   JXL_RETURN_IF_ERROR(modular_frame_encoder->EncodeStream(
       get_output(0), aux_out, kLayerModularGlobal, ModularStreamId::Global()));
 
@@ -1437,12 +1524,16 @@ Status EncodeFrame(const CompressParams& cparams_orig,
   JXL_RETURN_IF_ERROR(RunOnPool(pool, 0, frame_dim.num_dc_groups,
                                 resize_aux_outs, process_dc_group,
                                 "EncodeDCGroup"));
+  dc_timer.Stop();
 
   if (frame_header->encoding == FrameEncoding::kVarDCT) {
+    EncoderStageTimer timer(stage_stats, JXL_ENC_STAGE_HISTOGRAMS);
     JXL_RETURN_IF_ERROR(lossy_frame_encoder.EncodeGlobalACInfo(
         get_output(global_ac_index), modular_frame_encoder.get()));
   }
 
+  EncoderStageTimer groups_timer(stage_stats, JXL_ENC_STAGE_WRITE);
+
   std::atomic<int> num_errors{0};
   const auto process_group = [&](const uint32_t group_index,
                                  const size_t thread) {
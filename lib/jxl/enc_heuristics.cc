@@ -23,6 +23,7 @@
 #include "lib/jxl/enc_photon_noise.h"
 #include "lib/jxl/enc_quant_weights.h"
 #include "lib/jxl/enc_splines.h"
+#include "lib/jxl/enc_stage_stats.h"
 #include "lib/jxl/enc_xyb.h"
 #include "lib/jxl/gaborish.h"
 
@@ -777,6 +778,7 @@ Status DefaultEncoderHeuristics::LossyFrameHeuristics(
   // Find and subtract patches/dots.
   if (ApplyOverride(cparams.patches,
                     cparams.speed_tier <= SpeedTier::kSquirrel)) {
+    EncoderStageTimer timer(enc_state->stage_stats, JXL_ENC_STAGE_PATCHES);
     FindBestPatchDictionary(*opsin, enc_state, cms, pool, aux_out);
     PatchDictionaryEncoder::SubtractFrom(shared.image_features.patches, opsin);
   }
@@ -814,6 +816,8 @@ Status DefaultEncoderHeuristics::LossyFrameHeuristics(
 
   if (!opsin->xsize()) {
     JXL_ASSERT(HandlesColorConversion(cparams, *original_pixels));
+    EncoderStageTimer timer(enc_state->stage_stats,
+                            JXL_ENC_STAGE_COLOR_TRANSFORM);
     *opsin = Image3F(RoundUpToBlockDim(original_pixels->xsize()),
                      RoundUpToBlockDim(original_pixels->ysize()));
     opsin->ShrinkTo(original_pixels->xsize(), original_pixels->ysize());
@@ -834,6 +838,8 @@ Status DefaultEncoderHeuristics::LossyFrameHeuristics(
     FillImage(q, &enc_state->initial_quant_field);
   } else {
     // Call this here, as it relies on pre-gaborish values.
+    EncoderStageTimer timer(enc_state->stage_stats,
+                            JXL_ENC_STAGE_ADAPTIVE_QUANTIZATION);
     float butteraugli_distance_for_iqf = cparams.butteraugli_distance;
     if (!shared.frame_header.loop_filter.gab) {
       butteraugli_distance_for_iqf *= 0.73f;
@@ -854,6 +860,8 @@ Status DefaultEncoderHeuristics::LossyFrameHeuristics(
   FindBestDequantMatrices(cparams, *opsin, modular_frame_encoder,
                           &enc_state->shared.matrices);
 
+  EncoderStageTimer acs_timer(enc_state->stage_stats,
+                              JXL_ENC_STAGE_AC_STRATEGY);
   cfl_heuristics.Init(*opsin);
   acs_heuristics.Init(*opsin, enc_state);
 
@@ -921,9 +929,14 @@ Status DefaultEncoderHeuristics::LossyFrameHeuristics(
     cfl_heuristics.ComputeDC(/*fast=*/cparams.speed_tier >= SpeedTier::kWombat,
                              &enc_state->shared.cmap);
   }
+  acs_timer.Stop();
 
   // Refine quantization levels.
-  FindBestQuantizer(original_pixels, *opsin, enc_state, cms, pool, aux_out);
+  {
+    EncoderStageTimer timer(enc_state->stage_stats,
+                            JXL_ENC_STAGE_ADAPTIVE_QUANTIZATION);
+    FindBestQuantizer(original_pixels, *opsin, enc_state, cms, pool, aux_out);
+  }
 
   // Choose a context model that depends on the amount of quantization for AC.
   if (cparams.speed_tier < SpeedTier::kFalcon) {
@@ -27,6 +27,7 @@
 #include "lib/jxl/enc_params.h"
 #include "lib/jxl/enc_patch_dictionary.h"
 #include "lib/jxl/enc_quant_weights.h"
+#include "lib/jxl/enc_stage_stats.h"
 #include "lib/jxl/frame_header.h"
 #include "lib/jxl/gaborish.h"
 #include "lib/jxl/modular/encoding/context_predict.h"
@@ -481,6 +482,7 @@ Status ModularFrameEncoder::ComputeEncodingData(
   if (do_color && metadata.bit_depth.bits_per_sample <= 16 &&
       cparams_.speed_tier < SpeedTier::kCheetah &&
       cparams_.decoding_speed_tier < 2) {
+    EncoderStageTimer timer(enc_state->stage_stats, JXL_ENC_STAGE_PATCHES);
     FindBestPatchDictionary(*color, enc_state, cms, nullptr, aux_out,
                             cparams_.color_transform == ColorTransform::kXYB);
     PatchDictionaryEncoder::SubtractFrom(
@@ -959,15 +961,18 @@ Status ModularFrameEncoder::ComputeEncodingData(
   JXL_RETURN_IF_ERROR(ValidateChannelDimensions(gi, stream_options_[0]));
 
   return PrepareEncoding(frame_header, pool, enc_state->heuristics.get(),
-                         aux_out);
+                         enc_state->stage_stats, aux_out);
 }
 
 Status ModularFrameEncoder::PrepareEncoding(const FrameHeader& frame_header,
                                             ThreadPool* pool,
                                             EncoderHeuristics* heuristics,
+                                            EncoderStageStats* stage_stats,
                                             AuxOut* aux_out) {
   if (!tree_.empty()) return true;
 
+  EncoderStageTimer tree_timer(stage_stats, JXL_ENC_STAGE_MODULAR_TREE);
+
   // Compute tree.
   size_t num_streams = stream_images_.size();
   stream_headers_.resize(num_streams);
@@ -998,8 +1003,12 @@ Status ModularFrameEncoder::PrepareEncoding(const FrameHeader& frame_header,
     std::atomic_flag invalid_force_wp = ATOMIC_FLAG_INIT;
 
     std::vector<Tree> trees(useful_splits.size() - 1);
+    // With a single tree (e.g. for lossless images), learning it can use the
+    // pool itself. Otherwise the trees are learned in parallel.
+    ThreadPool* tree_pool = trees.size() == 1 ? pool : nullptr;
     JXL_RETURN_IF_ERROR(RunOnPool(
-        pool, 0, useful_splits.size() - 1, ThreadPool::NoInit,
+        trees.size() == 1 ? nullptr : pool, 0, useful_splits.size() - 1,
+        ThreadPool::NoInit,
         [&](const uint32_t chunk, size_t /* thread */) {
           // TODO(veluca): parallelize more.
           size_t total_pixels = 0;
@@ -1056,10 +1065,9 @@ Status ModularFrameEncoder::PrepareEncoding(const FrameHeader& frame_header,
                 /*aux_out=*/nullptr, 0, i, &tree_samples, &total_pixels));
           }
 
-          // TODO(veluca): parallelize more.
-          trees[chunk] =
-              LearnTree(std::move(tree_samples), total_pixels,
-                        stream_options_[start], local_multiplier_info, range);
+          trees[chunk] = LearnTree(std::move(tree_samples), total_pixels,
+                                   stream_options_[start],
+                                   local_multiplier_info, range, tree_pool);
         },
         "LearnTrees"));
     if (invalid_force_wp.test_and_set(std::memory_order_acq_rel)) {
@@ -1091,6 +1099,7 @@ Status ModularFrameEncoder::PrepareEncoding(const FrameHeader& frame_header,
   TokenizeTree(tree_, &tree_tokens_[0], &decoded_tree);
   JXL_ASSERT(tree_.size() == decoded_tree.size());
   tree_ = std::move(decoded_tree);
+  tree_timer.Stop();
 
   if (kPrintTree && WantDebugOutput(aux_out)) {
     if (frame_header.dc_level > 0) {
@@ -1101,6 +1110,7 @@ Status ModularFrameEncoder::PrepareEncoding(const FrameHeader& frame_header,
     }
   }
 
+  EncoderStageTimer tokenize_timer(stage_stats, JXL_ENC_STAGE_TOKENIZE);
   image_widths_.resize(num_streams);
   JXL_RETURN_IF_ERROR(RunOnPool(
       pool, 0, num_streams, ThreadPool::NoInit,
@@ -1125,7 +1135,8 @@ Status ModularFrameEncoder::PrepareEncoding(const FrameHeader& frame_header,
 }
 
 Status ModularFrameEncoder::EncodeGlobalInfo(BitWriter* writer,
-                                             AuxOut* aux_out) {
+                                             AuxOut* aux_out,
+                                             ThreadPool* pool) {
   BitWriter::Allotment allotment(writer, 1);
   // If we are using brotli, or not using modular mode.
   if (tree_tokens_.empty() || tree_tokens_[0].empty()) {
@@ -1182,6 +1193,8 @@ Status ModularFrameEncoder::EncodeGlobalInfo(BitWriter* writer,
   WriteTokens(tree_tokens_[0], code_, context_map_, writer, kLayerModularTree,
               aux_out);
   params.image_widths = image_widths_;
+  // Large trees have thousands of contexts to cluster.
+  params.pool = pool;
   // Write histograms.
   BuildAndEncodeHistograms(params, (tree_.size() + 1) / 2, tokens_, &code_,
                            &context_map_, writer, kLayerModularGlobal, aux_out);
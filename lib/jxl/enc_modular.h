@@ -13,6 +13,7 @@
 #include "lib/jxl/enc_bit_writer.h"
 #include "lib/jxl/enc_cache.h"
 #include "lib/jxl/enc_params.h"
+#include "lib/jxl/enc_stage_stats.h"
 #include "lib/jxl/frame_header.h"
 #include "lib/jxl/image.h"
 #include "lib/jxl/image_bundle.h"
@@ -33,7 +34,8 @@ class ModularFrameEncoder {
                              const JxlCmsInterface& cms, ThreadPool* pool,
                              AuxOut* aux_out, bool do_color);
   // Encodes global info (tree + histograms) in the `writer`.
-  Status EncodeGlobalInfo(BitWriter* writer, AuxOut* aux_out);
+  Status EncodeGlobalInfo(BitWriter* writer, AuxOut* aux_out,
+                          ThreadPool* pool);
   // Encodes a specific modular image (identified by `stream`) in the `writer`,
   // assigning bits to the provided `layer`.
   Status EncodeStream(BitWriter* writer, AuxOut* aux_out, size_t layer,
@@ -65,6 +67,7 @@ class ModularFrameEncoder {
  private:
   Status PrepareEncoding(const FrameHeader& frame_header, ThreadPool* pool,
                          EncoderHeuristics* heuristics,
+                         EncoderStageStats* stage_stats,
                          AuxOut* aux_out = nullptr);
   Status PrepareStreamParams(const Rect& rect, const CompressParams& cparams,
                              int minShift, int maxShift,
@@ -191,6 +191,12 @@ struct CompressParams {
   // Use brotli compression for any boxes derived from a JPEG frame.
   bool jpeg_compress_boxes = true;
 
+  // If true, the AC tokens of only a sample of the groups are kept in memory
+  // to build the histograms, and the other groups are tokenized again when
+  // they are written. This bounds the memory used by the tokens of large
+  // frames, at a small cost in density and speed.
+  bool streaming_ac_tokens = false;
+
   // Set the noise to what it would approximately be if shooting at the nominal
   // exposure for a given ISO setting on a 35mm camera.
   float photon_noise_iso = 0;
@@ -0,0 +1,91 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef LIB_JXL_ENC_STAGE_STATS_H_
+#define LIB_JXL_ENC_STAGE_STATS_H_
+
+// Time and memory used by the stages of the encoder, reported to the
+// application with JxlEncoderSetStageStatsCallback.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "jxl/encode.h"
+#include "lib/jxl/base/cache_aligned.h"
+#include "lib/jxl/base/thread_cpu_time.h"
+
+namespace jxl {
+
+constexpr size_t kNumEncoderStages = JXL_ENC_STAGE_DC_FRAME + 1;
+
+// Stats of a single frame. Stages may be entered several times, e.g. for the
+// reference frames of patches, and their measurements are summed.
+struct EncoderStageStats {
+  struct Stage {
+    bool entered = false;
+    JxlEncoderStageStats stats = {0.0, 0.0, 0};
+  };
+  Stage stages[kNumEncoderStages];
+};
+
+// Adds the resources used between its construction and destruction to the
+// given stage of stats. Does nothing if stats is null, which is the case
+// unless the application asked for the stats. Must be used from the thread
+// that calls EncodeFrame, for stages that are not nested in each other.
+// The CPU time and the allocations are those of the calling thread and of the
+// tasks it runs on the ThreadPool, so other encoders running in the same
+// process are not counted.
+class EncoderStageTimer {
+ public:
+  EncoderStageTimer(EncoderStageStats* stats, JxlEncoderStage stage)
+      : stats_(stats),
+        stage_(stage),
+        cpu_time_(stats ? &cpu_nanoseconds_ : nullptr) {
+    if (!stats_) return;
+    start_wall_ = std::chrono::steady_clock::now();
+    previous_counter_ = CacheAligned::ThreadAllocationCounter();
+    CacheAligned::SetThreadAllocationCounter(&allocated_bytes_);
+  }
+
+  EncoderStageTimer(const EncoderStageTimer&) = delete;
+  EncoderStageTimer& operator=(const EncoderStageTimer&) = delete;
+
+  ~EncoderStageTimer() { Stop(); }
+
+  // Ends the measurement before the end of the scope.
+  void Stop() {
+    if (!stats_) return;
+    EncoderStageStats::Stage& stage = stats_->stages[stage_];
+    stage.entered = true;
+    stage.stats.wall_seconds += std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now() -
+                                    start_wall_)
+                                    .count();
+    cpu_time_.Release();
+    stage.stats.cpu_seconds +=
+        cpu_nanoseconds_.load(std::memory_order_relaxed) * 1E-9;
+    CacheAligned::SetThreadAllocationCounter(previous_counter_);
+    stage.stats.allocated_bytes +=
+        allocated_bytes_.load(std::memory_order_relaxed);
+    stats_ = nullptr;
+  }
+
+ private:
+  EncoderStageStats* stats_;
+  JxlEncoderStage stage_;
+  std::chrono::steady_clock::time_point start_wall_;
+  std::atomic<uint64_t>* previous_counter_ = nullptr;
+  std::atomic<uint64_t> allocated_bytes_{0};
+  std::atomic<uint64_t> cpu_nanoseconds_{0};
+  // Declared after cpu_nanoseconds_, which it adds to.
+  ScopedCpuTimeCounter cpu_time_;
+};
+
+}  // namespace jxl
+
+#endif  // LIB_JXL_ENC_STAGE_STATS_H_
@@ -20,7 +20,9 @@
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/color_encoding_internal.h"
 #include "lib/jxl/color_management.h"
+#include "lib/jxl/common.h"
 #include "lib/jxl/enc_bit_writer.h"
+#include "lib/jxl/enc_external_image-inl.h"
 #include "lib/jxl/enc_image_bundle.h"
 #include "lib/jxl/fast_math-inl.h"
 #include "lib/jxl/fields.h"
@@ -197,6 +199,67 @@ Status SRGBToXYBAndLinear(const Image3F& srgb,
       "SRGBToXYBAndLinear");
 }
 
+// Fills premul_absorb, which must have room for 12 vectors, with the
+// pre-broadcasted constants of LinearRGBToXYB.
+void ComputePremulAbsorb(float intensity_target, float* premul_absorb) {
+  const HWY_FULL(float) d;
+  const size_t N = Lanes(d);
+  for (size_t i = 0; i < 9; ++i) {
+    const auto absorb =
+        Set(d, kOpsinAbsorbanceMatrix[i] * (intensity_target / 255.0f));
+    Store(absorb, d, premul_absorb + i * N);
+  }
+  for (size_t i = 0; i < 3; ++i) {
+    const auto neg_bias_cbrt = Set(d, -cbrtf(kOpsinAbsorbanceBias[i]));
+    Store(neg_bias_cbrt, d, premul_absorb + (9 + i) * N);
+  }
+}
+
+Status ExternalSRGBToXYB(const uint8_t* JXL_RESTRICT in, size_t row_size,
+                         size_t xsize, size_t ysize, JxlDataType data_type,
+                         size_t num_channels, bool swap_bytes, float mul,
+                         float intensity_target, ThreadPool* pool,
+                         Image3F* JXL_RESTRICT xyb) {
+  PROFILER_FUNC;
+  JXL_ASSERT(xyb->xsize() == xsize && xyb->ysize() == ysize);
+  const HWY_FULL(float) d;
+  HWY_ALIGN float premul_absorb[MaxLanes(d) * 12];
+  ComputePremulAbsorb(intensity_target, premul_absorb);
+
+  // Three rows of nonlinear sRGB per thread. Their padding is zeroed once,
+  // because the loop below reads whole vectors.
+  ImageF srgb_rows;
+  const auto init = [&](size_t num_threads) -> Status {
+    srgb_rows = ImageF(RoundUpTo(xsize, Lanes(d)), 3 * num_threads);
+    ZeroFillImage(&srgb_rows);
+    return true;
+  };
+  return RunOnPool(
+      pool, 0, static_cast<uint32_t>(ysize), init,
+      [&](const uint32_t task, size_t thread) {
+        const size_t y = static_cast<size_t>(task);
+        float* JXL_RESTRICT row_srgb0 = srgb_rows.Row(3 * thread + 0);
+        float* JXL_RESTRICT row_srgb1 = srgb_rows.Row(3 * thread + 1);
+        float* JXL_RESTRICT row_srgb2 = srgb_rows.Row(3 * thread + 2);
+        // Alpha, if any, is left to the caller.
+        float* rows_out[4] = {row_srgb0, row_srgb1, row_srgb2, nullptr};
+        LoadExternalRow(in + row_size * y, xsize, data_type, num_channels,
+                        swap_bytes, mul, rows_out);
+
+        float* JXL_RESTRICT row_xyb0 = xyb->PlaneRow(0, y);
+        float* JXL_RESTRICT row_xyb1 = xyb->PlaneRow(1, y);
+        float* JXL_RESTRICT row_xyb2 = xyb->PlaneRow(2, y);
+        for (size_t x = 0; x < xsize; x += Lanes(d)) {
+          const auto in_r = LinearFromSRGB(Load(d, row_srgb0 + x));
+          const auto in_g = LinearFromSRGB(Load(d, row_srgb1 + x));
+          const auto in_b = LinearFromSRGB(Load(d, row_srgb2 + x));
+          LinearRGBToXYB(in_r, in_g, in_b, premul_absorb, row_xyb0 + x,
+                         row_xyb1 + x, row_xyb2 + x);
+        }
+      },
+      "ExternalSRGBToXYB");
+}
+
 // This is different from Butteraugli's OpsinDynamicsImage() in the sense that
 // it does not contain a sensitivity multiplier based on the blurred image.
 const ImageBundle* ToXYB(const ImageBundle& in, ThreadPool* pool,
@@ -209,18 +272,8 @@ const ImageBundle* ToXYB(const ImageBundle& in, ThreadPool* pool,
   JXL_ASSERT(SameSize(in, *xyb));
 
   const HWY_FULL(float) d;
-  // Pre-broadcasted constants
   HWY_ALIGN float premul_absorb[MaxLanes(d) * 12];
-  const size_t N = Lanes(d);
-  for (size_t i = 0; i < 9; ++i) {
-    const auto absorb = Set(d, kOpsinAbsorbanceMatrix[i] *
-                                   (in.metadata()->IntensityTarget() / 255.0f));
-    Store(absorb, d, premul_absorb + i * N);
-  }
-  for (size_t i = 0; i < 3; ++i) {
-    const auto neg_bias_cbrt = Set(d, -cbrtf(kOpsinAbsorbanceBias[i]));
-    Store(neg_bias_cbrt, d, premul_absorb + (9 + i) * N);
-  }
+  ComputePremulAbsorb(in.metadata()->IntensityTarget(), premul_absorb);
 
   const bool want_linear = linear != nullptr;
 
@@ -365,6 +418,17 @@ void ScaleXYB(Image3F* opsin) {
   }
 }
 
+HWY_EXPORT(ExternalSRGBToXYB);
+Status ExternalSRGBToXYB(const uint8_t* JXL_RESTRICT in, size_t row_size,
+                         size_t xsize, size_t ysize, JxlDataType data_type,
+                         size_t num_channels, bool swap_bytes, float mul,
+                         float intensity_target, ThreadPool* pool,
+                         Image3F* JXL_RESTRICT xyb) {
+  return HWY_DYNAMIC_DISPATCH(ExternalSRGBToXYB)(
+      in, row_size, xsize, ysize, data_type, num_channels, swap_bytes, mul,
+      intensity_target, pool, xyb);
+}
+
 HWY_EXPORT(RgbToYcbcr);
 Status RgbToYcbcr(const ImageF& r_plane, const ImageF& g_plane,
                   const ImageF& b_plane, ImageF* y_plane, ImageF* cb_plane,
@@ -8,6 +8,10 @@
 
 // Converts to XYB color space.
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jxl/types.h"
 #include "lib/jxl/aux_out_fwd.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/data_parallel.h"
@@ -27,6 +31,19 @@ const ImageBundle* ToXYB(const ImageBundle& in, ThreadPool* pool,
                          Image3F* JXL_RESTRICT xyb, const JxlCmsInterface& cms,
                          ImageBundle* JXL_RESTRICT linear = nullptr);
 
+// Converts rows of interleaved nonlinear sRGB samples, consecutive rows being
+// row_size bytes apart, directly to XYB without an intermediate float image.
+// Only the first three of num_channels (3 or 4) samples of each pixel are
+// read. The arguments must have been validated as by ConvertFromExternal;
+// swap_bytes tells whether the byte order differs from the native one, and
+// integer samples are multiplied by mul. Gives the same result as
+// ConvertFromExternal followed by ToXYB.
+Status ExternalSRGBToXYB(const uint8_t* JXL_RESTRICT in, size_t row_size,
+                         size_t xsize, size_t ysize, JxlDataType data_type,
+                         size_t num_channels, bool swap_bytes, float mul,
+                         float intensity_target, ThreadPool* pool,
+                         Image3F* JXL_RESTRICT xyb);
+
 // Transforms each color component of the given XYB image into the [0.0, 1.0]
 // interval with an affine transform.
 void ScaleXYB(Image3F* opsin);
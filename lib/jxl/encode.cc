@@ -8,6 +8,7 @@
 #include <brotli/encode.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstring>
 
@@ -255,86 +256,49 @@ JxlEncoderStatus VerifyInputBitDepth(JxlBitDepth bit_depth,
   return JXL_ENC_SUCCESS;
 }
 
-bool EncodeFrameIndexBox(const jxl::JxlEncoderFrameIndexBox& frame_index_box,
-                         jxl::BitWriter& writer) {
-  bool ok = true;
-  int NF = 0;
+void EncodeFrameIndexBox(const jxl::JxlEncoderFrameIndexBox& frame_index_box,
+                         jxl::PaddedBytes* output) {
+  // The first frame is always listed.
+  std::vector<size_t> indexed;
   for (size_t i = 0; i < frame_index_box.entries.size(); ++i) {
     if (i == 0 || frame_index_box.entries[i].to_be_indexed) {
-      ++NF;
+      indexed.push_back(i);
     }
   }
-  // Frame index box contents varint + 8 bytes
-  // continue with NF * 3 * varint
-  // varint max length is 10 for 64 bit numbers, and these numbers
-  // are limited to 63 bits.
-  static const int kVarintMaxLength = 10;
-  static const int kFrameIndexBoxHeaderLength = kVarintMaxLength + 8;
-  static const int kFrameIndexBoxElementLength = 3 * kVarintMaxLength;
-  const int buffer_size =
-      kFrameIndexBoxHeaderLength + NF * kFrameIndexBoxElementLength;
-  std::vector<uint8_t> buffer_vec(buffer_size);
-  uint8_t* buffer = buffer_vec.data();
-  size_t output_pos = 0;
-  ok &= jxl::EncodeVarInt(NF, buffer_vec.size(), &output_pos, buffer);
-  StoreBE32(frame_index_box.TNUM, &buffer[output_pos]);
-  output_pos += 4;
-  StoreBE32(frame_index_box.TDEN, &buffer[output_pos]);
-  output_pos += 4;
-  // When we record a frame in the index, the record needs to know
-  // how many frames until the next indexed frame. That is why
-  // we store the 'prev' record. That 'prev' record needs to store
-  // the offset byte position to previously recorded indexed frame,
-  // that's why we also trace previous to the previous frame.
-  int prev_prev_ix = -1;  // For position offset (OFFi) delta coding.
-  int prev_ix = 0;
-  int T_prev = 0;
-  int T = 0;
-  for (size_t i = 1; i < frame_index_box.entries.size(); ++i) {
-    if (frame_index_box.entries[i].to_be_indexed) {
-      // Now we can record the previous entry, since we need to store
-      // there how many frames until the next one.
-      int64_t OFFi = frame_index_box.entries[prev_ix].OFFi;
-      if (prev_prev_ix != -1) {
-        // Offi needs to be offset of start byte of this frame compared to start
-        // byte of previous frame from this index in the JPEG XL codestream. For
-        // the first frame, this is the offset from the first byte of the JPEG
-        // XL codestream.
-        OFFi -= frame_index_box.entries[prev_prev_ix].OFFi;
+  jxl::EncodeVarInt(indexed.size(), output);
+  size_t pos = output->size();
+  output->resize(pos + 8);
+  StoreBE32(frame_index_box.TNUM, output->data() + pos);
+  StoreBE32(frame_index_box.TDEN, output->data() + pos + 4);
+  for (size_t k = 0; k < indexed.size(); ++k) {
+    const size_t i = indexed[k];
+    // For the last listed frame, Ti and Fi extend to the end of the stream.
+    const size_t next = k + 1 < indexed.size() ? indexed[k + 1]
+                                               : frame_index_box.entries.size();
+    // OFFi is relative to the previous listed frame, or to the start of the
+    // codestream for the first one.
+    uint64_t OFFi = frame_index_box.entries[i].OFFi;
+    if (k > 0) OFFi -= frame_index_box.entries[indexed[k - 1]].OFFi;
+    // Fi counts displayed frames: a frame with a duration of 0 is a layer of
+    // the next displayed frame, except for the last frame of the stream.
+    uint64_t Ti = 0;
+    uint64_t Fi = 0;
+    for (size_t j = i; j < next; ++j) {
+      Ti += frame_index_box.entries[j].duration;
+      if (frame_index_box.entries[j].duration != 0 ||
+          j + 1 == frame_index_box.entries.size()) {
+        ++Fi;
       }
-      int32_t Ti = T_prev;
-      int32_t Fi = i - prev_ix;
-      ok &= jxl::EncodeVarInt(OFFi, buffer_vec.size(), &output_pos, buffer);
-      ok &= jxl::EncodeVarInt(Ti, buffer_vec.size(), &output_pos, buffer);
-      ok &= jxl::EncodeVarInt(Fi, buffer_vec.size(), &output_pos, buffer);
-      prev_prev_ix = prev_ix;
-      prev_ix = i;
-      T_prev = T;
-      T += frame_index_box.entries[i].duration;
     }
+    jxl::EncodeVarInt(OFFi, output);
+    jxl::EncodeVarInt(Ti, output);
+    jxl::EncodeVarInt(Fi, output);
   }
-  {
-    // Last frame.
-    size_t i = frame_index_box.entries.size();
-    int64_t OFFi = frame_index_box.entries[prev_ix].OFFi;
-    if (prev_prev_ix != -1) {
-      OFFi -= frame_index_box.entries[prev_prev_ix].OFFi;
-    }
-    int32_t Ti = T_prev;
-    int32_t Fi = i - prev_ix;
-    ok &= jxl::EncodeVarInt(OFFi, buffer_vec.size(), &output_pos, buffer);
-    ok &= jxl::EncodeVarInt(Ti, buffer_vec.size(), &output_pos, buffer);
-    ok &= jxl::EncodeVarInt(Fi, buffer_vec.size(), &output_pos, buffer);
-  }
-  // Enough buffer has been allocated, this function should never fail in
-  // writing.
-  JXL_ASSERT(ok);
-  return ok;
 }
 
 }  // namespace
 
-JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
+JxlEncoderStatus JxlEncoderStruct::RefillOutputQueue() {
   jxl::PaddedBytes bytes;
 
   jxl::JxlEncoderQueuedInput& input = input_queue[0];
@@ -396,16 +360,16 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
 
     if (MustUseContainer()) {
       // Add "JXL " and ftyp box.
-      output_byte_queue.insert(
-          output_byte_queue.end(), jxl::kContainerHeader,
+      output_queue.Append(
+          jxl::kContainerHeader,
           jxl::kContainerHeader + sizeof(jxl::kContainerHeader));
       if (codestream_level != 5) {
         // Add jxll box directly after the ftyp box to indicate the codestream
         // level.
-        output_byte_queue.insert(
-            output_byte_queue.end(), jxl::kLevelBoxHeader,
+        output_queue.Append(
+            jxl::kLevelBoxHeader,
             jxl::kLevelBoxHeader + sizeof(jxl::kLevelBoxHeader));
-        output_byte_queue.push_back(codestream_level);
+        output_queue.push_back(codestream_level);
       }
 
       // Whether to write the basic info and color profile header of the
@@ -418,19 +382,16 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
 
       if (partial_header) {
         jxl::AppendBoxHeader(jxl::MakeBoxType("jxlp"), bytes.size() + 4,
-                             /*unbounded=*/false, &output_byte_queue);
-        AppendJxlpBoxCounter(jxlp_counter++, /*last=*/false,
-                             &output_byte_queue);
-        output_byte_queue.insert(output_byte_queue.end(), bytes.data(),
-                                 bytes.data() + bytes.size());
-        bytes.clear();
+                             /*unbounded=*/false, &output_queue);
+        AppendJxlpBoxCounter(jxlp_counter++, /*last=*/false, &output_queue);
+        output_queue.Append(std::move(bytes));
       }
 
       if (store_jpeg_metadata && !jpeg_metadata.empty()) {
         jxl::AppendBoxHeader(jxl::MakeBoxType("jbrd"), jpeg_metadata.size(),
-                             false, &output_byte_queue);
-        output_byte_queue.insert(output_byte_queue.end(), jpeg_metadata.begin(),
-                                 jpeg_metadata.end());
+                             false, &output_queue);
+        output_queue.Append(jpeg_metadata.data(),
+                            jpeg_metadata.data() + jpeg_metadata.size());
       }
     }
     wrote_bytes = true;
@@ -486,8 +447,38 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
       ib.duration = 0;
       ib.timecode = 0;
     }
+    if (input_frame->option_values.frame_index_box &&
+        (input_frame->option_values.header.layer_info.have_crop ||
+         input_frame->option_values.header.layer_info.blend_info.blendmode !=
+             JXL_BLEND_REPLACE)) {
+      return JXL_API_ERROR(this, JXL_ENC_ERR_API_USAGE,
+                           "Only frames without cropping or blending can be "
+                           "indexed");
+    }
     frame_index_box.AddFrame(codestream_bytes_written_end_of_frame, ib.duration,
                              input_frame->option_values.frame_index_box);
+    {
+      // Cropped frames take the area outside of the crop from the blend
+      // source, blended frames all of it.
+      const JxlLayerInfo& layer_info =
+          input_frame->option_values.header.layer_info;
+      std::vector<JxlBlendInfo> blend_infos(1, layer_info.blend_info);
+      for (size_t i = 0; i < metadata.m.num_extra_channels; ++i) {
+        blend_infos.push_back(
+            i < input_frame->option_values.extra_channel_blend_info.size()
+                ? input_frame->option_values.extra_channel_blend_info[i]
+                : layer_info.blend_info);
+      }
+      for (const JxlBlendInfo& blend_info : blend_infos) {
+        if ((layer_info.have_crop ||
+             blend_info.blendmode != JXL_BLEND_REPLACE) &&
+            !frame_index_box.CanReadSlot(blend_info.source)) {
+          return JXL_API_ERROR(this, JXL_ENC_ERR_API_USAGE,
+                               "Frames from an indexed frame on cannot use a "
+                               "reference frame saved before it");
+        }
+      }
+    }
     ib.blendmode = static_cast<jxl::BlendMode>(
         input_frame->option_values.header.layer_info.blend_info.blendmode);
     ib.blend =
@@ -499,8 +490,14 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
     ib.use_for_next_frame = !!save_as_reference;
 
     jxl::FrameInfo frame_info;
+    frame_info.ib_needs_color_transform = !input_frame->color_is_xyb;
     bool last_frame = frames_closed && !num_queued_frames;
     frame_info.is_last = last_frame;
+    // Frames with a duration of 0 are also saved, to be blended onto.
+    if (!last_frame && (ib.duration == 0 || save_as_reference != 0) &&
+        save_as_reference < jxl::kMaxNumReferenceFrames) {
+      frame_index_box.slots_saved_since_index |= 1u << save_as_reference;
+    }
     frame_info.save_as_reference = save_as_reference;
     frame_info.source =
         input_frame->option_values.header.layer_info.blend_info.source;
@@ -531,43 +528,76 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
       ib.origin.y0 = input_frame->option_values.header.layer_info.crop_y0;
     }
     JXL_ASSERT(writer.BitsWritten() == 0);
-    if (!jxl::EncodeFrame(input_frame->option_values.cparams, frame_info,
-                          &metadata, input_frame->frame, &enc_state, cms,
-                          thread_pool.get(), &writer,
-                          /*aux_out=*/nullptr)) {
-      return JXL_API_ERROR(this, JXL_ENC_ERR_GENERIC, "Failed to encode frame");
+    jxl::PaddedBytes frame_bytes;
+    jxl::EncoderStageStats stage_stats = input_frame->stage_stats;
+    if (stage_stats_callback) enc_state.stage_stats = &stage_stats;
+    if (input_frame->fast_lossless_frame) {
+      // The groups were encoded when the frame was added, only the frame
+      // header and TOC remain to be written.
+      jxl::EncoderStageTimer timer(enc_state.stage_stats, JXL_ENC_STAGE_WRITE);
+      frame_bytes.resize(JxlFastLosslessMaxRequiredOutput(
+          input_frame->fast_lossless_frame.get()));
+      frame_bytes.resize(JxlFastLosslessWriteFrame(
+          input_frame->fast_lossless_frame.get(), /*add_image_header=*/0,
+          last_frame, frame_bytes.data()));
+    } else {
+      if (!jxl::EncodeFrame(input_frame->option_values.cparams, frame_info,
+                            &metadata, input_frame->frame, &enc_state, cms,
+                            thread_pool.get(), &writer,
+                            /*aux_out=*/nullptr)) {
+        return JXL_API_ERROR(this, JXL_ENC_ERR_GENERIC,
+                             "Failed to encode frame");
+      }
+      frame_bytes = std::move(writer).TakeBytes();
+    }
+    if (stage_stats_callback) {
+      for (size_t i = 0; i < jxl::kNumEncoderStages; i++) {
+        if (!stage_stats.stages[i].entered) continue;
+        stage_stats_callback(stage_stats_opaque, num_encoded_frames,
+                             static_cast<JxlEncoderStage>(i),
+                             &stage_stats.stages[i].stats);
+      }
     }
+    num_encoded_frames++;
     codestream_bytes_written_beginning_of_frame =
         codestream_bytes_written_end_of_frame;
-    codestream_bytes_written_end_of_frame +=
-        jxl::DivCeil(writer.BitsWritten(), 8);
+    codestream_bytes_written_end_of_frame += frame_bytes.size();
 
     // Possibly bytes already contains the codestream header: in case this is
     // the first frame, and the codestream header was not encoded as jxlp above.
-    bytes.append(std::move(writer).TakeBytes());
+    // The frame itself is moved to the output queue without copying.
+    const size_t codestream_size = bytes.size() + frame_bytes.size();
     if (MustUseContainer()) {
       if (last_frame && jxlp_counter == 0) {
         // If this is the last frame and no jxlp boxes were used yet, it's
         // slighly more efficient to write a jxlc box since it has 4 bytes less
         // overhead.
-        jxl::AppendBoxHeader(jxl::MakeBoxType("jxlc"), bytes.size(),
-                             /*unbounded=*/false, &output_byte_queue);
+        jxl::AppendBoxHeader(jxl::MakeBoxType("jxlc"), codestream_size,
+                             /*unbounded=*/false, &output_queue);
       } else {
-        jxl::AppendBoxHeader(jxl::MakeBoxType("jxlp"), bytes.size() + 4,
-                             /*unbounded=*/false, &output_byte_queue);
-        AppendJxlpBoxCounter(jxlp_counter++, last_frame, &output_byte_queue);
+        jxl::AppendBoxHeader(jxl::MakeBoxType("jxlp"), codestream_size + 4,
+                             /*unbounded=*/false, &output_queue);
+        AppendJxlpBoxCounter(jxlp_counter++, last_frame, &output_queue);
       }
     }
 
-    output_byte_queue.insert(output_byte_queue.end(), bytes.data(),
-                             bytes.data() + bytes.size());
+    output_queue.Append(std::move(bytes));
+    output_queue.Append(std::move(frame_bytes));
 
     last_used_cparams = input_frame->option_values.cparams;
-    if (last_frame && frame_index_box.StoreFrameIndexBox()) {
-      bytes.clear();
-      EncodeFrameIndexBox(frame_index_box, writer);
-      jxl::AppendBoxHeader(jxl::MakeBoxType("jxli"), bytes.size(),
-                           /*unbounded=*/false, &output_byte_queue);
+    if (last_frame && MustUseContainer() &&
+        frame_index_box.StoreFrameIndexBox()) {
+      // The durations are in animation ticks, which last
+      // tps_denominator / tps_numerator seconds.
+      if (metadata.m.have_animation) {
+        frame_index_box.TNUM = metadata.m.animation.tps_denominator;
+        frame_index_box.TDEN = metadata.m.animation.tps_numerator;
+      }
+      jxl::PaddedBytes index_bytes;
+      EncodeFrameIndexBox(frame_index_box, &index_bytes);
+      jxl::AppendBoxHeader(jxl::MakeBoxType("jxli"), index_bytes.size(),
+                           /*unbounded=*/false, &output_queue);
+      output_queue.Append(std::move(index_bytes));
     }
   } else {
     // Not a frame, so is a box instead
@@ -590,14 +620,13 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
                              "Brotli compression for brob box failed");
       }
       jxl::AppendBoxHeader(jxl::MakeBoxType("brob"), compressed.size(), false,
-                           &output_byte_queue);
-      output_byte_queue.insert(output_byte_queue.end(), compressed.data(),
-                               compressed.data() + compressed.size());
+                           &output_queue);
+      output_queue.Append(std::move(compressed));
     } else {
       jxl::AppendBoxHeader(box->type, box->contents.size(), false,
-                           &output_byte_queue);
-      output_byte_queue.insert(output_byte_queue.end(), box->contents.data(),
-                               box->contents.data() + box->contents.size());
+                           &output_queue);
+      output_queue.Append(box->contents.data(),
+                          box->contents.data() + box->contents.size());
     }
   }
 
@@ -1015,6 +1044,7 @@ JxlEncoderStatus JxlEncoderFrameSettingsSetOption(
     case JXL_ENC_FRAME_SETTING_LOSSY_PALETTE:
     case JXL_ENC_FRAME_SETTING_JPEG_RECON_CFL:
     case JXL_ENC_FRAME_SETTING_JPEG_COMPRESS_BOXES:
+    case JXL_ENC_FRAME_SETTING_STREAMING_AC_TOKENS:
       if (value < -1 || value > 1) {
         return JXL_API_ERROR(
             frame_settings->enc, JXL_ENC_ERR_API_USAGE,
@@ -1223,7 +1253,21 @@ JxlEncoderStatus JxlEncoderFrameSettingsSetOption(
       }
       return JXL_ENC_SUCCESS;
     case JXL_ENC_FRAME_INDEX_BOX:
-      frame_settings->values.frame_index_box = true;
+      if (value < 0 || value > 1) {
+        return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_API_USAGE,
+                             "Option value has to be 0 or 1");
+      }
+      if (value == 1 && frame_settings->enc->wrote_bytes &&
+          !frame_settings->enc->MustUseContainer()) {
+        return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_API_USAGE,
+                             "The frame index box requires the container, "
+                             "which must be enabled before output starts");
+      }
+      frame_settings->values.frame_index_box = (value == 1);
+      if (value == 1) {
+        frame_settings->enc->frame_index_box.index_box_requested_through_api =
+            true;
+      }
       return JXL_ENC_SUCCESS;
     case JXL_ENC_FRAME_SETTING_PHOTON_NOISE:
       return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_NOT_SUPPORTED,
@@ -1232,6 +1276,9 @@ JxlEncoderStatus JxlEncoderFrameSettingsSetOption(
     case JXL_ENC_FRAME_SETTING_JPEG_COMPRESS_BOXES:
       frame_settings->values.cparams.jpeg_compress_boxes = value;
       return JXL_ENC_SUCCESS;
+    case JXL_ENC_FRAME_SETTING_STREAMING_AC_TOKENS:
+      frame_settings->values.cparams.streaming_ac_tokens = (value == 1);
+      return JXL_ENC_SUCCESS;
     default:
       return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_NOT_SUPPORTED,
                            "Unknown option");
@@ -1321,6 +1368,7 @@ JxlEncoderStatus JxlEncoderFrameSettingsSetFloatOption(
     case JXL_ENC_FRAME_SETTING_BROTLI_EFFORT:
     case JXL_ENC_FRAME_SETTING_FILL_ENUM:
     case JXL_ENC_FRAME_SETTING_JPEG_COMPRESS_BOXES:
+    case JXL_ENC_FRAME_SETTING_STREAMING_AC_TOKENS:
       return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_NOT_SUPPORTED,
                            "Int option, try setting it with "
                            "JxlEncoderFrameSettingsSetOption");
@@ -1355,9 +1403,15 @@ void JxlEncoderReset(JxlEncoder* enc) {
   enc->num_queued_frames = 0;
   enc->num_queued_boxes = 0;
   enc->encoder_options.clear();
-  enc->output_byte_queue.clear();
+  enc->output_queue.clear();
+  enc->output_callback = nullptr;
+  enc->output_callback_opaque = nullptr;
+  enc->stage_stats_callback = nullptr;
+  enc->stage_stats_opaque = nullptr;
+  enc->num_encoded_frames = 0;
   enc->codestream_bytes_written_beginning_of_frame = 0;
   enc->codestream_bytes_written_end_of_frame = 0;
+  enc->frame_index_box = jxl::JxlEncoderFrameIndexBox();
   enc->wrote_bytes = false;
   enc->jxlp_counter = 0;
   enc->metadata = jxl::CodecMetadata();
@@ -1473,7 +1527,8 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
   }
 
   jxl::CodecInOut io;
-  if (!jxl::jpeg::DecodeImageJPG(jxl::Span<const uint8_t>(buffer, size), &io)) {
+  if (!jxl::jpeg::DecodeImageJPG(jxl::Span<const uint8_t>(buffer, size), &io,
+                                 frame_settings->enc->thread_pool.get())) {
     return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_BAD_INPUT,
                          "Error during decode of input JPEG");
   }
@@ -1555,7 +1610,11 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
       jxl::JxlEncoderQueuedFrame{
           frame_settings->values,
           jxl::ImageBundle(&frame_settings->enc->metadata.m),
-          {}});
+          {},
+          {},
+          {},
+          {},
+          /*color_is_xyb=*/false});
   if (!queued_frame) {
     // TODO(jon): when can this happen? is this an API usage error?
     return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_GENERIC,
@@ -1588,9 +1647,36 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
   return JXL_ENC_SUCCESS;
 }
 
-JxlEncoderStatus JxlEncoderAddImageFrame(
-    const JxlEncoderFrameSettings* frame_settings,
-    const JxlPixelFormat* pixel_format, const void* buffer, size_t size) {
+namespace {
+// Whether the color channels of a frame can be converted to XYB as the frame
+// is added, instead of being stored as floats and converted by EncodeFrame:
+// the codestream must be XYB encoded, the input nonlinear sRGB integers, and
+// the effort too low for the encoder to compare with the original pixels.
+bool CanConvertToXYBOnAdd(const JxlEncoderFrameSettings* frame_settings,
+                          const JxlPixelFormat& pixel_format,
+                          const jxl::ColorEncoding& c_current) {
+  const jxl::JxlEncoderFrameSettingsValues& values = frame_settings->values;
+  if (!frame_settings->enc->metadata.m.xyb_encoded || values.lossless) {
+    return false;
+  }
+  if (pixel_format.data_type != JXL_TYPE_UINT8 &&
+      pixel_format.data_type != JXL_TYPE_UINT16) {
+    return false;
+  }
+  return pixel_format.num_channels >= 3 && c_current.IsSRGB() &&
+         !c_current.IsGray() &&
+         values.cparams.speed_tier > jxl::SpeedTier::kKitten;
+}
+
+// Shared implementation of JxlEncoderAddImageFrame and
+// JxlEncoderAddChunkedFrame. The convert function fills in the color and alpha
+// channels of the frame from the input pixels, and converts the color to XYB
+// if its to_xyb argument is set, which only happens if can_convert_to_xyb is.
+template <typename ConvertFunc>
+JxlEncoderStatus AddImageFrame(const JxlEncoderFrameSettings* frame_settings,
+                               const JxlPixelFormat* pixel_format,
+                               bool can_convert_to_xyb,
+                               const ConvertFunc& convert) {
   if (!frame_settings->enc->basic_info_set ||
       (!frame_settings->enc->color_encoding_set &&
        !frame_settings->enc->metadata.m.xyb_encoded)) {
@@ -1624,7 +1710,11 @@ JxlEncoderStatus JxlEncoderAddImageFrame(
       jxl::JxlEncoderQueuedFrame{
           frame_settings->values,
           jxl::ImageBundle(&frame_settings->enc->metadata.m),
-          {}});
+          {},
+          {},
+          {},
+          {},
+          /*color_is_xyb=*/false});
 
   if (!queued_frame) {
     // TODO(jon): when can this happen? is this an API usage error?
@@ -1694,14 +1784,23 @@ JxlEncoderStatus JxlEncoderAddImageFrame(
   size_t bits_per_sample =
       GetBitDepth(frame_settings->values.image_bit_depth,
                   frame_settings->enc->metadata.m, *pixel_format);
-  const uint8_t* uint8_buffer = reinterpret_cast<const uint8_t*>(buffer);
-  if (!jxl::ConvertFromExternal(
-          jxl::Span<const uint8_t>(uint8_buffer, size), xsize, ysize, c_current,
-          /*alpha_is_premultiplied=*/false, bits_per_sample, *pixel_format,
-          frame_settings->enc->thread_pool.get(), &(queued_frame->frame))) {
-    return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_API_USAGE,
-                         "Invalid input buffer");
+  const bool to_xyb =
+      can_convert_to_xyb &&
+      CanConvertToXYBOnAdd(frame_settings, *pixel_format, c_current);
+  {
+    // The conversion to XYB is the color transform stage of the frame.
+    jxl::EncoderStageTimer timer(
+        to_xyb && frame_settings->enc->stage_stats_callback
+            ? &queued_frame->stage_stats
+            : nullptr,
+        JXL_ENC_STAGE_COLOR_TRANSFORM);
+    if (!convert(xsize, ysize, c_current, bits_per_sample, to_xyb,
+                 &(queued_frame->frame))) {
+      return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_API_USAGE,
+                           "Invalid input buffer");
+    }
   }
+  queued_frame->color_is_xyb = to_xyb;
   if (frame_settings->values.lossless &&
       frame_settings->enc->metadata.m.xyb_encoded) {
     return JXL_API_ERROR(
@@ -1715,6 +1814,376 @@ JxlEncoderStatus JxlEncoderAddImageFrame(
   return JXL_ENC_SUCCESS;
 }
 
+// Number of rows requested from a JxlChunkedFrameInputSource at a time, and
+// coded as one frame: one row of groups.
+constexpr size_t kChunkedFrameRows = jxl::kGroupDim;
+
+// Whether the frame can be encoded by the effort 1 lossless encoder, which
+// reads the interleaved input directly and writes a fixed frame header: no
+// animation, crop, blending, reference frame or name, one alpha channel at
+// most, and integer samples of the bit depth of the image.
+bool CanUseFastLossless(const JxlEncoderFrameSettings* frame_settings,
+                        const JxlPixelFormat& pixel_format) {
+  const JxlEncoder* enc = frame_settings->enc;
+  const jxl::ImageMetadata& metadata = enc->metadata.m;
+  const jxl::JxlEncoderFrameSettingsValues& values = frame_settings->values;
+  if (!values.lossless ||
+      values.cparams.speed_tier != jxl::SpeedTier::kLightning) {
+    return false;
+  }
+  // Invalid input is left to AddImageFrame, which reports the error.
+  if (!enc->basic_info_set || !enc->color_encoding_set ||
+      enc->frames_closed || metadata.xyb_encoded) {
+    return false;
+  }
+  if (metadata.have_animation || metadata.bit_depth.floating_point_sample ||
+      metadata.bit_depth.bits_per_sample > 12) {
+    return false;
+  }
+  if ((pixel_format.num_channels < 3) !=
+      (enc->basic_info.num_color_channels == 1)) {
+    return false;
+  }
+  const bool has_alpha =
+      pixel_format.num_channels == 2 || pixel_format.num_channels == 4;
+  if (metadata.num_extra_channels != (has_alpha ? 1 : 0)) return false;
+  if (has_alpha) {
+    const jxl::ExtraChannelInfo& alpha = metadata.extra_channel_info[0];
+    if (alpha.type != jxl::ExtraChannel::kAlpha || alpha.dim_shift != 0 ||
+        alpha.bit_depth.floating_point_sample ||
+        alpha.bit_depth.bits_per_sample != metadata.bit_depth.bits_per_sample) {
+      return false;
+    }
+  }
+  const size_t bits_per_sample = metadata.bit_depth.bits_per_sample;
+  if (pixel_format.data_type != JXL_TYPE_UINT8 &&
+      pixel_format.data_type != JXL_TYPE_UINT16) {
+    return false;
+  }
+  // Samples are stored in a byte up to 8 bits, and in two bytes above.
+  if ((pixel_format.data_type == JXL_TYPE_UINT8) != (bits_per_sample <= 8) ||
+      GetBitDepth(values.image_bit_depth, metadata, pixel_format) !=
+          bits_per_sample) {
+    return false;
+  }
+  const JxlLayerInfo& layer_info = values.header.layer_info;
+  if (layer_info.have_crop || layer_info.save_as_reference != 0 ||
+      layer_info.blend_info.blendmode != JXL_BLEND_REPLACE) {
+    return false;
+  }
+  for (const JxlBlendInfo& blend_info : values.extra_channel_blend_info) {
+    if (blend_info.blendmode != JXL_BLEND_REPLACE) return false;
+  }
+  if (!values.frame_name.empty()) return false;
+  const jxl::CompressParams& cparams = values.cparams;
+  return cparams.resampling <= 1 && cparams.ec_resampling <= 1 &&
+         cparams.photon_noise_iso <= 0 && cparams.manual_noise.empty();
+}
+
+// Effort of the fast lossless encoder used for effort 1 of libjxl. Its effort
+// 2 also tries a palette for RGBA input, which is worth the small slowdown.
+constexpr int kFastLosslessEffort = 2;
+
+// Parallel runner of the fast lossless encoder. The encoder expects all the
+// calls to have run when the runner returns and can't be told about errors, so
+// if the thread pool fails, which it does before running any call, the calls
+// are run serially and the failure is recorded for the caller to report once
+// the frame is prepared.
+struct FastLosslessRunner {
+  jxl::ThreadPool* pool;
+  bool failed;
+};
+
+void RunFastLosslessOnPool(void* runner_opaque, void* opaque,
+                           void fun(void*, size_t), size_t count) {
+  auto* runner = static_cast<FastLosslessRunner*>(runner_opaque);
+  if (!runner->failed &&
+      jxl::RunOnPool(
+          runner->pool, 0, static_cast<uint32_t>(count),
+          jxl::ThreadPool::NoInit,
+          [&](const uint32_t i, size_t /*thread*/) { fun(opaque, i); },
+          "Encode fast lossless")) {
+    return;
+  }
+  runner->failed = true;
+  for (size_t i = 0; i < count; i++) fun(opaque, i);
+}
+
+// Encodes rows of interleaved pixels with the effort 1 lossless encoder and
+// adds the time it took to *stage_stats. Leaves *frame empty if the encoder is
+// not available.
+JxlEncoderStatus PrepareFastLosslessFrame(
+    JxlEncoder* enc, const uint8_t* pixels, size_t xsize, size_t row_size,
+    size_t ysize, size_t num_channels, bool big_endian,
+    jxl::EncoderStageStats* stage_stats,
+    std::unique_ptr<JxlFastLosslessFrameState, jxl::FastLosslessFrameDeleter>*
+        frame) {
+  FastLosslessRunner runner = {enc->thread_pool.get(), /*failed=*/false};
+  {
+    // The fast lossless encoder does not separate tokenization and entropy
+    // coding, all of it is reported as writing.
+    jxl::EncoderStageTimer timer(
+        enc->stage_stats_callback ? stage_stats : nullptr,
+        JXL_ENC_STAGE_WRITE);
+    frame->reset(JxlFastLosslessPrepareFrame(
+        pixels, xsize, row_size, ysize, num_channels,
+        enc->metadata.m.bit_depth.bits_per_sample, big_endian,
+        kFastLosslessEffort, &runner, RunFastLosslessOnPool));
+  }
+  if (runner.failed) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_GENERIC,
+                         "Parallel runner failed to encode the frame");
+  }
+  return JXL_ENC_SUCCESS;
+}
+
+// Encodes the frame with the effort 1 lossless encoder and queues it. Sets
+// *used to false, without queueing anything, if the input is invalid or the
+// encoder is not available; the regular path then encodes or rejects the
+// frame.
+JxlEncoderStatus AddFastLosslessFrame(
+    const JxlEncoderFrameSettings* frame_settings,
+    const JxlPixelFormat& pixel_format, const uint8_t* buffer, size_t size,
+    bool* used) {
+  JxlEncoder* enc = frame_settings->enc;
+  *used = false;
+  size_t xsize, ysize;
+  if (GetCurrentDimensions(frame_settings, xsize, ysize) != JXL_ENC_SUCCESS) {
+    return JXL_ENC_SUCCESS;
+  }
+  const size_t bytes_per_sample =
+      BitsPerChannel(pixel_format.data_type) / jxl::kBitsPerByte;
+  const size_t bytes_per_pixel = pixel_format.num_channels * bytes_per_sample;
+  const size_t last_row_size = xsize * bytes_per_pixel;
+  const size_t align = pixel_format.align;
+  const size_t row_size =
+      align > 1 ? jxl::DivCeil(last_row_size, align) * align : last_row_size;
+  if (size < row_size * (ysize - 1) + last_row_size ||
+      size > row_size * ysize) {
+    return JXL_ENC_SUCCESS;
+  }
+  const bool big_endian =
+      pixel_format.endianness == JXL_BIG_ENDIAN ||
+      (pixel_format.endianness == JXL_NATIVE_ENDIAN && !IsLittleEndian());
+  jxl::EncoderStageStats stage_stats;
+  std::unique_ptr<JxlFastLosslessFrameState, jxl::FastLosslessFrameDeleter>
+      fast_lossless_frame;
+  if (PrepareFastLosslessFrame(enc, buffer, xsize, row_size, ysize,
+                               pixel_format.num_channels, big_endian,
+                               &stage_stats,
+                               &fast_lossless_frame) != JXL_ENC_SUCCESS) {
+    return JXL_ENC_ERROR;
+  }
+  if (!fast_lossless_frame) return JXL_ENC_SUCCESS;
+
+  jxl::FastLosslessInput input = {{}, xsize, ysize, pixel_format.num_channels,
+                                  bytes_per_sample, big_endian};
+  if (enc->metadata.m.num_extra_channels != 0) {
+    // Keep the pixels in case the alpha channel is replaced.
+    input.pixels.resize(last_row_size * ysize);
+    for (size_t y = 0; y < ysize; y++) {
+      memcpy(input.pixels.data() + y * last_row_size, buffer + y * row_size,
+             last_row_size);
+    }
+  }
+  auto queued_frame = jxl::MemoryManagerMakeUnique<jxl::JxlEncoderQueuedFrame>(
+      &enc->memory_manager,
+      jxl::JxlEncoderQueuedFrame{
+          frame_settings->values,
+          jxl::ImageBundle(&enc->metadata.m),
+          std::vector<uint8_t>(enc->metadata.m.num_extra_channels, 1),
+          std::move(fast_lossless_frame), std::move(input), stage_stats,
+          /*color_is_xyb=*/false});
+  if (!queued_frame) return JXL_ENC_SUCCESS;
+  QueueFrame(frame_settings, queued_frame);
+  *used = true;
+  return JXL_ENC_SUCCESS;
+}
+
+// Replaces the alpha samples of a frame encoded by the effort 1 lossless
+// encoder with those of alpha, in [0, 1], and encodes the frame again.
+JxlEncoderStatus SetFastLosslessAlpha(JxlEncoder* enc, const jxl::ImageF& alpha,
+                                      jxl::JxlEncoderQueuedFrame* frame) {
+  jxl::FastLosslessInput& input = frame->fast_lossless_input;
+  if (input.pixels.empty() || alpha.xsize() != input.xsize ||
+      alpha.ysize() != input.ysize) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE,
+                         "Frame encoded at effort 1 has no alpha channel of "
+                         "this size");
+  }
+  // CanUseFastLossless requires the alpha channel to have the bit depth of
+  // the image.
+  const float maxval = static_cast<float>(
+      (1u << enc->metadata.m.bit_depth.bits_per_sample) - 1);
+  const size_t pixel_size = input.num_channels * input.bytes_per_sample;
+  for (size_t y = 0; y < input.ysize; y++) {
+    const float* JXL_RESTRICT row = alpha.ConstRow(y);
+    uint8_t* out = input.pixels.data() + y * input.xsize * pixel_size +
+                   (input.num_channels - 1) * input.bytes_per_sample;
+    for (size_t x = 0; x < input.xsize; x++, out += pixel_size) {
+      const uint32_t v = static_cast<uint32_t>(
+          std::lround(jxl::Clamp1(row[x], 0.0f, 1.0f) * maxval));
+      if (input.bytes_per_sample == 1) {
+        out[0] = static_cast<uint8_t>(v);
+      } else if (input.big_endian) {
+        StoreBE16(v, out);
+      } else {
+        StoreLE16(v, out);
+      }
+    }
+  }
+  return PrepareFastLosslessFrame(
+      enc, input.pixels.data(), input.xsize, input.xsize * pixel_size,
+      input.ysize, input.num_channels, input.big_endian, &frame->stage_stats,
+      &frame->fast_lossless_frame);
+}
+}  // namespace
+
+JxlEncoderStatus JxlEncoderAddImageFrame(
+    const JxlEncoderFrameSettings* frame_settings,
+    const JxlPixelFormat* pixel_format, const void* buffer, size_t size) {
+  const uint8_t* uint8_buffer = reinterpret_cast<const uint8_t*>(buffer);
+  if (CanUseFastLossless(frame_settings, *pixel_format)) {
+    bool used;
+    if (AddFastLosslessFrame(frame_settings, *pixel_format, uint8_buffer, size,
+                             &used) != JXL_ENC_SUCCESS) {
+      return JXL_ENC_ERROR;
+    }
+    if (used) return JXL_ENC_SUCCESS;
+  }
+  return AddImageFrame(
+      frame_settings, pixel_format, /*can_convert_to_xyb=*/true,
+      [&](size_t xsize, size_t ysize, const jxl::ColorEncoding& c_current,
+          size_t bits_per_sample, bool to_xyb, jxl::ImageBundle* ib) {
+        const jxl::Span<const uint8_t> bytes(uint8_buffer, size);
+        if (to_xyb) {
+          return jxl::ConvertFromExternalToXYB(
+              bytes, xsize, ysize, c_current,
+              /*alpha_is_premultiplied=*/false, bits_per_sample, *pixel_format,
+              frame_settings->enc->thread_pool.get(), ib);
+        }
+        return jxl::ConvertFromExternal(
+            bytes, xsize, ysize, c_current, /*alpha_is_premultiplied=*/false,
+            bits_per_sample, *pixel_format,
+            frame_settings->enc->thread_pool.get(), ib);
+      });
+}
+
+JxlEncoderStatus JxlEncoderAddChunkedFrame(
+    const JxlEncoderFrameSettings* frame_settings,
+    const JxlPixelFormat* pixel_format, JxlChunkedFrameInputSource source) {
+  JxlEncoder* enc = frame_settings->enc;
+  const jxl::JxlEncoderFrameSettingsValues& values = frame_settings->values;
+  if (source.get_color_channel_rows == nullptr ||
+      source.release_buffer == nullptr) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE,
+                         "Incomplete chunked frame input source");
+  }
+  if (values.cparams.already_downsampled) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE,
+                         "Chunked frames can not be already downsampled");
+  }
+  if (values.frame_index_box) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE,
+                         "Chunked frames can not be indexed");
+  }
+  // The bands are encoded before this function returns, so extra channels
+  // can only come from the source, as interleaved alpha.
+  const size_t num_interleaved_alpha = static_cast<size_t>(
+      pixel_format->num_channels == 2 || pixel_format->num_channels == 4);
+  if (enc->metadata.m.num_extra_channels > num_interleaved_alpha) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE,
+                         "Chunked frames can only have an interleaved alpha "
+                         "extra channel");
+  }
+  size_t xsize, ysize;
+  if (GetCurrentDimensions(frame_settings, xsize, ysize) != JXL_ENC_SUCCESS) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_GENERIC, "bad dimensions");
+  }
+  const JxlLayerInfo& layer_info = values.header.layer_info;
+  const int32_t x0 = layer_info.have_crop ? layer_info.crop_x0 : 0;
+  const int32_t y0 = layer_info.have_crop ? layer_info.crop_y0 : 0;
+  const uint32_t slot = layer_info.save_as_reference;
+  const size_t bytes_per_pixel = pixel_format->num_channels *
+                                 BitsPerChannel(pixel_format->data_type) /
+                                 jxl::kBitsPerByte;
+  const auto write = [enc](const uint8_t* data, size_t size) {
+    return enc->output_callback(enc->output_callback_opaque, data, size) !=
+           JXL_FALSE;
+  };
+
+  // Each band is coded as a frame cropped to its rows, blended onto the
+  // previous bands through the reference slot of the frame, so that only one
+  // band of the frame is held by the encoder at a time.
+  for (size_t band_y = 0; band_y < ysize; band_y += kChunkedFrameRows) {
+    const size_t band_ysize = std::min(kChunkedFrameRows, ysize - band_y);
+    const bool last_band = band_y + band_ysize == ysize;
+    JxlEncoderFrameSettings band_settings = *frame_settings;
+    JxlLayerInfo& band_layer_info = band_settings.values.header.layer_info;
+    band_layer_info.have_crop = JXL_TRUE;
+    band_layer_info.crop_x0 = x0;
+    band_layer_info.crop_y0 = y0 + static_cast<int32_t>(band_y);
+    band_layer_info.xsize = xsize;
+    band_layer_info.ysize = band_ysize;
+    if (band_y != 0) {
+      band_layer_info.blend_info.source = slot;
+      for (JxlBlendInfo& blend_info :
+           band_settings.values.extra_channel_blend_info) {
+        blend_info.source = slot;
+      }
+    }
+    if (!values.lossless) {
+      // The decoder applies these filters to each band on its own, which
+      // would leave a seam at every band boundary.
+      band_settings.values.cparams.gaborish = jxl::Override::kOff;
+      band_settings.values.cparams.epf = 0;
+    }
+    if (!last_band) {
+      // Zero-duration frames are not displayed on their own and are always
+      // saved in their reference slot.
+      band_settings.values.header.duration = 0;
+      band_settings.values.header.timecode = 0;
+      band_settings.values.frame_name.clear();
+    }
+    // The rows are converted as they arrive, to floats only.
+    const JxlEncoderStatus status = AddImageFrame(
+        &band_settings, pixel_format, /*can_convert_to_xyb=*/false,
+        [&](size_t band_xsize, size_t num_rows,
+            const jxl::ColorEncoding& c_current, size_t bits_per_sample,
+            bool /*to_xyb*/, jxl::ImageBundle* ib) {
+          const auto get_rows = [&](size_t y, size_t rows, size_t* row_size) {
+            const void* pixels = source.get_color_channel_rows(
+                source.opaque, band_y + y, rows, row_size);
+            if (pixels == nullptr) return jxl::Span<const uint8_t>();
+            return jxl::Span<const uint8_t>(
+                static_cast<const uint8_t*>(pixels),
+                *row_size * (rows - 1) + band_xsize * bytes_per_pixel);
+          };
+          const auto release_rows = [&](const uint8_t* pixels) {
+            source.release_buffer(source.opaque, pixels);
+          };
+          return jxl::ConvertFromExternalInRows(
+              get_rows, release_rows, num_rows, band_xsize, num_rows,
+              c_current, /*alpha_is_premultiplied=*/false, bits_per_sample,
+              *pixel_format, enc->thread_pool.get(), ib);
+        });
+    if (status != JXL_ENC_SUCCESS) return status;
+    if (last_band) break;
+    // Only the last band can be the last frame of the image, so the others
+    // are encoded right away, which frees their pixels.
+    while (!enc->input_queue.empty()) {
+      if (enc->RefillOutputQueue() != JXL_ENC_SUCCESS) {
+        return JXL_ENC_ERROR;
+      }
+      if (enc->output_callback && !enc->output_queue.Drain(write)) {
+        return JXL_API_ERROR(enc, JXL_ENC_ERR_GENERIC,
+                             "Output callback failed");
+      }
+    }
+  }
+  return JXL_ENC_SUCCESS;
+}
+
 JxlEncoderStatus JxlEncoderUseBoxes(JxlEncoder* enc) {
   if (enc->wrote_bytes) {
     return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE,
@@ -1797,6 +2266,19 @@ JXL_EXPORT JxlEncoderStatus JxlEncoderSetExtraChannelBuffer(
       frame_settings->enc->metadata.m.extra_channel_info[index], ec_format);
   const uint8_t* uint8_buffer = reinterpret_cast<const uint8_t*>(buffer);
   auto queued_frame = frame_settings->enc->input_queue.back().frame.get();
+  if (queued_frame->fast_lossless_frame) {
+    // The frame has no ImageBundle to convert into: the alpha samples are
+    // merged into its interleaved input instead.
+    jxl::ImageF alpha(xsize, ysize);
+    if (!jxl::ConvertFromExternal(jxl::Span<const uint8_t>(uint8_buffer, size),
+                                  xsize, ysize, bits_per_sample, ec_format, 0,
+                                  frame_settings->enc->thread_pool.get(),
+                                  &alpha)) {
+      return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_API_USAGE,
+                           "Failed to set buffer for extra channel");
+    }
+    return SetFastLosslessAlpha(frame_settings->enc, alpha, queued_frame);
+  }
   if (!jxl::ConvertFromExternal(jxl::Span<const uint8_t>(uint8_buffer, size),
                                 xsize, ysize, bits_per_sample, ec_format, 0,
                                 frame_settings->enc->thread_pool.get(),
@@ -1819,28 +2301,69 @@ void JxlEncoderCloseInput(JxlEncoder* enc) {
 }
 JxlEncoderStatus JxlEncoderProcessOutput(JxlEncoder* enc, uint8_t** next_out,
                                          size_t* avail_out) {
+  if (enc->output_callback) {
+    return JXL_API_ERROR(
+        enc, JXL_ENC_ERR_API_USAGE,
+        "Cannot use JxlEncoderProcessOutput with an output callback");
+  }
   while (*avail_out > 0 &&
-         (!enc->output_byte_queue.empty() || !enc->input_queue.empty())) {
-    if (!enc->output_byte_queue.empty()) {
-      size_t to_copy = std::min(*avail_out, enc->output_byte_queue.size());
-      std::copy_n(enc->output_byte_queue.begin(), to_copy, *next_out);
-      *next_out += to_copy;
-      *avail_out -= to_copy;
-      enc->output_byte_queue.erase(enc->output_byte_queue.begin(),
-                                   enc->output_byte_queue.begin() + to_copy);
+         (!enc->output_queue.empty() || !enc->input_queue.empty())) {
+    if (!enc->output_queue.empty()) {
+      enc->output_queue.PopFront(next_out, avail_out);
     } else if (!enc->input_queue.empty()) {
-      if (enc->RefillOutputByteQueue() != JXL_ENC_SUCCESS) {
+      if (enc->RefillOutputQueue() != JXL_ENC_SUCCESS) {
         return JXL_ENC_ERROR;
       }
     }
   }
 
-  if (!enc->output_byte_queue.empty() || !enc->input_queue.empty()) {
+  if (!enc->output_queue.empty() || !enc->input_queue.empty()) {
     return JXL_ENC_NEED_MORE_OUTPUT;
   }
   return JXL_ENC_SUCCESS;
 }
 
+JxlEncoderStatus JxlEncoderSetOutputCallback(JxlEncoder* enc,
+                                             JxlEncoderOutputCallback callback,
+                                             void* opaque) {
+  if (enc->wrote_bytes) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE,
+                         "Cannot change the output callback after output was "
+                         "produced");
+  }
+  enc->output_callback = callback;
+  enc->output_callback_opaque = opaque;
+  return JXL_ENC_SUCCESS;
+}
+
+JxlEncoderStatus JxlEncoderFlushOutput(JxlEncoder* enc) {
+  if (!enc->output_callback) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE,
+                         "No output callback set");
+  }
+  const auto write = [enc](const uint8_t* data, size_t size) {
+    return enc->output_callback(enc->output_callback_opaque, data, size) !=
+           JXL_FALSE;
+  };
+  for (;;) {
+    if (!enc->output_queue.Drain(write)) {
+      return JXL_API_ERROR(enc, JXL_ENC_ERR_GENERIC, "Output callback failed");
+    }
+    if (enc->input_queue.empty()) break;
+    if (enc->RefillOutputQueue() != JXL_ENC_SUCCESS) {
+      return JXL_ENC_ERROR;
+    }
+  }
+  return JXL_ENC_SUCCESS;
+}
+
+JxlEncoderStatus JxlEncoderSetStageStatsCallback(
+    JxlEncoder* enc, JxlEncoderStageStatsCallback callback, void* opaque) {
+  enc->stage_stats_callback = callback;
+  enc->stage_stats_opaque = opaque;
+  return JXL_ENC_SUCCESS;
+}
+
 JxlEncoderStatus JxlEncoderSetFrameHeader(JxlEncoderOptions* frame_settings,
                                           const JxlFrameHeader* frame_header) {
   if (frame_header->layer_info.blend_info.source > 3) {
@@ -7,7 +7,11 @@
 #ifndef LIB_JXL_ENCODE_INTERNAL_H_
 #define LIB_JXL_ENCODE_INTERNAL_H_
 
+#include <string.h>
+
+#include <algorithm>
 #include <deque>
+#include <memory>
 #include <vector>
 
 #include "jxl/encode.h"
@@ -15,7 +19,11 @@
 #include "jxl/parallel_runner.h"
 #include "jxl/types.h"
 #include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/padded_bytes.h"
+#include "lib/jxl/common.h"
+#include "lib/jxl/enc_fast_lossless.h"
 #include "lib/jxl/enc_frame.h"
+#include "lib/jxl/enc_stage_stats.h"
 #include "lib/jxl/memory_manager_internal.h"
 
 namespace jxl {
@@ -68,11 +76,27 @@ typedef struct JxlEncoderFrameIndexBoxStruct {
     }
     return false;
   }
+  // A tick lasts TNUM / TDEN seconds, set from the animation header when the
+  // box is written.
   int32_t TNUM = 1;
   int32_t TDEN = 1000;
 
   std::vector<JxlEncoderFrameIndexBoxEntry> entries;
 
+  // Whether a frame was indexed, and the reference slots saved by that frame
+  // or a later one, as a bit mask. Frames from an indexed frame on must not
+  // read slots saved before it, since a decoder seeking to it does not decode
+  // the earlier frames.
+  bool indexed_frame_seen = false;
+  uint32_t slots_saved_since_index = 0;
+
+  // Returns whether the frame may read the given reference slot.
+  bool CanReadSlot(size_t slot) const {
+    return !indexed_frame_seen ||
+           (slot < kMaxNumReferenceFrames &&
+            (slots_saved_since_index & (1u << slot)));
+  }
+
   // That way we can ensure that every index box will have the first frame.
   // If the API user decides to mark it as an indexed frame, we call
   // the AddFrame again, this time with requested.
@@ -90,6 +114,10 @@ typedef struct JxlEncoderFrameIndexBoxStruct {
         entries.clear();
       }
     }
+    if (to_be_indexed) {
+      indexed_frame_seen = true;
+      slots_saved_since_index = 0;
+    }
     JxlEncoderFrameIndexBoxEntry e;
     e.to_be_indexed = to_be_indexed;
     e.OFFi = OFFi;
@@ -129,10 +157,41 @@ constexpr unsigned char kContainerHeader[] = {
 
 constexpr unsigned char kLevelBoxHeader[] = {0, 0, 0, 0x9, 'j', 'x', 'l', 'l'};
 
+struct FastLosslessFrameDeleter {
+  void operator()(JxlFastLosslessFrameState* frame) const {
+    JxlFastLosslessFreeFrameState(frame);
+  }
+};
+
+// Interleaved input of a frame encoded by the effort 1 lossless encoder. It is
+// kept for frames with alpha, whose alpha samples can still be replaced by
+// JxlEncoderSetExtraChannelBuffer before the frame is written.
+struct FastLosslessInput {
+  // ysize rows of xsize pixels, without padding between rows.
+  std::vector<uint8_t> pixels;
+  size_t xsize;
+  size_t ysize;
+  size_t num_channels;
+  size_t bytes_per_sample;
+  bool big_endian;
+};
+
 struct JxlEncoderQueuedFrame {
   JxlEncoderFrameSettingsValues option_values;
   ImageBundle frame;
   std::vector<uint8_t> ec_initialized;
+  // If set, the frame was already encoded by the effort 1 lossless encoder
+  // when it was added, and the ImageBundle is empty.
+  std::unique_ptr<JxlFastLosslessFrameState, FastLosslessFrameDeleter>
+      fast_lossless_frame;
+  // Input of fast_lossless_frame if it has alpha, empty otherwise.
+  FastLosslessInput fast_lossless_input;
+  // Stages that already ran when the frame was added, i.e. the encoding of
+  // fast_lossless_frame or the conversion of the pixels to XYB.
+  EncoderStageStats stage_stats;
+  // If set, the color channels of frame were converted to XYB when the frame
+  // was added, and frame claims the color encoding of the image metadata.
+  bool color_is_xyb;
 };
 
 struct JxlEncoderQueuedBox {
@@ -150,6 +209,90 @@ struct JxlEncoderQueuedInput {
   MemoryManagerUniquePtr<JxlEncoderQueuedBox> box;
 };
 
+// Encoded bytes not yet handed to the user, as a list of chunks. Large parts
+// such as encoded frames are kept in the PaddedBytes they were written to,
+// without copying; small parts such as box headers are accumulated into
+// chunks owned by the queue.
+class JxlEncoderOutputQueue {
+ public:
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  // Appends a single byte, e.g. from AppendBoxHeader.
+  void push_back(uint8_t byte) {
+    if (chunks_.empty() || chunks_.back().taken) chunks_.emplace_back();
+    chunks_.back().bytes.push_back(byte);
+    size_++;
+  }
+
+  // Copies the bytes to the end of the queue.
+  void Append(const uint8_t* begin, const uint8_t* end) {
+    if (begin == end) return;
+    if (chunks_.empty() || chunks_.back().taken) chunks_.emplace_back();
+    chunks_.back().bytes.append(begin, end);
+    size_ += end - begin;
+  }
+
+  // Moves the bytes to the end of the queue without copying them.
+  void Append(PaddedBytes&& bytes) {
+    if (bytes.empty()) return;
+    size_ += bytes.size();
+    chunks_.emplace_back();
+    chunks_.back().bytes = std::move(bytes);
+    chunks_.back().taken = true;
+  }
+
+  // Copies up to avail_out bytes from the front of the queue to *next_out and
+  // removes them from the queue, advancing *next_out and decreasing
+  // *avail_out accordingly.
+  void PopFront(uint8_t** next_out, size_t* avail_out) {
+    while (*avail_out > 0 && !chunks_.empty()) {
+      Chunk& chunk = chunks_.front();
+      const size_t to_copy =
+          std::min(*avail_out, chunk.bytes.size() - chunk.pos);
+      memcpy(*next_out, chunk.bytes.data() + chunk.pos, to_copy);
+      *next_out += to_copy;
+      *avail_out -= to_copy;
+      chunk.pos += to_copy;
+      size_ -= to_copy;
+      if (chunk.pos == chunk.bytes.size()) chunks_.pop_front();
+    }
+  }
+
+  // Calls write(data, size) on each chunk in order, removing each chunk from
+  // the queue once written. Stops and returns false if write returns false.
+  template <typename WriteFunc>
+  bool Drain(const WriteFunc& write) {
+    while (!chunks_.empty()) {
+      Chunk& chunk = chunks_.front();
+      if (!write(chunk.bytes.data() + chunk.pos,
+                 chunk.bytes.size() - chunk.pos)) {
+        return false;
+      }
+      size_ -= chunk.bytes.size() - chunk.pos;
+      chunks_.pop_front();
+    }
+    return true;
+  }
+
+  void clear() {
+    chunks_.clear();
+    size_ = 0;
+  }
+
+ private:
+  struct Chunk {
+    PaddedBytes bytes;
+    // Number of bytes at the front of bytes already popped.
+    size_t pos = 0;
+    // Whether bytes were moved in with Append(PaddedBytes&&); such chunks are
+    // never appended to, since growing them could reallocate a large buffer.
+    bool taken = false;
+  };
+  std::deque<Chunk> chunks_;
+  size_t size_ = 0;
+};
+
 // Appends a JXL container box header with given type, size, and unbounded
 // properties to output.
 template <typename T>
@@ -197,7 +340,18 @@ struct JxlEncoderStruct {
   size_t num_queued_frames;
   size_t num_queued_boxes;
   std::vector<jxl::JxlEncoderQueuedInput> input_queue;
-  std::deque<uint8_t> output_byte_queue;
+  jxl::JxlEncoderOutputQueue output_queue;
+
+  // Set with JxlEncoderSetOutputCallback; if not null, output chunks are
+  // handed to it instead of being copied by JxlEncoderProcessOutput.
+  JxlEncoderOutputCallback output_callback;
+  void* output_callback_opaque;
+
+  // Set with JxlEncoderSetStageStatsCallback.
+  JxlEncoderStageStatsCallback stage_stats_callback;
+  void* stage_stats_opaque;
+  // Number of frames encoded so far, as reported to stage_stats_callback.
+  uint32_t num_encoded_frames;
 
   // How many codestream bytes have been written, i.e.,
   // content of jxlc and jxlp boxes. Frame index box jxli
@@ -242,16 +396,16 @@ struct JxlEncoderStruct {
   int brotli_effort = -1;
 
   // Takes the first frame in the input_queue, encodes it, and appends
-  // the bytes to the output_byte_queue.
-  JxlEncoderStatus RefillOutputByteQueue();
+  // the bytes to the output_queue.
+  JxlEncoderStatus RefillOutputQueue();
 
   bool MustUseContainer() const {
     return use_container || codestream_level != 5 || store_jpeg_metadata ||
-           use_boxes;
+           use_boxes || frame_index_box.index_box_requested_through_api;
   }
 
   // Appends the bytes of a JXL box header with the provided type and size to
-  // the end of the output_byte_queue. If unbounded is true, the size won't be
+  // the end of the output_queue. If unbounded is true, the size won't be
   // added to the header and the box will be assumed to continue until EOF.
   void AppendBoxHeader(const jxl::BoxType& type, size_t size, bool unbounded);
 };
@@ -5,14 +5,20 @@
 
 #include "jxl/encode.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include "enc_color_management.h"
 #include "gtest/gtest.h"
 #include "jxl/decode.h"
 #include "jxl/decode_cxx.h"
 #include "jxl/encode_cxx.h"
+#include "jxl/thread_parallel_runner_cxx.h"
 #include "lib/extras/codec.h"
 #include "lib/extras/dec/jxl.h"
+#include "lib/jxl/enc_butteraugli_comparator.h"
 #include "lib/jxl/enc_butteraugli_pnorm.h"
+#include "lib/jxl/enc_external_image.h"
 #include "lib/jxl/encode_internal.h"
 #include "lib/jxl/jpeg/dec_jpeg_data.h"
 #include "lib/jxl/jpeg/dec_jpeg_data_writer.h"
@@ -870,6 +876,697 @@ static void ProcessEncoder(JxlEncoder* enc, std::vector<uint8_t>& compressed,
   EXPECT_EQ(JXL_ENC_SUCCESS, process_result);
 }
 
+TEST(EncodeTest, OutputCallbackTest) {
+  const size_t xsize = 70;
+  const size_t ysize = 40;
+  JxlPixelFormat pixel_format = {4, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 4, 0);
+  const auto add_input = [&](JxlEncoder* enc) {
+    JxlBasicInfo basic_info;
+    jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+    basic_info.xsize = xsize;
+    basic_info.ysize = ysize;
+    basic_info.uses_original_profile = false;
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderUseContainer(enc, true));
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetCodestreamLevel(enc, 10));
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc, &basic_info));
+    JxlColorEncoding color_encoding;
+    JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetColorEncoding(enc, &color_encoding));
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderAddImageFrame(JxlEncoderFrameSettingsCreate(enc, NULL),
+                                      &pixel_format, pixels.data(),
+                                      pixels.size()));
+    JxlEncoderCloseInput(enc);
+  };
+
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  add_input(enc.get());
+  std::vector<uint8_t> expected(64);
+  uint8_t* next_out = expected.data();
+  size_t avail_out = expected.size();
+  ProcessEncoder(enc.get(), expected, next_out, avail_out);
+
+  JxlEncoderPtr cb_enc = JxlEncoderMake(nullptr);
+  std::vector<uint8_t> received;
+  size_t num_calls = 0;
+  struct Output {
+    std::vector<uint8_t>* bytes;
+    size_t* num_calls;
+  } output = {&received, &num_calls};
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetOutputCallback(
+                cb_enc.get(),
+                [](void* opaque, const uint8_t* data, size_t size) {
+                  Output* output = static_cast<Output*>(opaque);
+                  output->bytes->insert(output->bytes->end(), data,
+                                        data + size);
+                  ++*output->num_calls;
+                  return JXL_TRUE;
+                },
+                &output));
+  add_input(cb_enc.get());
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderFlushOutput(cb_enc.get()));
+  EXPECT_LT(0u, num_calls);
+  EXPECT_EQ(expected, received);
+
+  // Mixing with JxlEncoderProcessOutput is an error.
+  EXPECT_EQ(JXL_ENC_ERROR,
+            JxlEncoderProcessOutput(cb_enc.get(), &next_out, &avail_out));
+}
+
+TEST(EncodeTest, StageStatsCallbackTest) {
+  const size_t xsize = 300;
+  const size_t ysize = 270;
+  JxlPixelFormat pixel_format = {4, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 4, 0);
+  const auto encode = [&](JxlEncoder* enc) -> std::vector<uint8_t> {
+    JxlBasicInfo basic_info;
+    jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+    basic_info.xsize = xsize;
+    basic_info.ysize = ysize;
+    basic_info.uses_original_profile = false;
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetCodestreamLevel(enc, 10));
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc, &basic_info));
+    JxlColorEncoding color_encoding;
+    JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetColorEncoding(enc, &color_encoding));
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderAddImageFrame(JxlEncoderFrameSettingsCreate(enc, NULL),
+                                      &pixel_format, pixels.data(),
+                                      pixels.size()));
+    JxlEncoderCloseInput(enc);
+    std::vector<uint8_t> compressed(64);
+    uint8_t* next_out = compressed.data();
+    size_t avail_out = compressed.size();
+    ProcessEncoder(enc, compressed, next_out, avail_out);
+    return compressed;
+  };
+
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  const std::vector<uint8_t> expected = encode(enc.get());
+
+  struct Report {
+    uint32_t frame_index;
+    JxlEncoderStage stage;
+    JxlEncoderStageStats stats;
+  };
+  std::vector<Report> reports;
+  JxlEncoderPtr stats_enc = JxlEncoderMake(nullptr);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetStageStatsCallback(
+                stats_enc.get(),
+                [](void* opaque, uint32_t frame_index, JxlEncoderStage stage,
+                   const JxlEncoderStageStats* stats) {
+                  static_cast<std::vector<Report>*>(opaque)->push_back(
+                      {frame_index, stage, *stats});
+                },
+                &reports));
+  // Measuring the stages does not change the output.
+  EXPECT_EQ(expected, encode(stats_enc.get()));
+
+  std::vector<JxlEncoderStage> stages;
+  uint64_t allocated_bytes = 0;
+  for (const Report& report : reports) {
+    EXPECT_EQ(0u, report.frame_index);
+    EXPECT_GE(report.stats.wall_seconds, 0.0);
+    EXPECT_GE(report.stats.cpu_seconds, 0.0);
+    allocated_bytes += report.stats.allocated_bytes;
+    stages.push_back(report.stage);
+  }
+  EXPECT_TRUE(std::is_sorted(stages.begin(), stages.end()));
+  EXPECT_EQ(stages.end(), std::unique(stages.begin(), stages.end()));
+  for (JxlEncoderStage stage :
+       {JXL_ENC_STAGE_COLOR_TRANSFORM, JXL_ENC_STAGE_ADAPTIVE_QUANTIZATION,
+        JXL_ENC_STAGE_AC_STRATEGY, JXL_ENC_STAGE_TOKENIZE,
+        JXL_ENC_STAGE_HISTOGRAMS, JXL_ENC_STAGE_WRITE}) {
+    EXPECT_NE(stages.end(), std::find(stages.begin(), stages.end(), stage))
+        << "stage " << stage;
+  }
+  // At least the XYB image and the coefficients are allocated.
+  EXPECT_GE(allocated_bytes, xsize * ysize * 3 * sizeof(float));
+
+  // Resetting the encoder removes the callback.
+  JxlEncoderReset(stats_enc.get());
+  reports.clear();
+  EXPECT_EQ(expected, encode(stats_enc.get()));
+  EXPECT_TRUE(reports.empty());
+}
+
+TEST(EncodeTest, StageStatsProgressiveDCTest) {
+  const size_t xsize = 300;
+  const size_t ysize = 270;
+  JxlPixelFormat pixel_format = {4, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 4, 0);
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  std::vector<JxlEncoderStage> stages;
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetStageStatsCallback(
+                enc.get(),
+                [](void* opaque, uint32_t /*frame_index*/,
+                   JxlEncoderStage stage,
+                   const JxlEncoderStageStats* /*stats*/) {
+                  static_cast<std::vector<JxlEncoderStage>*>(opaque)->push_back(
+                      stage);
+                },
+                &stages));
+  JxlBasicInfo basic_info;
+  jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  basic_info.uses_original_profile = false;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetCodestreamLevel(enc.get(), 10));
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderFrameSettingsSetOption(
+                frame_settings, JXL_ENC_FRAME_SETTING_PROGRESSIVE_DC, 1));
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                    pixels.data(), pixels.size()));
+  JxlEncoderCloseInput(enc.get());
+  std::vector<uint8_t> compressed(64);
+  uint8_t* next_out = compressed.data();
+  size_t avail_out = compressed.size();
+  ProcessEncoder(enc.get(), compressed, next_out, avail_out);
+
+  // The DC frame has its own stage, the coefficients of the main frame are
+  // still tokenized.
+  EXPECT_NE(stages.end(),
+            std::find(stages.begin(), stages.end(), JXL_ENC_STAGE_DC_FRAME));
+  EXPECT_NE(stages.end(),
+            std::find(stages.begin(), stages.end(), JXL_ENC_STAGE_TOKENIZE));
+}
+
+TEST(EncodeTest, StageStatsKittenTest) {
+  // At effort 8 the adaptive quantization roundtrips the image through the
+  // other stages, which must not be measured twice.
+  const size_t xsize = 300;
+  const size_t ysize = 270;
+  JxlPixelFormat pixel_format = {4, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 4, 0);
+  JxlThreadParallelRunnerPtr runner = JxlThreadParallelRunnerMake(nullptr, 4);
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetParallelRunner(enc.get(), JxlThreadParallelRunner,
+                                        runner.get()));
+  std::vector<JxlEncoderStageStats> reports;
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetStageStatsCallback(
+                enc.get(),
+                [](void* opaque, uint32_t /*frame_index*/,
+                   JxlEncoderStage /*stage*/,
+                   const JxlEncoderStageStats* stats) {
+                  static_cast<std::vector<JxlEncoderStageStats>*>(opaque)
+                      ->push_back(*stats);
+                },
+                &reports));
+  JxlBasicInfo basic_info;
+  jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  basic_info.uses_original_profile = false;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetCodestreamLevel(enc.get(), 10));
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderFrameSettingsSetOption(frame_settings,
+                                             JXL_ENC_FRAME_SETTING_EFFORT, 8));
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                    pixels.data(), pixels.size()));
+  JxlEncoderCloseInput(enc.get());
+  std::vector<uint8_t> compressed(64);
+  uint8_t* next_out = compressed.data();
+  size_t avail_out = compressed.size();
+  ProcessEncoder(enc.get(), compressed, next_out, avail_out);
+  const double frame_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  ASSERT_FALSE(reports.empty());
+  double wall_seconds = 0.0;
+  double cpu_seconds = 0.0;
+  for (const JxlEncoderStageStats& stats : reports) {
+    wall_seconds += stats.wall_seconds;
+    cpu_seconds += stats.cpu_seconds;
+  }
+  EXPECT_LE(wall_seconds, frame_seconds);
+  EXPECT_GT(cpu_seconds, 0.0);
+}
+
+TEST(EncodeTest, ChunkedFrameTest) {
+  // More than one band of rows of the chunked input.
+  const size_t xsize = 40;
+  const size_t ysize = 300;
+  JxlPixelFormat pixel_format = {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 4, 0);
+  const size_t row_size = xsize * 4;
+  // The test image has 16-bit samples, use its bytes as 8-bit samples.
+  pixels.resize(row_size * ysize);
+
+  std::vector<uint8_t> compressed;
+  struct Source {
+    const std::vector<uint8_t>* pixels;
+    size_t row_size;
+    size_t next_row;
+    // Copy of the requested rows, to catch reads outside of them.
+    std::vector<uint8_t> band;
+    // Output received so far, as bytes.
+    const std::vector<uint8_t>* compressed;
+  } source_state = {&pixels, row_size, 0, {}, &compressed};
+  JxlChunkedFrameInputSource source;
+  source.opaque = &source_state;
+  source.get_color_channel_rows = [](void* opaque, size_t ypos, size_t ysize,
+                                     size_t* row_offset) {
+    Source* self = static_cast<Source*>(opaque);
+    EXPECT_EQ(self->next_row, ypos);
+    // The previous band must have been released, and encoded.
+    EXPECT_TRUE(self->band.empty());
+    EXPECT_EQ(ypos == 0, self->compressed->empty());
+    self->next_row += ysize;
+    self->band.assign(self->pixels->begin() + ypos * self->row_size,
+                      self->pixels->begin() + (ypos + ysize) * self->row_size);
+    *row_offset = self->row_size;
+    return static_cast<const void*>(self->band.data());
+  };
+  source.release_buffer = [](void* opaque, const void* buffer) {
+    Source* self = static_cast<Source*>(opaque);
+    EXPECT_EQ(self->band.data(), buffer);
+    self->band.clear();
+  };
+
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetOutputCallback(
+                enc.get(),
+                [](void* opaque, const uint8_t* data, size_t size) {
+                  auto* compressed = static_cast<std::vector<uint8_t>*>(opaque);
+                  compressed->insert(compressed->end(), data, data + size);
+                  return JXL_TRUE;
+                },
+                &compressed));
+  JxlBasicInfo basic_info;
+  jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  basic_info.uses_original_profile = true;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE));
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderAddChunkedFrame(frame_settings, &pixel_format, source));
+  EXPECT_EQ(ysize, source_state.next_row);
+  EXPECT_TRUE(source_state.band.empty());
+  JxlEncoderCloseInput(enc.get());
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderFlushOutput(enc.get()));
+
+  // Coalesced, the bands decode to the whole frame; without coalescing, to one
+  // cropped frame per band.
+  for (int coalescing = 1; coalescing >= 0; --coalescing) {
+    JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec.get(),
+                                        JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetCoalescing(dec.get(), coalescing ? JXL_TRUE
+                                                            : JXL_FALSE));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                  compressed.size()));
+    JxlDecoderCloseInput(dec.get());
+    const size_t band_ysize[2] = {256, ysize - 256};
+    size_t y0 = 0;
+    for (size_t i = 0; i < (coalescing ? 1 : 2); ++i) {
+      const size_t frame_ysize = coalescing ? ysize : band_ysize[i];
+      EXPECT_EQ(JXL_DEC_FRAME, JxlDecoderProcessInput(dec.get()));
+      JxlFrameHeader frame_header;
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderGetFrameHeader(dec.get(), &frame_header));
+      EXPECT_EQ(xsize, frame_header.layer_info.xsize);
+      EXPECT_EQ(frame_ysize, frame_header.layer_info.ysize);
+      if (!coalescing) {
+        EXPECT_EQ(static_cast<int32_t>(y0), frame_header.layer_info.crop_y0);
+      }
+      EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER,
+                JxlDecoderProcessInput(dec.get()));
+      std::vector<uint8_t> decoded(row_size * frame_ysize);
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutBuffer(dec.get(), &pixel_format,
+                                            decoded.data(), decoded.size()));
+      EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+      EXPECT_EQ(0, memcmp(&pixels[y0 * row_size], decoded.data(),
+                          decoded.size()));
+      y0 += frame_ysize;
+    }
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec.get()));
+  }
+}
+
+TEST(EncodeTest, ChunkedLossyFrameTest) {
+  // Two bands of rows, on a vertical gradient that makes seams visible.
+  const size_t xsize = 128;
+  const size_t ysize = 512;
+  JxlPixelFormat pixel_format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  const std::vector<uint8_t> pixels =
+      jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  const size_t row_size = xsize * 3 * 2;
+
+  struct Source {
+    const std::vector<uint8_t>* pixels;
+    size_t row_size;
+  } source_state = {&pixels, row_size};
+  JxlChunkedFrameInputSource source;
+  source.opaque = &source_state;
+  source.get_color_channel_rows = [](void* opaque, size_t ypos, size_t ysize,
+                                     size_t* row_offset) {
+    Source* self = static_cast<Source*>(opaque);
+    *row_offset = self->row_size;
+    return static_cast<const void*>(self->pixels->data() +
+                                    ypos * self->row_size);
+  };
+  source.release_buffer = [](void* opaque, const void* buffer) {};
+
+  const auto encode_and_decode = [&](bool chunked) {
+    JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+    JxlBasicInfo basic_info;
+    jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+    basic_info.xsize = xsize;
+    basic_info.ysize = ysize;
+    basic_info.uses_original_profile = false;
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+    JxlColorEncoding color_encoding;
+    JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+    JxlEncoderFrameSettings* frame_settings =
+        JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetFrameDistance(frame_settings, 1.0f));
+    if (chunked) {
+      EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderAddChunkedFrame(
+                                     frame_settings, &pixel_format, source));
+    } else {
+      EXPECT_EQ(JXL_ENC_SUCCESS,
+                JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                        pixels.data(), pixels.size()));
+    }
+    JxlEncoderCloseInput(enc.get());
+    std::vector<uint8_t> compressed(64);
+    uint8_t* next_out = compressed.data();
+    size_t avail_out = compressed.size();
+    ProcessEncoder(enc.get(), compressed, next_out, avail_out);
+
+    JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                  compressed.size()));
+    JxlDecoderCloseInput(dec.get());
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
+    std::vector<uint8_t> decoded(pixels.size());
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec.get(), &pixel_format,
+                                          decoded.data(), decoded.size()));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec.get()));
+    return decoded;
+  };
+
+  // Distance of the rows around the boundary of the bands.
+  const size_t strip_y0 = 256 - 32;
+  const size_t strip_ysize = 64;
+  const auto strip_distance = [&](const std::vector<uint8_t>& decoded) {
+    const auto strip = [&](const std::vector<uint8_t>& image) {
+      jxl::CodecInOut io;
+      io.SetSize(xsize, strip_ysize);
+      io.metadata.m.color_encoding = jxl::ColorEncoding::SRGB();
+      EXPECT_TRUE(jxl::ConvertFromExternal(
+          jxl::Span<const uint8_t>(image.data() + strip_y0 * row_size,
+                                   strip_ysize * row_size),
+          xsize, strip_ysize, jxl::ColorEncoding::SRGB(),
+          /*alpha_is_premultiplied=*/false, /*bits_per_sample=*/16,
+          pixel_format, /*pool=*/nullptr, &io.Main()));
+      return io;
+    };
+    return jxl::ButteraugliDistance(strip(pixels), strip(decoded),
+                               jxl::ButteraugliParams(), jxl::GetJxlCms(),
+                               /*distmap=*/nullptr, /*pool=*/nullptr);
+  };
+
+  const double chunked_distance = strip_distance(encode_and_decode(true));
+  const double frame_distance = strip_distance(encode_and_decode(false));
+  // Without the filters, the bands are a bit worse than the whole frame, but
+  // the boundary between them is not a visible seam.
+  EXPECT_LE(chunked_distance, 1.5 * frame_distance);
+  EXPECT_LE(chunked_distance, 2.0);
+}
+
+TEST(EncodeTest, FastLosslessTest) {
+  // Several groups in both directions.
+  const size_t ysize = 270;
+  struct TestCase {
+    size_t xsize;
+    JxlPixelFormat pixel_format;
+    uint32_t bits_per_sample;
+    bool fast_lossless;
+  };
+  // The fast lossless encoder codes rows in chunks of 16 pixels, so most
+  // widths end with a partial chunk.
+  const TestCase test_cases[] = {
+      {300, {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0}, 8, true},
+      {301, {1, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0}, 8, true},
+      {290, {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0}, 12, true},
+      {300, {2, JXL_TYPE_UINT16, JXL_LITTLE_ENDIAN, 0}, 10, true},
+      {304, {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0}, 8, true},
+      // Above 12 bits, effort 1 uses the regular encoder.
+      {300, {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0}, 16, false},
+  };
+  JxlThreadParallelRunnerPtr runner = JxlThreadParallelRunnerMake(nullptr, 4);
+  for (const TestCase& test_case : test_cases) {
+    const size_t xsize = test_case.xsize;
+    const JxlPixelFormat& pixel_format = test_case.pixel_format;
+    const size_t num_channels = pixel_format.num_channels;
+    const size_t bytes_per_sample =
+        pixel_format.data_type == JXL_TYPE_UINT8 ? 1 : 2;
+    const JxlBitDepth bit_depth = {JXL_BIT_DEPTH_FROM_CODESTREAM,
+                                   test_case.bits_per_sample, 0};
+
+    JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetParallelRunner(enc.get(), JxlThreadParallelRunner,
+                                          runner.get()));
+    JxlBasicInfo basic_info;
+    jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+    basic_info.xsize = xsize;
+    basic_info.ysize = ysize;
+    basic_info.bits_per_sample = test_case.bits_per_sample;
+    if (basic_info.alpha_bits != 0) {
+      basic_info.alpha_bits = basic_info.bits_per_sample;
+    }
+    basic_info.uses_original_profile = true;
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetCodestreamLevel(enc.get(), 10));
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+    JxlColorEncoding color_encoding;
+    JxlColorEncodingSetToSRGB(&color_encoding,
+                              /*is_gray=*/num_channels < 3);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+    JxlEncoderFrameSettings* frame_settings =
+        JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE));
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderFrameSettingsSetOption(
+                  frame_settings, JXL_ENC_FRAME_SETTING_EFFORT, 1));
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetFrameBitDepth(frame_settings, &bit_depth));
+
+    // Two layers, so that both the last and a non-last frame are tested.
+    std::vector<uint8_t> frames[2];
+    for (size_t i = 0; i < 2; ++i) {
+      std::vector<uint8_t> image =
+          jxl::test::GetSomeTestImage(xsize, ysize, num_channels, i);
+      frames[i].resize(xsize * ysize * num_channels * bytes_per_sample);
+      for (size_t k = 0; k < xsize * ysize * num_channels; ++k) {
+        const uint32_t value = ((image[2 * k] << 8) | image[2 * k + 1]) >>
+                               (16 - test_case.bits_per_sample);
+        if (bytes_per_sample == 1) {
+          frames[i][k] = value;
+        } else if (pixel_format.endianness == JXL_BIG_ENDIAN) {
+          StoreBE16(value, &frames[i][2 * k]);
+        } else {
+          StoreLE16(value, &frames[i][2 * k]);
+        }
+      }
+      EXPECT_EQ(JXL_ENC_SUCCESS,
+                JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                        frames[i].data(), frames[i].size()));
+    }
+    JxlEncoderCloseInput(enc.get());
+    std::vector<uint8_t> compressed(64);
+    uint8_t* next_out = compressed.data();
+    size_t avail_out = compressed.size();
+    ProcessEncoder(enc.get(), compressed, next_out, avail_out);
+
+    // Without coalescing, the layers are output as they are coded.
+    const size_t pixel_size = num_channels * bytes_per_sample;
+    JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec.get(),
+                                        JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetCoalescing(dec.get(), JXL_FALSE));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                  compressed.size()));
+    JxlDecoderCloseInput(dec.get());
+    for (size_t i = 0; i < 2; ++i) {
+      const std::vector<uint8_t>& frame = frames[i];
+      EXPECT_EQ(JXL_DEC_FRAME, JxlDecoderProcessInput(dec.get()));
+      JxlFrameHeader frame_header;
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderGetFrameHeader(dec.get(), &frame_header));
+      EXPECT_EQ(xsize, frame_header.layer_info.xsize);
+      EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER,
+                JxlDecoderProcessInput(dec.get()));
+      std::vector<uint8_t> pixels(xsize * ysize * pixel_size);
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutBuffer(dec.get(), &pixel_format,
+                                            pixels.data(), pixels.size()));
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutBitDepth(dec.get(), &bit_depth));
+      EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+      for (size_t y = 0; y < ysize; ++y) {
+        EXPECT_EQ(0, memcmp(&frame[y * xsize * pixel_size],
+                            &pixels[y * xsize * pixel_size],
+                            xsize * pixel_size))
+            << "row " << y << " of frame " << i;
+      }
+    }
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec.get()));
+  }
+}
+
+TEST(EncodeTest, FastLosslessAlphaBufferTest) {
+  const size_t xsize = 100;
+  const size_t ysize = 70;
+  JxlPixelFormat pixel_format = {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  JxlPixelFormat alpha_format = {1, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  // The alpha channel of the interleaved buffer is replaced by the one of
+  // the extra channel buffer.
+  std::vector<uint8_t> image = jxl::test::GetSomeTestImage(xsize, ysize, 4, 0);
+  std::vector<uint8_t> pixels(xsize * ysize * 4);
+  for (size_t k = 0; k < pixels.size(); ++k) pixels[k] = image[2 * k];
+  std::vector<uint8_t> alpha(xsize * ysize * 2);
+  for (size_t i = 0; i < xsize * ysize; ++i) {
+    StoreBE16(((i * 7) % 256) * 257, &alpha[2 * i]);
+  }
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  JxlBasicInfo basic_info;
+  jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  basic_info.uses_original_profile = true;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE));
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderFrameSettingsSetOption(frame_settings,
+                                             JXL_ENC_FRAME_SETTING_EFFORT, 1));
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                    pixels.data(), pixels.size()));
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetExtraChannelBuffer(frame_settings, &alpha_format,
+                                            alpha.data(), alpha.size(), 0));
+  JxlEncoderCloseInput(enc.get());
+  std::vector<uint8_t> compressed(64);
+  uint8_t* next_out = compressed.data();
+  size_t avail_out = compressed.size();
+  ProcessEncoder(enc.get(), compressed, next_out, avail_out);
+
+  std::vector<uint8_t> expected = pixels;
+  for (size_t i = 0; i < xsize * ysize; ++i) {
+    expected[4 * i + 3] = (i * 7) % 256;
+  }
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                compressed.size()));
+  JxlDecoderCloseInput(dec.get());
+  EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
+  std::vector<uint8_t> decoded(xsize * ysize * 4);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetImageOutBuffer(dec.get(), &pixel_format,
+                                        decoded.data(), decoded.size()));
+  EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+  EXPECT_EQ(expected, decoded);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec.get()));
+}
+
+// Fails without running anything, like a runner that can't start its threads.
+static JxlParallelRetCode FailingParallelRunner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range) {
+  return JXL_PARALLEL_RET_RUNNER_ERROR;
+}
+
+TEST(EncodeTest, FastLosslessRunnerErrorTest) {
+  const size_t xsize = 64;
+  const size_t ysize = 64;
+  JxlPixelFormat pixel_format = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  std::vector<uint8_t> pixels(xsize * ysize * 3, 128);
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetParallelRunner(enc.get(), FailingParallelRunner,
+                                        nullptr));
+  JxlBasicInfo basic_info;
+  jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  basic_info.uses_original_profile = true;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE));
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderFrameSettingsSetOption(frame_settings,
+                                             JXL_ENC_FRAME_SETTING_EFFORT, 1));
+  EXPECT_EQ(JXL_ENC_ERROR,
+            JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                    pixels.data(), pixels.size()));
+  EXPECT_EQ(JXL_ENC_ERR_GENERIC, JxlEncoderGetError(enc.get()));
+}
+
 TEST(EncodeTest, BasicInfoTest) {
   JxlEncoderPtr enc = JxlEncoderMake(nullptr);
   EXPECT_NE(nullptr, enc.get());
@@ -1085,6 +1782,403 @@ TEST(EncodeTest, AnimationHeaderTest) {
 
   EXPECT_EQ(true, seen_frame);
 }
+
+TEST(EncodeTest, FrameIndexSeekTest) {
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  EXPECT_NE(nullptr, enc.get());
+
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+  size_t xsize = 16;
+  size_t ysize = 16;
+  constexpr size_t kNumFrames = 8;
+  JxlPixelFormat pixel_format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  JxlBasicInfo basic_info;
+  jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  basic_info.uses_original_profile = JXL_TRUE;
+  basic_info.have_animation = true;
+  basic_info.animation.tps_numerator = 10;
+  basic_info.animation.tps_denominator = 1;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE));
+  JxlFrameHeader header;
+  JxlEncoderInitFrameHeader(&header);
+  header.duration = 1;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetFrameHeader(frame_settings, &header));
+
+  // Index frames 0 and 4.
+  std::vector<uint8_t> frames[kNumFrames];
+  for (size_t i = 0; i < kNumFrames; ++i) {
+    frames[i] = jxl::test::GetSomeTestImage(xsize, ysize, 3, i);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderFrameSettingsSetOption(
+                  frame_settings, JXL_ENC_FRAME_INDEX_BOX, i % 4 == 0));
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                      frames[i].data(), frames[i].size()));
+  }
+  JxlEncoderCloseInput(enc.get());
+  std::vector<uint8_t> compressed = std::vector<uint8_t>(64);
+  uint8_t* next_out = compressed.data();
+  size_t avail_out = compressed.size() - (next_out - compressed.data());
+  ProcessEncoder(enc.get(), compressed, next_out, avail_out);
+
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  EXPECT_NE(nullptr, dec.get());
+
+  // First pass over the boxes only, to find the frame index box.
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_BOX));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                compressed.size()));
+  JxlDecoderCloseInput(dec.get());
+  bool seen_index = false;
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+    if (status == JXL_DEC_SUCCESS) break;
+    ASSERT_EQ(JXL_DEC_BOX, status);
+    JxlBoxType type;
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderGetBoxType(dec.get(), type, JXL_FALSE));
+    if (memcmp(type, "jxli", 4) == 0) seen_index = true;
+  }
+  EXPECT_TRUE(seen_index);
+
+  JxlDecoderRewind(dec.get());
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_COLOR_ENCODING |
+                                                     JXL_DEC_FRAME |
+                                                     JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                compressed.size()));
+  size_t input_offset;
+  // Seeking requires the image headers.
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSeekToFrame(dec.get(), 6, &input_offset));
+  EXPECT_EQ(JXL_DEC_COLOR_ENCODING, JxlDecoderProcessInput(dec.get()));
+  JxlDecoderReleaseInput(dec.get());
+
+  // Seek forward to frame 6, which starts decoding at indexed frame 4, and
+  // then back to frame 1, from indexed frame 0.
+  size_t prev_offset = compressed.size();
+  for (size_t frame : {6, 1}) {
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSeekToFrame(dec.get(), frame, &input_offset));
+    EXPECT_LT(input_offset, prev_offset);
+    prev_offset = input_offset;
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec.get(), compressed.data() + input_offset,
+                                 compressed.size() - input_offset));
+    EXPECT_EQ(JXL_DEC_FRAME, JxlDecoderProcessInput(dec.get()));
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
+    std::vector<uint8_t> pixels(frames[frame].size());
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec.get(), &pixel_format,
+                                          pixels.data(), pixels.size()));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+    EXPECT_EQ(0u, jxl::test::ComparePixels(frames[frame].data(), pixels.data(),
+                                           xsize, ysize, pixel_format,
+                                           pixel_format));
+    JxlDecoderReleaseInput(dec.get());
+  }
+}
+
+// The frame counts of the index are in displayed frames, so zero-duration
+// layers are not counted, and an indexed layer is decoded together with the
+// frames blended onto it.
+TEST(EncodeTest, FrameIndexSeekZeroDurationTest) {
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  EXPECT_NE(nullptr, enc.get());
+
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+  const size_t xsize = 16;
+  const size_t ysize = 16;
+  const size_t crop_size = 8;
+  JxlPixelFormat pixel_format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  JxlBasicInfo basic_info;
+  jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  basic_info.uses_original_profile = JXL_TRUE;
+  basic_info.have_animation = true;
+  basic_info.animation.tps_numerator = 10;
+  basic_info.animation.tps_denominator = 1;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE));
+
+  // Coded frames, with the displayed frame they belong to:
+  // 0: indexed, displayed frame 0.
+  // 1: indexed zero-duration layer of displayed frame 1.
+  // 2: cropped onto layer 1, displayed frame 1.
+  // 3: indexed, displayed frame 2.
+  // 4: zero-duration layer of displayed frame 3, not indexed.
+  // 5: displayed frame 3.
+  const uint32_t durations[] = {1, 0, 1, 1, 0, 1};
+  const bool indexed[] = {true, true, false, true, false, false};
+  std::vector<uint8_t> frames[6];
+  for (size_t i = 0; i < 6; ++i) {
+    JxlFrameHeader header;
+    JxlEncoderInitFrameHeader(&header);
+    header.duration = durations[i];
+    size_t frame_xsize = xsize;
+    size_t frame_ysize = ysize;
+    if (i == 2) {
+      header.layer_info.have_crop = JXL_TRUE;
+      header.layer_info.xsize = frame_xsize = crop_size;
+      header.layer_info.ysize = frame_ysize = crop_size;
+    }
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetFrameHeader(frame_settings, &header));
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderFrameSettingsSetOption(
+                  frame_settings, JXL_ENC_FRAME_INDEX_BOX, indexed[i]));
+    frames[i] = jxl::test::GetSomeTestImage(frame_xsize, frame_ysize, 3, i);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                      frames[i].data(), frames[i].size()));
+  }
+  JxlEncoderCloseInput(enc.get());
+  std::vector<uint8_t> compressed = std::vector<uint8_t>(64);
+  uint8_t* next_out = compressed.data();
+  size_t avail_out = compressed.size() - (next_out - compressed.data());
+  ProcessEncoder(enc.get(), compressed, next_out, avail_out);
+
+  // Displayed frame 1 is layer 1 with the crop of frame 2 on its top left.
+  std::vector<uint8_t> expected1 = frames[1];
+  const size_t bytes_per_pixel = 6;
+  for (size_t y = 0; y < crop_size; ++y) {
+    memcpy(&expected1[y * xsize * bytes_per_pixel],
+           &frames[2][y * crop_size * bytes_per_pixel],
+           crop_size * bytes_per_pixel);
+  }
+  const std::vector<uint8_t>* expected[] = {&frames[0], &expected1, &frames[3],
+                                            &frames[5]};
+
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  EXPECT_NE(nullptr, dec.get());
+  // First pass over the boxes only, to find the frame index box.
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_BOX));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                compressed.size()));
+  JxlDecoderCloseInput(dec.get());
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+    if (status == JXL_DEC_SUCCESS) break;
+    ASSERT_EQ(JXL_DEC_BOX, status);
+  }
+
+  JxlDecoderRewind(dec.get());
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_COLOR_ENCODING |
+                                                     JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                compressed.size()));
+  EXPECT_EQ(JXL_DEC_COLOR_ENCODING, JxlDecoderProcessInput(dec.get()));
+  JxlDecoderReleaseInput(dec.get());
+
+  // Frame 3 starts at indexed frame 2, frame 1 at the indexed layer.
+  std::vector<uint8_t> pixels(frames[0].size());
+  for (size_t frame : {3, 1, 2}) {
+    size_t input_offset;
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSeekToFrame(dec.get(), frame, &input_offset));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec.get(), compressed.data() + input_offset,
+                                 compressed.size() - input_offset));
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec.get(), &pixel_format,
+                                          pixels.data(), pixels.size()));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+    EXPECT_EQ(0u, jxl::test::ComparePixels(expected[frame]->data(),
+                                           pixels.data(), xsize, ysize,
+                                           pixel_format, pixel_format));
+    JxlDecoderReleaseInput(dec.get());
+  }
+}
+
+// The times of the index are in animation ticks, so its time base is the
+// duration of a tick, here 1001/30000 seconds.
+TEST(EncodeTest, FrameIndexTimeBaseTest) {
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  EXPECT_NE(nullptr, enc.get());
+
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+  const size_t xsize = 16;
+  const size_t ysize = 16;
+  JxlPixelFormat pixel_format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  JxlBasicInfo basic_info;
+  jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  basic_info.uses_original_profile = JXL_TRUE;
+  basic_info.have_animation = true;
+  basic_info.animation.tps_numerator = 30000;
+  basic_info.animation.tps_denominator = 1001;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE));
+
+  // Frames 0 and 2 are indexed.
+  const uint32_t durations[] = {2, 3, 5, 1};
+  for (size_t i = 0; i < 4; ++i) {
+    JxlFrameHeader header;
+    JxlEncoderInitFrameHeader(&header);
+    header.duration = durations[i];
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetFrameHeader(frame_settings, &header));
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderFrameSettingsSetOption(
+                  frame_settings, JXL_ENC_FRAME_INDEX_BOX, i % 2 == 0));
+    std::vector<uint8_t> frame =
+        jxl::test::GetSomeTestImage(xsize, ysize, 3, i);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                      frame.data(), frame.size()));
+  }
+  JxlEncoderCloseInput(enc.get());
+  std::vector<uint8_t> compressed = std::vector<uint8_t>(64);
+  uint8_t* next_out = compressed.data();
+  size_t avail_out = compressed.size() - (next_out - compressed.data());
+  ProcessEncoder(enc.get(), compressed, next_out, avail_out);
+
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  EXPECT_NE(nullptr, dec.get());
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_BOX));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                compressed.size()));
+  JxlDecoderCloseInput(dec.get());
+  std::vector<uint8_t> index(256);
+  bool in_index = false;
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+    if (in_index) {
+      index.resize(index.size() - JxlDecoderReleaseBoxBuffer(dec.get()));
+      in_index = false;
+    }
+    if (status == JXL_DEC_SUCCESS) break;
+    ASSERT_EQ(JXL_DEC_BOX, status);
+    JxlBoxType type;
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderGetBoxType(dec.get(), type, JXL_FALSE));
+    if (memcmp(type, "jxli", 4) == 0) {
+      EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetBoxBuffer(dec.get(), index.data(),
+                                                        index.size()));
+      in_index = true;
+    }
+  }
+
+  size_t pos = 0;
+  EXPECT_EQ(2u, jxl::DecodeVarInt(index.data(), index.size(), &pos));
+  ASSERT_LE(pos + 8, index.size());
+  const uint32_t tnum = LoadBE32(index.data() + pos);
+  const uint32_t tden = LoadBE32(index.data() + pos + 4);
+  pos += 8;
+  EXPECT_EQ(1001u, tnum);
+  EXPECT_EQ(30000u, tden);
+  // Ti of indexed frame 0 spans frames 0 and 1, of indexed frame 2 the rest.
+  const uint64_t expected_ticks[] = {2 + 3, 5 + 1};
+  for (uint64_t ticks : expected_ticks) {
+    jxl::DecodeVarInt(index.data(), index.size(), &pos);  // OFFi
+    const uint64_t ti = jxl::DecodeVarInt(index.data(), index.size(), &pos);
+    jxl::DecodeVarInt(index.data(), index.size(), &pos);  // Fi
+    EXPECT_EQ(ticks, ti);
+    EXPECT_DOUBLE_EQ(ticks * 1001.0 / 30000.0,
+                     ti * static_cast<double>(tnum) / tden);
+  }
+  EXPECT_EQ(index.size(), pos);
+}
+
+// A frame after an indexed frame cannot blend onto a reference frame saved
+// before it, since seeking to the indexed frame does not decode that one.
+TEST(EncodeTest, FrameIndexReferenceBeforeIndexTest) {
+  for (bool reference_before_index : {false, true}) {
+    JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+    EXPECT_NE(nullptr, enc.get());
+
+    JxlEncoderFrameSettings* frame_settings =
+        JxlEncoderFrameSettingsCreate(enc.get(), NULL);
+    const size_t xsize = 16;
+    const size_t ysize = 16;
+    JxlPixelFormat pixel_format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+    JxlBasicInfo basic_info;
+    jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+    basic_info.xsize = xsize;
+    basic_info.ysize = ysize;
+    basic_info.uses_original_profile = JXL_TRUE;
+    basic_info.have_animation = true;
+    basic_info.animation.tps_numerator = 10;
+    basic_info.animation.tps_denominator = 1;
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc.get(), &basic_info));
+    JxlColorEncoding color_encoding;
+    JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/false);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetColorEncoding(enc.get(), &color_encoding));
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE));
+    std::vector<uint8_t> pixels =
+        jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+
+    // Frames 0 and 1 are indexed and saved in slots 1 and 2, frame 2 blends
+    // onto one of them.
+    for (size_t i = 0; i < 3; ++i) {
+      JxlFrameHeader header;
+      JxlEncoderInitFrameHeader(&header);
+      header.duration = 1;
+      if (i < 2) {
+        header.layer_info.save_as_reference = i + 1;
+      } else {
+        header.layer_info.blend_info.blendmode = JXL_BLEND_ADD;
+        header.layer_info.blend_info.source = reference_before_index ? 1 : 2;
+      }
+      EXPECT_EQ(JXL_ENC_SUCCESS,
+                JxlEncoderSetFrameHeader(frame_settings, &header));
+      EXPECT_EQ(JXL_ENC_SUCCESS,
+                JxlEncoderFrameSettingsSetOption(
+                    frame_settings, JXL_ENC_FRAME_INDEX_BOX, i < 2));
+      EXPECT_EQ(JXL_ENC_SUCCESS,
+                JxlEncoderAddImageFrame(frame_settings, &pixel_format,
+                                        pixels.data(), pixels.size()));
+    }
+    JxlEncoderCloseInput(enc.get());
+    std::vector<uint8_t> compressed(64);
+    uint8_t* next_out = compressed.data();
+    size_t avail_out = compressed.size();
+    JxlEncoderStatus status = JXL_ENC_NEED_MORE_OUTPUT;
+    while (status == JXL_ENC_NEED_MORE_OUTPUT) {
+      status = JxlEncoderProcessOutput(enc.get(), &next_out, &avail_out);
+      if (status == JXL_ENC_NEED_MORE_OUTPUT) {
+        size_t offset = next_out - compressed.data();
+        compressed.resize(compressed.size() * 2);
+        next_out = compressed.data() + offset;
+        avail_out = compressed.size() - offset;
+      }
+    }
+    if (reference_before_index) {
+      EXPECT_EQ(JXL_ENC_ERROR, status);
+      EXPECT_EQ(JXL_ENC_ERR_API_USAGE, JxlEncoderGetError(enc.get()));
+    } else {
+      EXPECT_EQ(JXL_ENC_SUCCESS, status);
+    }
+  }
+}
+
 TEST(EncodeTest, CroppedFrameTest) {
   JxlEncoderPtr enc = JxlEncoderMake(nullptr);
   EXPECT_NE(nullptr, enc.get());
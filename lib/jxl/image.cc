@@ -124,6 +124,13 @@ void PlaneBase::InitializePadding(const size_t sizeof_t, Padding padding) {
 #endif  // MEMORY_SANITIZER
 }
 
+void PlaneBase::ReuseStorage(const size_t xsize, const size_t ysize,
+                             const size_t sizeof_t) {
+  ShrinkTo(xsize, ysize);
+  msan::PoisonMemory(bytes_.get(), bytes_per_row_ * orig_ysize_);
+  InitializePadding(sizeof_t, Padding::kRoundUp);
+}
+
 void PlaneBase::Swap(PlaneBase& other) {
   std::swap(xsize_, other.xsize_);
   std::swap(ysize_, other.ysize_);
@@ -62,6 +62,12 @@ struct PlaneBase {
     // better locality because that would invalidate the image contents.
   }
 
+  // Whether the storage can hold an image of the given size, i.e. ShrinkTo
+  // accepts it.
+  bool HasCapacity(const size_t xsize, const size_t ysize) const {
+    return xsize <= orig_xsize_ && ysize <= orig_ysize_;
+  }
+
   // How many pixels.
   JXL_INLINE size_t xsize() const { return xsize_; }
   JXL_INLINE size_t ysize() const { return ysize_; }
@@ -110,6 +116,12 @@ struct PlaneBase {
   // border, where some lanes are uninitialized and assumed to be unused.
   void InitializePadding(size_t sizeof_t, Padding padding);
 
+  // Shrinks to the given size, which must fit in the storage, and leaves the
+  // image as a newly allocated one would be: msan sees the pixels and the
+  // rest of the storage as uninitialized, except for the padding that the
+  // constructor initializes. Unlike ShrinkTo, the contents are discarded.
+  void ReuseStorage(size_t xsize, size_t ysize, size_t sizeof_t);
+
   // (Members are non-const to enable assignment during move-assignment.)
   uint32_t xsize_;  // In valid pixels, not including any padding.
   uint32_t ysize_;
@@ -154,6 +166,11 @@ class Plane : public PlaneBase {
     InitializePadding(sizeof(T), Padding::kUnaligned);
   }
 
+  // See PlaneBase::ReuseStorage.
+  void ReuseStorage(const size_t xsize, const size_t ysize) {
+    PlaneBase::ReuseStorage(xsize, ysize, sizeof(T));
+  }
+
   JXL_INLINE T* Row(const size_t y) { return static_cast<T*>(VoidRow(y)); }
 
   // Returns pointer to const (see above).
@@ -188,6 +205,18 @@ bool SameSize(const Image1& image1, const Image2& image2) {
   return image1.xsize() == image2.xsize() && image1.ysize() == image2.ysize();
 }
 
+// Makes *image an image of the given size, keeping its storage if it is large
+// enough. As for a newly allocated image, the contents are undefined, and the
+// stale pixels of a kept storage are not visible to msan.
+template <class Image>
+void ReuseOrAllocateImage(size_t xsize, size_t ysize, Image* image) {
+  if (image->HasCapacity(xsize, ysize)) {
+    image->ReuseStorage(xsize, ysize);
+    return;
+  }
+  *image = Image(xsize, ysize);
+}
+
 template <typename T>
 class Image3;
 
@@ -453,6 +482,17 @@ class Image3 {
     }
   }
 
+  bool HasCapacity(const size_t xsize, const size_t ysize) const {
+    return planes_[0].HasCapacity(xsize, ysize);
+  }
+
+  // See PlaneBase::ReuseStorage.
+  void ReuseStorage(const size_t xsize, const size_t ysize) {
+    for (PlaneT& plane : planes_) {
+      plane.ReuseStorage(xsize, ysize);
+    }
+  }
+
   // Sizes of all three images are guaranteed to be equal.
   JXL_INLINE size_t xsize() const { return planes_[0].xsize(); }
   JXL_INLINE size_t ysize() const { return planes_[0].ysize(); }
@@ -8,6 +8,8 @@
 #include <stdlib.h>
 #include <string.h> /* for memset, memcpy */
 
+#include <algorithm>
+#include <atomic>
 #include <deque>
 #include <string>
 #include <vector>
@@ -690,8 +692,204 @@ size_t HistogramIndex(const JPEGData& jpg, size_t scan_index,
   return idx + component_index;
 }
 
+static JXL_INLINE int NextExtraZeroRunIndex(const JPEGScanInfo& scan_info,
+                                            const EncodeScanState& ss) {
+  if (ss.extra_zero_runs_pos < scan_info.extra_zero_runs.size()) {
+    return scan_info.extra_zero_runs[ss.extra_zero_runs_pos].block_idx;
+  } else {
+    return -1;
+  }
+}
+
+static JXL_INLINE int NextResetPoint(const JPEGScanInfo& scan_info,
+                                     EncodeScanState* ss) {
+  if (ss->next_reset_point_pos < scan_info.reset_points.size()) {
+    return scan_info.reset_points[ss->next_reset_point_pos++];
+  } else {
+    return -1;
+  }
+}
+
+// Emits the next restart marker, after flushing the buffered bits of the
+// previous restart interval.
+template <int kOutputMode>
+bool EmitRestartMarker(EncodeScanState* ss, const uint8_t** pad_bits,
+                       const uint8_t* pad_bits_end) {
+  Flush<kOutputMode>(&ss->coding_state, &ss->bw);
+  if (!JumpToByteBoundary(&ss->bw, pad_bits, pad_bits_end)) {
+    return false;
+  }
+  EmitMarker(&ss->bw, 0xD0 + ss->next_restart_marker);
+  ss->next_restart_marker += 1;
+  ss->next_restart_marker &= 0x7;
+  memset(ss->last_dc_coeff, 0, sizeof(ss->last_dc_coeff));
+  return true;
+}
+
+// Encodes the MCU at (mcu_x, ss->mcu_y) of the current scan.
+template <int kMode, int kOutputMode>
+static JXL_INLINE bool EncodeMCU(const JPEGData& jpg,
+                                 SerializationState* state, int Ss, int Se,
+                                 int Al, int mcu_x, EncodeScanState* ss) {
+  const JPEGScanInfo& scan_info = jpg.scan_info[state->scan_index];
+  // "Non-interleaved" means color data comes in separate scans, in other words
+  // each scan can contain only one color component.
+  const bool is_interleaved = (scan_info.num_components > 1);
+  JpegBitWriter* bw = &ss->bw;
+  DCTCodingState* coding_state = &ss->coding_state;
+  for (size_t i = 0; i < scan_info.num_components; ++i) {
+    const JPEGComponentScanInfo& si = scan_info.components[i];
+    const JPEGComponent& c = jpg.components[si.comp_idx];
+    size_t dc_tbl_idx = (kOutputMode == OutputModes::kModeHistogram
+                             ? HistogramIndex(jpg, state->scan_index, i)
+                             : si.dc_tbl_idx);
+    size_t ac_tbl_idx = (kOutputMode == OutputModes::kModeHistogram
+                             ? HistogramIndex(jpg, state->scan_index, i)
+                             : si.ac_tbl_idx);
+    // The tables are only modified in histogram mode, which is never run
+    // concurrently.
+    HuffmanCodeTable* dc_huff = &state->dc_huff_table[dc_tbl_idx];
+    HuffmanCodeTable* ac_huff = &state->ac_huff_table[ac_tbl_idx];
+    int n_blocks_y = is_interleaved ? c.v_samp_factor : 1;
+    int n_blocks_x = is_interleaved ? c.h_samp_factor : 1;
+    for (int iy = 0; iy < n_blocks_y; ++iy) {
+      for (int ix = 0; ix < n_blocks_x; ++ix) {
+        int block_y = ss->mcu_y * n_blocks_y + iy;
+        int block_x = mcu_x * n_blocks_x + ix;
+        int block_idx = block_y * c.width_in_blocks + block_x;
+        if (ss->block_scan_index == ss->next_reset_point) {
+          Flush<kOutputMode>(coding_state, bw);
+          ss->next_reset_point = NextResetPoint(scan_info, ss);
+        }
+        int num_zero_runs = 0;
+        if (ss->block_scan_index == ss->next_extra_zero_run_index) {
+          num_zero_runs = scan_info.extra_zero_runs[ss->extra_zero_runs_pos]
+                              .num_extra_zero_runs;
+          ++ss->extra_zero_runs_pos;
+          ss->next_extra_zero_run_index = NextExtraZeroRunIndex(scan_info, *ss);
+        }
+        const coeff_t* coeffs = &c.coeffs[block_idx << 6];
+        bool ok;
+        if (kMode == 0) {
+          ok = EncodeDCTBlockSequential<kOutputMode>(
+              coeffs, dc_huff, ac_huff, num_zero_runs,
+              ss->last_dc_coeff + si.comp_idx, bw);
+        } else if (kMode == 1) {
+          ok = EncodeDCTBlockProgressive<kOutputMode>(
+              coeffs, dc_huff, ac_huff, Ss, Se, Al, num_zero_runs, coding_state,
+              ss->last_dc_coeff + si.comp_idx, bw);
+        } else {
+          ok = EncodeRefinementBits<kOutputMode>(coeffs, ac_huff, Ss, Se, Al,
+                                                 coding_state, bw);
+        }
+        if (!ok) return false;
+        ++ss->block_scan_index;
+      }
+    }
+  }
+  return true;
+}
+
+// Restart intervals with fewer MCUs than this are grouped into one task.
+constexpr size_t kMinMcusPerTask = 1024;
+
+// Encodes the restart intervals of the current scan on the thread pool. The
+// intervals are independent of each other, apart from the restart markers
+// between them, so each task writes its intervals to its own queue, and the
+// queues are concatenated in order. Returns false on error.
+template <int kMode>
+bool EncodeRestartIntervalsParallel(const JPEGData& jpg,
+                                    SerializationState* state, int Ss, int Se,
+                                    int Al, ThreadPool* pool) {
+  const JPEGScanInfo& scan_info = jpg.scan_info[state->scan_index];
+  const bool is_interleaved = (scan_info.num_components > 1);
+  int MCUs_per_row = 0;
+  int MCU_rows = 0;
+  jpg.CalculateMcuSize(scan_info, &MCUs_per_row, &MCU_rows);
+  size_t blocks_per_mcu = 0;
+  for (size_t i = 0; i < scan_info.num_components; ++i) {
+    const JPEGComponent& c = jpg.components[scan_info.components[i].comp_idx];
+    blocks_per_mcu += is_interleaved ? c.h_samp_factor * c.v_samp_factor : 1;
+  }
+  const size_t num_mcus = static_cast<size_t>(MCUs_per_row) * MCU_rows;
+  const size_t restart_interval = jpg.restart_interval;
+  const size_t num_intervals = DivCeil(num_mcus, restart_interval);
+  const size_t intervals_per_task =
+      DivCeil(kMinMcusPerTask, restart_interval);
+  const size_t num_tasks = DivCeil(num_intervals, intervals_per_task);
+
+  std::vector<std::deque<OutputChunk>> task_output(num_tasks);
+  std::atomic<bool> has_error{false};
+  const auto encode_task = [&](const uint32_t task, size_t /* thread */) {
+    const size_t begin_interval = task * intervals_per_task;
+    const size_t end_interval =
+        std::min(num_intervals, begin_interval + intervals_per_task);
+    const size_t begin_mcu = begin_interval * restart_interval;
+    const size_t begin_block = begin_mcu * blocks_per_mcu;
+    EncodeScanState ss;
+    JpegBitWriterInit(&ss.bw, &task_output[task]);
+    ss.coding_state.eob_run_ = 0;
+    ss.coding_state.cur_ac_huff_ = nullptr;
+    ss.next_restart_marker =
+        begin_interval > 0 ? (begin_interval - 1) & 0x7 : 0;
+    ss.block_scan_index = begin_block;
+    const auto& zero_runs = scan_info.extra_zero_runs;
+    ss.extra_zero_runs_pos =
+        std::lower_bound(zero_runs.begin(), zero_runs.end(), begin_block,
+                         [](const JPEGScanInfo::ExtraZeroRunInfo& run,
+                            size_t block) { return run.block_idx < block; }) -
+        zero_runs.begin();
+    ss.next_extra_zero_run_index = NextExtraZeroRunIndex(scan_info, ss);
+    ss.next_reset_point_pos =
+        std::lower_bound(scan_info.reset_points.begin(),
+                         scan_info.reset_points.end(), begin_block) -
+        scan_info.reset_points.begin();
+    ss.next_reset_point = NextResetPoint(scan_info, &ss);
+    // There are no padding bits, so the restart markers do not depend on the
+    // previous intervals.
+    const uint8_t* pad_bits = nullptr;
+    for (size_t interval = begin_interval; interval < end_interval;
+         ++interval) {
+      if (interval > 0 && !EmitRestartMarker<OutputModes::kModeWrite>(
+                              &ss, &pad_bits, nullptr)) {
+        has_error = true;
+        return;
+      }
+      const size_t end_mcu =
+          std::min(num_mcus, (interval + 1) * restart_interval);
+      for (size_t mcu = interval * restart_interval; mcu < end_mcu; ++mcu) {
+        ss.mcu_y = mcu / MCUs_per_row;
+        if (!EncodeMCU<kMode, OutputModes::kModeWrite>(
+                jpg, state, Ss, Se, Al, mcu % MCUs_per_row, &ss)) {
+          has_error = true;
+          return;
+        }
+      }
+    }
+    Flush<OutputModes::kModeWrite>(&ss.coding_state, &ss.bw);
+    if (!JumpToByteBoundary(&ss.bw, &pad_bits, nullptr) || !ss.bw.healthy) {
+      has_error = true;
+      return;
+    }
+    JpegBitWriterFinish(&ss.bw);
+  };
+  if (!RunOnPool(pool, 0, num_tasks, ThreadPool::NoInit, encode_task,
+                 "EncodeRestartIntervals")) {
+    return false;
+  }
+  if (has_error) return false;
+  for (std::deque<OutputChunk>& chunks : task_output) {
+    for (OutputChunk& chunk : chunks) {
+      state->output_queue.emplace_back(std::move(chunk));
+    }
+  }
+  return true;
+}
+
 template <int kMode, int kOutputMode>
 SerializationStatus JXL_NOINLINE DoEncodeScan(const JPEGData& jpg,
+                                              size_t num_ready_rows,
+                                              ThreadPool* pool,
                                               SerializationState* state) {
   const JPEGScanInfo& scan_info = jpg.scan_info[state->scan_index];
   EncodeScanState& ss = state->scan_state;
@@ -699,22 +897,6 @@ SerializationStatus JXL_NOINLINE DoEncodeScan(const JPEGData& jpg,
   const int restart_interval =
       state->seen_dri_marker ? jpg.restart_interval : 0;
 
-  const auto get_next_extra_zero_run_index = [&ss, &scan_info]() -> int {
-    if (ss.extra_zero_runs_pos < scan_info.extra_zero_runs.size()) {
-      return scan_info.extra_zero_runs[ss.extra_zero_runs_pos].block_idx;
-    } else {
-      return -1;
-    }
-  };
-
-  const auto get_next_reset_point = [&ss, &scan_info]() -> int {
-    if (ss.next_reset_point_pos < scan_info.reset_points.size()) {
-      return scan_info.reset_points[ss.next_reset_point_pos++];
-    } else {
-      return -1;
-    }
-  };
-
   if (ss.stage == EncodeScanState::HEAD) {
     if (!EncodeSOS(jpg, scan_info, state)) return SerializationStatus::ERROR;
     JpegBitWriterInit(&ss.bw, &state->output_queue);
@@ -723,9 +905,9 @@ SerializationStatus JXL_NOINLINE DoEncodeScan(const JPEGData& jpg,
     ss.next_restart_marker = 0;
     ss.block_scan_index = 0;
     ss.extra_zero_runs_pos = 0;
-    ss.next_extra_zero_run_index = get_next_extra_zero_run_index();
+    ss.next_extra_zero_run_index = NextExtraZeroRunIndex(scan_info, ss);
     ss.next_reset_point_pos = 0;
-    ss.next_reset_point = get_next_reset_point();
+    ss.next_reset_point = NextResetPoint(scan_info, &ss);
     ss.mcu_y = 0;
     memset(ss.last_dc_coeff, 0, sizeof(ss.last_dc_coeff));
     ss.stage = EncodeScanState::BODY;
@@ -735,9 +917,6 @@ SerializationStatus JXL_NOINLINE DoEncodeScan(const JPEGData& jpg,
 
   JXL_DASSERT(ss.stage == EncodeScanState::BODY);
 
-  // "Non-interleaved" means color data comes in separate scans, in other words
-  // each scan can contain only one color component.
-  const bool is_interleaved = (scan_info.num_components > 1);
   int MCUs_per_row = 0;
   int MCU_rows = 0;
   jpg.CalculateMcuSize(scan_info, &MCUs_per_row, &MCU_rows);
@@ -746,96 +925,52 @@ SerializationStatus JXL_NOINLINE DoEncodeScan(const JPEGData& jpg,
   const int Ss = is_progressive ? scan_info.Ss : 0;
   const int Se = is_progressive ? scan_info.Se : 63;
 
-  // DC-only is defined by [0..0] spectral range.
-  const bool want_ac = ((Ss != 0) || (Se != 0));
-  // TODO: support streaming decoding again.
-  const bool complete_ac = true;
-  const bool has_ac = true;
-  if (want_ac && !has_ac) return SerializationStatus::NEEDS_MORE_INPUT;
-
-  // |has_ac| implies |complete_dc| but not vice versa; for the sake of
-  // simplicity we pretend they are equal, because they are separated by just a
-  // few bytes of input.
-  const bool complete_dc = has_ac;
-  const bool complete = want_ac ? complete_ac : complete_dc;
-  // When "incomplete" |ac_dc| tracks information about current ("incomplete")
-  // band parsing progress.
-
-  // FIXME: Is this always complete?
-  // const int last_mcu_y =
-  //     complete ? MCU_rows : parsing_state.internal->ac_dc.next_mcu_y *
-  //     v_group;
-  (void)complete;
-  const int last_mcu_y = complete ? MCU_rows : 0;
+  // Only the MCU rows that are entirely within the first num_ready_rows rows
+  // of the image can be encoded.
+  int max_v_samp_factor = 1;
+  for (const auto& c : jpg.components) {
+    max_v_samp_factor = std::max(c.v_samp_factor, max_v_samp_factor);
+  }
+  const int v_group =
+      scan_info.num_components > 1
+          ? 1
+          : jpg.components[scan_info.components[0].comp_idx].v_samp_factor;
+  const size_t mcu_height = 8 * max_v_samp_factor / v_group;
+  const int last_mcu_y =
+      num_ready_rows >= static_cast<size_t>(jpg.height)
+          ? MCU_rows
+          : std::min<int>(MCU_rows, num_ready_rows / mcu_height);
+
+  if (kOutputMode == OutputModes::kModeWrite && pool != nullptr &&
+      restart_interval > 0 && state->pad_bits == nullptr && ss.mcu_y == 0 &&
+      last_mcu_y == MCU_rows &&
+      static_cast<size_t>(MCUs_per_row) * MCU_rows > kMinMcusPerTask) {
+    if (!EncodeRestartIntervalsParallel<kMode>(jpg, state, Ss, Se, Al, pool)) {
+      return SerializationStatus::ERROR;
+    }
+    ss.mcu_y = MCU_rows;
+  }
 
   for (; ss.mcu_y < last_mcu_y; ++ss.mcu_y) {
     for (int mcu_x = 0; mcu_x < MCUs_per_row; ++mcu_x) {
       // Possibly emit a restart marker.
       if (restart_interval > 0 && ss.restarts_to_go == 0) {
-        Flush<kOutputMode>(coding_state, bw);
-        if (!JumpToByteBoundary(bw, &state->pad_bits, state->pad_bits_end)) {
+        if (!EmitRestartMarker<kOutputMode>(&ss, &state->pad_bits,
+                                            state->pad_bits_end)) {
           return SerializationStatus::ERROR;
         }
-        EmitMarker(bw, 0xD0 + ss.next_restart_marker);
-        ss.next_restart_marker += 1;
-        ss.next_restart_marker &= 0x7;
         ss.restarts_to_go = restart_interval;
-        memset(ss.last_dc_coeff, 0, sizeof(ss.last_dc_coeff));
       }
-      // Encode one MCU
-      for (size_t i = 0; i < scan_info.num_components; ++i) {
-        const JPEGComponentScanInfo& si = scan_info.components[i];
-        const JPEGComponent& c = jpg.components[si.comp_idx];
-        size_t dc_tbl_idx = (kOutputMode == OutputModes::kModeHistogram
-                                 ? HistogramIndex(jpg, state->scan_index, i)
-                                 : si.dc_tbl_idx);
-        size_t ac_tbl_idx = (kOutputMode == OutputModes::kModeHistogram
-                                 ? HistogramIndex(jpg, state->scan_index, i)
-                                 : si.ac_tbl_idx);
-        HuffmanCodeTable* dc_huff = &state->dc_huff_table[dc_tbl_idx];
-        HuffmanCodeTable* ac_huff = &state->ac_huff_table[ac_tbl_idx];
-        int n_blocks_y = is_interleaved ? c.v_samp_factor : 1;
-        int n_blocks_x = is_interleaved ? c.h_samp_factor : 1;
-        for (int iy = 0; iy < n_blocks_y; ++iy) {
-          for (int ix = 0; ix < n_blocks_x; ++ix) {
-            int block_y = ss.mcu_y * n_blocks_y + iy;
-            int block_x = mcu_x * n_blocks_x + ix;
-            int block_idx = block_y * c.width_in_blocks + block_x;
-            if (ss.block_scan_index == ss.next_reset_point) {
-              Flush<kOutputMode>(coding_state, bw);
-              ss.next_reset_point = get_next_reset_point();
-            }
-            int num_zero_runs = 0;
-            if (ss.block_scan_index == ss.next_extra_zero_run_index) {
-              num_zero_runs = scan_info.extra_zero_runs[ss.extra_zero_runs_pos]
-                                  .num_extra_zero_runs;
-              ++ss.extra_zero_runs_pos;
-              ss.next_extra_zero_run_index = get_next_extra_zero_run_index();
-            }
-            const coeff_t* coeffs = &c.coeffs[block_idx << 6];
-            bool ok;
-            if (kMode == 0) {
-              ok = EncodeDCTBlockSequential<kOutputMode>(
-                  coeffs, dc_huff, ac_huff, num_zero_runs,
-                  ss.last_dc_coeff + si.comp_idx, bw);
-            } else if (kMode == 1) {
-              ok = EncodeDCTBlockProgressive<kOutputMode>(
-                  coeffs, dc_huff, ac_huff, Ss, Se, Al, num_zero_runs,
-                  coding_state, ss.last_dc_coeff + si.comp_idx, bw);
-            } else {
-              ok = EncodeRefinementBits<kOutputMode>(coeffs, ac_huff, Ss, Se,
-                                                     Al, coding_state, bw);
-            }
-            if (!ok) return SerializationStatus::ERROR;
-            ++ss.block_scan_index;
-          }
-        }
+      if (!EncodeMCU<kMode, kOutputMode>(jpg, state, Ss, Se, Al, mcu_x, &ss)) {
+        return SerializationStatus::ERROR;
       }
       --ss.restarts_to_go;
     }
   }
   if (ss.mcu_y < MCU_rows) {
     if (!bw->healthy) return SerializationStatus::ERROR;
+    // Make the bytes of the encoded rows available to the output.
+    if (bw->pos > 0) SwapBuffer(bw);
     return SerializationStatus::NEEDS_MORE_INPUT;
   }
   Flush<kOutputMode>(coding_state, bw);
@@ -852,6 +987,8 @@ SerializationStatus JXL_NOINLINE DoEncodeScan(const JPEGData& jpg,
 
 template <int kOutputMode>
 static SerializationStatus JXL_INLINE EncodeScan(const JPEGData& jpg,
+                                                 size_t num_ready_rows,
+                                                 ThreadPool* pool,
                                                  SerializationState* state) {
   const JPEGScanInfo& scan_info = jpg.scan_info[state->scan_index];
   const bool is_progressive = state->is_progressive;
@@ -862,17 +999,18 @@ static SerializationStatus JXL_INLINE EncodeScan(const JPEGData& jpg,
   const bool need_sequential =
       !is_progressive || (Ah == 0 && Al == 0 && Ss == 0 && Se == 63);
   if (need_sequential) {
-    return DoEncodeScan<0, kOutputMode>(jpg, state);
+    return DoEncodeScan<0, kOutputMode>(jpg, num_ready_rows, pool, state);
   } else if (Ah == 0) {
-    return DoEncodeScan<1, kOutputMode>(jpg, state);
+    return DoEncodeScan<1, kOutputMode>(jpg, num_ready_rows, pool, state);
   } else {
-    return DoEncodeScan<2, kOutputMode>(jpg, state);
+    return DoEncodeScan<2, kOutputMode>(jpg, num_ready_rows, pool, state);
   }
 }
 
 template <int kOutputMode>
 SerializationStatus SerializeSection(uint8_t marker, SerializationState* state,
-                                     const JPEGData& jpg) {
+                                     const JPEGData& jpg, size_t num_ready_rows,
+                                     ThreadPool* pool) {
   const auto to_status = [](bool result) {
     return result ? SerializationStatus::DONE : SerializationStatus::ERROR;
   };
@@ -903,7 +1041,7 @@ SerializationStatus SerializeSection(uint8_t marker, SerializationState* state,
       return to_status(EncodeEOI(jpg, state));
 
     case 0xDA:
-      return EncodeScan<kOutputMode>(jpg, state);
+      return EncodeScan<kOutputMode>(jpg, num_ready_rows, pool, state);
 
     case 0xDB:
       return to_status(EncodeDQT(jpg, state));
@@ -940,9 +1078,9 @@ SerializationStatus SerializeSection(uint8_t marker, SerializationState* state,
   }
 }
 
-// TODO(veluca): add streaming support again.
 template <int kOutputMode>
-Status WriteJpegInternal(const JPEGData& jpg, const JPEGOutput& out,
+Status WriteJpegInternal(const JPEGData& jpg, size_t num_ready_rows,
+                         ThreadPool* pool, const JPEGOutput& out,
                          SerializationState* ss) {
   const auto maybe_push_output = [&]() -> Status {
     if (ss->stage != SerializationState::ERROR) {
@@ -953,6 +1091,7 @@ Status WriteJpegInternal(const JPEGData& jpg, const JPEGOutput& out,
           return StatusMessage(Status(StatusCode::kNotEnoughBytes),
                                "Failed to write output");
         }
+        chunk.next += num_written;
         chunk.len -= num_written;
         if (chunk.len == 0) {
           ss->output_queue.pop_front();
@@ -962,6 +1101,9 @@ Status WriteJpegInternal(const JPEGData& jpg, const JPEGOutput& out,
     return true;
   };
 
+  // Bytes that did not fit in the output in the previous call come first.
+  JXL_QUIET_RETURN_IF_ERROR(maybe_push_output());
+
   while (true) {
     switch (ss->stage) {
       case SerializationState::INIT: {
@@ -990,8 +1132,8 @@ Status WriteJpegInternal(const JPEGData& jpg, const JPEGOutput& out,
         }
 
         EncodeSOI(ss);
-        JXL_QUIET_RETURN_IF_ERROR(maybe_push_output());
         ss->stage = SerializationState::SERIALIZE_SECTION;
+        JXL_QUIET_RETURN_IF_ERROR(maybe_push_output());
         break;
       }
 
@@ -1001,22 +1143,24 @@ Status WriteJpegInternal(const JPEGData& jpg, const JPEGOutput& out,
           break;
         }
         uint8_t marker = jpg.marker_order[ss->section_index];
-        SerializationStatus status =
-            SerializeSection<kOutputMode>(marker, ss, jpg);
+        SerializationStatus status = SerializeSection<kOutputMode>(
+            marker, ss, jpg, num_ready_rows, pool);
         if (status == SerializationStatus::ERROR) {
           JXL_WARNING("Failed to encode marker 0x%.2x", marker);
           ss->stage = SerializationState::ERROR;
           break;
         }
-        JXL_QUIET_RETURN_IF_ERROR(maybe_push_output());
-        if (status == SerializationStatus::NEEDS_MORE_INPUT) {
-          return JXL_FAILURE("Incomplete serialization data");
-        } else if (status != SerializationStatus::DONE) {
+        if (status == SerializationStatus::DONE) {
+          ++ss->section_index;
+        } else if (status != SerializationStatus::NEEDS_MORE_INPUT) {
           JXL_DASSERT(false);
           ss->stage = SerializationState::ERROR;
           break;
         }
-        ++ss->section_index;
+        JXL_QUIET_RETURN_IF_ERROR(maybe_push_output());
+        // The rest of the scan is written in the next call, when more rows
+        // are ready.
+        if (status == SerializationStatus::NEEDS_MORE_INPUT) return true;
         break;
       }
 
@@ -1037,12 +1181,19 @@ Status WriteJpegInternal(const JPEGData& jpg, const JPEGOutput& out,
 
 Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out) {
   SerializationState ss;
-  return WriteJpegInternal<OutputModes::kModeWrite>(jpg, out, &ss);
+  return WriteJpeg(jpg, jpg.height, /*pool=*/nullptr, out, &ss);
+}
+
+Status WriteJpeg(const JPEGData& jpg, size_t num_ready_rows, ThreadPool* pool,
+                 const JPEGOutput& out, SerializationState* ss) {
+  return WriteJpegInternal<OutputModes::kModeWrite>(jpg, num_ready_rows, pool,
+                                                    out, ss);
 }
 
 Status ProcessJpeg(const JPEGData& jpg, SerializationState* ss) {
   auto nullout = [](const uint8_t* buf, size_t len) { return len; };
-  return WriteJpegInternal<OutputModes::kModeHistogram>(jpg, nullout, ss);
+  return WriteJpegInternal<OutputModes::kModeHistogram>(
+      jpg, jpg.height, /*pool=*/nullptr, nullout, ss);
 }
 
 Status EncodeImageJPGCoefficients(const CodecInOut* io, PaddedBytes* bytes) {
@@ -13,6 +13,7 @@
 
 #include <functional>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/codec_in_out.h"
 #include "lib/jxl/jpeg/dec_jpeg_serialization_state.h"
 #include "lib/jxl/jpeg/jpeg_data.h"
@@ -26,6 +27,17 @@ using JPEGOutput = std::function<size_t(const uint8_t* buf, size_t len)>;
 
 Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out);
 
+// Writes the JPEG incrementally, continuing where the previous call with the
+// same `ss` stopped. Only the first `num_ready_rows` rows of the image are
+// written, in whole MCU rows, so that the output can start while the
+// coefficients of the next rows are still being decoded. The writing is
+// complete when ss->stage is SerializationState::DONE. If `out` accepts fewer
+// bytes than it is given, returns StatusCode::kNotEnoughBytes, and the next
+// call writes the remaining bytes first. Scans with restart intervals are
+// encoded in parallel on `pool`, if not null.
+Status WriteJpeg(const JPEGData& jpg, size_t num_ready_rows, ThreadPool* pool,
+                 const JPEGOutput& out, SerializationState* ss);
+
 // Same as WriteJpeg, but instead of writing to the output, collects statistics
 // about the bit-stream into `ss`.
 Status ProcessJpeg(const JPEGData& jpg, SerializationState* ss);
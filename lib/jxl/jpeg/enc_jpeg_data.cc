@@ -296,7 +296,8 @@ Status EncodeJPEGData(JPEGData& jpeg_data, PaddedBytes* bytes,
   return true;
 }
 
-Status DecodeImageJPG(const Span<const uint8_t> bytes, CodecInOut* io) {
+Status DecodeImageJPG(const Span<const uint8_t> bytes, CodecInOut* io,
+                      ThreadPool* pool) {
   if (!IsJPG(bytes)) return false;
   io->frames.clear();
   io->frames.reserve(1);
@@ -304,7 +305,7 @@ Status DecodeImageJPG(const Span<const uint8_t> bytes, CodecInOut* io) {
   io->Main().jpeg_data = make_unique<jpeg::JPEGData>();
   jpeg::JPEGData* jpeg_data = io->Main().jpeg_data.get();
   if (!jpeg::ReadJpeg(bytes.data(), bytes.size(), jpeg::JpegReadMode::kReadAll,
-                      jpeg_data)) {
+                      pool, jpeg_data)) {
     return JXL_FAILURE("Error reading JPEG");
   }
   JXL_RETURN_IF_ERROR(
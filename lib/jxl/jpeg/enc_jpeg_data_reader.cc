@@ -9,9 +9,13 @@
 #include <string.h>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/printf_macros.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/common.h"
@@ -379,6 +383,16 @@ bool ProcessCOM(const uint8_t* data, const size_t len, size_t* pos,
   return true;
 }
 
+// Reconstruction data produced while decoding a range of MCUs of a scan. It is
+// kept apart from the JPEGData so that ranges can be decoded in parallel and
+// appended to it in stream order afterwards.
+struct ScanRangeOutput {
+  bool has_zero_padding_bit = false;
+  std::vector<uint8_t> padding_bits;
+  std::vector<uint32_t> reset_points;
+  std::vector<JPEGScanInfo::ExtraZeroRunInfo> extra_zero_runs;
+};
+
 // Helper structure to read bits from the entropy coded data segment.
 struct BitReaderState {
   BitReaderState(const uint8_t* data, const size_t len, size_t pos)
@@ -435,16 +449,16 @@ struct BitReaderState {
   // Enqueue the padding bits seen (0 or 1).
   // Returns false if there is inconsistent or invalid padding or the stream
   // ended too early.
-  bool FinishStream(JPEGData* jpg, size_t* pos) {
+  bool FinishStream(ScanRangeOutput* out, size_t* pos) {
     int npadbits = bits_left_ & 7;
     if (npadbits > 0) {
       uint64_t padmask = (1ULL << npadbits) - 1;
       uint64_t padbits = (val_ >> (bits_left_ - npadbits)) & padmask;
       if (padbits != padmask) {
-        jpg->has_zero_padding_bit = true;
+        out->has_zero_padding_bit = true;
       }
       for (int i = npadbits - 1; i >= 0; --i) {
-        jpg->padding_bits.push_back((padbits >> i) & 1);
+        out->padding_bits.push_back((padbits >> i) & 1);
       }
     }
     // Give back some bytes that we did not use.
@@ -726,9 +740,9 @@ bool RefineDCTBlock(const HuffmanTableEntry* ac_huff, int Ss, int Se, int Al,
 
 bool ProcessRestart(const uint8_t* data, const size_t len,
                     int* next_restart_marker, BitReaderState* br,
-                    JPEGData* jpg) {
+                    ScanRangeOutput* out) {
   size_t pos = 0;
-  if (!br->FinishStream(jpg, &pos)) {
+  if (!br->FinishStream(out, &pos)) {
     return JXL_FAILURE("Invalid scan");
   }
   int expected_marker = 0xd0 + *next_restart_marker;
@@ -744,46 +758,23 @@ bool ProcessRestart(const uint8_t* data, const size_t len,
   return true;
 }
 
-bool ProcessScan(const uint8_t* data, const size_t len,
-                 const std::vector<HuffmanTableEntry>& dc_huff_lut,
-                 const std::vector<HuffmanTableEntry>& ac_huff_lut,
-                 uint16_t scan_progression[kMaxComponents][kDCTBlockSize],
-                 bool is_progressive, size_t* pos, JPEGData* jpg) {
+// Reads the SOS marker segment and checks that the new scan is consistent
+// with the scans before it.
+bool ProcessScanHeader(const uint8_t* data, const size_t len,
+                       uint16_t scan_progression[kMaxComponents][kDCTBlockSize],
+                       bool is_progressive, size_t* pos, JPEGData* jpg) {
   if (!ProcessSOS(data, len, pos, jpg)) {
     return false;
   }
-  JPEGScanInfo* scan_info = &jpg->scan_info.back();
-  bool is_interleaved = (scan_info->num_components > 1);
-  int max_h_samp_factor = 1;
-  int max_v_samp_factor = 1;
-  for (size_t i = 0; i < jpg->components.size(); ++i) {
-    max_h_samp_factor =
-        std::max(max_h_samp_factor, jpg->components[i].h_samp_factor);
-    max_v_samp_factor =
-        std::max(max_v_samp_factor, jpg->components[i].v_samp_factor);
-  }
-
-  int MCU_rows = DivCeil(jpg->height, max_v_samp_factor * 8);
-  int MCUs_per_row = DivCeil(jpg->width, max_h_samp_factor * 8);
-  if (!is_interleaved) {
-    const JPEGComponent& c = jpg->components[scan_info->components[0].comp_idx];
-    MCUs_per_row = DivCeil(jpg->width * c.h_samp_factor, 8 * max_h_samp_factor);
-    MCU_rows = DivCeil(jpg->height * c.v_samp_factor, 8 * max_v_samp_factor);
-  }
-  coeff_t last_dc_coeff[kMaxComponents] = {0};
-  BitReaderState br(data, len, *pos);
-  int restarts_to_go = jpg->restart_interval;
-  int next_restart_marker = 0;
-  int eobrun = -1;
-  int block_scan_index = 0;
-  const int Al = is_progressive ? scan_info->Al : 0;
-  const int Ah = is_progressive ? scan_info->Ah : 0;
-  const int Ss = is_progressive ? scan_info->Ss : 0;
-  const int Se = is_progressive ? scan_info->Se : 63;
+  const JPEGScanInfo& scan_info = jpg->scan_info.back();
+  const int Al = is_progressive ? scan_info.Al : 0;
+  const int Ah = is_progressive ? scan_info.Ah : 0;
+  const int Ss = is_progressive ? scan_info.Ss : 0;
+  const int Se = is_progressive ? scan_info.Se : 63;
   const uint16_t scan_bitmask = Ah == 0 ? (0xffff << Al) : (1u << Al);
   const uint16_t refinement_bitmask = (1 << Al) - 1;
-  for (size_t i = 0; i < scan_info->num_components; ++i) {
-    int comp_idx = scan_info->components[i].comp_idx;
+  for (size_t i = 0; i < scan_info.num_components; ++i) {
+    int comp_idx = scan_info.components[i].comp_idx;
     for (int k = Ss; k <= Se; ++k) {
       if (scan_progression[comp_idx][k] & scan_bitmask) {
         return JXL_FAILURE(
@@ -802,65 +793,104 @@ bool ProcessScan(const uint8_t* data, const size_t len,
   if (Al > 10) {
     return JXL_FAILURE("Scan parameter Al=%d is not supported.", Al);
   }
-  for (int mcu_y = 0; mcu_y < MCU_rows; ++mcu_y) {
-    for (int mcu_x = 0; mcu_x < MCUs_per_row; ++mcu_x) {
-      // Handle the restart intervals.
-      if (jpg->restart_interval > 0) {
-        if (restarts_to_go == 0) {
-          if (ProcessRestart(data, len, &next_restart_marker, &br, jpg)) {
-            restarts_to_go = jpg->restart_interval;
-            memset(static_cast<void*>(last_dc_coeff), 0, sizeof(last_dc_coeff));
-            if (eobrun > 0) {
-              return JXL_FAILURE("End-of-block run too long.");
-            }
-            eobrun = -1;  // fresh start
-          } else {
-            return JXL_FAILURE("Could not process restart.");
+  return true;
+}
+
+// Returns the number of DCT blocks in one MCU of the scan.
+size_t NumBlocksPerMcu(const JPEGData& jpg, const JPEGScanInfo& scan_info) {
+  if (scan_info.num_components == 1) return 1;
+  size_t num_blocks = 0;
+  for (size_t i = 0; i < scan_info.num_components; ++i) {
+    const JPEGComponent& c = jpg.components[scan_info.components[i].comp_idx];
+    num_blocks += c.h_samp_factor * c.v_samp_factor;
+  }
+  return num_blocks;
+}
+
+// Decodes the MCUs [begin_mcu, end_mcu) of the scan, where begin_mcu is the
+// first MCU of a restart interval whose entropy-coded data starts at *pos.
+// Restart markers between the intervals of the range are consumed, and *pos
+// is set to the first byte after the data of the last interval.
+bool DecodeScanRange(const uint8_t* data, const size_t len,
+                     const HuffmanTableEntry* dc_huff_lut,
+                     const HuffmanTableEntry* ac_huff_lut,
+                     const JPEGScanInfo& scan_info, bool is_progressive,
+                     int restart_interval, size_t begin_mcu, size_t end_mcu,
+                     size_t* pos, JPEGData* jpg, ScanRangeOutput* out) {
+  bool is_interleaved = (scan_info.num_components > 1);
+  int MCUs_per_row;
+  int MCU_rows;
+  jpg->CalculateMcuSize(scan_info, &MCUs_per_row, &MCU_rows);
+  coeff_t last_dc_coeff[kMaxComponents] = {0};
+  BitReaderState br(data, len, *pos);
+  int restarts_to_go = restart_interval;
+  int next_restart_marker =
+      restart_interval > 0 ? (begin_mcu / restart_interval) & 0x7 : 0;
+  int eobrun = -1;
+  uint32_t block_scan_index = begin_mcu * NumBlocksPerMcu(*jpg, scan_info);
+  const int Al = is_progressive ? scan_info.Al : 0;
+  const int Ah = is_progressive ? scan_info.Ah : 0;
+  const int Ss = is_progressive ? scan_info.Ss : 0;
+  const int Se = is_progressive ? scan_info.Se : 63;
+  for (size_t mcu = begin_mcu; mcu < end_mcu; ++mcu) {
+    const int mcu_y = mcu / MCUs_per_row;
+    const int mcu_x = mcu % MCUs_per_row;
+    // Handle the restart intervals.
+    if (restart_interval > 0) {
+      if (restarts_to_go == 0) {
+        if (ProcessRestart(data, len, &next_restart_marker, &br, out)) {
+          restarts_to_go = restart_interval;
+          memset(static_cast<void*>(last_dc_coeff), 0, sizeof(last_dc_coeff));
+          if (eobrun > 0) {
+            return JXL_FAILURE("End-of-block run too long.");
           }
+          eobrun = -1;  // fresh start
+        } else {
+          return JXL_FAILURE("Could not process restart.");
         }
-        --restarts_to_go;
       }
-      // Decode one MCU.
-      for (size_t i = 0; i < scan_info->num_components; ++i) {
-        JPEGComponentScanInfo* si = &scan_info->components[i];
-        JPEGComponent* c = &jpg->components[si->comp_idx];
-        const HuffmanTableEntry* dc_lut =
-            &dc_huff_lut[si->dc_tbl_idx * kJpegHuffmanLutSize];
-        const HuffmanTableEntry* ac_lut =
-            &ac_huff_lut[si->ac_tbl_idx * kJpegHuffmanLutSize];
-        int nblocks_y = is_interleaved ? c->v_samp_factor : 1;
-        int nblocks_x = is_interleaved ? c->h_samp_factor : 1;
-        for (int iy = 0; iy < nblocks_y; ++iy) {
-          for (int ix = 0; ix < nblocks_x; ++ix) {
-            int block_y = mcu_y * nblocks_y + iy;
-            int block_x = mcu_x * nblocks_x + ix;
-            int block_idx = block_y * c->width_in_blocks + block_x;
-            bool reset_state = false;
-            int num_zero_runs = 0;
-            coeff_t* coeffs = &c->coeffs[block_idx * kDCTBlockSize];
-            if (Ah == 0) {
-              if (!DecodeDCTBlock(dc_lut, ac_lut, Ss, Se, Al, &eobrun,
-                                  &reset_state, &num_zero_runs, &br, jpg,
-                                  &last_dc_coeff[si->comp_idx], coeffs)) {
-                return false;
-              }
-            } else {
-              if (!RefineDCTBlock(ac_lut, Ss, Se, Al, &eobrun, &reset_state,
-                                  &br, jpg, coeffs)) {
-                return false;
-              }
-            }
-            if (reset_state) {
-              scan_info->reset_points.emplace_back(block_scan_index);
+      --restarts_to_go;
+    }
+    // Decode one MCU.
+    for (size_t i = 0; i < scan_info.num_components; ++i) {
+      const JPEGComponentScanInfo* si = &scan_info.components[i];
+      JPEGComponent* c = &jpg->components[si->comp_idx];
+      const HuffmanTableEntry* dc_lut =
+          &dc_huff_lut[si->dc_tbl_idx * kJpegHuffmanLutSize];
+      const HuffmanTableEntry* ac_lut =
+          &ac_huff_lut[si->ac_tbl_idx * kJpegHuffmanLutSize];
+      int nblocks_y = is_interleaved ? c->v_samp_factor : 1;
+      int nblocks_x = is_interleaved ? c->h_samp_factor : 1;
+      for (int iy = 0; iy < nblocks_y; ++iy) {
+        for (int ix = 0; ix < nblocks_x; ++ix) {
+          int block_y = mcu_y * nblocks_y + iy;
+          int block_x = mcu_x * nblocks_x + ix;
+          int block_idx = block_y * c->width_in_blocks + block_x;
+          bool reset_state = false;
+          int num_zero_runs = 0;
+          coeff_t* coeffs = &c->coeffs[block_idx * kDCTBlockSize];
+          if (Ah == 0) {
+            if (!DecodeDCTBlock(dc_lut, ac_lut, Ss, Se, Al, &eobrun,
+                                &reset_state, &num_zero_runs, &br, jpg,
+                                &last_dc_coeff[si->comp_idx], coeffs)) {
+              return false;
             }
-            if (num_zero_runs > 0) {
-              JPEGScanInfo::ExtraZeroRunInfo info;
-              info.block_idx = block_scan_index;
-              info.num_extra_zero_runs = num_zero_runs;
-              scan_info->extra_zero_runs.push_back(info);
+          } else {
+            if (!RefineDCTBlock(ac_lut, Ss, Se, Al, &eobrun, &reset_state,
+                                &br, jpg, coeffs)) {
+              return false;
             }
-            ++block_scan_index;
           }
+          if (reset_state) {
+            out->reset_points.emplace_back(block_scan_index);
+          }
+          if (num_zero_runs > 0) {
+            JPEGScanInfo::ExtraZeroRunInfo info;
+            info.block_idx = block_scan_index;
+            info.num_extra_zero_runs = num_zero_runs;
+            out->extra_zero_runs.push_back(info);
+          }
+          ++block_scan_index;
         }
       }
     }
@@ -868,9 +898,47 @@ bool ProcessScan(const uint8_t* data, const size_t len,
   if (eobrun > 0) {
     return JXL_FAILURE("End-of-block run too long.");
   }
-  if (!br.FinishStream(jpg, pos)) {
+  if (!br.FinishStream(out, pos)) {
     return JXL_FAILURE("Invalid scan.");
   }
+  return true;
+}
+
+// Appends the reconstruction data of a decoded range to the scan and to *jpg.
+void AppendScanRange(const ScanRangeOutput& out, JPEGScanInfo* scan_info,
+                     JPEGData* jpg) {
+  if (out.has_zero_padding_bit) jpg->has_zero_padding_bit = true;
+  jpg->padding_bits.insert(jpg->padding_bits.end(), out.padding_bits.begin(),
+                           out.padding_bits.end());
+  scan_info->reset_points.insert(scan_info->reset_points.end(),
+                                 out.reset_points.begin(),
+                                 out.reset_points.end());
+  scan_info->extra_zero_runs.insert(scan_info->extra_zero_runs.end(),
+                                    out.extra_zero_runs.begin(),
+                                    out.extra_zero_runs.end());
+}
+
+bool ProcessScan(const uint8_t* data, const size_t len,
+                 const std::vector<HuffmanTableEntry>& dc_huff_lut,
+                 const std::vector<HuffmanTableEntry>& ac_huff_lut,
+                 uint16_t scan_progression[kMaxComponents][kDCTBlockSize],
+                 bool is_progressive, size_t* pos, JPEGData* jpg) {
+  if (!ProcessScanHeader(data, len, scan_progression, is_progressive, pos,
+                         jpg)) {
+    return false;
+  }
+  JPEGScanInfo* scan_info = &jpg->scan_info.back();
+  int MCUs_per_row;
+  int MCU_rows;
+  jpg->CalculateMcuSize(*scan_info, &MCUs_per_row, &MCU_rows);
+  ScanRangeOutput out;
+  if (!DecodeScanRange(data, len, dc_huff_lut.data(), ac_huff_lut.data(),
+                       *scan_info, is_progressive, jpg->restart_interval, 0,
+                       static_cast<size_t>(MCUs_per_row) * MCU_rows, pos, jpg,
+                       &out)) {
+    return false;
+  }
+  AppendScanRange(out, scan_info, jpg);
   if (*pos > len) {
     return JXL_FAILURE("Unexpected end of file during scan. pos=%" PRIuS
                        " len=%" PRIuS,
@@ -879,6 +947,178 @@ bool ProcessScan(const uint8_t* data, const size_t len,
   return true;
 }
 
+// Minimum number of MCUs decoded by one task of ParallelScanDecoder, to keep
+// the per-task overhead small compared to the entropy decoding.
+constexpr size_t kMinMcusPerTask = 1024;
+
+// Decodes the entropy-coded segments of the scans on a thread pool.
+//
+// While the markers are read, AddScan only locates the segment of each scan
+// and the restart markers inside it. Decode then runs the scans in waves of
+// consecutive scans that touch disjoint coefficients (different components or
+// spectral bands), and splits each scan at its restart markers into tasks of
+// at least kMinMcusPerTask MCUs.
+//
+// The result is identical to the serial decoder as long as the segments are
+// where the serial decoder would find them; every task checks that it ended
+// exactly at the next restart marker or at the end of the segment, and
+// Decode fails otherwise, so that the caller can fall back to the serial
+// decoder.
+class ParallelScanDecoder {
+ public:
+  // Adds the scan whose header was just read, and whose entropy-coded segment
+  // starts at *pos. Sets *pos to the marker after the segment. Returns false
+  // if the segment does not have the expected restart markers.
+  bool AddScan(const uint8_t* data, const size_t len,
+               const std::vector<HuffmanTableEntry>& dc_huff_lut,
+               const std::vector<HuffmanTableEntry>& ac_huff_lut,
+               bool is_progressive, size_t* pos, const JPEGData& jpg) {
+    Scan scan;
+    scan.scan_idx = jpg.scan_info.size() - 1;
+    scan.is_progressive = is_progressive;
+    scan.restart_interval = jpg.restart_interval;
+    // Tables only change with DHT markers, so the number of Huffman codes read
+    // so far tells whether the previous copy of the tables can be reused.
+    if (luts_.empty() || lut_version_ != jpg.huffman_code.size()) {
+      luts_.emplace_back(dc_huff_lut, ac_huff_lut);
+      lut_version_ = jpg.huffman_code.size();
+    }
+    scan.lut_idx = luts_.size() - 1;
+    int MCUs_per_row;
+    int MCU_rows;
+    jpg.CalculateMcuSize(jpg.scan_info.back(), &MCUs_per_row, &MCU_rows);
+    scan.num_mcus = static_cast<size_t>(MCUs_per_row) * MCU_rows;
+    const size_t num_intervals =
+        scan.restart_interval > 0
+            ? DivCeil(scan.num_mcus, size_t(scan.restart_interval))
+            : 1;
+    // Offsets of the entropy-coded data of each restart interval, followed by
+    // the end of the segment.
+    scan.interval_pos.push_back(*pos);
+    size_t p = *pos;
+    for (;;) {
+      while (p + 1 < len && (data[p] != 0xff || data[p + 1] == 0)) {
+        p += data[p] == 0xff ? 2 : 1;
+      }
+      if (p + 1 >= len) return false;
+      const int marker = data[p + 1];
+      if (scan.interval_pos.size() == num_intervals) break;
+      const int expected_marker = 0xd0 + ((scan.interval_pos.size() - 1) & 7);
+      if (marker != expected_marker) return false;
+      p += 2;
+      scan.interval_pos.push_back(p);
+    }
+    scan.interval_pos.push_back(p);
+    *pos = p;
+    scans_.push_back(std::move(scan));
+    return true;
+  }
+
+  bool Decode(const uint8_t* data, const size_t len, ThreadPool* pool,
+              JPEGData* jpg) {
+    std::vector<Task> tasks;
+    // Index of the first task of each wave, followed by the number of tasks.
+    std::vector<size_t> wave_begin;
+    std::vector<std::pair<uint32_t, uint32_t>> wave_bands[kMaxComponents];
+    for (size_t s = 0; s < scans_.size(); ++s) {
+      const Scan& scan = scans_[s];
+      const JPEGScanInfo& scan_info = jpg->scan_info[scan.scan_idx];
+      const uint32_t Ss = scan.is_progressive ? scan_info.Ss : 0;
+      const uint32_t Se = scan.is_progressive ? scan_info.Se : 63;
+      bool overlaps = wave_begin.empty();
+      for (size_t i = 0; i < scan_info.num_components; ++i) {
+        for (const auto& band : wave_bands[scan_info.components[i].comp_idx]) {
+          if (Ss <= band.second && band.first <= Se) overlaps = true;
+        }
+      }
+      if (overlaps) {
+        wave_begin.push_back(tasks.size());
+        for (auto& bands : wave_bands) bands.clear();
+      }
+      for (size_t i = 0; i < scan_info.num_components; ++i) {
+        wave_bands[scan_info.components[i].comp_idx].emplace_back(Ss, Se);
+      }
+      const size_t num_intervals = scan.interval_pos.size() - 1;
+      const size_t intervals_per_task =
+          scan.restart_interval > 0
+              ? DivCeil(kMinMcusPerTask, size_t(scan.restart_interval))
+              : 1;
+      for (size_t i = 0; i < num_intervals; i += intervals_per_task) {
+        Task task;
+        task.scan = s;
+        task.begin_interval = i;
+        task.end_interval = std::min(num_intervals, i + intervals_per_task);
+        tasks.push_back(task);
+      }
+    }
+    wave_begin.push_back(tasks.size());
+
+    std::vector<ScanRangeOutput> outputs(tasks.size());
+    std::atomic<bool> has_error{false};
+    for (size_t w = 0; w + 1 < wave_begin.size(); ++w) {
+      const auto decode_task = [&](const uint32_t task_idx,
+                                   size_t /* thread */) {
+        if (has_error) return;
+        const Task& task = tasks[task_idx];
+        const Scan& scan = scans_[task.scan];
+        const JPEGScanInfo& scan_info = jpg->scan_info[scan.scan_idx];
+        const size_t begin_mcu = task.begin_interval * scan.restart_interval;
+        const size_t end_mcu =
+            task.end_interval == scan.interval_pos.size() - 1
+                ? scan.num_mcus
+                : task.end_interval * scan.restart_interval;
+        size_t pos = scan.interval_pos[task.begin_interval];
+        // The data of the last interval of the task ends two bytes before the
+        // start of the next one, where its restart marker is.
+        size_t expected_end = scan.interval_pos[task.end_interval];
+        if (end_mcu != scan.num_mcus) expected_end -= 2;
+        const auto& luts = luts_[scan.lut_idx];
+        if (!DecodeScanRange(data, len, luts.first.data(), luts.second.data(),
+                             scan_info, scan.is_progressive,
+                             scan.restart_interval, begin_mcu, end_mcu, &pos,
+                             jpg, &outputs[task_idx]) ||
+            pos != expected_end) {
+          has_error = true;
+        }
+      };
+      if (!RunOnPool(pool, wave_begin[w], wave_begin[w + 1],
+                     ThreadPool::NoInit, decode_task, "DecodeJpegScans")) {
+        return JXL_FAILURE("DecodeJpegScans failed");
+      }
+      if (has_error) {
+        return JXL_FAILURE("Parallel scan decoding did not match the stream");
+      }
+    }
+    for (size_t t = 0; t < tasks.size(); ++t) {
+      const size_t scan_idx = scans_[tasks[t].scan].scan_idx;
+      AppendScanRange(outputs[t], &jpg->scan_info[scan_idx], jpg);
+    }
+    return true;
+  }
+
+ private:
+  struct Scan {
+    size_t scan_idx;
+    bool is_progressive;
+    int restart_interval;
+    size_t lut_idx;
+    size_t num_mcus;
+    std::vector<size_t> interval_pos;
+  };
+  struct Task {
+    size_t scan;
+    size_t begin_interval;
+    size_t end_interval;
+  };
+
+  std::vector<Scan> scans_;
+  // Copies of the DC and AC Huffman lookup tables used by the scans.
+  std::vector<std::pair<std::vector<HuffmanTableEntry>,
+                        std::vector<HuffmanTableEntry>>>
+      luts_;
+  size_t lut_version_ = 0;
+};
+
 // Changes the quant_idx field of the components to refer to the index of the
 // quant table in the jpg->quant array.
 bool FixupIndexes(JPEGData* jpg) {
@@ -920,6 +1160,21 @@ size_t FindNextMarker(const uint8_t* data, const size_t len, size_t pos) {
 
 bool ReadJpeg(const uint8_t* data, const size_t len, JpegReadMode mode,
               JPEGData* jpg) {
+  return ReadJpeg(data, len, mode, /*pool=*/nullptr, jpg);
+}
+
+bool ReadJpeg(const uint8_t* data, const size_t len, JpegReadMode mode,
+              ThreadPool* pool, JPEGData* jpg) {
+  std::unique_ptr<ParallelScanDecoder> scan_decoder;
+  if (pool != nullptr && mode == JpegReadMode::kReadAll) {
+    scan_decoder = jxl::make_unique<ParallelScanDecoder>();
+  }
+  // Reruns the serial decoder from scratch if the parallel one could not
+  // reproduce its result.
+  const auto read_serially = [&]() -> bool {
+    *jpg = JPEGData();
+    return ReadJpeg(data, len, mode, /*pool=*/nullptr, jpg);
+  };
   size_t pos = 0;
   // Check SOI marker.
   JXL_JPEG_EXPECT_MARKER();
@@ -975,7 +1230,15 @@ bool ReadJpeg(const uint8_t* data, const size_t len, JpegReadMode mode,
         // Found end marker.
         break;
       case 0xda:
-        if (mode == JpegReadMode::kReadAll) {
+        if (scan_decoder) {
+          ok = ProcessScanHeader(data, len, scan_progression, is_progressive,
+                                 &pos, jpg);
+          if (ok && !scan_decoder->AddScan(data, len, dc_huff_lut,
+                                           ac_huff_lut, is_progressive, &pos,
+                                           *jpg)) {
+            return read_serially();
+          }
+        } else if (mode == JpegReadMode::kReadAll) {
           ok = ProcessScan(data, len, dc_huff_lut, ac_huff_lut,
                            scan_progression, is_progressive, &pos, jpg);
         }
@@ -1027,6 +1290,9 @@ bool ReadJpeg(const uint8_t* data, const size_t len, JpegReadMode mode,
   if (!found_sof) {
     return JXL_FAILURE("Missing SOF marker.");
   }
+  if (scan_decoder && !scan_decoder->Decode(data, len, pool, jpg)) {
+    return read_serially();
+  }
 
   // Supplemental checks.
   if (mode == JpegReadMode::kReadAll) {
@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/jpeg/jpeg_data.h"
 
 namespace jxl {
@@ -30,6 +31,14 @@ enum class JpegReadMode {
 bool ReadJpeg(const uint8_t* data, const size_t len, JpegReadMode mode,
               JPEGData* jpg);
 
+// Same as above, but in kReadAll mode decodes the entropy-coded data on the
+// pool: scans that touch disjoint coefficients are decoded concurrently, and
+// scans with restart markers are split into ranges of restart intervals. The
+// result is the same as without a pool; streams whose segments can not be
+// split reliably are decoded serially.
+bool ReadJpeg(const uint8_t* data, const size_t len, JpegReadMode mode,
+              ThreadPool* pool, JPEGData* jpg);
+
 }  // namespace jpeg
 }  // namespace jxl
 
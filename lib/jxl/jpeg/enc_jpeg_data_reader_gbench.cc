@@ -0,0 +1,117 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "jxl/encode.h"
+#include "jxl/encode_cxx.h"
+#include "lib/jxl/base/padded_bytes.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/base/thread_pool_internal.h"
+#include "lib/jxl/common.h"
+#include "lib/jxl/jpeg/enc_jpeg_data_reader.h"
+#include "lib/jxl/jpeg/jpeg_data.h"
+#include "lib/jxl/testdata.h"
+
+namespace jxl {
+namespace {
+
+// Baseline and progressive JPEGs with different chroma subsampling.
+const char* const kJpegCorpus[] = {
+    "jxl/flower/flower.png.im_q85_420.jpg",
+    "jxl/flower/flower.png.im_q85_444.jpg",
+    "jxl/flower/flower.png.im_q85_420_progr.jpg",
+};
+
+// Reports the throughput in input bytes per second and per second and core,
+// so that the scaling with the number of threads can be read directly.
+void SetThroughputCounters(benchmark::State& state, size_t bytes_per_iteration,
+                           int threads) {
+  const double bytes = static_cast<double>(state.iterations()) *
+                       static_cast<double>(bytes_per_iteration);
+  state.SetBytesProcessed(bytes);
+  state.counters["MB/s/core"] = benchmark::Counter(
+      bytes * 1e-6 / std::max(threads, 1), benchmark::Counter::kIsRate);
+}
+
+// Arguments: image, number of worker threads (or -1 to parse without a pool).
+void BM_ReadJpeg(benchmark::State& state) {
+  const PaddedBytes jpeg = ReadTestData(kJpegCorpus[state.range(0)]);
+  const int threads = state.range(1);
+  std::unique_ptr<ThreadPoolInternal> pool;
+  if (threads >= 0) pool = jxl::make_unique<ThreadPoolInternal>(threads);
+  for (auto _ : state) {
+    jpeg::JPEGData jpg;
+    JXL_CHECK(jpeg::ReadJpeg(jpeg.data(), jpeg.size(),
+                             jpeg::JpegReadMode::kReadAll, pool.get(), &jpg));
+    benchmark::DoNotOptimize(jpg.components[0].coeffs.data());
+  }
+  SetThroughputCounters(state, jpeg.size(), threads);
+}
+
+void ReadJpegArgs(benchmark::internal::Benchmark* b) {
+  for (size_t image = 0; image < sizeof(kJpegCorpus) / sizeof(*kJpegCorpus);
+       ++image) {
+    for (int threads : {-1, 1, 2, 4, 8}) {
+      b->Args({static_cast<int>(image), threads});
+    }
+  }
+  b->ArgNames({"image", "threads"});
+}
+
+BENCHMARK(BM_ReadJpeg)->Apply(ReadJpegArgs)->UseRealTime();
+
+// Losslessly transcodes the whole corpus with one encoder per image, the way
+// a batch conversion job does. Arguments: number of worker threads.
+void BM_TranscodeJpegBatch(benchmark::State& state) {
+  std::vector<PaddedBytes> jpegs;
+  size_t batch_size = 0;
+  for (const char* filename : kJpegCorpus) {
+    jpegs.push_back(ReadTestData(filename));
+    batch_size += jpegs.back().size();
+  }
+  const int threads = state.range(0);
+  ThreadPoolInternal pool(threads);
+  std::vector<uint8_t> compressed(1 << 20);
+  for (auto _ : state) {
+    for (const PaddedBytes& jpeg : jpegs) {
+      JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+      JXL_CHECK(JXL_ENC_SUCCESS ==
+                JxlEncoderSetParallelRunner(enc.get(), pool.runner(),
+                                            pool.runner_opaque()));
+      JXL_CHECK(JXL_ENC_SUCCESS ==
+                JxlEncoderStoreJPEGMetadata(enc.get(), JXL_TRUE));
+      JxlEncoderFrameSettings* frame_settings =
+          JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+      JXL_CHECK(JXL_ENC_SUCCESS == JxlEncoderAddJPEGFrame(frame_settings,
+                                                          jpeg.data(),
+                                                          jpeg.size()));
+      JxlEncoderCloseInput(enc.get());
+      uint8_t* next_out = compressed.data();
+      size_t avail_out = compressed.size();
+      JXL_CHECK(JXL_ENC_SUCCESS ==
+                JxlEncoderProcessOutput(enc.get(), &next_out, &avail_out));
+    }
+  }
+  state.counters["images"] = jpegs.size();
+  SetThroughputCounters(state, batch_size, threads);
+}
+
+BENCHMARK(BM_TranscodeJpegBatch)
+    ->ArgName("threads")
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace jxl
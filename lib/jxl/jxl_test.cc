@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <array>
 #include <future>
 #include <string>
@@ -42,6 +43,7 @@
 #include "lib/jxl/jpeg/dec_jpeg_data.h"
 #include "lib/jxl/jpeg/dec_jpeg_data_writer.h"
 #include "lib/jxl/jpeg/enc_jpeg_data.h"
+#include "lib/jxl/jpeg/enc_jpeg_data_reader.h"
 #include "lib/jxl/jpeg/jpeg_data.h"
 #include "lib/jxl/modular/options.h"
 #include "lib/jxl/test_utils.h"
@@ -355,6 +357,46 @@ TEST(JxlTest, RoundtripLargeFast) {
   EXPECT_THAT(ComputeDistance2(t.ppf(), ppf_out), IsSlightlyBelow(90));
 }
 
+TEST(JxlTest, RoundtripLargeFastStreamingACTokens) {
+  ThreadPoolInternal pool(8);
+  const PaddedBytes orig = ReadTestData("jxl/flower/flower.png");
+  TestImage t;
+  t.DecodeFromBytes(orig).ClearMetadata();
+
+  JXLCompressParams cparams;
+  cparams.AddOption(JXL_ENC_FRAME_SETTING_EFFORT, 7);  // kSquirrel
+  PackedPixelFile ppf_buffered;
+  size_t buffered_size =
+      Roundtrip(t.ppf(), cparams, {}, &pool, &ppf_buffered);
+
+  // Only 14 of the 54 groups are in the histogram sample, the histograms must
+  // still be able to encode the tokens of the other groups.
+  cparams.AddOption(JXL_ENC_FRAME_SETTING_STREAMING_AC_TOKENS, 1);
+  PackedPixelFile ppf_out;
+  size_t streaming_size = Roundtrip(t.ppf(), cparams, {}, &pool, &ppf_out);
+  EXPECT_LE(streaming_size, buffered_size * 1.02);
+  EXPECT_THAT(ComputeDistance2(t.ppf(), ppf_out), IsSlightlyBelow(90));
+}
+
+TEST(JxlTest, AcStrategySearchStats) {
+  ThreadPoolInternal pool(4);
+  const PaddedBytes orig = ReadTestData("jxl/flower/flower.png");
+  CodecInOut io;
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io, &pool));
+  io.ShrinkTo(512, 512);
+
+  CompressParams cparams;
+  cparams.speed_tier = SpeedTier::kSquirrel;
+  AuxOut aux_out;
+  CodecInOut io2;
+  Roundtrip(&io, cparams, {}, &pool, &io2, &aux_out);
+  // The unaligned 16x16 search tries again most of the 16x8 and 8x16
+  // candidates of the aligned search.
+  EXPECT_GT(aux_out.num_acs_estimates_cached, 0u);
+  EXPECT_LT(aux_out.num_acs_estimates_cached, aux_out.num_acs_estimates);
+  EXPECT_GT(aux_out.acs_8x8_seconds, 0.0);
+}
+
 TEST(JxlTest, RoundtripDotsForceEpf) {
   ThreadPoolInternal pool(8);
   const PaddedBytes orig =
@@ -1366,6 +1408,136 @@ TEST(JxlTest, JXL_TRANSCODE_JPEG_TEST(RoundtripJpegRecompression420Progr)) {
   EXPECT_NEAR(RoundtripJpeg(orig, &pool), 455499u, 10);
 }
 
+TEST(JxlTest, JXL_TRANSCODE_JPEG_TEST(WriteJpegParallelAndStreaming)) {
+  // The second scan of the progressive JPEG can only start once the first one
+  // is complete, so most of its bytes come with the last rows.
+  const std::pair<const char*, bool> kFiles[] = {
+      {"jxl/flower/flower.png.im_q85_420.jpg", false},
+      {"jxl/flower/flower.png.im_q85_420_progr.jpg", true}};
+  for (const auto& file : kFiles) {
+    const PaddedBytes orig = ReadTestData(file.first);
+    jpeg::JPEGData jpg;
+    ASSERT_TRUE(jpeg::ReadJpeg(orig.data(), orig.size(),
+                               jpeg::JpegReadMode::kReadAll, &jpg));
+    // Add restart intervals, so that the scans can be written in parallel.
+    jpg.restart_interval = 13;
+    auto sos =
+        std::find(jpg.marker_order.begin(), jpg.marker_order.end(), 0xDA);
+    jpg.marker_order.insert(sos, 0xDD);
+
+    std::vector<uint8_t> expected;
+    ASSERT_TRUE(jpeg::WriteJpeg(jpg, [&](const uint8_t* buf, size_t len) {
+      expected.insert(expected.end(), buf, buf + len);
+      return len;
+    }));
+
+    ThreadPoolInternal pool(4);
+    std::vector<uint8_t> parallel;
+    jpeg::SerializationState parallel_state;
+    ASSERT_TRUE(jpeg::WriteJpeg(
+        jpg, jpg.height, &pool,
+        [&](const uint8_t* buf, size_t len) {
+          parallel.insert(parallel.end(), buf, buf + len);
+          return len;
+        },
+        &parallel_state));
+    EXPECT_EQ(jpeg::SerializationState::DONE, parallel_state.stage);
+    EXPECT_EQ(expected, parallel);
+
+    // Make a few more rows ready at a time, and write them with a small
+    // output buffer.
+    std::vector<uint8_t> streamed;
+    jpeg::SerializationState streaming_state;
+    size_t num_ready_rows = 0;
+    size_t bytes_before_last_row = 0;
+    while (streaming_state.stage != jpeg::SerializationState::DONE) {
+      num_ready_rows = std::min<size_t>(jpg.height, num_ready_rows + 64);
+      Status status = StatusCode::kNotEnoughBytes;
+      while (status.code() == StatusCode::kNotEnoughBytes) {
+        size_t avail = 1000;
+        status = jpeg::WriteJpeg(
+            jpg, num_ready_rows, &pool,
+            [&](const uint8_t* buf, size_t len) {
+              size_t n = std::min(avail, len);
+              streamed.insert(streamed.end(), buf, buf + n);
+              avail -= n;
+              return n;
+            },
+            &streaming_state);
+      }
+      ASSERT_TRUE(status);
+      if (num_ready_rows < static_cast<size_t>(jpg.height)) {
+        bytes_before_last_row = streamed.size();
+      }
+    }
+    EXPECT_EQ(expected, streamed);
+    if (!file.second) {
+      EXPECT_GT(bytes_before_last_row, expected.size() / 2);
+    }
+  }
+}
+
+TEST(JxlTest, JXL_TRANSCODE_JPEG_TEST(ReadJpegParallel)) {
+  ThreadPoolInternal pool(4);
+  for (const char* filename : {"jxl/flower/flower.png.im_q85_420.jpg",
+                               "jxl/flower/flower.png.im_q85_420_progr.jpg"}) {
+    const PaddedBytes orig = ReadTestData(filename);
+    jpeg::JPEGData jpg;
+    ASSERT_TRUE(jpeg::ReadJpeg(orig.data(), orig.size(),
+                               jpeg::JpegReadMode::kReadAll, &jpg));
+    // Without restart markers only the scans are decoded in parallel, with
+    // them the scans are also split.
+    for (uint32_t restart_interval : {0u, 1u, 13u, 1000u}) {
+      std::vector<uint8_t> bytes(orig.data(), orig.data() + orig.size());
+      if (restart_interval != 0) {
+        jpeg::JPEGData restarted = jpg;
+        restarted.restart_interval = restart_interval;
+        auto sos = std::find(restarted.marker_order.begin(),
+                             restarted.marker_order.end(), 0xDA);
+        restarted.marker_order.insert(sos, 0xDD);
+        bytes.clear();
+        ASSERT_TRUE(
+            jpeg::WriteJpeg(restarted, [&](const uint8_t* buf, size_t len) {
+              bytes.insert(bytes.end(), buf, buf + len);
+              return len;
+            }));
+      }
+      jpeg::JPEGData serial;
+      ASSERT_TRUE(jpeg::ReadJpeg(bytes.data(), bytes.size(),
+                                 jpeg::JpegReadMode::kReadAll, &serial));
+      jpeg::JPEGData parallel;
+      ASSERT_TRUE(jpeg::ReadJpeg(bytes.data(), bytes.size(),
+                                 jpeg::JpegReadMode::kReadAll, &pool,
+                                 &parallel));
+      EXPECT_EQ(serial.padding_bits, parallel.padding_bits);
+      ASSERT_EQ(serial.scan_info.size(), parallel.scan_info.size());
+      for (size_t i = 0; i < serial.scan_info.size(); ++i) {
+        EXPECT_EQ(serial.scan_info[i].reset_points,
+                  parallel.scan_info[i].reset_points);
+        EXPECT_EQ(serial.scan_info[i].extra_zero_runs.size(),
+                  parallel.scan_info[i].extra_zero_runs.size());
+      }
+      ASSERT_EQ(serial.components.size(), parallel.components.size());
+      for (size_t c = 0; c < serial.components.size(); ++c) {
+        EXPECT_EQ(serial.components[c].coeffs, parallel.components[c].coeffs);
+      }
+      std::vector<uint8_t> written;
+      ASSERT_TRUE(
+          jpeg::WriteJpeg(parallel, [&](const uint8_t* buf, size_t len) {
+            written.insert(written.end(), buf, buf + len);
+            return len;
+          }));
+      EXPECT_EQ(bytes, written);
+
+      // Truncated streams are rejected like by the serial parser.
+      parallel = jpeg::JPEGData();
+      EXPECT_FALSE(jpeg::ReadJpeg(bytes.data(), bytes.size() / 2,
+                                  jpeg::JpegReadMode::kReadAll, &pool,
+                                  &parallel));
+    }
+  }
+}
+
 TEST(JxlTest, RoundtripProgressive) {
   ThreadPoolInternal pool(4);
   const PaddedBytes orig = ReadTestData("jxl/flower/flower.png");
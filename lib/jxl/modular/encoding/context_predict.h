@@ -416,7 +416,8 @@ enum PredictorMode {
   kUseWP = 2,
   kForceComputeProperties = 4,
   kAllPredictions = 8,
-  kNoEdgeCases = 16
+  kNoEdgeCases = 16,
+  kNoReferences = 32
 };
 
 JXL_INLINE pixel_type_w PredictOne(Predictor p, pixel_type_w left,
@@ -509,7 +510,7 @@ JXL_INLINE PredictionResult Predict(
     wp_pred = wp_state->Predict<compute_properties>(
         x, y, w, top, left, topright, topleft, toptop, p, offset);
   }
-  if (!nec && compute_properties) {
+  if (!(mode & kNoReferences) && compute_properties) {
     offset += weighted::kNumProperties;
     // Extra properties.
     const pixel_type *JXL_RESTRICT rp = references->Row(x);
@@ -568,14 +569,22 @@ inline PredictionResult PredictTreeNoWP(Properties *p, size_t w,
       p, w, pp, onerow, x, y, Predictor::Zero, &tree_lookup, &references,
       /*wp_state=*/nullptr, /*predictions=*/nullptr);
 }
-// Only use for y > 1, x > 1, x < w-2, and empty references
-JXL_INLINE PredictionResult
-PredictTreeNoWPNEC(Properties *p, size_t w, const pixel_type *JXL_RESTRICT pp,
-                   const intptr_t onerow, const int x, const int y,
-                   const MATreeLookup &tree_lookup, const Channel &references) {
-  return detail::Predict<detail::kUseTree | detail::kNoEdgeCases>(
-      p, w, pp, onerow, x, y, Predictor::Zero, &tree_lookup, &references,
-      /*wp_state=*/nullptr, /*predictions=*/nullptr);
+// Tree prediction for decode loops that are specialised on what the tree
+// uses. use_wp must be true if the tree uses the weighted predictor or its
+// property, and use_references if it uses properties of previous channels.
+// no_edge_cases is only allowed for y > 1, x > 1, x < w-2.
+template <bool use_wp, bool use_references, bool no_edge_cases>
+JXL_INLINE PredictionResult PredictTreeSpecialized(
+    Properties *p, size_t w, const pixel_type *JXL_RESTRICT pp,
+    const intptr_t onerow, const int x, const int y,
+    const MATreeLookup &tree_lookup, const Channel &references,
+    weighted::State *wp_state) {
+  constexpr int mode = detail::kUseTree | (use_wp ? detail::kUseWP : 0) |
+                       (use_references ? 0 : detail::kNoReferences) |
+                       (no_edge_cases ? detail::kNoEdgeCases : 0);
+  return detail::Predict<mode>(p, w, pp, onerow, x, y, Predictor::Zero,
+                               &tree_lookup, &references, wp_state,
+                               /*predictions=*/nullptr);
 }
 
 inline PredictionResult PredictTreeWP(Properties *p, size_t w,
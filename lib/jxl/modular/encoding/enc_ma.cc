@@ -168,10 +168,204 @@ void SplitTreeSamples(TreeSamples &tree_samples, size_t begin, size_t pos,
   }
 }
 
+struct SplitInfo {
+  size_t prop = 0;
+  uint32_t val = 0;
+  size_t pos = 0;
+  float lcost = std::numeric_limits<float>::max();
+  float rcost = std::numeric_limits<float>::max();
+  Predictor lpred = Predictor::Zero;
+  Predictor rpred = Predictor::Zero;
+  float Cost() const { return lcost + rcost; }
+};
+
+// Best splits of a node along a single property, for each of the kinds of
+// splits that FindBestSplit chooses from.
+struct PropertySplits {
+  SplitInfo static_constant;
+  SplitInfo static_;
+  SplitInfo nonstatic;
+  SplitInfo nowp;
+};
+
+struct CostInfo {
+  float cost = std::numeric_limits<float>::max();
+  float extra_cost = 0;
+  float Cost() const { return cost + extra_cost; }
+  Predictor pred;  // will be uninitialized in some cases, but never used.
+};
+
+// Per-thread buffers of FindBestSplitForProperty, for a single node.
+struct SplitScratch {
+  std::vector<int> prop_value_used_count;
+  std::vector<int> count_increase;
+  std::vector<size_t> extra_bits_increase;
+  std::vector<CostInfo> costs_l;
+  std::vector<CostInfo> costs_r;
+  std::vector<int32_t> counts_above;
+  std::vector<int32_t> counts_below;
+  std::vector<int32_t> rounded_counts;
+};
+
+// Nodes with fewer (distinct samples * predictors) are searched on the calling
+// thread.
+constexpr size_t kMinSamplesForThreads = 1 << 14;
+
+// Keeps the first split with the lowest cost, as a serial search would.
+void UpdateBestSplit(const SplitInfo &candidate, SplitInfo *best) {
+  if (candidate.Cost() < best->Cost()) *best = candidate;
+}
+
+// For a property, compute which of its values are used, and what tokens
+// correspond to those usages. Then, iterate through the values, and compute
+// the entropy of each side of the split (of the form `prop > threshold`).
+// Finally, find the split that minimizes the cost.
+void FindBestSplitForProperty(const TreeSamples &tree_samples, size_t prop,
+                              size_t begin, size_t end, size_t max_symbols,
+                              const std::vector<int32_t> &counts,
+                              const std::vector<uint32_t> &tot_extra_bits,
+                              Predictor node_predictor,
+                              uint64_t used_properties,
+                              float change_pred_penalty,
+                              SplitScratch *scratch, PropertySplits *splits) {
+  size_t num_predictors = tree_samples.NumPredictors();
+  std::vector<int> &prop_value_used_count = scratch->prop_value_used_count;
+  std::vector<int> &count_increase = scratch->count_increase;
+  std::vector<size_t> &extra_bits_increase = scratch->extra_bits_increase;
+  std::vector<CostInfo> &costs_l = scratch->costs_l;
+  std::vector<CostInfo> &costs_r = scratch->costs_r;
+  std::vector<int32_t> &counts_above = scratch->counts_above;
+  std::vector<int32_t> &counts_below = scratch->counts_below;
+  std::vector<int32_t> &rounded_counts = scratch->rounded_counts;
+
+  costs_l.clear();
+  costs_r.clear();
+  size_t prop_size = tree_samples.NumPropertyValues(prop);
+  if (extra_bits_increase.size() < prop_size) {
+    count_increase.resize(prop_size * max_symbols);
+    extra_bits_increase.resize(prop_size);
+  }
+  // Clear prop_value_used_count (which cannot be cleared "on the go")
+  prop_value_used_count.clear();
+  prop_value_used_count.resize(prop_size);
+
+  size_t first_used = prop_size;
+  size_t last_used = 0;
+
+  // TODO(veluca): consider finding multiple splits along a single
+  // property at the same time, possibly with a bottom-up approach.
+  for (size_t i = begin; i < end; i++) {
+    size_t p = tree_samples.Property(prop, i);
+    prop_value_used_count[p]++;
+    last_used = std::max(last_used, p);
+    first_used = std::min(first_used, p);
+  }
+  costs_l.resize(last_used - first_used);
+  costs_r.resize(last_used - first_used);
+  // For all predictors, compute the right and left costs of each split.
+  for (size_t pred = 0; pred < num_predictors; pred++) {
+    // Compute cost and histogram increments for each property value.
+    for (size_t i = begin; i < end; i++) {
+      size_t p = tree_samples.Property(prop, i);
+      size_t cnt = tree_samples.Count(i);
+      size_t sym = tree_samples.Token(pred, i);
+      count_increase[p * max_symbols + sym] += cnt;
+      extra_bits_increase[p] += tree_samples.NBits(pred, i) * cnt;
+    }
+    memcpy(counts_above.data(), counts.data() + pred * max_symbols,
+           max_symbols * sizeof counts_above[0]);
+    memset(counts_below.data(), 0, max_symbols * sizeof counts_below[0]);
+    size_t extra_bits_below = 0;
+    // Exclude last used: this ensures neither counts_above nor
+    // counts_below is empty.
+    for (size_t i = first_used; i < last_used; i++) {
+      if (!prop_value_used_count[i]) continue;
+      extra_bits_below += extra_bits_increase[i];
+      // The increase for this property value has been used, and will not
+      // be used again: clear it. Also below.
+      extra_bits_increase[i] = 0;
+      for (size_t sym = 0; sym < max_symbols; sym++) {
+        counts_above[sym] -= count_increase[i * max_symbols + sym];
+        counts_below[sym] += count_increase[i * max_symbols + sym];
+        count_increase[i * max_symbols + sym] = 0;
+      }
+      float rcost = EstimateBits(counts_above.data(),
+                                 rounded_counts.data(), max_symbols) +
+                    tot_extra_bits[pred] - extra_bits_below;
+      float lcost = EstimateBits(counts_below.data(),
+                                 rounded_counts.data(), max_symbols) +
+                    extra_bits_below;
+      JXL_DASSERT(extra_bits_below <= tot_extra_bits[pred]);
+      float penalty = 0;
+      // Never discourage moving away from the Weighted predictor.
+      if (tree_samples.PredictorFromIndex(pred) != node_predictor &&
+          node_predictor != Predictor::Weighted) {
+        penalty = change_pred_penalty;
+      }
+      // If everything else is equal, disfavour Weighted (slower) and
+      // favour Zero (faster if it's the only predictor used in a
+      // group+channel combination)
+      if (tree_samples.PredictorFromIndex(pred) == Predictor::Weighted) {
+        penalty += 1e-8;
+      }
+      if (tree_samples.PredictorFromIndex(pred) == Predictor::Zero) {
+        penalty -= 1e-8;
+      }
+      if (rcost + penalty < costs_r[i - first_used].Cost()) {
+        costs_r[i - first_used].cost = rcost;
+        costs_r[i - first_used].extra_cost = penalty;
+        costs_r[i - first_used].pred = tree_samples.PredictorFromIndex(pred);
+      }
+      if (lcost + penalty < costs_l[i - first_used].Cost()) {
+        costs_l[i - first_used].cost = lcost;
+        costs_l[i - first_used].extra_cost = penalty;
+        costs_l[i - first_used].pred = tree_samples.PredictorFromIndex(pred);
+      }
+    }
+  }
+  // Iterate through the possible splits and find the one with minimum sum
+  // of costs of the two sides.
+  size_t split = begin;
+  for (size_t i = first_used; i < last_used; i++) {
+    if (!prop_value_used_count[i]) continue;
+    split += prop_value_used_count[i];
+    float rcost = costs_r[i - first_used].cost;
+    float lcost = costs_l[i - first_used].cost;
+    // WP was not used + we would use the WP property or predictor
+    bool adds_wp =
+        (tree_samples.PropertyFromIndex(prop) == kWPProp &&
+         (used_properties & (1LU << prop)) == 0) ||
+        ((costs_l[i - first_used].pred == Predictor::Weighted ||
+          costs_r[i - first_used].pred == Predictor::Weighted) &&
+         node_predictor != Predictor::Weighted);
+    bool zero_entropy_side = rcost == 0 || lcost == 0;
+
+    SplitInfo &best =
+        prop < kNumStaticProperties
+            ? (zero_entropy_side ? splits->static_constant : splits->static_)
+            : (adds_wp ? splits->nonstatic : splits->nowp);
+    if (lcost + rcost < best.Cost()) {
+      best.prop = prop;
+      best.val = i;
+      best.pos = split;
+      best.lcost = lcost;
+      best.lpred = costs_l[i - first_used].pred;
+      best.rcost = rcost;
+      best.rpred = costs_r[i - first_used].pred;
+    }
+  }
+  // Clear extra_bits_increase and cost_increase for last_used.
+  extra_bits_increase[last_used] = 0;
+  for (size_t sym = 0; sym < max_symbols; sym++) {
+    count_increase[last_used * max_symbols + sym] = 0;
+  }
+}
+
 void FindBestSplit(TreeSamples &tree_samples, float threshold,
                    const std::vector<ModularMultiplierInfo> &mul_info,
                    StaticPropRange initial_static_prop_range,
-                   float fast_decode_multiplier, Tree *tree) {
+                   float fast_decode_multiplier, ThreadPool *pool,
+                   Tree *tree) {
   struct NodeInfo {
     size_t pos;
     size_t begin;
@@ -197,17 +391,6 @@ void FindBestSplit(TreeSamples &tree_samples, float threshold,
     nodes.pop_back();
     if (begin == end) continue;
 
-    struct SplitInfo {
-      size_t prop = 0;
-      uint32_t val = 0;
-      size_t pos = 0;
-      float lcost = std::numeric_limits<float>::max();
-      float rcost = std::numeric_limits<float>::max();
-      Predictor lpred = Predictor::Zero;
-      Predictor rpred = Predictor::Zero;
-      float Cost() { return lcost + rcost; }
-    };
-
     SplitInfo best_split_static_constant;
     SplitInfo best_split_static;
     SplitInfo best_split_nonstatic;
@@ -278,155 +461,46 @@ void FindBestSplit(TreeSamples &tree_samples, float threshold,
     }
 
     if (best != &forced_split) {
-      std::vector<int> prop_value_used_count;
-      std::vector<int> count_increase;
-      std::vector<size_t> extra_bits_increase;
-      // For each property, compute which of its values are used, and what
-      // tokens correspond to those usages. Then, iterate through the values,
-      // and compute the entropy of each side of the split (of the form `prop >
-      // threshold`). Finally, find the split that minimizes the cost.
-      struct CostInfo {
-        float cost = std::numeric_limits<float>::max();
-        float extra_cost = 0;
-        float Cost() const { return cost + extra_cost; }
-        Predictor pred;  // will be uninitialized in some cases, but never used.
-      };
-      std::vector<CostInfo> costs_l;
-      std::vector<CostInfo> costs_r;
-
-      std::vector<int32_t> counts_above(max_symbols);
-      std::vector<int32_t> counts_below(max_symbols);
-
       // The lower the threshold, the higher the expected noisiness of the
       // estimate. Thus, discourage changing predictors.
       float change_pred_penalty = 800.0f / (100.0f + threshold);
-      for (size_t prop = 0; prop < num_properties && base_bits > threshold;
-           prop++) {
-        costs_l.clear();
-        costs_r.clear();
-        size_t prop_size = tree_samples.NumPropertyValues(prop);
-        if (extra_bits_increase.size() < prop_size) {
-          count_increase.resize(prop_size * max_symbols);
-          extra_bits_increase.resize(prop_size);
-        }
-        // Clear prop_value_used_count (which cannot be cleared "on the go")
-        prop_value_used_count.clear();
-        prop_value_used_count.resize(prop_size);
-
-        size_t first_used = prop_size;
-        size_t last_used = 0;
-
-        // TODO(veluca): consider finding multiple splits along a single
-        // property at the same time, possibly with a bottom-up approach.
-        for (size_t i = begin; i < end; i++) {
-          size_t p = tree_samples.Property(prop, i);
-          prop_value_used_count[p]++;
-          last_used = std::max(last_used, p);
-          first_used = std::min(first_used, p);
-        }
-        costs_l.resize(last_used - first_used);
-        costs_r.resize(last_used - first_used);
-        // For all predictors, compute the right and left costs of each split.
-        for (size_t pred = 0; pred < num_predictors; pred++) {
-          // Compute cost and histogram increments for each property value.
-          for (size_t i = begin; i < end; i++) {
-            size_t p = tree_samples.Property(prop, i);
-            size_t cnt = tree_samples.Count(i);
-            size_t sym = tree_samples.Token(pred, i);
-            count_increase[p * max_symbols + sym] += cnt;
-            extra_bits_increase[p] += tree_samples.NBits(pred, i) * cnt;
-          }
-          memcpy(counts_above.data(), counts.data() + pred * max_symbols,
-                 max_symbols * sizeof counts_above[0]);
-          memset(counts_below.data(), 0, max_symbols * sizeof counts_below[0]);
-          size_t extra_bits_below = 0;
-          // Exclude last used: this ensures neither counts_above nor
-          // counts_below is empty.
-          for (size_t i = first_used; i < last_used; i++) {
-            if (!prop_value_used_count[i]) continue;
-            extra_bits_below += extra_bits_increase[i];
-            // The increase for this property value has been used, and will not
-            // be used again: clear it. Also below.
-            extra_bits_increase[i] = 0;
-            for (size_t sym = 0; sym < max_symbols; sym++) {
-              counts_above[sym] -= count_increase[i * max_symbols + sym];
-              counts_below[sym] += count_increase[i * max_symbols + sym];
-              count_increase[i * max_symbols + sym] = 0;
-            }
-            float rcost = EstimateBits(counts_above.data(),
-                                       rounded_counts.data(), max_symbols) +
-                          tot_extra_bits[pred] - extra_bits_below;
-            float lcost = EstimateBits(counts_below.data(),
-                                       rounded_counts.data(), max_symbols) +
-                          extra_bits_below;
-            JXL_DASSERT(extra_bits_below <= tot_extra_bits[pred]);
-            float penalty = 0;
-            // Never discourage moving away from the Weighted predictor.
-            if (tree_samples.PredictorFromIndex(pred) !=
-                    (*tree)[pos].predictor &&
-                (*tree)[pos].predictor != Predictor::Weighted) {
-              penalty = change_pred_penalty;
-            }
-            // If everything else is equal, disfavour Weighted (slower) and
-            // favour Zero (faster if it's the only predictor used in a
-            // group+channel combination)
-            if (tree_samples.PredictorFromIndex(pred) == Predictor::Weighted) {
-              penalty += 1e-8;
-            }
-            if (tree_samples.PredictorFromIndex(pred) == Predictor::Zero) {
-              penalty -= 1e-8;
-            }
-            if (rcost + penalty < costs_r[i - first_used].Cost()) {
-              costs_r[i - first_used].cost = rcost;
-              costs_r[i - first_used].extra_cost = penalty;
-              costs_r[i - first_used].pred =
-                  tree_samples.PredictorFromIndex(pred);
-            }
-            if (lcost + penalty < costs_l[i - first_used].Cost()) {
-              costs_l[i - first_used].cost = lcost;
-              costs_l[i - first_used].extra_cost = penalty;
-              costs_l[i - first_used].pred =
-                  tree_samples.PredictorFromIndex(pred);
-            }
-          }
+      const Predictor node_predictor = (*tree)[pos].predictor;
+      std::vector<PropertySplits> property_splits(num_properties);
+      std::vector<SplitScratch> scratch;
+      const auto init = [&](size_t num_threads) -> Status {
+        scratch.resize(num_threads);
+        for (SplitScratch &s : scratch) {
+          s.counts_above.resize(max_symbols);
+          s.counts_below.resize(max_symbols);
+          s.rounded_counts.resize(max_symbols);
         }
-        // Iterate through the possible splits and find the one with minimum sum
-        // of costs of the two sides.
-        size_t split = begin;
-        for (size_t i = first_used; i < last_used; i++) {
-          if (!prop_value_used_count[i]) continue;
-          split += prop_value_used_count[i];
-          float rcost = costs_r[i - first_used].cost;
-          float lcost = costs_l[i - first_used].cost;
-          // WP was not used + we would use the WP property or predictor
-          bool adds_wp =
-              (tree_samples.PropertyFromIndex(prop) == kWPProp &&
-               (used_properties & (1LU << prop)) == 0) ||
-              ((costs_l[i - first_used].pred == Predictor::Weighted ||
-                costs_r[i - first_used].pred == Predictor::Weighted) &&
-               (*tree)[pos].predictor != Predictor::Weighted);
-          bool zero_entropy_side = rcost == 0 || lcost == 0;
-
-          SplitInfo &best =
-              prop < kNumStaticProperties
-                  ? (zero_entropy_side ? best_split_static_constant
-                                       : best_split_static)
-                  : (adds_wp ? best_split_nonstatic : best_split_nowp);
-          if (lcost + rcost < best.Cost()) {
-            best.prop = prop;
-            best.val = i;
-            best.pos = split;
-            best.lcost = lcost;
-            best.lpred = costs_l[i - first_used].pred;
-            best.rcost = rcost;
-            best.rpred = costs_r[i - first_used].pred;
+        return true;
+      };
+      const auto find_split = [&](const uint32_t prop, size_t thread) {
+        FindBestSplitForProperty(
+            tree_samples, prop, begin, end, max_symbols, counts,
+            tot_extra_bits, node_predictor, used_properties,
+            change_pred_penalty, &scratch[thread], &property_splits[prop]);
+      };
+      if (base_bits > threshold) {
+        // The properties are searched independently, the best splits are then
+        // chosen in the same order as a serial search would.
+        if (pool != nullptr &&
+            (end - begin) * num_predictors >= kMinSamplesForThreads) {
+          JXL_CHECK(RunOnPool(pool, 0, num_properties, init, find_split,
+                              "FindBestSplit"));
+        } else {
+          JXL_CHECK(init(1));
+          for (size_t prop = 0; prop < num_properties; prop++) {
+            find_split(prop, 0);
           }
         }
-        // Clear extra_bits_increase and cost_increase for last_used.
-        extra_bits_increase[last_used] = 0;
-        for (size_t sym = 0; sym < max_symbols; sym++) {
-          count_increase[last_used * max_symbols + sym] = 0;
-        }
+      }
+      for (const PropertySplits &splits : property_splits) {
+        UpdateBestSplit(splits.static_constant, &best_split_static_constant);
+        UpdateBestSplit(splits.static_, &best_split_static);
+        UpdateBestSplit(splits.nonstatic, &best_split_nonstatic);
+        UpdateBestSplit(splits.nowp, &best_split_nowp);
       }
 
       // Try to avoid introducing WP.
@@ -490,7 +564,8 @@ HWY_EXPORT(FindBestSplit);  // Local function.
 void ComputeBestTree(TreeSamples &tree_samples, float threshold,
                      const std::vector<ModularMultiplierInfo> &mul_info,
                      StaticPropRange static_prop_range,
-                     float fast_decode_multiplier, Tree *tree) {
+                     float fast_decode_multiplier, ThreadPool *pool,
+                     Tree *tree) {
   // TODO(veluca): take into account that different contexts can have different
   // uint configs.
   //
@@ -506,7 +581,7 @@ void ComputeBestTree(TreeSamples &tree_samples, float threshold,
              std::numeric_limits<uint32_t>::max());
   HWY_DYNAMIC_DISPATCH(FindBestSplit)
   (tree_samples, threshold, mul_info, static_prop_range, fast_decode_multiplier,
-   tree);
+   pool, tree);
 }
 
 constexpr int32_t TreeSamples::kPropertyRange;
@@ -8,6 +8,7 @@
 
 #include <numeric>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/enc_ans.h"
 #include "lib/jxl/entropy_coder.h"
 #include "lib/jxl/modular/encoding/dec_ma.h"
@@ -148,10 +149,13 @@ void CollectPixelSamples(const Image &image, const ModularOptions &options,
                          std::vector<pixel_type> &pixel_samples,
                          std::vector<pixel_type> &diff_samples);
 
+// The split search of large nodes runs on `pool`, with the same result as
+// without a pool.
 void ComputeBestTree(TreeSamples &tree_samples, float threshold,
                      const std::vector<ModularMultiplierInfo> &mul_info,
                      StaticPropRange static_prop_range,
-                     float fast_decode_multiplier, Tree *tree);
+                     float fast_decode_multiplier, ThreadPool *pool,
+                     Tree *tree);
 
 }  // namespace jxl
 #endif  // LIB_JXL_MODULAR_ENCODING_ENC_MA_H_
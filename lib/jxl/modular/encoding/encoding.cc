@@ -125,6 +125,78 @@ FlatTree FilterTree(const Tree &global_tree,
   return output;
 }
 
+namespace {
+
+JXL_INLINE pixel_type MakePixel(uint64_t v, pixel_type multiplier,
+                                pixel_type_w offset) {
+  JXL_DASSERT((v & 0xFFFFFFFF) == v);
+  pixel_type_w val = UnpackSigned(v);
+  // if it overflows, it overflows, and we have a problem anyway
+  return val * multiplier + offset;
+}
+
+// Decodes pixels [x0, x1) of row y of a channel with a full tree lookup per
+// pixel.
+template <bool use_wp, bool use_references, bool no_edge_cases>
+void DecodeRowWithTree(BitReader *br, ANSSymbolReader *reader,
+                       const MATreeLookup &tree_lookup,
+                       const Channel &references, Properties *properties,
+                       weighted::State *wp_state, Channel *channel, size_t x0,
+                       size_t x1, size_t y) {
+  pixel_type *JXL_RESTRICT p = channel->Row(y);
+  const intptr_t onerow = channel->plane.PixelsPerRow();
+  for (size_t x = x0; x < x1; x++) {
+    PredictionResult res =
+        PredictTreeSpecialized<use_wp, use_references, no_edge_cases>(
+            properties, channel->w, p + x, onerow, x, y, tree_lookup,
+            references, wp_state);
+    uint64_t v = reader->ReadHybridUintClustered(res.context, br);
+    p[x] = MakePixel(v, res.multiplier, res.guess);
+    if (use_wp) wp_state->UpdateErrors(p[x], x, y, channel->w);
+  }
+}
+
+// Generic decoding of a channel with a full tree lookup per pixel. The
+// template arguments are chosen per channel from what the filtered tree uses,
+// so that the weighted predictor and the properties of previous channels are
+// only computed if needed. Pixels away from the channel borders skip the edge
+// case checks.
+template <bool use_wp, bool use_references>
+void DecodeWithTree(BitReader *br, ANSSymbolReader *reader,
+                    const FlatTree &tree, const weighted::Header &wp_header,
+                    const std::array<pixel_type, kNumStaticProperties> &props,
+                    size_t num_props, pixel_type chan, Image *image) {
+  Channel &channel = image->channel[chan];
+  MATreeLookup tree_lookup(tree);
+  Properties properties = Properties(num_props);
+  Channel references(properties.size() - kNumNonrefProperties, channel.w);
+  weighted::State wp_state(wp_header, use_wp ? channel.w : 0,
+                           use_wp ? channel.h : 0);
+  for (size_t y = 0; y < channel.h; y++) {
+    InitPropsRow(&properties, props, y);
+    if (use_references) {
+      PrecomputeReferences(channel, y, *image, chan, &references);
+    }
+    if (y > 1 && channel.w > 8) {
+      DecodeRowWithTree<use_wp, use_references, false>(
+          br, reader, tree_lookup, references, &properties, &wp_state,
+          &channel, 0, 2, y);
+      DecodeRowWithTree<use_wp, use_references, true>(
+          br, reader, tree_lookup, references, &properties, &wp_state,
+          &channel, 2, channel.w - 2, y);
+      DecodeRowWithTree<use_wp, use_references, false>(
+          br, reader, tree_lookup, references, &properties, &wp_state,
+          &channel, channel.w - 2, channel.w, y);
+    } else {
+      DecodeRowWithTree<use_wp, use_references, false>(
+          br, reader, tree_lookup, references, &properties, &wp_state,
+          &channel, 0, channel.w, y);
+    }
+  }
+}
+
+}  // namespace
+
 Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
                                  const std::vector<uint8_t> &context_map,
                                  const Tree &global_tree,
@@ -157,16 +229,9 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
   }
 
   JXL_DEBUG_V(3, "Decoded MA tree with %" PRIuS " nodes", tree.size());
+  const bool tree_has_references = num_props > kNumNonrefProperties;
 
   // MAANS decode
-  const auto make_pixel = [](uint64_t v, pixel_type multiplier,
-                             pixel_type_w offset) -> pixel_type {
-    JXL_DASSERT((v & 0xFFFFFFFF) == v);
-    pixel_type_w val = UnpackSigned(v);
-    // if it overflows, it overflows, and we have a problem anyway
-    return val * multiplier + offset;
-  };
-
   if (tree.size() == 1) {
     // special optimized case: no meta-adaptation, so no need
     // to compute properties.
@@ -181,7 +246,7 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
         // Special-case: histogram has a single symbol, with no extra bits, and
         // we use ANS mode.
         JXL_DEBUG_V(8, "Fastest track.");
-        pixel_type v = make_pixel(value, multiplier, offset);
+        pixel_type v = MakePixel(value, multiplier, offset);
         for (size_t y = 0; y < channel.h; y++) {
           pixel_type *JXL_RESTRICT r = channel.Row(y);
           std::fill(r, r + channel.w, v);
@@ -201,7 +266,7 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
             pixel_type *JXL_RESTRICT r = channel.Row(y);
             for (size_t x = 0; x < channel.w; x++) {
               uint32_t v = reader->ReadHybridUintClustered(ctx_id, br);
-              r[x] = make_pixel(v, multiplier, offset);
+              r[x] = MakePixel(v, multiplier, offset);
             }
           }
         }
@@ -251,7 +316,7 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
           pixel_type topleft = (x && y ? *(r + x - 1 - onerow) : left);
           pixel_type guess = ClampedGradient(top, left, topleft);
           uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
-          r[x] = make_pixel(v, 1, guess);
+          r[x] = MakePixel(v, 1, guess);
         }
       }
     } else if (predictor != Predictor::Weighted) {
@@ -266,7 +331,7 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
           pixel_type_w g = pred.guess + offset;
           uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
           // NOTE: pred.multiplier is unset.
-          r[x] = make_pixel(v, multiplier, g);
+          r[x] = MakePixel(v, multiplier, g);
         }
       }
     } else {
@@ -281,7 +346,7 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
                                .guess +
                            offset;
           uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
-          r[x] = make_pixel(v, multiplier, g);
+          r[x] = MakePixel(v, multiplier, g);
           wp_state.UpdateErrors(r[x], x, y, channel.w);
         }
       }
@@ -320,8 +385,8 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
                 kPropRangeFast - 1);
         uint32_t ctx_id = context_lookup[pos];
         uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
-        r[x] = make_pixel(v, multipliers[pos],
-                          static_cast<pixel_type_w>(offsets[pos]) + guess);
+        r[x] = MakePixel(v, multipliers[pos],
+                         static_cast<pixel_type_w>(offsets[pos]) + guess);
       }
     }
   } else if (is_wp_only) {
@@ -347,75 +412,27 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
                                       kPropRangeFast - 1);
         uint32_t ctx_id = context_lookup[pos];
         uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
-        r[x] = make_pixel(v, multipliers[pos],
-                          static_cast<pixel_type_w>(offsets[pos]) + guess);
+        r[x] = MakePixel(v, multipliers[pos],
+                         static_cast<pixel_type_w>(offsets[pos]) + guess);
         wp_state.UpdateErrors(r[x], x, y, channel.w);
       }
     }
-  } else if (!tree_has_wp_prop_or_pred) {
-    // special optimized case: the weighted predictor and its properties are not
-    // used, so no need to compute weights and properties.
+  } else if (!tree_has_wp_prop_or_pred && !tree_has_references) {
     JXL_DEBUG_V(8, "Slow track.");
-    MATreeLookup tree_lookup(tree);
-    Properties properties = Properties(num_props);
-    const intptr_t onerow = channel.plane.PixelsPerRow();
-    Channel references(properties.size() - kNumNonrefProperties, channel.w);
-    for (size_t y = 0; y < channel.h; y++) {
-      pixel_type *JXL_RESTRICT p = channel.Row(y);
-      PrecomputeReferences(channel, y, *image, chan, &references);
-      InitPropsRow(&properties, static_props, y);
-      if (y > 1 && channel.w > 8 && references.w == 0) {
-        for (size_t x = 0; x < 2; x++) {
-          PredictionResult res =
-              PredictTreeNoWP(&properties, channel.w, p + x, onerow, x, y,
-                              tree_lookup, references);
-          uint64_t v = reader->ReadHybridUintClustered(res.context, br);
-          p[x] = make_pixel(v, res.multiplier, res.guess);
-        }
-        for (size_t x = 2; x < channel.w - 2; x++) {
-          PredictionResult res =
-              PredictTreeNoWPNEC(&properties, channel.w, p + x, onerow, x, y,
-                                 tree_lookup, references);
-          uint64_t v = reader->ReadHybridUintClustered(res.context, br);
-          p[x] = make_pixel(v, res.multiplier, res.guess);
-        }
-        for (size_t x = channel.w - 2; x < channel.w; x++) {
-          PredictionResult res =
-              PredictTreeNoWP(&properties, channel.w, p + x, onerow, x, y,
-                              tree_lookup, references);
-          uint64_t v = reader->ReadHybridUintClustered(res.context, br);
-          p[x] = make_pixel(v, res.multiplier, res.guess);
-        }
-      } else {
-        for (size_t x = 0; x < channel.w; x++) {
-          PredictionResult res =
-              PredictTreeNoWP(&properties, channel.w, p + x, onerow, x, y,
-                              tree_lookup, references);
-          uint64_t v = reader->ReadHybridUintClustered(res.context, br);
-          p[x] = make_pixel(v, res.multiplier, res.guess);
-        }
-      }
-    }
-  } else {
+    DecodeWithTree</*use_wp=*/false, /*use_references=*/false>(
+        br, reader, tree, wp_header, static_props, num_props, chan, image);
+  } else if (!tree_has_wp_prop_or_pred) {
+    JXL_DEBUG_V(8, "Slow track with references.");
+    DecodeWithTree</*use_wp=*/false, /*use_references=*/true>(
+        br, reader, tree, wp_header, static_props, num_props, chan, image);
+  } else if (!tree_has_references) {
     JXL_DEBUG_V(8, "Slowest track.");
-    MATreeLookup tree_lookup(tree);
-    Properties properties = Properties(num_props);
-    const intptr_t onerow = channel.plane.PixelsPerRow();
-    Channel references(properties.size() - kNumNonrefProperties, channel.w);
-    weighted::State wp_state(wp_header, channel.w, channel.h);
-    for (size_t y = 0; y < channel.h; y++) {
-      pixel_type *JXL_RESTRICT p = channel.Row(y);
-      InitPropsRow(&properties, static_props, y);
-      PrecomputeReferences(channel, y, *image, chan, &references);
-      for (size_t x = 0; x < channel.w; x++) {
-        PredictionResult res =
-            PredictTreeWP(&properties, channel.w, p + x, onerow, x, y,
-                          tree_lookup, references, &wp_state);
-        uint64_t v = reader->ReadHybridUintClustered(res.context, br);
-        p[x] = make_pixel(v, res.multiplier, res.guess);
-        wp_state.UpdateErrors(p[x], x, y, channel.w);
-      }
-    }
+    DecodeWithTree</*use_wp=*/true, /*use_references=*/false>(
+        br, reader, tree, wp_header, static_props, num_props, chan, image);
+  } else {
+    JXL_DEBUG_V(8, "Slowest track with references.");
+    DecodeWithTree</*use_wp=*/true, /*use_references=*/true>(
+        br, reader, tree, wp_header, static_props, num_props, chan, image);
   }
   return true;
 }
@@ -0,0 +1,101 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "jxl/decode.h"
+#include "jxl/decode_cxx.h"
+#include "lib/extras/codec.h"
+#include "lib/jxl/enc_cache.h"
+#include "lib/jxl/enc_color_management.h"
+#include "lib/jxl/enc_file.h"
+#include "lib/jxl/enc_params.h"
+#include "lib/jxl/testdata.h"
+
+namespace jxl {
+namespace {
+
+// Lossless test images, shared by the benchmarks below.
+const char* const kLosslessCorpus[] = {
+    "jxl/flower/flower.png",
+    "external/wesaturate/500px/u76c0g_bliznaca_srgb8.png",
+    "external/wesaturate/500px/tmshre_riaphotographs_srgb8.png",
+};
+
+// Tree modes, each of which makes the decoder use a different track of
+// DecodeModularChannelMAANS for most channels.
+const ModularOptions::TreeMode kTreeModes[] = {
+    ModularOptions::TreeMode::kGradientOnly,
+    ModularOptions::TreeMode::kWPOnly,
+    ModularOptions::TreeMode::kNoWP,
+    ModularOptions::TreeMode::kDefault,
+};
+
+PaddedBytes EncodeLossless(const char* filename,
+                           ModularOptions::TreeMode tree_mode,
+                           int max_properties) {
+  CodecInOut io;
+  JXL_CHECK(SetFromBytes(Span<const uint8_t>(ReadTestData(filename)), &io));
+  CompressParams cparams;
+  cparams.SetLossless();
+  cparams.options.wp_tree_mode = tree_mode;
+  cparams.options.max_properties = max_properties;
+  PaddedBytes compressed;
+  PassesEncoderState enc_state;
+  JXL_CHECK(EncodeFile(cparams, &io, &enc_state, &compressed, GetJxlCms()));
+  return compressed;
+}
+
+// Arguments: image, tree mode, number of previous channel properties. Decodes
+// on a single thread, so that the throughput of the tracks can be compared.
+void BM_ModularDecodeTrack(benchmark::State& state) {
+  const PaddedBytes compressed =
+      EncodeLossless(kLosslessCorpus[state.range(0)],
+                     kTreeModes[state.range(1)], state.range(2));
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  std::vector<uint8_t> pixels;
+  size_t num_pixels = 0;
+  for (auto _ : state) {
+    JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+    JXL_CHECK(JXL_DEC_SUCCESS ==
+              JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_FULL_IMAGE));
+    JXL_CHECK(JXL_DEC_SUCCESS == JxlDecoderSetInput(dec.get(),
+                                                    compressed.data(),
+                                                    compressed.size()));
+    JxlDecoderCloseInput(dec.get());
+    JXL_CHECK(JXL_DEC_NEED_IMAGE_OUT_BUFFER ==
+              JxlDecoderProcessInput(dec.get()));
+    size_t buffer_size;
+    JXL_CHECK(JXL_DEC_SUCCESS ==
+              JxlDecoderImageOutBufferSize(dec.get(), &format, &buffer_size));
+    pixels.resize(buffer_size);
+    num_pixels = buffer_size / 3;
+    JXL_CHECK(JXL_DEC_SUCCESS ==
+              JxlDecoderSetImageOutBuffer(dec.get(), &format, pixels.data(),
+                                          pixels.size()));
+    JXL_CHECK(JXL_DEC_FULL_IMAGE == JxlDecoderProcessInput(dec.get()));
+  }
+  state.counters["bpp"] = compressed.size() * 8.0 / num_pixels;
+  state.SetItemsProcessed(state.iterations() * num_pixels);
+}
+
+void ModularDecodeTrackArgs(benchmark::internal::Benchmark* b) {
+  for (int image = 0; image < 3; image++) {
+    for (int tree_mode = 0; tree_mode < 4; tree_mode++) {
+      b->Args({image, tree_mode, 0});
+      // Properties of previous channels need their own decode loops.
+      if (tree_mode >= 2) b->Args({image, tree_mode, 2});
+    }
+  }
+  b->ArgNames({"image", "tree_mode", "prev_channels"});
+}
+
+BENCHMARK(BM_ModularDecodeTrack)->Apply(ModularDecodeTrackArgs);
+
+}  // namespace
+}  // namespace jxl
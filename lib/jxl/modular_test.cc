@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <array>
 #include <string>
@@ -75,6 +76,32 @@ TEST(ModularTest, JXL_TSAN_SLOW_TEST(RoundtripLosslessGroups1024)) {
   TestLosslessGroups(3);
 }
 
+// The split search of the tree learning runs on the thread pool for large
+// nodes, and must produce the same tree as without a pool.
+TEST(ModularTest, LosslessTreeLearningIsThreadIndependent) {
+  const PaddedBytes orig = ReadTestData("jxl/flower/flower.png");
+  CodecInOut io;
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io));
+  io.ShrinkTo(io.xsize() / 2, io.ysize() / 2);
+  CompressParams cparams;
+  cparams.SetLossless();
+  cparams.speed_tier = SpeedTier::kTortoise;
+
+  PaddedBytes compressed_serial;
+  PassesEncoderState enc_state_serial;
+  ASSERT_TRUE(EncodeFile(cparams, &io, &enc_state_serial, &compressed_serial,
+                         GetJxlCms(), /*aux_out=*/nullptr, /*pool=*/nullptr));
+  ThreadPoolInternal pool(8);
+  PaddedBytes compressed_parallel;
+  PassesEncoderState enc_state_parallel;
+  ASSERT_TRUE(EncodeFile(cparams, &io, &enc_state_parallel,
+                         &compressed_parallel, GetJxlCms(),
+                         /*aux_out=*/nullptr, &pool));
+  ASSERT_EQ(compressed_serial.size(), compressed_parallel.size());
+  EXPECT_EQ(0, memcmp(compressed_serial.data(), compressed_parallel.data(),
+                      compressed_serial.size()));
+}
+
 TEST(ModularTest, RoundtripLosslessCustomWP_PermuteRCT) {
   ThreadPool* pool = nullptr;
   const PaddedBytes orig =
@@ -238,6 +265,59 @@ TEST(ModularTest, RoundtripExtraProperties) {
   }
 }
 
+// Covers the generic decode loops with and without the weighted predictor and
+// the properties of previous channels.
+TEST(ModularTest, RoundtripTreeTracks) {
+  constexpr size_t kSize = 100;
+  Image image(kSize, kSize, /*bitdepth=*/8, 3);
+  Rng rng(0);
+  for (size_t c = 0; c < 3; c++) {
+    for (size_t y = 0; y < kSize; y++) {
+      for (size_t x = 0; x < kSize; x++) {
+        image.channel[c].plane.Row(y)[x] =
+            (x * (c + 1) + y * 2) % 200 + rng.UniformU(0, 20);
+      }
+    }
+  }
+  for (int max_properties : {0, 4}) {
+    for (bool use_wp : {false, true}) {
+      ModularOptions options;
+      options.max_properties = max_properties;
+      options.predictor = use_wp ? Predictor::Weighted : Predictor::Gradient;
+      options.wp_tree_mode = use_wp ? ModularOptions::TreeMode::kDefault
+                                    : ModularOptions::TreeMode::kNoWP;
+      BitWriter writer;
+      ASSERT_TRUE(ModularGenericCompress(image, options, &writer));
+      writer.ZeroPadToByte();
+      Image decoded(kSize, kSize, /*bitdepth=*/8, image.channel.size());
+      for (size_t i = 0; i < image.channel.size(); i++) {
+        const Channel& ch = image.channel[i];
+        decoded.channel[i] = Channel(ch.w, ch.h, ch.hshift, ch.vshift);
+      }
+      Status status = true;
+      {
+        BitReader reader(writer.GetSpan());
+        BitReaderScopedCloser closer(&reader, &status);
+        ASSERT_TRUE(ModularGenericDecompress(&reader, decoded,
+                                             /*header=*/nullptr,
+                                             /*group_id=*/0, &options));
+      }
+      ASSERT_TRUE(status);
+      for (size_t c = 0; c < image.channel.size(); c++) {
+        for (size_t y = 0; y < kSize; y++) {
+          for (size_t x = 0; x < kSize; x++) {
+            ASSERT_EQ(image.channel[c].plane.Row(y)[x],
+                      decoded.channel[c].plane.Row(y)[x])
+                << "max_properties = " << max_properties
+                << ", use_wp = " << use_wp << ", c = " << c << ", x = " << x
+                << ", y = " << y;
+          }
+        }
+      }
+    }
+  }
+}
+
 TEST(ModularTest, RoundtripLosslessCustomSqueeze) {
   ThreadPool* pool = nullptr;
   const PaddedBytes orig =
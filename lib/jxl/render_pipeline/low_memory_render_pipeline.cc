@@ -194,11 +194,12 @@ void LowMemoryRenderPipeline::EnsureBordersStorage() {
                                        1 << shifts[c].second);
     Rect horizontal = Rect(0, 0, downsampled_xsize, bordery * num_yborders);
     if (!SameSize(horizontal, borders_horizontal_[c])) {
-      borders_horizontal_[c] = ImageF(horizontal.xsize(), horizontal.ysize());
+      borders_horizontal_[c] =
+          AllocateBuffer(horizontal.xsize(), horizontal.ysize());
     }
     Rect vertical = Rect(0, 0, borderx * num_xborders, downsampled_ysize);
     if (!SameSize(vertical, borders_vertical_[c])) {
-      borders_vertical_[c] = ImageF(vertical.xsize(), vertical.ysize());
+      borders_vertical_[c] = AllocateBuffer(vertical.xsize(), vertical.ysize());
     }
   }
 }
@@ -357,6 +358,28 @@ void LowMemoryRenderPipeline::Init() {
   }
 }
 
+void LowMemoryRenderPipeline::ReleaseBuffers(std::vector<ImageF>* buffers) {
+  auto release = [buffers](ImageF* buffer) {
+    if (buffer->xsize() != 0) buffers->push_back(std::move(*buffer));
+  };
+  for (ImageF& buffer : borders_horizontal_) release(&buffer);
+  for (ImageF& buffer : borders_vertical_) release(&buffer);
+  for (auto& thread_data : group_data_) {
+    for (ImageF& buffer : thread_data) release(&buffer);
+  }
+  for (auto& thread_data : stage_data_) {
+    for (auto& channel_data : thread_data) {
+      for (ImageF& buffer : channel_data) release(&buffer);
+    }
+  }
+  for (ImageF& buffer : out_of_frame_data_) release(&buffer);
+  borders_horizontal_.clear();
+  borders_vertical_.clear();
+  group_data_.clear();
+  stage_data_.clear();
+  out_of_frame_data_.clear();
+}
+
 void LowMemoryRenderPipeline::PrepareForThreadsInternal(size_t num,
                                                         bool use_group_ids) {
   const auto& shifts = channel_shifts_[0];
@@ -367,11 +390,11 @@ void LowMemoryRenderPipeline::PrepareForThreadsInternal(size_t num,
     group_data_.emplace_back();
     group_data_[t].resize(shifts.size());
     for (size_t c = 0; c < shifts.size(); c++) {
-      group_data_[t][c] = ImageF(GroupInputXSize(c) + group_data_x_border_ * 2,
-                                 GroupInputYSize(c) + group_data_y_border_ * 2);
+      group_data_[t][c] =
+          AllocateBuffer(GroupInputXSize(c) + group_data_x_border_ * 2,
+                         GroupInputYSize(c) + group_data_y_border_ * 2);
     }
   }
-  // TODO(veluca): avoid reallocating buffers if not needed.
   stage_data_.resize(num);
   size_t upsampling = 1u << base_color_shift_;
   size_t group_dim = frame_dimensions_.group_dim * upsampling;
@@ -391,7 +414,11 @@ void LowMemoryRenderPipeline::PrepareForThreadsInternal(size_t num,
               2 * next_y_border + (1 << stages_[i]->settings_.shift_y);
           stage_buffer_ysize = 1 << CeilLog2Nonzero(stage_buffer_ysize);
           next_y_border = stages_[i]->settings_.border_y;
-          stage_data_[t][c][i] = ImageF(stage_buffer_xsize, stage_buffer_ysize);
+          ImageF& buffer = stage_data_[t][c][i];
+          if (buffer.xsize() != stage_buffer_xsize ||
+              buffer.ysize() != stage_buffer_ysize) {
+            buffer = AllocateBuffer(stage_buffer_xsize, stage_buffer_ysize);
+          }
         }
       }
     }
@@ -413,7 +440,11 @@ void LowMemoryRenderPipeline::PrepareForThreadsInternal(size_t num,
         std::max(left_padding, std::max(middle_padding, right_padding));
     out_of_frame_data_.resize(num);
     for (size_t t = 0; t < num; t++) {
-      out_of_frame_data_[t] = ImageF(out_of_frame_xsize, shifts.size());
+      if (out_of_frame_data_[t].xsize() != out_of_frame_xsize ||
+          out_of_frame_data_[t].ysize() != shifts.size()) {
+        out_of_frame_data_[t] =
+            AllocateBuffer(out_of_frame_xsize, shifts.size());
+      }
     }
   }
 }
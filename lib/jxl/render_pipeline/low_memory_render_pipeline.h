@@ -16,6 +16,9 @@ namespace jxl {
 // A multithreaded, low-memory rendering pipeline that only allocates a minimal
 // amount of buffers.
 class LowMemoryRenderPipeline final : public RenderPipeline {
+ public:
+  void ReleaseBuffers(std::vector<ImageF>* buffers) override;
+
  private:
   std::vector<std::pair<ImageF*, Rect>> PrepareBuffers(
       size_t group_id, size_t thread_id) override;
@@ -25,6 +28,9 @@ class LowMemoryRenderPipeline final : public RenderPipeline {
   void ProcessBuffers(size_t group_id, size_t thread_id) override;
 
   void ClearDone(size_t i) override { group_border_assigner_.ClearDone(i); }
+  std::pair<size_t, size_t> GroupBorder() const override {
+    return group_border_;
+  }
 
   void Init() override;
 
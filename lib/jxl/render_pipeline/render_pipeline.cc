@@ -19,7 +19,7 @@ void RenderPipeline::Builder::AddStage(
 }
 
 std::unique_ptr<RenderPipeline> RenderPipeline::Builder::Finalize(
-    FrameDimensions frame_dimensions) && {
+    FrameDimensions frame_dimensions, std::vector<ImageF>* spare_buffers) && {
 #if JXL_ENABLE_ASSERT
   // Check that the last stage is not an kInOut stage for any channel, and that
   // there is at least one stage.
@@ -88,6 +88,10 @@ std::unique_ptr<RenderPipeline> RenderPipeline::Builder::Finalize(
     }
   }
   res->stages_ = std::move(stages_);
+  if (spare_buffers) {
+    res->spare_buffers_ = std::move(*spare_buffers);
+    spare_buffers->clear();
+  }
   res->Init();
   return res;
 }
@@ -121,9 +125,30 @@ Status RenderPipeline::PrepareForThreads(size_t num, bool use_group_ids) {
     JXL_RETURN_IF_ERROR(stage->PrepareForThreads(num));
   }
   PrepareForThreadsInternal(num, use_group_ids);
+  spare_buffers_.clear();
   return true;
 }
 
+ImageF RenderPipeline::AllocateBuffer(size_t xsize, size_t ysize) {
+  // Takes the large enough spare buffer with the shortest rows, so that the
+  // wider ones remain for wider requests.
+  size_t best = spare_buffers_.size();
+  for (size_t i = 0; i < spare_buffers_.size(); i++) {
+    if (!spare_buffers_[i].HasCapacity(xsize, ysize)) continue;
+    if (best == spare_buffers_.size() ||
+        spare_buffers_[i].bytes_per_row() <
+            spare_buffers_[best].bytes_per_row()) {
+      best = i;
+    }
+  }
+  if (best == spare_buffers_.size()) return ImageF(xsize, ysize);
+  ImageF buffer = std::move(spare_buffers_[best]);
+  spare_buffers_[best] = std::move(spare_buffers_.back());
+  spare_buffers_.pop_back();
+  buffer.ReuseStorage(xsize, ysize);
+  return buffer;
+}
+
 void RenderPipelineInput::Done() {
   JXL_ASSERT(pipeline_);
   pipeline_->InputReady(group_id_, thread_id_, buffers_);
@@ -62,9 +62,11 @@ class RenderPipeline {
     void UseSimpleImplementation() { use_simple_implementation_ = true; }
 
     // Finalizes setup of the pipeline. Shifts for all channels should be 0 at
-    // this point.
+    // this point. The pipeline takes over the images in `spare_buffers`, if
+    // given, and uses them instead of allocating buffers that fit in them.
     std::unique_ptr<RenderPipeline> Finalize(
-        FrameDimensions frame_dimensions) &&;
+        FrameDimensions frame_dimensions,
+        std::vector<ImageF>* spare_buffers = nullptr) &&;
 
    private:
     std::vector<std::unique_ptr<RenderPipelineStage>> stages_;
@@ -83,6 +85,10 @@ class RenderPipeline {
     return true;
   }
 
+  // Moves the buffers of the pipeline to `buffers`, to be passed to the
+  // Finalize of a next pipeline. The pipeline cannot be used afterwards.
+  virtual void ReleaseBuffers(std::vector<ImageF>* buffers) {}
+
   // Allocates storage to run with `num` threads. If `use_group_ids` is true,
   // storage is allocated for each group, not each thread. The behaviour is
   // undefined if calling this function multiple times with a different value
@@ -102,6 +108,13 @@ class RenderPipeline {
 
   virtual void ClearDone(size_t i) {}
 
+  // Returns the number of pixels, in frame coordinates, around each group
+  // that are only rendered once the neighbouring groups are done too. The
+  // simple implementation renders nothing before all the groups are done.
+  virtual std::pair<size_t, size_t> GroupBorder() const {
+    return {frame_dimensions_.xsize, frame_dimensions_.ysize};
+  }
+
  protected:
   std::vector<std::unique_ptr<RenderPipelineStage>> stages_;
   // Shifts for every channel at the input of each stage.
@@ -115,6 +128,11 @@ class RenderPipeline {
 
   std::vector<uint8_t> group_completed_passes_;
 
+  // Returns an image of the given size, which is one of the spare buffers,
+  // shrunk to this size, if there is one large enough. The contents are
+  // undefined.
+  ImageF AllocateBuffer(size_t xsize, size_t ysize);
+
   friend class RenderPipelineInput;
 
  private:
@@ -130,6 +148,9 @@ class RenderPipeline {
   // equal) `num`.
   virtual void PrepareForThreadsInternal(size_t num, bool use_group_ids) = 0;
 
+  // Buffers of a previous pipeline, freed once the storage is prepared.
+  std::vector<ImageF> spare_buffers_;
+
   // Called once frame dimensions and stages are known.
   virtual void Init() {}
 };
@@ -0,0 +1,128 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/jxl/render_pipeline/stage_cms.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace jxl {
+
+namespace {
+
+// Describes `c` to the color management system. The ICC profile must outlive
+// the use of `profile`.
+void GetCmsProfile(const ColorEncoding& c, JxlColorProfile* profile) {
+  profile->icc.data = c.ICC().data();
+  profile->icc.size = c.ICC().size();
+  if (c.HaveFields()) {
+    ConvertInternalToExternalColorEncoding(c, &profile->color_encoding);
+  } else {
+    // Only the ICC profile is known.
+    memset(&profile->color_encoding, 0, sizeof(profile->color_encoding));
+    profile->color_encoding.color_space =
+        c.IsGray() ? JXL_COLOR_SPACE_GRAY : JXL_COLOR_SPACE_UNKNOWN;
+  }
+  profile->num_channels = c.Channels();
+}
+
+class CmsStage : public RenderPipelineStage {
+ public:
+  explicit CmsStage(const OutputEncodingInfo& output_encoding_info)
+      : RenderPipelineStage(RenderPipelineStage::Settings()),
+        cms_(output_encoding_info.color_management_system),
+        c_src_(output_encoding_info.color_encoding),
+        c_dst_(output_encoding_info.cms_output_encoding),
+        intensity_target_(output_encoding_info.desired_intensity_target),
+        num_channels_(c_src_.Channels()) {
+    JXL_ASSERT(num_channels_ == c_dst_.Channels());
+  }
+
+  CmsStage(const CmsStage&) = delete;
+  CmsStage& operator=(const CmsStage&) = delete;
+
+  ~CmsStage() override {
+    if (cms_data_ != nullptr) cms_.destroy(cms_data_);
+  }
+
+  void ProcessRow(const RowInfo& input_rows, const RowInfo& output_rows,
+                  size_t xextra, size_t xsize, size_t xpos, size_t ypos,
+                  size_t thread_id) const final {
+    PROFILER_ZONE("Cms");
+    float* JXL_RESTRICT rows[3];
+    for (size_t c = 0; c < num_channels_; c++) {
+      rows[c] = GetInputRow(input_rows, c, 0);
+    }
+    float* JXL_RESTRICT src = cms_.get_src_buf(cms_data_, thread_id);
+    float* JXL_RESTRICT dst = cms_.get_dst_buf(cms_data_, thread_id);
+    for (size_t x0 = 0; x0 < xsize; x0 += kMaxPixelsPerCall) {
+      size_t len = std::min(kMaxPixelsPerCall, xsize - x0);
+      for (size_t x = 0; x < len; x++) {
+        for (size_t c = 0; c < num_channels_; c++) {
+          src[x * num_channels_ + c] = rows[c][x0 + x];
+        }
+      }
+      // ProcessRow can not report errors: the pixels are left unconverted if
+      // the color management system fails on them.
+      if (!cms_.run(cms_data_, thread_id, src, dst, len)) continue;
+      for (size_t x = 0; x < len; x++) {
+        for (size_t c = 0; c < num_channels_; c++) {
+          rows[c][x0 + x] = dst[x * num_channels_ + c];
+        }
+      }
+    }
+  }
+
+  RenderPipelineChannelMode GetChannelMode(size_t c) const final {
+    return c < num_channels_ ? RenderPipelineChannelMode::kInPlace
+                             : RenderPipelineChannelMode::kIgnored;
+  }
+
+  const char* GetName() const override { return "Cms"; }
+
+ private:
+  static constexpr size_t kMaxPixelsPerCall = 1024;
+
+  Status PrepareForThreads(size_t num_threads) override {
+    // Creating the transform can be expensive, keep it for as long as it has
+    // enough buffers.
+    if (cms_data_ != nullptr && num_threads <= num_threads_) return true;
+    if (cms_data_ != nullptr) {
+      cms_.destroy(cms_data_);
+      cms_data_ = nullptr;
+    }
+    if (c_src_.ICC().empty()) JXL_RETURN_IF_ERROR(c_src_.CreateICC());
+    JxlColorProfile input_profile;
+    GetCmsProfile(c_src_, &input_profile);
+    JxlColorProfile output_profile;
+    GetCmsProfile(c_dst_, &output_profile);
+    cms_data_ = cms_.init(cms_.init_data, num_threads, kMaxPixelsPerCall,
+                          &input_profile, &output_profile, intensity_target_);
+    if (cms_data_ == nullptr) {
+      return JXL_FAILURE("Failed to initialize the color management system");
+    }
+    num_threads_ = num_threads;
+    return true;
+  }
+
+  JxlCmsInterface cms_;
+  void* cms_data_ = nullptr;
+  size_t num_threads_ = 0;
+  ColorEncoding c_src_;
+  ColorEncoding c_dst_;
+  float intensity_target_;
+  size_t num_channels_;
+};
+
+}  // namespace
+
+std::unique_ptr<RenderPipelineStage> GetCmsStage(
+    const OutputEncodingInfo& output_encoding_info) {
+  if (!output_encoding_info.use_cms) return nullptr;
+  return jxl::make_unique<CmsStage>(output_encoding_info);
+}
+
+}  // namespace jxl
@@ -33,13 +33,15 @@ using hwy::HWY_NAMESPACE::ShiftRightSame;
 
 class WriteToOutputStage : public RenderPipelineStage {
  public:
-  WriteToOutputStage(const ImageOutput& main_output, size_t width,
-                     size_t height, bool has_alpha, bool unpremul_alpha,
-                     size_t alpha_c, Orientation undo_orientation,
+  WriteToOutputStage(const ImageOutput& main_output, const Rect& output_rect,
+                     bool has_alpha, bool unpremul_alpha, size_t alpha_c,
+                     Orientation undo_orientation,
                      const std::vector<ImageOutput>& extra_output)
       : RenderPipelineStage(RenderPipelineStage::Settings()),
-        width_(width),
-        height_(height),
+        x0_(output_rect.x0()),
+        y0_(output_rect.y0()),
+        width_(output_rect.xsize()),
+        height_(output_rect.ysize()),
         main_(main_output),
         num_color_(main_.num_channels_ < 3 ? 1 : 3),
         want_alpha_(main_.num_channels_ == 2 || main_.num_channels_ == 4),
@@ -80,22 +82,28 @@ class WriteToOutputStage : public RenderPipelineStage {
                   size_t thread_id) const final {
     JXL_DASSERT(xextra == 0);
     JXL_DASSERT(main_.run_opaque_ || main_.buffer_);
-    if (ypos >= height_) return;
+    if (ypos < y0_ || ypos - y0_ >= height_) return;
+    ypos -= y0_;
+    // Skip the pixels left of the output rect.
+    size_t skip = xpos < x0_ ? x0_ - xpos : 0;
+    if (skip >= xsize) return;
+    xpos += skip - x0_;
     if (xpos >= width_) return;
     if (flip_y_) {
       ypos = height_ - 1u - ypos;
     }
-    size_t limit = std::min(xsize, width_ - xpos);
+    size_t limit = std::min(xsize - skip, width_ - xpos);
     for (size_t x0 = 0; x0 < limit; x0 += kMaxPixelsPerCall) {
       size_t xstart = xpos + x0;
       size_t len = std::min<size_t>(kMaxPixelsPerCall, limit - x0);
 
       const float* line_buffers[4];
       for (size_t c = 0; c < num_color_; c++) {
-        line_buffers[c] = GetInputRow(input_rows, c, 0) + x0;
+        line_buffers[c] = GetInputRow(input_rows, c, 0) + skip + x0;
       }
       if (has_alpha_) {
-        line_buffers[num_color_] = GetInputRow(input_rows, alpha_c_, 0) + x0;
+        line_buffers[num_color_] =
+            GetInputRow(input_rows, alpha_c_, 0) + skip + x0;
       } else {
         // opaque_alpha_ is a way to set all values to 1.0f.
         line_buffers[num_color_] = opaque_alpha_.data();
@@ -105,7 +113,8 @@ class WriteToOutputStage : public RenderPipelineStage {
       }
       OutputBuffers(main_, thread_id, ypos, xstart, len, line_buffers);
       for (const auto& extra : extra_channels_) {
-        line_buffers[0] = GetInputRow(input_rows, extra.channel_index_, 0) + x0;
+        line_buffers[0] =
+            GetInputRow(input_rows, extra.channel_index_, 0) + skip + x0;
         OutputBuffers(extra, thread_id, ypos, xstart, len, line_buffers);
       }
     }
@@ -441,6 +450,9 @@ class WriteToOutputStage : public RenderPipelineStage {
   }
 
   static constexpr size_t kMaxPixelsPerCall = 1024;
+  // Rect of the image written to the output, before applying the orientation.
+  size_t x0_;
+  size_t y0_;
   size_t width_;
   size_t height_;
   Output main_;  // color + alpha
@@ -461,12 +473,12 @@ class WriteToOutputStage : public RenderPipelineStage {
 constexpr size_t WriteToOutputStage::kMaxPixelsPerCall;
 
 std::unique_ptr<RenderPipelineStage> GetWriteToOutputStage(
-    const ImageOutput& main_output, size_t width, size_t height, bool has_alpha,
+    const ImageOutput& main_output, const Rect& output_rect, bool has_alpha,
     bool unpremul_alpha, size_t alpha_c, Orientation undo_orientation,
     std::vector<ImageOutput>& extra_output) {
-  return jxl::make_unique<WriteToOutputStage>(
-      main_output, width, height, has_alpha, unpremul_alpha, alpha_c,
-      undo_orientation, extra_output);
+  return jxl::make_unique<WriteToOutputStage>(main_output, output_rect,
+                                             has_alpha, unpremul_alpha, alpha_c,
+                                             undo_orientation, extra_output);
 }
 
 // NOLINTNEXTLINE(google-readability-namespace-comments)
@@ -588,11 +600,11 @@ std::unique_ptr<RenderPipelineStage> GetWriteToImage3FStage(Image3F* image) {
 }
 
 std::unique_ptr<RenderPipelineStage> GetWriteToOutputStage(
-    const ImageOutput& main_output, size_t width, size_t height, bool has_alpha,
+    const ImageOutput& main_output, const Rect& output_rect, bool has_alpha,
     bool unpremul_alpha, size_t alpha_c, Orientation undo_orientation,
     std::vector<ImageOutput>& extra_output) {
   return HWY_DYNAMIC_DISPATCH(GetWriteToOutputStage)(
-      main_output, width, height, has_alpha, unpremul_alpha, alpha_c,
+      main_output, output_rect, has_alpha, unpremul_alpha, alpha_c,
       undo_orientation, extra_output);
 }
 
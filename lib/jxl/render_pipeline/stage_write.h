@@ -20,9 +20,10 @@ std::unique_ptr<RenderPipelineStage> GetWriteToImageBundleStage(
 // Gets a stage to write color channels to an Image3F.
 std::unique_ptr<RenderPipelineStage> GetWriteToImage3FStage(Image3F* image);
 
-// Gets a stage to write to a pixel callback or image buffer.
+// Gets a stage to write the pixels of output_rect to a pixel callback or
+// image buffer. The rect is in image coordinates before undo_orientation.
 std::unique_ptr<RenderPipelineStage> GetWriteToOutputStage(
-    const ImageOutput& main_output, size_t width, size_t height, bool has_alpha,
+    const ImageOutput& main_output, const Rect& output_rect, bool has_alpha,
     bool unpremul_alpha, size_t alpha_c, Orientation undo_orientation,
     std::vector<ImageOutput>& extra_output);
 
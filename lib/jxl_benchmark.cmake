@@ -8,8 +8,13 @@
 set(JPEGXL_INTERNAL_SOURCES_GBENCH
   extras/tone_mapping_gbench.cc
   jxl/dec_external_image_gbench.cc
+  jxl/decode_gbench.cc
+  jxl/enc_cluster_gbench.cc
   jxl/enc_external_image_gbench.cc
+  jxl/enc_fast_lossless_gbench.cc
   jxl/gauss_blur_gbench.cc
+  jxl/jpeg/enc_jpeg_data_reader_gbench.cc
+  jxl/modular_gbench.cc
   jxl/splines_gbench.cc
   jxl/tf_gbench.cc
 )
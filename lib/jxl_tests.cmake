@@ -23,6 +23,7 @@ set(TEST_FILES
   jxl/dct_test.cc
   jxl/decode_test.cc
   jxl/enc_external_image_test.cc
+  jxl/enc_fast_lossless_test.cc
   jxl/enc_photon_noise_test.cc
   jxl/encode_test.cc
   jxl/entropy_coder_test.cc
@@ -58,7 +59,9 @@ set(TEST_FILES
   jxl/splines_test.cc
   jxl/toc_test.cc
   jxl/xorshift128plus_test.cc
+  threads/shared_parallel_runner_test.cc
   threads/thread_parallel_runner_test.cc
+  threads/work_stealing_parallel_runner_test.cc
   ### Files before this line are handled by build_cleaner.py
   # TODO(deymo): Move this to tools/
   ../tools/box/box_test.cc
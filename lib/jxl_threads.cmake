@@ -7,9 +7,12 @@ find_package(Threads REQUIRED)
 
 set(JPEGXL_THREADS_SOURCES
   threads/resizable_parallel_runner.cc
+  threads/shared_parallel_runner.cc
+  threads/thread_memory_manager_internal.h
   threads/thread_parallel_runner.cc
   threads/thread_parallel_runner_internal.cc
   threads/thread_parallel_runner_internal.h
+  threads/work_stealing_parallel_runner.cc
 )
 
 ### Define the jxl_threads shared or static target library. The ${target}
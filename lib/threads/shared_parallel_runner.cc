@@ -0,0 +1,257 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "jxl/shared_parallel_runner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lib/threads/thread_memory_manager_internal.h"
+
+namespace jpegxl {
+namespace {
+
+// A fixed set of worker threads that helps any number of concurrent Run()
+// calls. Each call is registered as a job; workers take one chunk of tasks at
+// a time from the jobs in round-robin order, so that a call with many tasks
+// doesn't starve the others.
+class SharedThreadPool {
+ public:
+  explicit SharedThreadPool(size_t num_worker_threads) {
+    workers_.reserve(num_worker_threads);
+    for (size_t i = 0; i < num_worker_threads; ++i) {
+      workers_.emplace_back([this]() { WorkerBody(); });
+    }
+  }
+
+  ~SharedThreadPool() {
+    {
+      std::unique_lock<std::mutex> l(mutex_);
+      exit_ = true;
+    }
+    work_available_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  JxlParallelRetCode Run(size_t max_threads, void* jpegxl_opaque,
+                         JxlParallelRunInit init, JxlParallelRunFunction func,
+                         uint32_t start_range, uint32_t end_range) {
+    if (start_range > end_range) return -1;
+    if (start_range == end_range) return 0;
+
+    size_t num_threads = workers_.size() + 1;
+    if (max_threads != 0) num_threads = std::min(num_threads, max_threads);
+    JxlParallelRetCode ret = init(jpegxl_opaque, num_threads);
+    if (ret != 0) return ret;
+
+    if (num_threads == 1) {
+      for (uint32_t task = start_range; task < end_range; ++task) {
+        func(jpegxl_opaque, task, 0);
+      }
+      return 0;
+    }
+
+    Job job;
+    job.func = func;
+    job.opaque = jpegxl_opaque;
+    job.next_task.store(start_range, std::memory_order_relaxed);
+    job.end = end_range;
+    job.num_tasks = end_range - start_range;
+    job.chunk_size = std::max<uint32_t>(
+        job.num_tasks / (num_threads * kChunksPerThread), 1u);
+    // Thread 0 is the calling thread, the others are handed to workers.
+    for (size_t slot = num_threads - 1; slot > 0; --slot) {
+      job.free_slots.push_back(slot);
+    }
+
+    {
+      std::unique_lock<std::mutex> l(mutex_);
+      jobs_.push_back(&job);
+    }
+    // Avoid waking up more workers than can help with this job.
+    for (size_t i = 1; i < num_threads; ++i) {
+      work_available_.notify_one();
+    }
+
+    uint32_t num_done = 0;
+    for (;;) {
+      const uint32_t num_run = RunChunk(&job, 0);
+      if (num_run == 0) break;
+      num_done += num_run;
+    }
+
+    std::unique_lock<std::mutex> l(mutex_);
+    job.num_done += num_done;
+    // Workers may still hold a slot after running their last (possibly empty)
+    // chunk, wait for all of them to let go of the job.
+    while (job.num_done != job.num_tasks ||
+           job.free_slots.size() != num_threads - 1) {
+      job_done_.wait(l);
+    }
+    jobs_.erase(std::find(jobs_.begin(), jobs_.end(), &job));
+    return 0;
+  }
+
+  // The memory manager used to allocate this object and its runners.
+  JxlMemoryManager memory_manager;
+
+ private:
+  static constexpr uint32_t kChunksPerThread = 4;
+
+  // State of a single Run() call, owned by the stack frame of that call.
+  struct Job {
+    JxlParallelRunFunction func;
+    void* opaque;
+
+    // 64-bit so that reserving past the end of the range can't overflow.
+    std::atomic<uint64_t> next_task;
+    uint32_t end;
+    uint32_t num_tasks;
+    uint32_t chunk_size;
+
+    // Guarded by SharedThreadPool::mutex_.
+    // Thread ids not currently used by a thread running tasks of this job.
+    std::vector<size_t> free_slots;
+    uint32_t num_done = 0;
+  };
+
+  // Runs the next chunk of tasks of the job, returns the number of tasks run
+  // or zero if all tasks were already reserved.
+  static uint32_t RunChunk(Job* job, size_t thread) {
+    const uint64_t begin =
+        job->next_task.fetch_add(job->chunk_size, std::memory_order_relaxed);
+    if (begin >= job->end) return 0;
+    const uint32_t end = std::min<uint64_t>(begin + job->chunk_size, job->end);
+    for (uint32_t task = begin; task < end; ++task) {
+      job->func(job->opaque, task, thread);
+    }
+    return end - begin;
+  }
+
+  // Returns the next job, in round-robin order, that has tasks left and is
+  // below its concurrency limit, or nullptr. Requires mutex_ to be held.
+  Job* PickJob() {
+    const size_t num_jobs = jobs_.size();
+    for (size_t i = 0; i < num_jobs; ++i) {
+      const size_t index = (next_job_ + i) % num_jobs;
+      Job* job = jobs_[index];
+      if (job->free_slots.empty() ||
+          job->next_task.load(std::memory_order_relaxed) >= job->end) {
+        continue;
+      }
+      next_job_ = index + 1;
+      return job;
+    }
+    return nullptr;
+  }
+
+  void WorkerBody() {
+    std::unique_lock<std::mutex> l(mutex_);
+    for (;;) {
+      if (exit_) return;
+      Job* job = PickJob();
+      if (job == nullptr) {
+        work_available_.wait(l);
+        continue;
+      }
+      const size_t thread = job->free_slots.back();
+      job->free_slots.pop_back();
+      l.unlock();
+      const uint32_t num_run = RunChunk(job, thread);
+      l.lock();
+      job->free_slots.push_back(thread);
+      job->num_done += num_run;
+      if (job->num_done == job->num_tasks) {
+        job_done_.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+
+  // Protects all the remaining variables and the guarded fields of the jobs.
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable job_done_;
+  std::vector<Job*> jobs_;
+  size_t next_job_ = 0;
+  bool exit_ = false;
+};
+
+// The opaque runner of JxlSharedParallelRunner.
+struct SharedParallelRunner {
+  SharedThreadPool* pool;
+  size_t max_threads;
+};
+
+}  // namespace
+}  // namespace jpegxl
+
+extern "C" {
+JXL_THREADS_EXPORT void* JxlSharedThreadPoolCreate(
+    const JxlMemoryManager* memory_manager, size_t num_worker_threads) {
+  JxlMemoryManager local_memory_manager;
+  if (!jpegxl::ThreadMemoryManagerInit(&local_memory_manager, memory_manager))
+    return nullptr;
+
+  void* alloc = jpegxl::ThreadMemoryManagerAlloc(
+      &local_memory_manager, sizeof(jpegxl::SharedThreadPool));
+  if (!alloc) return nullptr;
+  // Placement new constructor on allocated memory
+  jpegxl::SharedThreadPool* pool =
+      new (alloc) jpegxl::SharedThreadPool(num_worker_threads);
+  pool->memory_manager = local_memory_manager;
+
+  return pool;
+}
+
+JXL_THREADS_EXPORT void JxlSharedThreadPoolDestroy(void* pool_opaque) {
+  jpegxl::SharedThreadPool* pool =
+      static_cast<jpegxl::SharedThreadPool*>(pool_opaque);
+  if (pool) {
+    JxlMemoryManager local_memory_manager = pool->memory_manager;
+    // Call destructor directly since custom free function is used.
+    pool->~SharedThreadPool();
+    jpegxl::ThreadMemoryManagerFree(&local_memory_manager, pool);
+  }
+}
+
+JXL_THREADS_EXPORT JxlParallelRetCode JxlSharedParallelRunner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range) {
+  const auto* runner =
+      static_cast<const jpegxl::SharedParallelRunner*>(runner_opaque);
+  return runner->pool->Run(runner->max_threads, jpegxl_opaque, init, func,
+                           start_range, end_range);
+}
+
+JXL_THREADS_EXPORT void* JxlSharedParallelRunnerCreate(void* pool_opaque,
+                                                       size_t max_threads) {
+  if (pool_opaque == nullptr) return nullptr;
+  jpegxl::SharedThreadPool* pool =
+      static_cast<jpegxl::SharedThreadPool*>(pool_opaque);
+  void* alloc = jpegxl::ThreadMemoryManagerAlloc(
+      &pool->memory_manager, sizeof(jpegxl::SharedParallelRunner));
+  if (!alloc) return nullptr;
+  return new (alloc) jpegxl::SharedParallelRunner{pool, max_threads};
+}
+
+JXL_THREADS_EXPORT void JxlSharedParallelRunnerDestroy(void* runner_opaque) {
+  jpegxl::SharedParallelRunner* runner =
+      static_cast<jpegxl::SharedParallelRunner*>(runner_opaque);
+  if (runner) {
+    // The pool outlives its runners.
+    JxlMemoryManager local_memory_manager = runner->pool->memory_manager;
+    runner->~SharedParallelRunner();
+    jpegxl::ThreadMemoryManagerFree(&local_memory_manager, runner);
+  }
+}
+}
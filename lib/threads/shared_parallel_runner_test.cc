@@ -0,0 +1,118 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "jxl/shared_parallel_runner.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "jxl/shared_parallel_runner_cxx.h"
+#include "lib/jxl/base/data_parallel.h"
+
+namespace jpegxl {
+namespace {
+
+// Runs num_tasks tasks on the runner and checks that each of them ran once,
+// with a thread id below the number of threads passed to init and with no
+// more than max_threads of them running concurrently.
+void RunAndCheck(void* runner, uint32_t num_tasks, size_t max_threads) {
+  jxl::ThreadPool pool(JxlSharedParallelRunner, runner);
+  std::vector<std::atomic<int>> visited(num_tasks);
+  for (auto& v : visited) v.store(0);
+  std::atomic<size_t> num_running{0};
+  std::atomic<size_t> max_running{0};
+  size_t num_threads = 0;
+  EXPECT_TRUE(RunOnPool(
+      &pool, 0, num_tasks,
+      [&num_threads](size_t n) {
+        num_threads = n;
+        return true;
+      },
+      [&](const uint32_t task, const size_t thread) {
+        EXPECT_LT(thread, num_threads);
+        const size_t running = num_running.fetch_add(1) + 1;
+        size_t prev = max_running.load();
+        while (running > prev &&
+               !max_running.compare_exchange_weak(prev, running)) {
+        }
+        visited[task].fetch_add(1);
+        num_running.fetch_sub(1);
+      },
+      "RunAndCheck"));
+  if (max_threads != 0) {
+    EXPECT_LE(num_threads, max_threads);
+  }
+  EXPECT_LE(max_running.load(), num_threads);
+  for (uint32_t i = 0; i < num_tasks; ++i) {
+    EXPECT_EQ(1, visited[i].load());
+  }
+}
+
+// The pool and its runners are allocated with the memory manager of the pool,
+// and a manager with only one of alloc and free set is rejected.
+TEST(SharedParallelRunnerTest, TestMemoryManager) {
+  struct Counts {
+    int allocs = 0;
+    int frees = 0;
+  } counts;
+  JxlMemoryManager memory_manager;
+  memory_manager.opaque = &counts;
+  memory_manager.alloc = [](void* opaque, size_t size) {
+    static_cast<Counts*>(opaque)->allocs++;
+    return malloc(size);
+  };
+  memory_manager.free = [](void* opaque, void* address) {
+    static_cast<Counts*>(opaque)->frees++;
+    free(address);
+  };
+  void* pool = JxlSharedThreadPoolCreate(&memory_manager, 2);
+  ASSERT_NE(nullptr, pool);
+  void* runner = JxlSharedParallelRunnerCreate(pool, 0);
+  ASSERT_NE(nullptr, runner);
+  EXPECT_EQ(2, counts.allocs);
+  RunAndCheck(runner, 100, 0);
+  JxlSharedParallelRunnerDestroy(runner);
+  JxlSharedThreadPoolDestroy(pool);
+  EXPECT_EQ(2, counts.frees);
+
+  memory_manager.free = nullptr;
+  EXPECT_EQ(nullptr, JxlSharedThreadPoolCreate(&memory_manager, 2));
+}
+
+TEST(SharedParallelRunnerTest, TestSingleCaller) {
+  for (size_t num_workers = 0; num_workers <= 6; ++num_workers) {
+    auto pool = JxlSharedThreadPoolMake(nullptr, num_workers);
+    for (size_t max_threads = 0; max_threads <= 4; ++max_threads) {
+      auto runner = JxlSharedParallelRunnerMake(pool.get(), max_threads);
+      for (uint32_t num_tasks = 0; num_tasks < 70; num_tasks += 23) {
+        RunAndCheck(runner.get(), num_tasks, max_threads);
+      }
+    }
+  }
+}
+
+// Many callers, each with its own runner, share the same workers.
+TEST(SharedParallelRunnerTest, TestConcurrentCallers) {
+  const size_t kNumCallers = 8;
+  auto pool = JxlSharedThreadPoolMake(nullptr, 4);
+  std::vector<std::thread> callers;
+  for (size_t i = 0; i < kNumCallers; ++i) {
+    callers.emplace_back([&pool, i]() {
+      const size_t max_threads = 1 + i % 3;
+      auto runner = JxlSharedParallelRunnerMake(pool.get(), max_threads);
+      for (int rep = 0; rep < 20; ++rep) {
+        RunAndCheck(runner.get(), 100 + rep, max_threads);
+      }
+    });
+  }
+  for (std::thread& caller : callers) {
+    caller.join();
+  }
+}
+
+}  // namespace
+}  // namespace jpegxl
@@ -5,58 +5,9 @@
 
 #include "jxl/thread_parallel_runner.h"
 
-#include <string.h>
-
+#include "lib/threads/thread_memory_manager_internal.h"
 #include "lib/threads/thread_parallel_runner_internal.h"
 
-namespace {
-
-// Default JxlMemoryManager using malloc and free for the jpegxl_threads
-// library. Same as the default JxlMemoryManager for the jpegxl library
-// itself.
-
-// Default alloc and free functions.
-void* ThreadMemoryManagerDefaultAlloc(void* opaque, size_t size) {
-  return malloc(size);
-}
-
-void ThreadMemoryManagerDefaultFree(void* opaque, void* address) {
-  free(address);
-}
-
-// Initializes the memory manager instance with the passed one. The
-// MemoryManager passed in |memory_manager| may be NULL or contain NULL
-// functions which will be initialized with the default ones. If either alloc
-// or free are NULL, then both must be NULL, otherwise this function returns an
-// error.
-bool ThreadMemoryManagerInit(JxlMemoryManager* self,
-                             const JxlMemoryManager* memory_manager) {
-  if (memory_manager) {
-    *self = *memory_manager;
-  } else {
-    memset(self, 0, sizeof(*self));
-  }
-  if (!self->alloc != !self->free) {
-    return false;
-  }
-  if (!self->alloc) self->alloc = ThreadMemoryManagerDefaultAlloc;
-  if (!self->free) self->free = ThreadMemoryManagerDefaultFree;
-
-  return true;
-}
-
-void* ThreadMemoryManagerAlloc(const JxlMemoryManager* memory_manager,
-                               size_t size) {
-  return memory_manager->alloc(memory_manager->opaque, size);
-}
-
-void ThreadMemoryManagerFree(const JxlMemoryManager* memory_manager,
-                             void* address) {
-  return memory_manager->free(memory_manager->opaque, address);
-}
-
-}  // namespace
-
 JxlParallelRetCode JxlThreadParallelRunner(
     void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
     JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range) {
@@ -70,11 +21,11 @@ JxlParallelRetCode JxlThreadParallelRunner(
 void* JxlThreadParallelRunnerCreate(const JxlMemoryManager* memory_manager,
                                     size_t num_worker_threads) {
   JxlMemoryManager local_memory_manager;
-  if (!ThreadMemoryManagerInit(&local_memory_manager, memory_manager))
+  if (!jpegxl::ThreadMemoryManagerInit(&local_memory_manager, memory_manager))
     return nullptr;
 
-  void* alloc = ThreadMemoryManagerAlloc(&local_memory_manager,
-                                         sizeof(jpegxl::ThreadParallelRunner));
+  void* alloc = jpegxl::ThreadMemoryManagerAlloc(
+      &local_memory_manager, sizeof(jpegxl::ThreadParallelRunner));
   if (!alloc) return nullptr;
   // Placement new constructor on allocated memory
   jpegxl::ThreadParallelRunner* runner =
@@ -91,7 +42,7 @@ void JxlThreadParallelRunnerDestroy(void* runner_opaque) {
     JxlMemoryManager local_memory_manager = runner->memory_manager;
     // Call destructor directly since custom free function is used.
     runner->~ThreadParallelRunner();
-    ThreadMemoryManagerFree(&local_memory_manager, runner);
+    jpegxl::ThreadMemoryManagerFree(&local_memory_manager, runner);
   }
 }
 
@@ -0,0 +1,324 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "jxl/work_stealing_parallel_runner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lib/threads/thread_memory_manager_internal.h"
+
+namespace jpegxl {
+namespace {
+
+// A thread pool where every worker owns a queue of chunks of tasks. Run()
+// may be called from inside a task of an outer Run() on the same pool: the
+// calling worker pushes the inner chunks to its own queue and then helps
+// executing them, while idle workers steal from it. Once none of them is
+// left, it runs chunks of other jobs until its own job is done.
+class WorkStealingParallelRunner {
+ public:
+  explicit WorkStealingParallelRunner(size_t num_worker_threads)
+      : queues_(num_worker_threads),
+        num_threads_(num_worker_threads == 0 ? 1 : num_worker_threads + 1) {
+    workers_.reserve(num_worker_threads);
+    for (size_t i = 0; i < num_worker_threads; ++i) {
+      workers_.emplace_back([this, i]() { WorkerBody(i); });
+    }
+  }
+
+  ~WorkStealingParallelRunner() {
+    {
+      std::unique_lock<std::mutex> l(sleep_mutex_);
+      exit_ = true;
+    }
+    work_available_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  JxlParallelRetCode Run(void* jpegxl_opaque, JxlParallelRunInit init,
+                         JxlParallelRunFunction func, uint32_t start_range,
+                         uint32_t end_range) {
+    if (start_range > end_range) return -1;
+    if (start_range == end_range) return 0;
+
+    JxlParallelRetCode ret = init(jpegxl_opaque, num_threads_);
+    if (ret != 0) return ret;
+
+    if (workers_.empty()) {
+      for (uint32_t task = start_range; task < end_range; ++task) {
+        func(jpegxl_opaque, task, 0);
+      }
+      return 0;
+    }
+
+    // Workers use their own index as thread id, any other caller uses the
+    // extra last one.
+    const size_t self = CurrentWorker();
+    const size_t thread = self == kNotAWorker ? workers_.size() : self;
+
+    Job job;
+    job.func = func;
+    job.opaque = jpegxl_opaque;
+    const uint32_t num_tasks = end_range - start_range;
+    job.num_pending.store(num_tasks, std::memory_order_relaxed);
+
+    // Same "guided" chunk size heuristic as ThreadParallelRunner; thieves
+    // further split the chunks they steal.
+    const uint32_t chunk_size = std::max<uint32_t>(
+        num_tasks / (num_threads_ * kChunksPerThread), 1u);
+    size_t queue = self == kNotAWorker ? 0 : self;
+    for (uint32_t begin = start_range; begin < end_range;) {
+      const uint32_t end = begin + std::min(end_range - begin, chunk_size);
+      {
+        std::unique_lock<std::mutex> l(queues_[queue].mutex);
+        queues_[queue].chunks.push_back(Chunk{&job, begin, end});
+      }
+      // Tasks from outside the pool are spread over all the workers.
+      if (self == kNotAWorker) queue = (queue + 1) % queues_.size();
+      begin = end;
+    }
+    WakeWorkers();
+
+    // Help with the tasks of this job first, then with those of any other job
+    // that does not have a task running on this thread, until this job is
+    // done.
+    for (;;) {
+      if (job.num_pending.load(std::memory_order_acquire) == 0) break;
+      const uint64_t epoch = work_epoch_.load(std::memory_order_acquire);
+      Chunk chunk;
+      if (TakeChunk(&job, self, &chunk) || TakeChunk(nullptr, self, &chunk)) {
+        RunChunk(chunk, thread);
+        continue;
+      }
+      std::unique_lock<std::mutex> l(done_mutex_);
+      while (job.num_pending.load(std::memory_order_acquire) != 0 &&
+             work_epoch_.load(std::memory_order_acquire) == epoch) {
+        job_done_.wait(l);
+      }
+    }
+    return 0;
+  }
+
+  // The memory manager used to allocate this object.
+  JxlMemoryManager memory_manager;
+
+ private:
+  static constexpr size_t kNotAWorker = ~static_cast<size_t>(0);
+  static constexpr uint32_t kChunksPerThread = 4;
+
+  // State of a single Run() call, owned by the stack frame of that call.
+  struct Job;
+
+  // Jobs that have a task running on the current thread, innermost first. A
+  // thread must not run another task of these jobs: it would reuse the thread
+  // id of the task that is waiting further up the stack.
+  struct ActiveJob {
+    const Job* job;
+    const ActiveJob* parent;
+  };
+
+  struct Job {
+    JxlParallelRunFunction func;
+    void* opaque;
+    // Number of tasks not yet finished.
+    std::atomic<uint32_t> num_pending;
+  };
+
+  // Range of tasks [begin, end) of a job.
+  struct Chunk {
+    Job* job;
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  // The owner pushes and pops at the back, thieves steal from the front.
+  // Aligned to avoid false sharing between the queue mutexes.
+  struct alignas(64) WorkerQueue {
+    std::mutex mutex;
+    std::deque<Chunk> chunks;
+  };
+
+  // Returns the index of the calling thread in this pool, or kNotAWorker.
+  size_t CurrentWorker() const {
+    return current_runner_ == this ? current_worker_ : kNotAWorker;
+  }
+
+  void WorkerBody(size_t worker) {
+    current_runner_ = this;
+    current_worker_ = worker;
+    for (;;) {
+      const uint64_t epoch = work_epoch_.load(std::memory_order_acquire);
+      Chunk chunk;
+      if (TakeChunk(nullptr, worker, &chunk)) {
+        RunChunk(chunk, worker);
+        continue;
+      }
+      std::unique_lock<std::mutex> l(sleep_mutex_);
+      while (!exit_ && work_epoch_.load(std::memory_order_acquire) == epoch) {
+        work_available_.wait(l);
+      }
+      if (exit_) return;
+    }
+  }
+
+  void WakeWorkers() {
+    work_epoch_.fetch_add(1, std::memory_order_acq_rel);
+    // Sleeping workers and waiting Run() calls check the epoch while holding
+    // the respective lock, taking it here ensures none of them misses the
+    // notification.
+    { std::unique_lock<std::mutex> l(sleep_mutex_); }
+    work_available_.notify_all();
+    { std::unique_lock<std::mutex> l(done_mutex_); }
+    job_done_.notify_all();
+  }
+
+  // Returns whether the calling thread may run tasks of the job.
+  static bool MayRun(const Job* job) {
+    for (const ActiveJob* active = active_jobs_; active != nullptr;
+         active = active->parent) {
+      if (active->job == job) return false;
+    }
+    return true;
+  }
+
+  // Whether a chunk of candidate may be taken when looking for chunks of job,
+  // or for chunks of any job that may run on this thread if job is nullptr.
+  static bool Matches(const Job* job, const Job* candidate) {
+    return job != nullptr ? candidate == job : MayRun(candidate);
+  }
+
+  // Takes a chunk of the given job, or of any job if job is nullptr. Looks at
+  // the back of the own queue of worker "self" first, then steals from the
+  // front of the other queues.
+  bool TakeChunk(const Job* job, size_t self, Chunk* chunk) {
+    if (self != kNotAWorker) {
+      WorkerQueue& own = queues_[self];
+      std::unique_lock<std::mutex> l(own.mutex);
+      for (auto it = own.chunks.rbegin(); it != own.chunks.rend(); ++it) {
+        if (!Matches(job, it->job)) continue;
+        *chunk = *it;
+        own.chunks.erase(std::next(it).base());
+        return true;
+      }
+    }
+    const size_t num_queues = queues_.size();
+    const size_t first = self == kNotAWorker ? 0 : self + 1;
+    for (size_t i = 0; i < num_queues; ++i) {
+      const size_t victim = (first + i) % num_queues;
+      if (victim == self) continue;
+      if (Steal(job, &queues_[victim], chunk)) return true;
+    }
+    return false;
+  }
+
+  // Takes the first half of the oldest matching chunk of another worker.
+  static bool Steal(const Job* job, WorkerQueue* queue, Chunk* chunk) {
+    std::unique_lock<std::mutex> l(queue->mutex);
+    for (auto it = queue->chunks.begin(); it != queue->chunks.end(); ++it) {
+      if (!Matches(job, it->job)) continue;
+      const uint32_t size = it->end - it->begin;
+      const uint32_t stolen = (size + 1) / 2;
+      *chunk = Chunk{it->job, it->begin, it->begin + stolen};
+      it->begin += stolen;
+      if (it->begin == it->end) queue->chunks.erase(it);
+      return true;
+    }
+    return false;
+  }
+
+  void RunChunk(const Chunk& chunk, size_t thread) {
+    Job* job = chunk.job;
+    const ActiveJob active{job, active_jobs_};
+    active_jobs_ = &active;
+    for (uint32_t task = chunk.begin; task < chunk.end; ++task) {
+      job->func(job->opaque, task, thread);
+    }
+    active_jobs_ = active.parent;
+    const uint32_t num_done = chunk.end - chunk.begin;
+    // The job may be destroyed by its Run() call as soon as num_pending
+    // reaches zero, so it must not be accessed after the fetch_sub.
+    if (job->num_pending.fetch_sub(num_done, std::memory_order_acq_rel) ==
+        num_done) {
+      std::unique_lock<std::mutex> l(done_mutex_);
+      job_done_.notify_all();
+    }
+  }
+
+  static thread_local const WorkStealingParallelRunner* current_runner_;
+  static thread_local size_t current_worker_;
+  static thread_local const ActiveJob* active_jobs_;
+
+  std::vector<WorkerQueue> queues_;
+  std::vector<std::thread> workers_;
+  const size_t num_threads_;
+
+  // Incremented every time new chunks are pushed.
+  std::atomic<uint64_t> work_epoch_{0};
+
+  // Protects exit_ and is used by idle workers to wait for work_available_.
+  std::mutex sleep_mutex_;
+  std::condition_variable work_available_;
+  bool exit_ = false;
+
+  // Used by Run() to wait for tasks of its job running on other threads, or
+  // for new chunks to help with.
+  std::mutex done_mutex_;
+  std::condition_variable job_done_;
+};
+
+thread_local const WorkStealingParallelRunner*
+    WorkStealingParallelRunner::current_runner_ = nullptr;
+thread_local size_t WorkStealingParallelRunner::current_worker_ = 0;
+thread_local const WorkStealingParallelRunner::ActiveJob*
+    WorkStealingParallelRunner::active_jobs_ = nullptr;
+
+}  // namespace
+}  // namespace jpegxl
+
+extern "C" {
+JXL_THREADS_EXPORT JxlParallelRetCode JxlWorkStealingParallelRunner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range) {
+  return static_cast<jpegxl::WorkStealingParallelRunner*>(runner_opaque)
+      ->Run(jpegxl_opaque, init, func, start_range, end_range);
+}
+
+JXL_THREADS_EXPORT void* JxlWorkStealingParallelRunnerCreate(
+    const JxlMemoryManager* memory_manager, size_t num_worker_threads) {
+  JxlMemoryManager local_memory_manager;
+  if (!jpegxl::ThreadMemoryManagerInit(&local_memory_manager, memory_manager))
+    return nullptr;
+
+  void* alloc = jpegxl::ThreadMemoryManagerAlloc(
+      &local_memory_manager, sizeof(jpegxl::WorkStealingParallelRunner));
+  if (!alloc) return nullptr;
+  // Placement new constructor on allocated memory
+  jpegxl::WorkStealingParallelRunner* runner =
+      new (alloc) jpegxl::WorkStealingParallelRunner(num_worker_threads);
+  runner->memory_manager = local_memory_manager;
+
+  return runner;
+}
+
+JXL_THREADS_EXPORT void JxlWorkStealingParallelRunnerDestroy(
+    void* runner_opaque) {
+  jpegxl::WorkStealingParallelRunner* runner =
+      static_cast<jpegxl::WorkStealingParallelRunner*>(runner_opaque);
+  if (runner) {
+    JxlMemoryManager local_memory_manager = runner->memory_manager;
+    // Call destructor directly since custom free function is used.
+    runner->~WorkStealingParallelRunner();
+    jpegxl::ThreadMemoryManagerFree(&local_memory_manager, runner);
+  }
+}
+}
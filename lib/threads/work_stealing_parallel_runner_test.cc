@@ -0,0 +1,110 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "jxl/work_stealing_parallel_runner.h"
+
+#include <atomic>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "jxl/work_stealing_parallel_runner_cxx.h"
+#include "lib/jxl/base/data_parallel.h"
+
+namespace jpegxl {
+namespace {
+
+// Every task is run exactly once and with a thread id in range, for various
+// pool sizes, including zero worker threads.
+TEST(WorkStealingParallelRunnerTest, TestPool) {
+  for (int num_threads = 0; num_threads <= 8; ++num_threads) {
+    auto runner = JxlWorkStealingParallelRunnerMake(nullptr, num_threads);
+    jxl::ThreadPool pool(JxlWorkStealingParallelRunner, runner.get());
+    for (int num_tasks = 0; num_tasks < 100; num_tasks += 7) {
+      std::vector<std::atomic<int>> visited(num_tasks);
+      for (auto& v : visited) v.store(0);
+      size_t max_threads = 0;
+      const int begin = 3;
+      EXPECT_TRUE(RunOnPool(
+          &pool, begin, begin + num_tasks,
+          [&max_threads](size_t num_threads) {
+            max_threads = num_threads;
+            return true;
+          },
+          [&](const uint32_t task, const size_t thread) {
+            EXPECT_LT(thread, max_threads);
+            visited[task - begin].fetch_add(1);
+          },
+          "TestPool"));
+      for (int i = 0; i < num_tasks; ++i) {
+        EXPECT_EQ(1, visited[i].load());
+      }
+    }
+  }
+}
+
+// The runner is allocated with the given memory manager, and a manager with
+// only one of alloc and free set is rejected.
+TEST(WorkStealingParallelRunnerTest, TestMemoryManager) {
+  struct Counts {
+    int allocs = 0;
+    int frees = 0;
+  } counts;
+  JxlMemoryManager memory_manager;
+  memory_manager.opaque = &counts;
+  memory_manager.alloc = [](void* opaque, size_t size) {
+    static_cast<Counts*>(opaque)->allocs++;
+    return malloc(size);
+  };
+  memory_manager.free = [](void* opaque, void* address) {
+    static_cast<Counts*>(opaque)->frees++;
+    free(address);
+  };
+  void* runner = JxlWorkStealingParallelRunnerCreate(&memory_manager, 2);
+  ASSERT_NE(nullptr, runner);
+  EXPECT_EQ(1, counts.allocs);
+  JxlWorkStealingParallelRunnerDestroy(runner);
+  EXPECT_EQ(1, counts.frees);
+
+  memory_manager.free = nullptr;
+  EXPECT_EQ(nullptr, JxlWorkStealingParallelRunnerCreate(&memory_manager, 2));
+}
+
+// Run calls from inside a task complete, and no two tasks of the same call run
+// concurrently with the same thread id.
+TEST(WorkStealingParallelRunnerTest, TestNested) {
+  const int kNumThreads = 6;
+  const uint32_t kNumOuter = 16;
+  const uint32_t kNumInner = 50;
+  auto runner = JxlWorkStealingParallelRunnerMake(nullptr, kNumThreads);
+  jxl::ThreadPool pool(JxlWorkStealingParallelRunner, runner.get());
+
+  std::vector<std::atomic<int>> outer_busy(kNumThreads + 1);
+  for (auto& b : outer_busy) b.store(0);
+  std::atomic<uint32_t> sum{0};
+  EXPECT_TRUE(RunOnPool(
+      &pool, 0, kNumOuter, jxl::ThreadPool::NoInit,
+      [&](const uint32_t outer, const size_t outer_thread) {
+        EXPECT_EQ(0, outer_busy[outer_thread].fetch_add(1));
+        std::vector<std::atomic<int>> inner_busy(kNumThreads + 1);
+        for (auto& b : inner_busy) b.store(0);
+        EXPECT_TRUE(RunOnPool(
+            &pool, 0, kNumInner, jxl::ThreadPool::NoInit,
+            [&](const uint32_t inner, const size_t inner_thread) {
+              EXPECT_EQ(0, inner_busy[inner_thread].fetch_add(1));
+              sum.fetch_add(outer * kNumInner + inner);
+              inner_busy[inner_thread].fetch_sub(1);
+            },
+            "TestNestedInner"));
+        outer_busy[outer_thread].fetch_sub(1);
+      },
+      "TestNestedOuter"));
+
+  uint32_t expected = 0;
+  for (uint32_t i = 0; i < kNumOuter * kNumInner; ++i) expected += i;
+  EXPECT_EQ(expected, sum.load());
+}
+
+}  // namespace
+}  // namespace jpegxl
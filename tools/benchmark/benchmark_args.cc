@@ -68,6 +68,16 @@ Status BenchmarkArgs::AddCommandLineOptions() {
           false);
   AddFlag(&print_details_csv, "print_details_csv",
           "When print_details is used, print as CSV.", false);
+  AddString(&report_json, "report_json",
+            "If not empty, write the size, distance and the time of every "
+            "encode and decode rep, with the wall and CPU time of each "
+            "encoder and decoder stage, with p50/p90/p99 latencies per image "
+            "and per method, and the peak RSS of the run, to this JSON file.");
+  AddString(&report_csv, "report_csv",
+            "If not empty, write one line per image, method and rep with the "
+            "encode and decode time and stage timings of the rep and the "
+            "p50/p90/p99 latencies and size of the image and method to this "
+            "CSV file.");
   AddString(&extra_metrics, "extra_metrics",
             "Extra metrics to be computed. Only displayed with --print_details "
             "or --print_details_csv. Comma-separated list of NAME:COMMAND "
@@ -198,6 +208,10 @@ Status BenchmarkArgs::AddCommandLineOptions() {
            "being smoothed out. 1.0 means no HF asymmetry. 0.3 is "
            "a good value to start exploring for asymmetry.",
            0.8f);
+  AddUnsigned(&butteraugli_tile_size, "butteraugli_tile_size",
+              "If not 0, compute butteraugli in tiles of this size (a "
+              "multiple of 8) in parallel on the inner pool, with less memory.",
+              0);
   AddFlag(&profiler, "profiler", "If true, print profiler results.", false);
 
   AddFlag(&show_progress, "show_progress",
@@ -103,6 +103,8 @@ struct BenchmarkArgs {
   std::string codec;
   bool print_details;
   bool print_details_csv;
+  std::string report_json;
+  std::string report_csv;
   bool print_more_stats;
   bool print_distance_percentiles;
   bool silent_errors;
@@ -147,6 +149,7 @@ struct BenchmarkArgs {
   int num_samples;
   int sample_dimensions;
   ButteraugliParams ba_params;
+  size_t butteraugli_tile_size;
 
   bool profiler;
   double error_pnorm;
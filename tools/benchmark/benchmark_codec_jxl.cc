@@ -31,6 +31,7 @@
 #include "lib/jxl/enc_external_image.h"
 #include "lib/jxl/enc_file.h"
 #include "lib/jxl/enc_params.h"
+#include "lib/jxl/enc_stage_stats.h"
 #include "lib/jxl/image_bundle.h"
 #include "lib/jxl/image_metadata.h"
 #include "lib/jxl/modular/encoding/encoding.h"
@@ -279,6 +280,10 @@ class JxlCodec : public ImageCodec {
 
     const double start = Now();
     PassesEncoderState passes_encoder_state;
+    // The same measurements as JxlEncoderSetStageStatsCallback, summed over
+    // the frames.
+    EncoderStageStats stage_stats;
+    passes_encoder_state.stage_stats = &stage_stats;
     PaddedBytes compressed_padded;
     JXL_RETURN_IF_ERROR(EncodeFile(cparams_, io, &passes_encoder_state,
                                    &compressed_padded, GetJxlCms(), &cinfo_,
@@ -286,6 +291,11 @@ class JxlCodec : public ImageCodec {
     const double end = Now();
     compressed->assign(compressed_padded.begin(), compressed_padded.end());
     speed_stats->NotifyElapsed(end - start);
+    EncoderStageReport stages;
+    for (size_t i = 0; i < kNumEncoderStages; i++) {
+      stages[i] = stage_stats.stages[i].stats;
+    }
+    encode_stages_.push_back(stages);
     return true;
   }
 
@@ -304,6 +314,16 @@ class JxlCodec : public ImageCodec {
     // originals, so we must set the option to keep the original orientation
     // instead.
     dparams_.keep_orientation = true;
+    DecoderStageReport stages = {};
+    dparams_.stage_stats_callback = [](void* opaque, uint32_t /*frame_index*/,
+                                       JxlDecoderStage stage,
+                                       const JxlDecoderStageStats* stats) {
+      JxlDecoderStageStats& sum =
+          (*static_cast<DecoderStageReport*>(opaque))[stage];
+      sum.wall_seconds += stats->wall_seconds;
+      sum.cpu_seconds += stats->cpu_seconds;
+    };
+    dparams_.stage_stats_opaque = &stages;
     extras::PackedPixelFile ppf;
     size_t decoded_bytes;
     const double start = Now();
@@ -311,6 +331,7 @@ class JxlCodec : public ImageCodec {
                                        dparams_, &decoded_bytes, &ppf));
     const double end = Now();
     speed_stats->NotifyElapsed(end - start);
+    decode_stages_.push_back(stages);
     JXL_RETURN_IF_ERROR(ConvertPackedPixelFileToCodecInOut(ppf, pool, io));
     return true;
   }
@@ -320,6 +341,12 @@ class JxlCodec : public ImageCodec {
     jxl_stats.num_inputs = 1;
     jxl_stats.aux_out = cinfo_;
     stats->jxl_stats.Assimilate(jxl_stats);
+    stats->encode_stages.insert(stats->encode_stages.end(),
+                                encode_stages_.begin(), encode_stages_.end());
+    stats->decode_stages.insert(stats->decode_stages.end(),
+                                decode_stages_.begin(), decode_stages_.end());
+    encode_stages_.clear();
+    decode_stages_.clear();
   }
 
  protected:
@@ -329,6 +356,9 @@ class JxlCodec : public ImageCodec {
   extras::JXLDecompressParams dparams_;
   bool uint8_ = false;
   bool normalize_bitrate_ = false;
+  // Stages of the reps since the last GetMoreStats.
+  std::vector<EncoderStageReport> encode_stages_;
+  std::vector<DecoderStageReport> decode_stages_;
 };
 
 ImageCodec* CreateNewJxlCodec(const BenchmarkArgs& args) {
@@ -5,6 +5,7 @@
 
 #include "tools/benchmark/benchmark_stats.h"
 
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -12,7 +13,9 @@
 
 #include <algorithm>
 #include <cmath>
+#include <tuple>
 
+#include "lib/jxl/base/file_io.h"
 #include "lib/jxl/base/printf_macros.h"
 #include "lib/jxl/base/status.h"
 #include "tools/benchmark/benchmark_args.h"
@@ -161,6 +164,14 @@ void BenchmarkStats::Assimilate(const BenchmarkStats& victim) {
   for (size_t i = 0; i < victim.extra_metrics.size(); i++) {
     extra_metrics[i] += victim.extra_metrics[i];
   }
+  encode_seconds.insert(encode_seconds.end(), victim.encode_seconds.begin(),
+                        victim.encode_seconds.end());
+  decode_seconds.insert(decode_seconds.end(), victim.decode_seconds.begin(),
+                        victim.decode_seconds.end());
+  encode_stages.insert(encode_stages.end(), victim.encode_stages.begin(),
+                       victim.encode_stages.end());
+  decode_stages.insert(decode_stages.end(), victim.decode_stages.begin(),
+                       victim.decode_stages.end());
 }
 
 void BenchmarkStats::PrintMoreStats() const {
@@ -373,4 +384,254 @@ std::string PrintAggregate(
   return PrintFormattedEntries(num_extra_metrics, result);
 }
 
+double Percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0.0;
+  std::sort(values.begin(), values.end());
+  const double pos = p * (values.size() - 1);
+  const size_t lower = static_cast<size_t>(pos);
+  if (lower + 1 >= values.size()) return values.back();
+  const double frac = pos - lower;
+  return values[lower] * (1.0 - frac) + values[lower + 1] * frac;
+}
+
+namespace {
+
+std::string JsonString(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out += StringPrintf("\\u%04x", c);
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+// Quotes a CSV field if it contains a separator, a quote or a line break,
+// doubling the quotes inside.
+std::string CsvField(const std::string& s) {
+  if (s.find_first_of(",\"\r\n") == std::string::npos) return s;
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"') out += '"';
+    out += c;
+  }
+  return out + "\"";
+}
+
+std::string JsonPercentiles(const std::vector<double>& values) {
+  return StringPrintf("{\"p50\": %.6f, \"p90\": %.6f, \"p99\": %.6f}",
+                      Percentile(values, 0.5), Percentile(values, 0.9),
+                      Percentile(values, 0.99));
+}
+
+std::string JsonArray(const std::vector<double>& values) {
+  std::string out = "[";
+  for (size_t i = 0; i < values.size(); i++) {
+    out += StringPrintf(i == 0 ? "%.6f" : ", %.6f", values[i]);
+  }
+  return out + "]";
+}
+
+// Names of the stages in the reports, in the order of JxlEncoderStage and
+// JxlDecoderStage.
+const char* const kEncoderStageNames[kNumEncoderStages] = {
+    "color_transform",
+    "patches",
+    "adaptive_quantization",
+    "ac_strategy",
+    "modular_tree",
+    "tokenize",
+    "histograms",
+    "write",
+    "dc_frame",
+};
+const char* const kDecoderStageNames[kNumDecoderStages] = {
+    "dc",
+    "ac",
+    "render",
+};
+
+bool Entered(const JxlEncoderStageStats& stats) {
+  return stats.wall_seconds > 0.0 || stats.cpu_seconds > 0.0 ||
+         stats.allocated_bytes > 0;
+}
+
+bool Entered(const JxlDecoderStageStats& stats) {
+  return stats.wall_seconds > 0.0 || stats.cpu_seconds > 0.0;
+}
+
+std::string JsonStageStats(const JxlEncoderStageStats& stats) {
+  return StringPrintf("{\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, "
+                      "\"allocated_bytes\": %" PRIu64 "}",
+                      stats.wall_seconds, stats.cpu_seconds,
+                      stats.allocated_bytes);
+}
+
+std::string JsonStageStats(const JxlDecoderStageStats& stats) {
+  return StringPrintf("{\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f}",
+                      stats.wall_seconds, stats.cpu_seconds);
+}
+
+// One object per rep, with the stages that were entered in it.
+template <class Report, size_t kNumStages>
+std::string JsonStages(const std::vector<Report>& reps,
+                       const char* const (&names)[kNumStages]) {
+  std::string out = "[";
+  for (size_t i = 0; i < reps.size(); i++) {
+    out += i == 0 ? "{" : ", {";
+    bool first = true;
+    for (size_t stage = 0; stage < kNumStages; stage++) {
+      if (!Entered(reps[i][stage])) continue;
+      out += first ? "" : ", ";
+      out += JsonString(names[stage]) + ": " + JsonStageStats(reps[i][stage]);
+      first = false;
+    }
+    out += "}";
+  }
+  return out + "]";
+}
+
+std::string CsvStageStats(const JxlEncoderStageStats& stats) {
+  return StringPrintf(",%.6f,%.6f,%" PRIu64, stats.wall_seconds,
+                      stats.cpu_seconds, stats.allocated_bytes);
+}
+
+std::string CsvStageStats(const JxlDecoderStageStats& stats) {
+  return StringPrintf(",%.6f,%.6f", stats.wall_seconds, stats.cpu_seconds);
+}
+
+// The stage fields of rep i, empty if there is no such rep.
+template <class Report>
+std::string CsvStages(const std::vector<Report>& reps, size_t i,
+                      size_t fields_per_stage) {
+  const size_t num_stages = std::tuple_size<Report>::value;
+  if (i >= reps.size()) return std::string(num_stages * fields_per_stage, ',');
+  std::string out;
+  for (size_t stage = 0; stage < num_stages; stage++) {
+    out += CsvStageStats(reps[i][stage]);
+  }
+  return out;
+}
+
+double BitsPerPixel(const BenchmarkStats& stats) {
+  return stats.total_input_pixels == 0
+             ? 0.0
+             : stats.total_compressed_size * 8.0 / stats.total_input_pixels;
+}
+
+}  // namespace
+
+Status WriteJsonReport(const std::string& filename,
+                       const std::vector<std::string>& methods,
+                       const std::vector<BenchmarkRecord>& records,
+                       size_t peak_rss_bytes) {
+  std::string out =
+      StringPrintf("{\n  \"peak_rss_bytes\": %" PRIuS ",\n  \"methods\": [",
+                   peak_rss_bytes);
+  for (size_t m = 0; m < methods.size(); m++) {
+    BenchmarkStats method_stats;
+    std::string images;
+    for (const BenchmarkRecord& record : records) {
+      if (record.method != methods[m]) continue;
+      const BenchmarkStats& stats = *record.stats;
+      method_stats.Assimilate(stats);
+      images += images.empty() ? "\n" : ",\n";
+      images += "        {\"image\": " + JsonString(record.image);
+      images += StringPrintf(
+          ", \"pixels\": %" PRIuS ", \"compressed_bytes\": %" PRIuS
+          ", \"bpp\": %.6f, \"max_distance\": %.6f, \"errors\": %" PRIuS,
+          stats.total_input_pixels, stats.total_compressed_size,
+          BitsPerPixel(stats), stats.max_distance, stats.total_errors);
+      images += ",\n         \"encode_seconds\": " +
+                JsonArray(stats.encode_seconds) +
+                ", \"encode_percentiles\": " +
+                JsonPercentiles(stats.encode_seconds);
+      images += ",\n         \"decode_seconds\": " +
+                JsonArray(stats.decode_seconds) +
+                ", \"decode_percentiles\": " +
+                JsonPercentiles(stats.decode_seconds);
+      if (!stats.encode_stages.empty()) {
+        images += ",\n         \"encode_stages\": " +
+                  JsonStages(stats.encode_stages, kEncoderStageNames);
+      }
+      if (!stats.decode_stages.empty()) {
+        images += ",\n         \"decode_stages\": " +
+                  JsonStages(stats.decode_stages, kDecoderStageNames);
+      }
+      images += "}";
+    }
+    out += m == 0 ? "\n" : ",\n";
+    out += "    {\"method\": " + JsonString(methods[m]);
+    out += StringPrintf(
+        ", \"pixels\": %" PRIuS ", \"compressed_bytes\": %" PRIuS
+        ", \"bpp\": %.6f, \"max_distance\": %.6f, \"errors\": %" PRIuS,
+        method_stats.total_input_pixels, method_stats.total_compressed_size,
+        BitsPerPixel(method_stats), method_stats.max_distance,
+        method_stats.total_errors);
+    out += ",\n     \"encode_percentiles\": " +
+           JsonPercentiles(method_stats.encode_seconds);
+    out += ",\n     \"decode_percentiles\": " +
+           JsonPercentiles(method_stats.decode_seconds);
+    out += ",\n     \"images\": [" + images + "]}";
+  }
+  out += "]\n}\n";
+  return WriteFile(out, filename);
+}
+
+Status WriteCsvReport(const std::string& filename,
+                      const std::vector<BenchmarkRecord>& records) {
+  std::string out =
+      "method,image,pixels,compressed_bytes,bpp,max_distance,errors,"
+      "encode_reps,encode_p50,encode_p90,encode_p99,"
+      "decode_reps,decode_p50,decode_p90,decode_p99,"
+      "rep,encode_seconds,decode_seconds";
+  for (const char* name : kEncoderStageNames) {
+    out += StringPrintf(",encode_%s_wall,encode_%s_cpu,encode_%s_bytes", name,
+                        name, name);
+  }
+  for (const char* name : kDecoderStageNames) {
+    out += StringPrintf(",decode_%s_wall,decode_%s_cpu", name, name);
+  }
+  out += "\n";
+  for (const BenchmarkRecord& record : records) {
+    const BenchmarkStats& stats = *record.stats;
+    std::string image = CsvField(record.method) + "," + CsvField(record.image);
+    image += StringPrintf(
+        ",%" PRIuS ",%" PRIuS ",%.6f,%.6f,%" PRIuS, stats.total_input_pixels,
+        stats.total_compressed_size, BitsPerPixel(stats), stats.max_distance,
+        stats.total_errors);
+    image += StringPrintf(",%" PRIuS ",%.6f,%.6f,%.6f",
+                          stats.encode_seconds.size(),
+                          Percentile(stats.encode_seconds, 0.5),
+                          Percentile(stats.encode_seconds, 0.9),
+                          Percentile(stats.encode_seconds, 0.99));
+    image += StringPrintf(",%" PRIuS ",%.6f,%.6f,%.6f",
+                          stats.decode_seconds.size(),
+                          Percentile(stats.decode_seconds, 0.5),
+                          Percentile(stats.decode_seconds, 0.9),
+                          Percentile(stats.decode_seconds, 0.99));
+    // At least one line per image, also if it has no reps.
+    const size_t num_reps = std::max<size_t>(
+        1, std::max(stats.encode_seconds.size(), stats.decode_seconds.size()));
+    for (size_t i = 0; i < num_reps; i++) {
+      out += image + StringPrintf(",%" PRIuS, i);
+      out += i < stats.encode_seconds.size()
+                 ? StringPrintf(",%.6f", stats.encode_seconds[i])
+                 : ",";
+      out += i < stats.decode_seconds.size()
+                 ? StringPrintf(",%.6f", stats.decode_seconds[i])
+                 : ",";
+      out += CsvStages(stats.encode_stages, i, /*fields_per_stage=*/3);
+      out += CsvStages(stats.decode_stages, i, /*fields_per_stage=*/2);
+      out += "\n";
+    }
+  }
+  return WriteFile(out, filename);
+}
+
 }  // namespace jxl
@@ -9,10 +9,16 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <array>
 #include <string>
 #include <vector>
 
+#include "jxl/decode.h"
+#include "jxl/encode.h"
 #include "lib/jxl/aux_out.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/dec_stage_stats.h"
+#include "lib/jxl/enc_stage_stats.h"
 
 namespace jxl {
 
@@ -33,6 +39,11 @@ struct JxlStats {
   AuxOut aux_out;
 };
 
+// Resources used by each stage of the encoder or decoder in one rep, summed
+// over the frames of the image. Stages that were not entered are zero.
+using EncoderStageReport = std::array<JxlEncoderStageStats, kNumEncoderStages>;
+using DecoderStageReport = std::array<JxlDecoderStageStats, kNumDecoderStages>;
+
 // The value of an entry in the table. Depending on the ColumnType, the string,
 // size_t or double should be used.
 struct ColumnValue {
@@ -67,8 +78,45 @@ struct BenchmarkStats {
   size_t total_errors = 0;
   JxlStats jxl_stats;
   std::vector<float> extra_metrics;
+  // Wall time of every encode and decode rep, in seconds.
+  std::vector<double> encode_seconds;
+  std::vector<double> decode_seconds;
+  // Per-stage resources of every encode and decode rep, only filled by the
+  // codecs that measure them.
+  std::vector<EncoderStageReport> encode_stages;
+  std::vector<DecoderStageReport> decode_stages;
+};
+
+// Statistics of one image compressed with one method, for the
+// machine-readable reports.
+struct BenchmarkRecord {
+  std::string method;
+  std::string image;
+  const BenchmarkStats* stats;
 };
 
+// Returns the p-th percentile (p in [0, 1]) of values, interpolating linearly
+// between the closest ranks, or 0 if values is empty.
+double Percentile(std::vector<double> values, double p);
+
+// Writes one JSON object with the peak resident set size of the run and, per
+// method, the latency percentiles over all reps of all images and, per image,
+// the sizes, distances and the timing of every rep, including its stages if
+// the codec measures them. The peak RSS is only known for the whole process,
+// whose images may run concurrently, so it is not reported per image or
+// method.
+Status WriteJsonReport(const std::string& filename,
+                       const std::vector<std::string>& methods,
+                       const std::vector<BenchmarkRecord>& records,
+                       size_t peak_rss_bytes);
+
+// Writes one CSV line per image, method and rep with the size and latency
+// percentiles of the image, and the time of the rep and of its stages. Fields
+// that a rep does not have, e.g. the decode time of an encode-only rep, are
+// empty. Fields are quoted as in RFC 4180 where needed.
+Status WriteCsvReport(const std::string& filename,
+                      const std::vector<BenchmarkRecord>& records);
+
 std::string PrintHeader(const std::vector<std::string>& extra_metrics_names);
 
 // Given the rows of all printed statistics, print an aggregate row.
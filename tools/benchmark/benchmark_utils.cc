@@ -15,6 +15,7 @@
 #include <libgen.h>
 #include <spawn.h>
 #include <stdio.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -74,6 +75,16 @@ Status RunCommand(const std::string& command,
   return WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == EXIT_SUCCESS;
 }
 
+size_t PeakResidentSetBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+  return usage.ru_maxrss;  // Already in bytes.
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
 }  // namespace jxl
 
 #else
@@ -92,6 +103,8 @@ Status RunCommand(const std::string& command,
   return JXL_FAILURE("Not supported on this build");
 }
 
+size_t PeakResidentSetBytes() { return 0; }
+
 }  // namespace jxl
 
 #endif  // _MSC_VER
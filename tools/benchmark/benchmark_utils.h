@@ -6,6 +6,8 @@
 #ifndef TOOLS_BENCHMARK_BENCHMARK_UTILS_H_
 #define TOOLS_BENCHMARK_BENCHMARK_UTILS_H_
 
+#include <stddef.h>
+
 #include <string>
 #include <vector>
 
@@ -31,6 +33,10 @@ Status RunCommand(const std::string& command,
                   const std::vector<std::string>& arguments,
                   bool quiet = false);
 
+// Returns the peak resident set size of the process so far, in bytes, or 0 if
+// it is not known on this platform.
+size_t PeakResidentSetBytes();
+
 }  // namespace jxl
 
 #endif  // TOOLS_BENCHMARK_BENCHMARK_UTILS_H_
@@ -140,6 +140,7 @@ void DoCompress(const std::string& filename, const CodecInOut& io,
         }
       }
     }
+    s->encode_seconds = speed_stats.Elapsed();
     JXL_CHECK(speed_stats.GetSummary(&summary));
     s->total_time_encode += summary.central_tendency;
   }
@@ -171,6 +172,7 @@ void DoCompress(const std::string& filename, const CodecInOut& io,
       // of decode_reps, so only take the value from the first iteration.
       if (i == 0) s->total_input_pixels += io2.dec_pixels;
     }
+    s->decode_seconds = speed_stats.Elapsed();
     JXL_CHECK(speed_stats.GetSummary(&summary));
     s->total_time_decode += summary.central_tendency;
   }
@@ -225,7 +227,8 @@ void DoCompress(const std::string& filename, const CodecInOut& io,
           params.intensity_target = 80.0;
         }
         distance = ButteraugliDistance(ib1, ib2, params, GetJxlCms(), &distmap,
-                                       inner_pool);
+                                       inner_pool,
+                                       Args()->butteraugli_tile_size);
         // Ensure pixels in range 0-1
         s->distance_2 += ComputeDistance2(ib1, ib2, GetJxlCms());
       } else {
@@ -819,6 +822,7 @@ class Benchmark {
           fprintf(stderr, "There were error(s) in the benchmark.\n");
         }
       }
+      if (!WriteReports(methods, fnames, tasks)) ret = EXIT_FAILURE;
     }
 
     // Must have exited profiler zone above before calling.
@@ -830,6 +834,27 @@ class Benchmark {
   }
 
  private:
+  static Status WriteReports(const StringVec& methods, const StringVec& fnames,
+                             const std::vector<Task>& tasks) {
+    if (Args()->report_json.empty() && Args()->report_csv.empty()) {
+      return true;
+    }
+    std::vector<BenchmarkRecord> records;
+    for (const Task& t : tasks) {
+      records.push_back(BenchmarkRecord{methods[t.idx_method],
+                                        FileBaseName(fnames[t.idx_image]),
+                                        &t.stats});
+    }
+    if (!Args()->report_json.empty()) {
+      JXL_RETURN_IF_ERROR(WriteJsonReport(Args()->report_json, methods,
+                                          records, PeakResidentSetBytes()));
+    }
+    if (!Args()->report_csv.empty()) {
+      JXL_RETURN_IF_ERROR(WriteCsvReport(Args()->report_csv, records));
+    }
+    return true;
+  }
+
   static int NumOuterThreads(const int num_hw_threads, const int num_tasks) {
     int num_threads = Args()->num_threads;
     // Default to #cores
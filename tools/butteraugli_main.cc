@@ -44,7 +44,7 @@ Status RunButteraugli(const char* pathname1, const char* pathname2,
                       const std::string& distmap_filename,
                       const std::string& raw_distmap_filename,
                       const std::string& colorspace_hint, double p,
-                      float intensity_target) {
+                      float intensity_target, size_t tile_size) {
   extras::ColorHints color_hints;
   if (!colorspace_hint.empty()) {
     color_hints.Add("color_space", colorspace_hint);
@@ -79,8 +79,9 @@ Status RunButteraugli(const char* pathname1, const char* pathname2,
   ba_params.hf_asymmetry = 1.0f;
   ba_params.xmul = 1.0f;
   ba_params.intensity_target = intensity_target;
-  const float distance = ButteraugliDistance(io1.Main(), io2.Main(), ba_params,
-                                             GetJxlCms(), &distmap, &pool);
+  const float distance =
+      ButteraugliDistance(io1.Main(), io2.Main(), ba_params, GetJxlCms(),
+                          &distmap, &pool, tile_size);
   printf("%.10f\n", distance);
 
   double pnorm = ComputeDistanceP(distmap, ba_params, p);
@@ -117,6 +118,7 @@ int main(int argc, char** argv) {
             "  [--intensity_target <intensity_target>]\n"
             "  [--colorspace <colorspace_hint>]\n"
             "  [--pnorm <pth norm>]\n"
+            "  [--tile_size <multiple of 8>]\n"
             "NOTE: images get converted to linear sRGB for butteraugli. Images"
             " without attached profiles (such as ppm or pfm) are interpreted"
             " as nonlinear sRGB. The hint format is RGB_D65_SRG_Rel_Lin for"
@@ -130,6 +132,7 @@ int main(int argc, char** argv) {
   std::string colorspace;
   double p = 3;
   float intensity_target = 80.0;  // sRGB intensity target.
+  size_t tile_size = 0;            // Compare the whole image at once.
   for (int i = 3; i < argc; i++) {
     if (std::string(argv[i]) == "--distmap" && i + 1 < argc) {
       distmap = argv[++i];
@@ -146,6 +149,13 @@ int main(int argc, char** argv) {
         fprintf(stderr, "Failed to parse pnorm \"%s\".\n", argv[i]);
         return 1;
       }
+    } else if (std::string(argv[i]) == "--tile_size" && i + 1 < argc) {
+      char* end;
+      tile_size = strtoul(argv[++i], &end, 10);
+      if (end == argv[i] || tile_size % 8 != 0) {
+        fprintf(stderr, "Invalid tile size \"%s\".\n", argv[i]);
+        return 1;
+      }
     } else {
       fprintf(stderr, "Unrecognized flag \"%s\".\n", argv[i]);
       return 1;
@@ -153,7 +163,7 @@ int main(int argc, char** argv) {
   }
 
   return jxl::RunButteraugli(argv[1], argv[2], distmap, raw_distmap, colorspace,
-                             p, intensity_target)
+                             p, intensity_target, tile_size)
              ? 0
              : 1;
 }
@@ -298,6 +298,13 @@ struct CompressArgs {
         "(not provided = default, 0 = disable, 1 = enable).",
         &gaborish, &ParseOverride, 1);
 
+    cmdline->AddOptionValue(
+        '\0', "streaming_ac_tokens", "0|1",
+        "Bound the memory used for AC tokens by keeping only those of a "
+        "sample of the groups, at a small cost in speed and size. "
+        "(not provided = default, 0 = disable, 1 = enable).",
+        &streaming_ac_tokens, &ParseOverride, 2);
+
     cmdline->AddOptionValue(
         '\0', "intensity_target", "N",
         "Upper bound on the intensity level present in the image in nits. "
@@ -459,6 +466,7 @@ struct CompressArgs {
   jxl::Override dots = jxl::Override::kDefault;
   jxl::Override patches = jxl::Override::kDefault;
   jxl::Override gaborish = jxl::Override::kDefault;
+  jxl::Override streaming_ac_tokens = jxl::Override::kDefault;
   jxl::Override group_order = jxl::Override::kDefault;
   jxl::Override compress_boxes = jxl::Override::kDefault;
 
@@ -665,6 +673,8 @@ void ProcessFlags(const jxl::extras::Codec codec,
   ProcessBoolFlag(args->dots, JXL_ENC_FRAME_SETTING_DOTS, params);
   ProcessBoolFlag(args->patches, JXL_ENC_FRAME_SETTING_PATCHES, params);
   ProcessBoolFlag(args->gaborish, JXL_ENC_FRAME_SETTING_GABORISH, params);
+  ProcessBoolFlag(args->streaming_ac_tokens,
+                  JXL_ENC_FRAME_SETTING_STREAMING_AC_TOKENS, params);
   ProcessBoolFlag(args->group_order, JXL_ENC_FRAME_SETTING_GROUP_ORDER, params);
 
   if (!args->frame_indexing.empty()) {
@@ -15,6 +15,13 @@ import java.nio.Buffer;
 class DecoderJni {
   private static native void nativeGetBasicInfo(int[] context, Buffer data);
   private static native void nativeGetPixels(int[] context, Buffer data, Buffer pixels, Buffer icc);
+  private static native long nativeCreateDecoder(long pool, int maxThreads);
+  private static native void nativeDestroyDecoder(long decoder);
+  private static native int nativeResetDecoder(long decoder, int pixelFormat);
+  private static native int nativeFeed(long decoder, Buffer data, int offset, int length);
+  private static native int nativeSetPixelsBuffer(long decoder, Buffer pixels);
+  private static native void nativeGetStreamInfo(int[] context, long decoder);
+  private static native int nativeGetIcc(long decoder, Buffer icc);
 
   static Status makeStatus(int statusCode) {
     switch (statusCode) {
@@ -24,6 +31,8 @@ class DecoderJni {
         return Status.INVALID_STREAM;
       case 1:
         return Status.NOT_ENOUGH_INPUT;
+      case 2:
+        return Status.NEED_MORE_OUTPUT;
       default:
         throw new IllegalStateException("Unknown status code");
     }
@@ -68,6 +77,48 @@ class DecoderJni {
     return makeStatus(context[0]);
   }
 
+  /** Create a decoder reused for many images; returns 0 on failure. */
+  static long createDecoder(long pool, int maxThreads) {
+    return nativeCreateDecoder(pool, maxThreads);
+  }
+
+  static void destroyDecoder(long decoder) {
+    nativeDestroyDecoder(decoder);
+  }
+
+  /** Prepare the decoder for the next image. */
+  static Status resetDecoder(long decoder, PixelFormat pixelFormat) {
+    return makeStatus(nativeResetDecoder(decoder, pixelFormat.ordinal()));
+  }
+
+  /** Decode the remaining bytes of data, after the ones fed before. */
+  static Status feed(long decoder, Buffer data) {
+    if (!data.isDirect()) {
+      throw new IllegalArgumentException("data must be direct buffer");
+    }
+    return makeStatus(nativeFeed(decoder, data, data.position(), data.remaining()));
+  }
+
+  static Status setPixelsBuffer(long decoder, Buffer pixels) {
+    if (!pixels.isDirect()) {
+      throw new IllegalArgumentException("pixels must be direct buffer");
+    }
+    return makeStatus(nativeSetPixelsBuffer(decoder, pixels));
+  }
+
+  static StreamInfo getStreamInfo(long decoder) {
+    int[] context = new int[6];
+    nativeGetStreamInfo(context, decoder);
+    return makeStreamInfo(context);
+  }
+
+  static Status getIcc(long decoder, Buffer icc) {
+    if (!icc.isDirect()) {
+      throw new IllegalArgumentException("icc must be direct buffer");
+    }
+    return makeStatus(nativeGetIcc(decoder, icc));
+  }
+
   /** Utility library, disable object construction. */
   private DecoderJni() {}
 }
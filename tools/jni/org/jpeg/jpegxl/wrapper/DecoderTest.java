@@ -5,6 +5,7 @@
 
 package org.jpeg.jpegxl.wrapper;
 
+import java.nio.Buffer;
 import java.nio.ByteBuffer;
 
 public class DecoderTest {
@@ -114,6 +115,76 @@ public class DecoderTest {
     }
   }
 
+  // Feeds the stream a few bytes at a time; the pixels buffer is only set when asked for.
+  static ImageData decodeInChunks(
+      StreamingDecoder decoder, byte[] bytes, PixelFormat pixelFormat, int chunkSize) {
+    decoder.reset(pixelFormat);
+    boolean askedForOutput = false;
+    Status status = Status.NOT_ENOUGH_INPUT;
+    for (int offset = 0; offset < bytes.length && status != Status.OK; offset += chunkSize) {
+      int length = Math.min(chunkSize, bytes.length - offset);
+      ByteBuffer chunk = ByteBuffer.allocateDirect(length);
+      chunk.put(bytes, offset, length);
+      chunk.flip();
+      status = decoder.feed(chunk);
+      if (status == Status.NEED_MORE_OUTPUT) {
+        askedForOutput = true;
+        decoder.setPixelsBuffer(ByteBuffer.allocateDirect(decoder.getPixelsSize()));
+        status = decoder.feed();
+      }
+      if (status == Status.INVALID_STREAM) {
+        throw new IllegalStateException("Unexpected decoding error");
+      }
+    }
+    if (status != Status.OK) {
+      throw new IllegalStateException("Expected complete image, but got " + status);
+    }
+    if (!askedForOutput) {
+      throw new IllegalStateException("Expected 'need more output'");
+    }
+    return decoder.getImageData();
+  }
+
+  static void checkSamePixels(Buffer expected, Buffer actual) {
+    ByteBuffer expectedBytes = ((ByteBuffer) expected).duplicate();
+    ByteBuffer actualBytes = ((ByteBuffer) actual).duplicate();
+    expectedBytes.clear();
+    actualBytes.clear();
+    if (!expectedBytes.equals(actualBytes)) {
+      throw new IllegalStateException("Pixels differ from one-shot decoding");
+    }
+  }
+
+  static void testStreamingDecoder() {
+    ImageData expected = Decoder.decode(makeSimpleImage(), PixelFormat.RGBA_8888);
+    try (ThreadPool pool = new ThreadPool(2);
+         StreamingDecoder decoder = new StreamingDecoder(pool, 0)) {
+      for (int chunkSize : new int[] {1, 7, SIMPLE_IMAGE_BYTES.length}) {
+        ImageData imageData =
+            decodeInChunks(decoder, SIMPLE_IMAGE_BYTES, PixelFormat.RGBA_8888, chunkSize);
+        checkSimpleImageData(imageData);
+        checkSamePixels(expected.pixels, imageData.pixels);
+      }
+    }
+  }
+
+  static void testStreamingDecoderReuse() {
+    ImageData simple = Decoder.decode(makeSimpleImage(), PixelFormat.RGB_F16);
+    ImageData pixel = Decoder.decode(
+        makeByteBuffer(PIXEL_IMAGE_BYTES, PIXEL_IMAGE_BYTES.length), PixelFormat.RGBA_8888);
+    try (StreamingDecoder decoder = new StreamingDecoder()) {
+      for (int i = 0; i < 3; ++i) {
+        checkSamePixels(simple.pixels,
+            decodeInChunks(decoder, SIMPLE_IMAGE_BYTES, PixelFormat.RGB_F16, 5).pixels);
+        ImageData imageData = decodeInChunks(decoder, PIXEL_IMAGE_BYTES, PixelFormat.RGBA_8888, 3);
+        if (imageData.width != PIXEL_IMAGE_DIM || imageData.height != PIXEL_IMAGE_DIM) {
+          throw new IllegalStateException("Invalid width / height");
+        }
+        checkSamePixels(pixel.pixels, imageData.pixels);
+      }
+    }
+  }
+
   // Simple executable to avoid extra dependencies.
   public static void main(String[] args) {
     testRgba();
@@ -123,5 +194,7 @@ public class DecoderTest {
     testGetInfoNoAlpha();
     testGetInfoAlpha();
     testNotEnoughInput();
+    testStreamingDecoder();
+    testStreamingDecoderReuse();
   }
 }
@@ -0,0 +1,126 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+package org.jpeg.jpegxl.wrapper;
+
+import java.nio.Buffer;
+import java.nio.ByteBuffer;
+
+/**
+ * JPEG XL encoder that is reused for many images.
+ *
+ * Pixels are sRGB for 8-bit formats and linear sRGB for float formats, as produced by the decoder.
+ *
+ * The native methods are in the jxl_enc_jni library, which has to be loaded in addition to the
+ * jxl_jni library of the decoder and {@link ThreadPool}.
+ */
+public class Encoder implements AutoCloseable {
+  private final ThreadPool threadPool;
+  private long encoder;
+  private int effort = 7;
+  private float distance = 1.0f;
+  private boolean lossless = false;
+
+  /** Encoder running on the calling thread. */
+  public Encoder() {
+    this(null, 0);
+  }
+
+  /**
+   * Encoder running on the given pool.
+   *
+   * @param maxThreads maximal number of threads encoding a single image, 0 for no limit
+   */
+  public Encoder(ThreadPool threadPool, int maxThreads) {
+    if (maxThreads < 0) {
+      throw new IllegalArgumentException("maxThreads must not be negative");
+    }
+    this.threadPool = threadPool;
+    long pool = (threadPool == null) ? 0 : threadPool.acquire();
+    encoder = EncoderJni.createEncoder(pool, maxThreads);
+    if (encoder == 0) {
+      if (threadPool != null) {
+        threadPool.release();
+      }
+      throw new IllegalStateException("Failed to create encoder");
+    }
+  }
+
+  private long handle() {
+    if (encoder == 0) {
+      throw new IllegalStateException("Encoder is closed");
+    }
+    return encoder;
+  }
+
+  /** Effort of the next encodings, 1 (fastest) to 9 (slowest); default is 7. */
+  public void setEffort(int effort) {
+    if (effort < 1 || effort > 9) {
+      throw new IllegalArgumentException("effort must be in [1, 9]");
+    }
+    this.effort = effort;
+  }
+
+  /** Butteraugli distance of the next lossy encodings, 0 to 25; default is 1. */
+  public void setDistance(float distance) {
+    if (!(distance >= 0.0f && distance <= 25.0f)) {
+      throw new IllegalArgumentException("distance must be in [0, 25]");
+    }
+    this.distance = distance;
+  }
+
+  /** Whether the next encodings are lossless; distance is ignored then. */
+  public void setLossless(boolean lossless) {
+    this.lossless = lossless;
+  }
+
+  /**
+   * Start encoding the remaining bytes of the direct pixels buffer, and write the start of the
+   * stream to the remaining space of the direct output buffer, advancing its position.
+   *
+   * @return {@link Status#OK} if the stream is complete, or {@link Status#NEED_MORE_OUTPUT} if the
+   *     rest has to be retrieved with {@link #writeOutput}
+   */
+  public Status encode(
+      Buffer pixels, int width, int height, PixelFormat pixelFormat, ByteBuffer output) {
+    return EncoderJni.encode(
+        handle(), pixels, width, height, pixelFormat, effort, lossless, distance, output);
+  }
+
+  /** Write the next part of the stream, after {@link Status#NEED_MORE_OUTPUT}. */
+  public Status writeOutput(ByteBuffer output) {
+    return EncoderJni.writeOutput(handle(), output);
+  }
+
+  /** Encode the image to a new buffer of the size of the stream. */
+  public ByteBuffer encode(Buffer pixels, int width, int height, PixelFormat pixelFormat) {
+    ByteBuffer output = ByteBuffer.allocateDirect(Math.max(pixels.remaining() / 4, 4096));
+    Status status = encode(pixels, width, height, pixelFormat, output);
+    while (status == Status.NEED_MORE_OUTPUT) {
+      ByteBuffer larger = ByteBuffer.allocateDirect(output.capacity() * 2);
+      output.flip();
+      larger.put(output);
+      output = larger;
+      status = writeOutput(output);
+    }
+    output.flip();
+    ByteBuffer result = ByteBuffer.allocateDirect(output.remaining());
+    result.put(output);
+    result.flip();
+    return result;
+  }
+
+  @Override
+  public void close() {
+    if (encoder == 0) {
+      return;
+    }
+    EncoderJni.destroyEncoder(encoder);
+    encoder = 0;
+    if (threadPool != null) {
+      threadPool.release();
+    }
+  }
+}
@@ -0,0 +1,80 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+package org.jpeg.jpegxl.wrapper;
+
+import java.nio.Buffer;
+
+/**
+ * Low level JNI wrapper.
+ *
+ * This class is package-private, should be only be used by high level wrapper.
+ */
+class EncoderJni {
+  private static native long nativeCreateEncoder(long pool, int maxThreads);
+  private static native void nativeDestroyEncoder(long encoder);
+  private static native void nativeEncode(
+      int[] context, long encoder, float distance, Buffer pixels, Buffer output);
+  private static native void nativeWriteOutput(int[] context, long encoder, Buffer output);
+
+  /** Create an encoder reused for many images; returns 0 on failure. */
+  static long createEncoder(long pool, int maxThreads) {
+    return nativeCreateEncoder(pool, maxThreads);
+  }
+
+  static void destroyEncoder(long encoder) {
+    nativeDestroyEncoder(encoder);
+  }
+
+  /**
+   * Encode the remaining bytes of pixels; writes the start of the stream to the remaining space of
+   * output and advances its position.
+   */
+  static Status encode(long encoder, Buffer pixels, int width, int height,
+      PixelFormat pixelFormat, int effort, boolean lossless, float distance, Buffer output) {
+    if (!pixels.isDirect()) {
+      throw new IllegalArgumentException("pixels must be direct buffer");
+    }
+    if (!output.isDirect()) {
+      throw new IllegalArgumentException("output must be direct buffer");
+    }
+    int[] context = new int[9];
+    context[0] = pixelFormat.ordinal();
+    context[1] = width;
+    context[2] = height;
+    context[3] = effort;
+    context[4] = lossless ? 1 : 0;
+    context[5] = pixels.position();
+    context[6] = pixels.remaining();
+    context[7] = output.position();
+    context[8] = output.remaining();
+    nativeEncode(context, encoder, distance, pixels, output);
+    return makeResult(context, output);
+  }
+
+  /** Write the next part of the stream to the remaining space of output. */
+  static Status writeOutput(long encoder, Buffer output) {
+    if (!output.isDirect()) {
+      throw new IllegalArgumentException("output must be direct buffer");
+    }
+    int[] context = new int[2];
+    context[0] = output.position();
+    context[1] = output.remaining();
+    nativeWriteOutput(context, encoder, output);
+    return makeResult(context, output);
+  }
+
+  private static Status makeResult(int[] context, Buffer output) {
+    Status status = DecoderJni.makeStatus(context[0]);
+    if (status == Status.INVALID_STREAM) {
+      throw new IllegalStateException("Encoding failed");
+    }
+    output.position(output.position() + context[1]);
+    return status;
+  }
+
+  /** Utility library, disable object construction. */
+  private EncoderJni() {}
+}
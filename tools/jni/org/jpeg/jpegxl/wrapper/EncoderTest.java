@@ -0,0 +1,113 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+package org.jpeg.jpegxl.wrapper;
+
+import java.nio.ByteBuffer;
+
+public class EncoderTest {
+  static {
+    // The encoder natives are in their own library; the decoder library is
+    // needed too, for ThreadPool and for checking the encoded images.
+    String jniLibrary = System.getProperty("org.jpeg.jpegxl.wrapper.lib");
+    String encoderJniLibrary = System.getProperty("org.jpeg.jpegxl.wrapper.enc_lib");
+    if (jniLibrary != null && encoderJniLibrary != null) {
+      try {
+        System.load(new java.io.File(jniLibrary).getAbsolutePath());
+        System.load(new java.io.File(encoderJniLibrary).getAbsolutePath());
+      } catch (UnsatisfiedLinkError ex) {
+        String message =
+            "If the nested exception message says that some standard library (stdc++, tcmalloc, etc.) was not found, "
+            + "it is likely that JDK discovered by the build system overrides library search path. "
+            + "Try specifying a different JDK via JAVA_HOME environment variable and doing a clean build.";
+        throw new RuntimeException(message, ex);
+      }
+    }
+  }
+
+  private static final int WIDTH = 67;
+  private static final int HEIGHT = 45;
+
+  static ByteBuffer makeRgbaPixels() {
+    ByteBuffer pixels = ByteBuffer.allocateDirect(WIDTH * HEIGHT * 4);
+    for (int y = 0; y < HEIGHT; ++y) {
+      for (int x = 0; x < WIDTH; ++x) {
+        pixels.put((byte) (x * 3));
+        pixels.put((byte) (y * 5));
+        pixels.put((byte) (x * y));
+        pixels.put((byte) (255 - x));
+      }
+    }
+    pixels.flip();
+    return pixels;
+  }
+
+  static void checkDimensions(StreamInfo info) {
+    if (info.status != Status.OK) {
+      throw new IllegalStateException("Unexpected decoding error");
+    }
+    if (info.width != WIDTH || info.height != HEIGHT) {
+      throw new IllegalStateException("Invalid width / height");
+    }
+  }
+
+  // Writes the stream to a small buffer, so that it is retrieved in parts.
+  static void testLosslessRoundtrip() {
+    ByteBuffer pixels = makeRgbaPixels();
+    ByteBuffer output = ByteBuffer.allocate(1 << 16);
+    try (Encoder encoder = new Encoder()) {
+      encoder.setEffort(1);
+      encoder.setLossless(true);
+      ByteBuffer part = ByteBuffer.allocateDirect(64);
+      Status status =
+          encoder.encode(pixels.duplicate(), WIDTH, HEIGHT, PixelFormat.RGBA_8888, part);
+      int numParts = 1;
+      while (status == Status.NEED_MORE_OUTPUT) {
+        part.flip();
+        output.put(part);
+        part.clear();
+        status = encoder.writeOutput(part);
+        numParts++;
+      }
+      if (status != Status.OK) {
+        throw new IllegalStateException("Unexpected encoding status " + status);
+      }
+      part.flip();
+      output.put(part);
+      output.flip();
+      if (numParts < 2) {
+        throw new IllegalStateException("Expected 'need more output'");
+      }
+    }
+    // The decoder reads the whole capacity of the buffer.
+    ByteBuffer encoded = ByteBuffer.allocateDirect(output.remaining());
+    encoded.put(output);
+    checkDimensions(Decoder.decodeInfo(encoded));
+    ImageData imageData = Decoder.decode(encoded, PixelFormat.RGBA_8888);
+    ByteBuffer decoded = (ByteBuffer) imageData.pixels;
+    decoded.clear();
+    if (!decoded.equals(pixels)) {
+      throw new IllegalStateException("Lossless roundtrip changed the pixels");
+    }
+  }
+
+  // Reuses an encoder for several images, on a shared pool.
+  static void testLossyReuse() {
+    try (ThreadPool pool = new ThreadPool(2); Encoder encoder = new Encoder(pool, 0)) {
+      encoder.setEffort(3);
+      for (float distance : new float[] {1.0f, 4.0f}) {
+        encoder.setDistance(distance);
+        ByteBuffer output = encoder.encode(makeRgbaPixels(), WIDTH, HEIGHT, PixelFormat.RGBA_8888);
+        checkDimensions(Decoder.decodeInfo(output));
+      }
+    }
+  }
+
+  // Simple executable to avoid extra dependencies.
+  public static void main(String[] args) {
+    testLosslessRoundtrip();
+    testLossyReuse();
+  }
+}
@@ -13,5 +13,8 @@ public enum Status {
   NOT_ENOUGH_INPUT,
 
   /** Stream is corrupted. */
-  INVALID_STREAM
+  INVALID_STREAM,
+
+  /** Output buffer is missing or too small; provide one and call again. */
+  NEED_MORE_OUTPUT
 }
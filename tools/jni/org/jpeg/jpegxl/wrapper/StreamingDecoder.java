@@ -0,0 +1,136 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+package org.jpeg.jpegxl.wrapper;
+
+import java.nio.Buffer;
+import java.nio.ByteBuffer;
+
+/**
+ * JPEG XL decoder that is reused for many images and accepts the stream in chunks.
+ *
+ * Usage: {@link #reset} for each image, then {@link #feed} the stream until it returns
+ * {@link Status#OK}. When it returns {@link Status#NEED_MORE_OUTPUT}, set a pixels buffer of
+ * {@link #getPixelsSize} bytes and continue feeding (an empty buffer is fine).
+ */
+public class StreamingDecoder implements AutoCloseable {
+  private static final ByteBuffer EMPTY = ByteBuffer.allocateDirect(0);
+
+  private final ThreadPool threadPool;
+  private long decoder;
+  private PixelFormat pixelFormat = PixelFormat.RGBA_8888;
+  // Referenced so that the native decoder can write to it.
+  private Buffer pixels;
+
+  /** Decoder running on the calling thread. */
+  public StreamingDecoder() {
+    this(null, 0);
+  }
+
+  /**
+   * Decoder running on the given pool.
+   *
+   * @param maxThreads maximal number of threads decoding a single image, 0 for no limit
+   */
+  public StreamingDecoder(ThreadPool threadPool, int maxThreads) {
+    if (maxThreads < 0) {
+      throw new IllegalArgumentException("maxThreads must not be negative");
+    }
+    this.threadPool = threadPool;
+    long pool = (threadPool == null) ? 0 : threadPool.acquire();
+    decoder = DecoderJni.createDecoder(pool, maxThreads);
+    if (decoder == 0) {
+      if (threadPool != null) {
+        threadPool.release();
+      }
+      throw new IllegalStateException("Failed to create decoder");
+    }
+  }
+
+  private long handle() {
+    if (decoder == 0) {
+      throw new IllegalStateException("Decoder is closed");
+    }
+    return decoder;
+  }
+
+  /** Start decoding of the next image. */
+  public void reset(PixelFormat pixelFormat) {
+    if (DecoderJni.resetDecoder(handle(), pixelFormat) != Status.OK) {
+      throw new IllegalStateException("Failed to reset decoder");
+    }
+    this.pixelFormat = pixelFormat;
+    pixels = null;
+  }
+
+  /** Decode the remaining bytes of data; consumes them all. */
+  public Status feed(Buffer data) {
+    Status status = DecoderJni.feed(handle(), data);
+    data.position(data.limit());
+    return status;
+  }
+
+  /** Continue decoding without new input, e.g. after setting the pixels buffer. */
+  public Status feed() {
+    return DecoderJni.feed(handle(), EMPTY);
+  }
+
+  /** Information about the current image; status is OK once it is known. */
+  public StreamInfo getStreamInfo() {
+    return DecoderJni.getStreamInfo(handle());
+  }
+
+  /** Size of the pixels buffer for the current image. */
+  public int getPixelsSize() {
+    StreamInfo info = getStreamInfo();
+    if (info.status != Status.OK) {
+      throw new IllegalStateException("Image size is not known yet");
+    }
+    return info.pixelsSize;
+  }
+
+  /** Set the direct buffer the pixels of the current image are decoded to. */
+  public void setPixelsBuffer(Buffer pixels) {
+    if (DecoderJni.setPixelsBuffer(handle(), pixels) != Status.OK) {
+      throw new IllegalStateException("Failed to set pixels buffer");
+    }
+    this.pixels = pixels;
+  }
+
+  /** Pixels decoded so far, in the format of the last {@link #reset}. */
+  public ImageData getImageData() {
+    StreamInfo info = getStreamInfo();
+    if (info.status != Status.OK || pixels == null) {
+      throw new IllegalStateException("Image is not decoded yet");
+    }
+    return new ImageData(info.width, info.height, pixels, getIcc(), pixelFormat);
+  }
+
+  /** ICC profile of the current image. */
+  public ByteBuffer getIcc() {
+    StreamInfo info = getStreamInfo();
+    if (info.status != Status.OK) {
+      throw new IllegalStateException("ICC profile is not known yet");
+    }
+    ByteBuffer icc = ByteBuffer.allocateDirect(info.iccSize);
+    if (DecoderJni.getIcc(handle(), icc) != Status.OK) {
+      throw new IllegalStateException("Failed to get ICC profile");
+    }
+    return icc;
+  }
+
+  @Override
+  public void close() {
+    if (decoder == 0) {
+      return;
+    }
+    DecoderJni.destroyDecoder(decoder);
+    decoder = 0;
+    pixels = null;
+    if (threadPool != null) {
+      threadPool.release();
+    }
+  }
+}
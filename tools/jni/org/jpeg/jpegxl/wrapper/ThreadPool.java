@@ -0,0 +1,55 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+package org.jpeg.jpegxl.wrapper;
+
+/**
+ * Worker threads shared by any number of {@link StreamingDecoder} and {@link Encoder} instances.
+ *
+ * The pool must be closed after all the decoders and encoders using it.
+ */
+public class ThreadPool implements AutoCloseable {
+  private static native long nativeCreate(int numThreads);
+  private static native void nativeDestroy(long pool);
+
+  private long pool;
+  private int numUsers;
+
+  /** Start a pool of the given number of worker threads. */
+  public ThreadPool(int numThreads) {
+    if (numThreads < 0) {
+      throw new IllegalArgumentException("numThreads must not be negative");
+    }
+    pool = nativeCreate(numThreads);
+    if (pool == 0) {
+      throw new IllegalStateException("Failed to create thread pool");
+    }
+  }
+
+  /** Register a decoder or encoder using the pool; returns the native handle. */
+  synchronized long acquire() {
+    if (pool == 0) {
+      throw new IllegalStateException("Thread pool is closed");
+    }
+    numUsers++;
+    return pool;
+  }
+
+  synchronized void release() {
+    numUsers--;
+  }
+
+  @Override
+  public synchronized void close() {
+    if (pool == 0) {
+      return;
+    }
+    if (numUsers != 0) {
+      throw new IllegalStateException("Thread pool is still in use");
+    }
+    nativeDestroy(pool);
+    pool = 0;
+  }
+}
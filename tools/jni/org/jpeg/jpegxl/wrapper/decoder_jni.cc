@@ -7,62 +7,33 @@
 
 #include <jni.h>
 
+#include <algorithm>
 #include <cstdlib>
+#include <utility>
+#include <vector>
 
 #include "jxl/decode.h"
+#include "jxl/decode_cxx.h"
+#include "jxl/shared_parallel_runner.h"
 #include "jxl/thread_parallel_runner.h"
 #include "lib/jxl/base/status.h"
+#include "tools/jni/org/jpeg/jpegxl/wrapper/jni_util.h"
 
 namespace {
 
-template <typename From, typename To>
-bool StaticCast(const From& from, To* to) {
-  To tmp = static_cast<To>(from);
-  // Check sign is preserved.
-  if ((from < 0 && tmp > 0) || (from > 0 && tmp < 0)) return false;
-  // Check value is preserved.
-  if (from != static_cast<From>(tmp)) return false;
-  *to = tmp;
-  return true;
-}
-
-bool BufferToSpan(JNIEnv* env, jobject buffer, uint8_t** data, size_t* size) {
-  if (buffer == nullptr) return true;
-
-  *data = reinterpret_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
-  if (*data == nullptr) return false;
-  return StaticCast(env->GetDirectBufferCapacity(buffer), size);
-}
-
-int ToStatusCode(const jxl::Status& status) {
-  if (status) return 0;
-  if (status.IsFatalError()) return -1;
-  return 1;  // Non-fatal -> not enough input.
-}
-
-constexpr const size_t kLastPixelFormat = 3;
-constexpr const size_t kNoPixelFormat = static_cast<size_t>(-1);
-
-JxlPixelFormat ToPixelFormat(size_t pixel_format) {
-  if (pixel_format == 0) {
-    // RGBA, 4 x byte per pixel, no scanline padding.
-    return {/*num_channels=*/4, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, /*align=*/0};
-  } else if (pixel_format == 1) {
-    // RGBA, 4 x float16 per pixel, no scanline padding.
-    return {/*num_channels=*/4, JXL_TYPE_FLOAT16, JXL_LITTLE_ENDIAN,
-            /*align=*/0};
-  } else if (pixel_format == 2) {
-    // RGB, 4 x byte per pixel, no scanline padding.
-    return {/*num_channels=*/3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, /*align=*/0};
-  } else if (pixel_format == 3) {
-    // RGB, 4 x float16 per pixel, no scanline padding.
-    return {/*num_channels=*/3, JXL_TYPE_FLOAT16, JXL_LITTLE_ENDIAN,
-            /*align=*/0};
-  } else {
-    abort();
-    return {0, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
-  }
-}
+using jxl::jni::BufferRangeToSpan;
+using jxl::jni::BufferToSpan;
+using jxl::jni::FromHandle;
+using jxl::jni::kLastPixelFormat;
+using jxl::jni::kNoPixelFormat;
+using jxl::jni::kStatusInvalidStream;
+using jxl::jni::kStatusNeedMoreOutput;
+using jxl::jni::kStatusNotEnoughInput;
+using jxl::jni::kStatusOk;
+using jxl::jni::StaticCast;
+using jxl::jni::ToHandle;
+using jxl::jni::ToPixelFormat;
+using jxl::jni::ToStatusCode;
 
 jxl::Status DoDecode(JNIEnv* env, jobject data_buffer, size_t* info_pixels_size,
                      size_t* info_icc_size, JxlBasicInfo* info,
@@ -177,6 +148,129 @@ jxl::Status DoDecode(JNIEnv* env, jobject data_buffer, size_t* info_pixels_size,
   return true;
 }
 
+// Decoder reused for many images, with the input fed in chunks.
+struct StreamingDecoder {
+  StreamingDecoder(JxlDecoderPtr dec, void* runner)
+      : dec(std::move(dec)), runner(runner) {}
+  ~StreamingDecoder() {
+    // The decoder may still reference the runner.
+    dec.reset();
+    if (runner) JxlSharedParallelRunnerDestroy(runner);
+  }
+
+  JxlDecoderPtr dec;
+  // JxlSharedParallelRunner on the pool of the Java decoder, or null to
+  // decode on the calling thread.
+  void* runner;
+
+  JxlPixelFormat format;
+  // Input that the decoder has not consumed yet, which it needs again.
+  std::vector<uint8_t> input;
+  bool have_info = false;
+  JxlBasicInfo info;
+  size_t pixels_size = 0;
+  std::vector<uint8_t> icc;
+  // Direct buffer of the Java decoder, kept reachable on the Java side.
+  uint8_t* pixels = nullptr;
+  size_t pixels_capacity = 0;
+  bool pixels_set = false;
+  bool done = false;
+};
+
+jxl::Status ResetStreamingDecoder(StreamingDecoder* decoder,
+                                  size_t pixel_format) {
+  JxlDecoder* dec = decoder->dec.get();
+  JxlDecoderReset(dec);
+  if (decoder->runner &&
+      JxlDecoderSetParallelRunner(dec, JxlSharedParallelRunner,
+                                  decoder->runner) != JXL_DEC_SUCCESS) {
+    return JXL_FAILURE("Failed to set parallel runner");
+  }
+  if (JxlDecoderSubscribeEvents(dec, JXL_DEC_BASIC_INFO |
+                                         JXL_DEC_COLOR_ENCODING |
+                                         JXL_DEC_FULL_IMAGE) !=
+      JXL_DEC_SUCCESS) {
+    return JXL_FAILURE("Failed to subscribe for events");
+  }
+  decoder->format = ToPixelFormat(pixel_format);
+  decoder->input.clear();
+  decoder->have_info = false;
+  decoder->pixels_size = 0;
+  decoder->icc.clear();
+  decoder->pixels = nullptr;
+  decoder->pixels_capacity = 0;
+  decoder->pixels_set = false;
+  decoder->done = false;
+  return true;
+}
+
+// Decodes the buffered input as far as possible. Returns one of the status
+// codes, kStatusOk once the first frame is complete.
+jint ProcessStreamingInput(StreamingDecoder* decoder) {
+  if (decoder->done) return kStatusOk;
+  JxlDecoder* dec = decoder->dec.get();
+  if (JxlDecoderSetInput(dec, decoder->input.data(), decoder->input.size()) !=
+      JXL_DEC_SUCCESS) {
+    return kStatusInvalidStream;
+  }
+  jint result = kStatusInvalidStream;
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec);
+    if (status == JXL_DEC_NEED_MORE_INPUT) {
+      result = kStatusNotEnoughInput;
+    } else if (status == JXL_DEC_BASIC_INFO) {
+      if (JxlDecoderGetBasicInfo(dec, &decoder->info) != JXL_DEC_SUCCESS ||
+          JxlDecoderImageOutBufferSize(dec, &decoder->format,
+                                       &decoder->pixels_size) !=
+              JXL_DEC_SUCCESS) {
+        break;
+      }
+      decoder->have_info = true;
+      continue;
+    } else if (status == JXL_DEC_COLOR_ENCODING) {
+      size_t icc_size = 0;
+      if (JxlDecoderGetICCProfileSize(dec, &decoder->format,
+                                      JXL_COLOR_PROFILE_TARGET_DATA,
+                                      &icc_size) != JXL_DEC_SUCCESS) {
+        icc_size = 0;
+      }
+      decoder->icc.resize(icc_size);
+      if (icc_size > 0 &&
+          JxlDecoderGetColorAsICCProfile(
+              dec, &decoder->format, JXL_COLOR_PROFILE_TARGET_DATA,
+              decoder->icc.data(), icc_size) != JXL_DEC_SUCCESS) {
+        break;
+      }
+      continue;
+    } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      if (decoder->pixels == nullptr ||
+          decoder->pixels_capacity < decoder->pixels_size) {
+        // The Java side provides the buffer and calls again.
+        result = kStatusNeedMoreOutput;
+      } else if (decoder->pixels_set ||
+                 JxlDecoderSetImageOutBuffer(dec, &decoder->format,
+                                             decoder->pixels,
+                                             decoder->pixels_size) !=
+                     JXL_DEC_SUCCESS) {
+        break;
+      } else {
+        decoder->pixels_set = true;
+        continue;
+      }
+    } else if (status == JXL_DEC_FULL_IMAGE) {
+      // Later frames, if any, are not decoded.
+      decoder->done = true;
+      result = kStatusOk;
+    }
+    break;
+  }
+  const size_t remaining = JxlDecoderReleaseInput(dec);
+  decoder->input.erase(decoder->input.begin(),
+                       decoder->input.end() - remaining);
+  if (decoder->done) decoder->input.clear();
+  return result;
+}
+
 #undef FAILURE
 
 }  // namespace
@@ -271,6 +365,115 @@ JNIEXPORT void JNICALL Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeGetPixels(
   env->SetIntArrayRegion(ctx, 0, 1, context);
 }
 
+JNIEXPORT jlong JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeCreateDecoder(
+    JNIEnv* /* env */, jobject /* jobj */, jlong pool, jint max_threads) {
+  void* runner = nullptr;
+  if (pool != 0) {
+    size_t num_threads;
+    if (!StaticCast(max_threads, &num_threads)) return 0;
+    runner = JxlSharedParallelRunnerCreate(FromHandle<void>(pool), num_threads);
+    if (runner == nullptr) return 0;
+  }
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  if (!dec) {
+    if (runner) JxlSharedParallelRunnerDestroy(runner);
+    return 0;
+  }
+  StreamingDecoder* decoder = new StreamingDecoder(std::move(dec), runner);
+  if (!ResetStreamingDecoder(decoder, /*pixel_format=*/0)) {
+    delete decoder;
+    return 0;
+  }
+  return ToHandle(decoder);
+}
+
+JNIEXPORT void JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeDestroyDecoder(
+    JNIEnv* /* env */, jobject /* jobj */, jlong decoder) {
+  delete FromHandle<StreamingDecoder>(decoder);
+}
+
+JNIEXPORT jint JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeResetDecoder(
+    JNIEnv* /* env */, jobject /* jobj */, jlong decoder, jint pixel_format) {
+  size_t format;
+  if (!StaticCast(pixel_format, &format) || format > kLastPixelFormat) {
+    return kStatusInvalidStream;
+  }
+  return ToStatusCode(
+      ResetStreamingDecoder(FromHandle<StreamingDecoder>(decoder), format));
+}
+
+JNIEXPORT jint JNICALL Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeFeed(
+    JNIEnv* env, jobject /* jobj */, jlong decoder, jobject data_buffer,
+    jint offset, jint length) {
+  StreamingDecoder* streaming_decoder = FromHandle<StreamingDecoder>(decoder);
+  uint8_t* data = nullptr;
+  size_t data_size = 0;
+  if (!BufferRangeToSpan(env, data_buffer, offset, length, &data,
+                         &data_size)) {
+    return kStatusInvalidStream;
+  }
+  if (!streaming_decoder->done) {
+    streaming_decoder->input.insert(streaming_decoder->input.end(), data,
+                                    data + data_size);
+  }
+  return ProcessStreamingInput(streaming_decoder);
+}
+
+JNIEXPORT jint JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeSetPixelsBuffer(
+    JNIEnv* env, jobject /* jobj */, jlong decoder, jobject pixels_buffer) {
+  StreamingDecoder* streaming_decoder = FromHandle<StreamingDecoder>(decoder);
+  if (streaming_decoder->pixels_set) return kStatusInvalidStream;
+  uint8_t* pixels = nullptr;
+  size_t pixels_size = 0;
+  if (!BufferToSpan(env, pixels_buffer, &pixels, &pixels_size)) {
+    return kStatusInvalidStream;
+  }
+  streaming_decoder->pixels = pixels;
+  streaming_decoder->pixels_capacity = pixels_size;
+  return kStatusOk;
+}
+
+JNIEXPORT void JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeGetStreamInfo(
+    JNIEnv* env, jobject /* jobj */, jintArray ctx, jlong decoder) {
+  const StreamingDecoder* streaming_decoder =
+      FromHandle<StreamingDecoder>(decoder);
+  jint context[6] = {0};
+  jxl::Status status = true;
+  if (!streaming_decoder->have_info) {
+    status = JXL_STATUS(jxl::StatusCode::kNotEnoughBytes, "Not enough input");
+  }
+  if (status) {
+    bool ok = true;
+    ok &= StaticCast(streaming_decoder->info.xsize, context + 1);
+    ok &= StaticCast(streaming_decoder->info.ysize, context + 2);
+    ok &= StaticCast(streaming_decoder->pixels_size, context + 3);
+    ok &= StaticCast(streaming_decoder->icc.size(), context + 4);
+    ok &= StaticCast(streaming_decoder->info.alpha_bits, context + 5);
+    if (!ok) status = JXL_FAILURE("Invalid value");
+  }
+  context[0] = ToStatusCode(status);
+  env->SetIntArrayRegion(ctx, 0, 6, context);
+}
+
+JNIEXPORT jint JNICALL Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeGetIcc(
+    JNIEnv* env, jobject /* jobj */, jlong decoder, jobject icc_buffer) {
+  const StreamingDecoder* streaming_decoder =
+      FromHandle<StreamingDecoder>(decoder);
+  uint8_t* icc = nullptr;
+  size_t icc_size = 0;
+  if (!BufferToSpan(env, icc_buffer, &icc, &icc_size) ||
+      icc_size < streaming_decoder->icc.size()) {
+    return kStatusInvalidStream;
+  }
+  std::copy(streaming_decoder->icc.begin(), streaming_decoder->icc.end(), icc);
+  return kStatusOk;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -36,6 +36,81 @@ JNIEXPORT void JNICALL Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeGetPixels(
     JNIEnv* env, jobject /*jobj*/, jintArray ctx, jobject data_buffer,
     jobject pixels_buffer, jobject icc_buffer);
 
+/**
+ * Create a decoder that is reused for many images, or return 0 on failure.
+ *
+ * @param pool ThreadPool handle, or 0 to decode on the calling thread
+ * @param max_threads maximal number of pool threads to use, 0 for all
+ */
+JNIEXPORT jlong JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeCreateDecoder(JNIEnv* env,
+                                                            jobject /*jobj*/,
+                                                            jlong pool,
+                                                            jint max_threads);
+
+/** Destroy a decoder created by nativeCreateDecoder. */
+JNIEXPORT void JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeDestroyDecoder(JNIEnv* env,
+                                                             jobject /*jobj*/,
+                                                             jlong decoder);
+
+/**
+ * Prepare the decoder for the next image; keeps its allocations.
+ *
+ * @param pixel_format format of the pixels of the next image
+ * @return status code
+ */
+JNIEXPORT jint JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeResetDecoder(JNIEnv* env,
+                                                           jobject /*jobj*/,
+                                                           jlong decoder,
+                                                           jint pixel_format);
+
+/**
+ * Append the next chunk of the JXL stream and decode as far as possible.
+ *
+ * @param data [in] Buffer with the next part of the JXL stream
+ * @param offset position of the chunk in data
+ * @param length size of the chunk
+ * @return status code; "need more output" when the pixels buffer is missing
+ *         or too small
+ */
+JNIEXPORT jint JNICALL Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeFeed(
+    JNIEnv* env, jobject /*jobj*/, jlong decoder, jobject data_buffer,
+    jint offset, jint length);
+
+/**
+ * Set the buffer the pixels of the current image are decoded to.
+ *
+ * @param pixels [out] Buffer to place pixels to; must stay valid until the
+ *        image is decoded or the decoder is reset
+ * @return status code
+ */
+JNIEXPORT jint JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeSetPixelsBuffer(
+    JNIEnv* env, jobject /*jobj*/, jlong decoder, jobject pixels_buffer);
+
+/**
+ * Get the information about the current image decoded so far.
+ *
+ * @param ctx {out_status, out_width, out_height, pixels_size, icc_size,
+ *             alpha_bits} tuple
+ */
+JNIEXPORT void JNICALL
+Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeGetStreamInfo(JNIEnv* env,
+                                                            jobject /*jobj*/,
+                                                            jintArray ctx,
+                                                            jlong decoder);
+
+/**
+ * Get the ICC profile of the current image.
+ *
+ * @param icc [out] Buffer to place the ICC profile to
+ * @return status code
+ */
+JNIEXPORT jint JNICALL Java_org_jpeg_jpegxl_wrapper_DecoderJni_nativeGetIcc(
+    JNIEnv* env, jobject /*jobj*/, jlong decoder, jobject icc_buffer);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,8 +4,10 @@
 // license that can be found in the LICENSE file.
 
 #include <jni.h>
+#include <stddef.h>
 
 #include "tools/jni/org/jpeg/jpegxl/wrapper/decoder_jni.h"
+#include "tools/jni/org/jpeg/jpegxl/wrapper/thread_pool_jni.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,6 +18,25 @@ static char* kGetBasicInfoSig = const_cast<char*>("([ILjava/nio/Buffer;)V");
 static char* kGetPixelsName = const_cast<char*>("nativeGetPixels");
 static char* kGetPixelsInfoSig = const_cast<char*>(
     "([ILjava/nio/Buffer;Ljava/nio/Buffer;Ljava/nio/Buffer;)V");
+static char* kCreateDecoderName = const_cast<char*>("nativeCreateDecoder");
+static char* kCreateDecoderSig = const_cast<char*>("(JI)J");
+static char* kDestroyDecoderName = const_cast<char*>("nativeDestroyDecoder");
+static char* kDestroyDecoderSig = const_cast<char*>("(J)V");
+static char* kResetDecoderName = const_cast<char*>("nativeResetDecoder");
+static char* kResetDecoderSig = const_cast<char*>("(JI)I");
+static char* kFeedName = const_cast<char*>("nativeFeed");
+static char* kFeedSig = const_cast<char*>("(JLjava/nio/Buffer;II)I");
+static char* kSetPixelsBufferName = const_cast<char*>("nativeSetPixelsBuffer");
+static char* kSetPixelsBufferSig = const_cast<char*>("(JLjava/nio/Buffer;)I");
+static char* kGetStreamInfoName = const_cast<char*>("nativeGetStreamInfo");
+static char* kGetStreamInfoSig = const_cast<char*>("([IJ)V");
+static char* kGetIccName = const_cast<char*>("nativeGetIcc");
+static char* kGetIccSig = const_cast<char*>("(JLjava/nio/Buffer;)I");
+
+static char* kCreateName = const_cast<char*>("nativeCreate");
+static char* kCreateSig = const_cast<char*>("(I)J");
+static char* kDestroyName = const_cast<char*>("nativeDestroy");
+static char* kDestroySig = const_cast<char*>("(J)V");
 
 #define JXL_JNI_METHOD(NAME) \
   (reinterpret_cast<void*>(  \
@@ -23,24 +44,52 @@ static char* kGetPixelsInfoSig = const_cast<char*>(
 
 static const JNINativeMethod kDecoderMethods[] = {
     {kGetBasicInfoName, kGetBasicInfoSig, JXL_JNI_METHOD(GetBasicInfo)},
-    {kGetPixelsName, kGetPixelsInfoSig, JXL_JNI_METHOD(GetPixels)}};
+    {kGetPixelsName, kGetPixelsInfoSig, JXL_JNI_METHOD(GetPixels)},
+    {kCreateDecoderName, kCreateDecoderSig, JXL_JNI_METHOD(CreateDecoder)},
+    {kDestroyDecoderName, kDestroyDecoderSig, JXL_JNI_METHOD(DestroyDecoder)},
+    {kResetDecoderName, kResetDecoderSig, JXL_JNI_METHOD(ResetDecoder)},
+    {kFeedName, kFeedSig, JXL_JNI_METHOD(Feed)},
+    {kSetPixelsBufferName, kSetPixelsBufferSig,
+     JXL_JNI_METHOD(SetPixelsBuffer)},
+    {kGetStreamInfoName, kGetStreamInfoSig, JXL_JNI_METHOD(GetStreamInfo)},
+    {kGetIccName, kGetIccSig, JXL_JNI_METHOD(GetIcc)}};
+
+static const size_t kNumDecoderMethods = 9;
+
+#undef JXL_JNI_METHOD
+
+#define JXL_JNI_METHOD(NAME) \
+  (reinterpret_cast<void*>(  \
+      Java_org_jpeg_jpegxl_wrapper_ThreadPool_native##NAME))
+
+static const JNINativeMethod kThreadPoolMethods[] = {
+    {kCreateName, kCreateSig, JXL_JNI_METHOD(Create)},
+    {kDestroyName, kDestroySig, JXL_JNI_METHOD(Destroy)}};
 
-static const size_t kNumDecoderMethods = 2;
+static const size_t kNumThreadPoolMethods = 2;
 
 #undef JXL_JNI_METHOD
 
+static bool RegisterMethods(JNIEnv* env, const char* class_name,
+                            const JNINativeMethod* methods,
+                            size_t num_methods) {
+  jclass clazz = env->FindClass(class_name);
+  if (clazz == nullptr) {
+    return false;
+  }
+  return env->RegisterNatives(clazz, methods, num_methods) >= 0;
+}
+
 JNIEXPORT jint JNI_OnLoad(JavaVM* vm, void* reserved) {
   JNIEnv* env;
   if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK) {
     return -1;
   }
 
-  jclass clazz = env->FindClass("org/jpeg/jpegxl/wrapper/DecoderJni");
-  if (clazz == nullptr) {
-    return -1;
-  }
-
-  if (env->RegisterNatives(clazz, kDecoderMethods, kNumDecoderMethods) < 0) {
+  if (!RegisterMethods(env, "org/jpeg/jpegxl/wrapper/DecoderJni",
+                       kDecoderMethods, kNumDecoderMethods) ||
+      !RegisterMethods(env, "org/jpeg/jpegxl/wrapper/ThreadPool",
+                       kThreadPoolMethods, kNumThreadPoolMethods)) {
     return -1;
   }
 
@@ -0,0 +1,231 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "tools/jni/org/jpeg/jpegxl/wrapper/encoder_jni.h"
+
+#include <jni.h>
+
+#include <utility>
+
+#include "jxl/encode.h"
+#include "jxl/encode_cxx.h"
+#include "jxl/shared_parallel_runner.h"
+#include "lib/jxl/base/status.h"
+#include "tools/jni/org/jpeg/jpegxl/wrapper/jni_util.h"
+
+namespace {
+
+using jxl::jni::BufferRangeToSpan;
+using jxl::jni::FromHandle;
+using jxl::jni::kLastPixelFormat;
+using jxl::jni::kStatusInvalidStream;
+using jxl::jni::kStatusNeedMoreOutput;
+using jxl::jni::kStatusOk;
+using jxl::jni::StaticCast;
+using jxl::jni::ToHandle;
+using jxl::jni::ToPixelFormat;
+
+// Encoder reused for many images.
+struct Encoder {
+  Encoder(JxlEncoderPtr enc, void* runner)
+      : enc(std::move(enc)), runner(runner) {}
+  ~Encoder() {
+    // The encoder may still reference the runner.
+    enc.reset();
+    if (runner) JxlSharedParallelRunnerDestroy(runner);
+  }
+
+  JxlEncoderPtr enc;
+  // JxlSharedParallelRunner on the pool of the Java encoder, or null to
+  // encode on the calling thread.
+  void* runner;
+};
+
+struct EncodeParams {
+  size_t pixel_format;
+  size_t xsize;
+  size_t ysize;
+  int effort;
+  bool lossless;
+  float distance;
+};
+
+// Starts encoding of a single frame image; the stream is then retrieved with
+// WriteOutput.
+jxl::Status StartEncoding(Encoder* encoder, const EncodeParams& params,
+                          const uint8_t* pixels, size_t pixels_size) {
+  JxlEncoder* enc = encoder->enc.get();
+  JxlEncoderReset(enc);
+  if (encoder->runner &&
+      JxlEncoderSetParallelRunner(enc, JxlSharedParallelRunner,
+                                  encoder->runner) != JXL_ENC_SUCCESS) {
+    return JXL_FAILURE("Failed to set parallel runner");
+  }
+
+  const JxlPixelFormat format = ToPixelFormat(params.pixel_format);
+  const bool is_float = (format.data_type == JXL_TYPE_FLOAT16);
+  JxlBasicInfo info;
+  JxlEncoderInitBasicInfo(&info);
+  info.xsize = params.xsize;
+  info.ysize = params.ysize;
+  info.bits_per_sample = is_float ? 16 : 8;
+  info.exponent_bits_per_sample = is_float ? 5 : 0;
+  info.uses_original_profile = params.lossless ? JXL_TRUE : JXL_FALSE;
+  if (format.num_channels == 4) {
+    info.num_extra_channels = 1;
+    info.alpha_bits = info.bits_per_sample;
+    info.alpha_exponent_bits = info.exponent_bits_per_sample;
+  }
+  if (JxlEncoderSetBasicInfo(enc, &info) != JXL_ENC_SUCCESS) {
+    return JXL_FAILURE("Failed to set basic info");
+  }
+
+  // Float pixels are linear, as in the decoder output.
+  JxlColorEncoding color_encoding;
+  if (is_float) {
+    JxlColorEncodingSetToLinearSRGB(&color_encoding, /*is_gray=*/JXL_FALSE);
+  } else {
+    JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/JXL_FALSE);
+  }
+  if (JxlEncoderSetColorEncoding(enc, &color_encoding) != JXL_ENC_SUCCESS) {
+    return JXL_FAILURE("Failed to set color encoding");
+  }
+
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc, nullptr);
+  if (JxlEncoderFrameSettingsSetOption(frame_settings,
+                                       JXL_ENC_FRAME_SETTING_EFFORT,
+                                       params.effort) != JXL_ENC_SUCCESS) {
+    return JXL_FAILURE("Failed to set effort");
+  }
+  if (params.lossless) {
+    if (JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE) !=
+        JXL_ENC_SUCCESS) {
+      return JXL_FAILURE("Failed to set lossless");
+    }
+  } else if (JxlEncoderSetFrameDistance(frame_settings, params.distance) !=
+             JXL_ENC_SUCCESS) {
+    return JXL_FAILURE("Failed to set distance");
+  }
+
+  if (JxlEncoderAddImageFrame(frame_settings, &format, pixels, pixels_size) !=
+      JXL_ENC_SUCCESS) {
+    return JXL_FAILURE("Failed to add image frame");
+  }
+  JxlEncoderCloseInput(enc);
+  return true;
+}
+
+// Writes as much of the stream as fits to the output. Returns one of the
+// status codes.
+jint WriteOutput(Encoder* encoder, uint8_t* output, size_t output_size,
+                 size_t* bytes_written) {
+  uint8_t* next_out = output;
+  size_t avail_out = output_size;
+  JxlEncoderStatus status =
+      JxlEncoderProcessOutput(encoder->enc.get(), &next_out, &avail_out);
+  *bytes_written = output_size - avail_out;
+  if (status == JXL_ENC_SUCCESS) return kStatusOk;
+  if (status == JXL_ENC_NEED_MORE_OUTPUT) return kStatusNeedMoreOutput;
+  return kStatusInvalidStream;
+}
+
+// Stores the status code and number of bytes written to the first two
+// elements of ctx.
+void SetResult(JNIEnv* env, jintArray ctx, jint status, size_t bytes_written) {
+  jint result[2] = {status, 0};
+  if (!StaticCast(bytes_written, result + 1)) {
+    result[0] = kStatusInvalidStream;
+  }
+  env->SetIntArrayRegion(ctx, 0, 2, result);
+}
+
+}  // namespace
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+JNIEXPORT jlong JNICALL
+Java_org_jpeg_jpegxl_wrapper_EncoderJni_nativeCreateEncoder(
+    JNIEnv* /* env */, jobject /* jobj */, jlong pool, jint max_threads) {
+  void* runner = nullptr;
+  if (pool != 0) {
+    size_t num_threads;
+    if (!StaticCast(max_threads, &num_threads)) return 0;
+    runner = JxlSharedParallelRunnerCreate(FromHandle<void>(pool), num_threads);
+    if (runner == nullptr) return 0;
+  }
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  if (!enc) {
+    if (runner) JxlSharedParallelRunnerDestroy(runner);
+    return 0;
+  }
+  return ToHandle(new Encoder(std::move(enc), runner));
+}
+
+JNIEXPORT void JNICALL
+Java_org_jpeg_jpegxl_wrapper_EncoderJni_nativeDestroyEncoder(
+    JNIEnv* /* env */, jobject /* jobj */, jlong encoder) {
+  delete FromHandle<Encoder>(encoder);
+}
+
+JNIEXPORT void JNICALL Java_org_jpeg_jpegxl_wrapper_EncoderJni_nativeEncode(
+    JNIEnv* env, jobject /* jobj */, jintArray ctx, jlong encoder,
+    jfloat distance, jobject pixels_buffer, jobject output_buffer) {
+  Encoder* native_encoder = FromHandle<Encoder>(encoder);
+  jint context[9] = {0};
+  env->GetIntArrayRegion(ctx, 0, 9, context);
+
+  EncodeParams params;
+  uint8_t* pixels = nullptr;
+  size_t pixels_size = 0;
+  uint8_t* output = nullptr;
+  size_t output_size = 0;
+  bool ok = true;
+  ok &= StaticCast(context[0], &params.pixel_format);
+  ok &= StaticCast(context[1], &params.xsize);
+  ok &= StaticCast(context[2], &params.ysize);
+  params.effort = context[3];
+  params.lossless = (context[4] != 0);
+  params.distance = distance;
+  ok = ok && params.pixel_format <= kLastPixelFormat;
+  ok = ok && BufferRangeToSpan(env, pixels_buffer, context[5], context[6],
+                               &pixels, &pixels_size);
+  ok = ok && BufferRangeToSpan(env, output_buffer, context[7], context[8],
+                               &output, &output_size);
+  ok = ok && StartEncoding(native_encoder, params, pixels, pixels_size);
+  if (!ok) {
+    SetResult(env, ctx, kStatusInvalidStream, 0);
+    return;
+  }
+  size_t bytes_written = 0;
+  jint status =
+      WriteOutput(native_encoder, output, output_size, &bytes_written);
+  SetResult(env, ctx, status, bytes_written);
+}
+
+JNIEXPORT void JNICALL
+Java_org_jpeg_jpegxl_wrapper_EncoderJni_nativeWriteOutput(
+    JNIEnv* env, jobject /* jobj */, jintArray ctx, jlong encoder,
+    jobject output_buffer) {
+  jint context[2] = {0};
+  env->GetIntArrayRegion(ctx, 0, 2, context);
+  uint8_t* output = nullptr;
+  size_t output_size = 0;
+  if (!BufferRangeToSpan(env, output_buffer, context[0], context[1], &output,
+                         &output_size)) {
+    SetResult(env, ctx, kStatusInvalidStream, 0);
+    return;
+  }
+  size_t bytes_written = 0;
+  jint status = WriteOutput(FromHandle<Encoder>(encoder), output, output_size,
+                            &bytes_written);
+  SetResult(env, ctx, status, bytes_written);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,63 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef TOOLS_JNI_ORG_JPEG_JPEGXL_WRAPPER_ENCODER_JNI
+#define TOOLS_JNI_ORG_JPEG_JPEGXL_WRAPPER_ENCODER_JNI
+
+#include <jni.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Create an encoder that is reused for many images, or return 0 on failure.
+ *
+ * @param pool ThreadPool handle, or 0 to encode on the calling thread
+ * @param max_threads maximal number of pool threads to use, 0 for all
+ */
+JNIEXPORT jlong JNICALL
+Java_org_jpeg_jpegxl_wrapper_EncoderJni_nativeCreateEncoder(JNIEnv* env,
+                                                            jobject /*jobj*/,
+                                                            jlong pool,
+                                                            jint max_threads);
+
+/** Destroy an encoder created by nativeCreateEncoder. */
+JNIEXPORT void JNICALL
+Java_org_jpeg_jpegxl_wrapper_EncoderJni_nativeDestroyEncoder(JNIEnv* env,
+                                                             jobject /*jobj*/,
+                                                             jlong encoder);
+
+/**
+ * Encode an image and write as much of the JXL stream as fits to the output.
+ *
+ * @param ctx {in_pixel_format_out_status, in_width_out_bytes_written,
+ *             height, effort, lossless, pixels_offset, pixels_length,
+ *             output_offset, output_length} tuple
+ * @param distance butteraugli distance of lossy encoding
+ * @param pixels [in] Buffer with the pixels to encode
+ * @param output [out] Buffer to place the JXL stream to
+ */
+JNIEXPORT void JNICALL Java_org_jpeg_jpegxl_wrapper_EncoderJni_nativeEncode(
+    JNIEnv* env, jobject /*jobj*/, jintArray ctx, jlong encoder,
+    jfloat distance, jobject pixels_buffer, jobject output_buffer);
+
+/**
+ * Write the next part of the JXL stream after "need more output".
+ *
+ * @param ctx {in_output_offset_out_status,
+ *             in_output_length_out_bytes_written} tuple
+ * @param output [out] Buffer to place the JXL stream to
+ */
+JNIEXPORT void JNICALL
+Java_org_jpeg_jpegxl_wrapper_EncoderJni_nativeWriteOutput(
+    JNIEnv* env, jobject /*jobj*/, jintArray ctx, jlong encoder,
+    jobject output_buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TOOLS_JNI_ORG_JPEG_JPEGXL_WRAPPER_ENCODER_JNI
@@ -0,0 +1,59 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <jni.h>
+#include <stddef.h>
+
+#include "tools/jni/org/jpeg/jpegxl/wrapper/encoder_jni.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static char* kCreateEncoderName = const_cast<char*>("nativeCreateEncoder");
+static char* kCreateEncoderSig = const_cast<char*>("(JI)J");
+static char* kDestroyEncoderName = const_cast<char*>("nativeDestroyEncoder");
+static char* kDestroyEncoderSig = const_cast<char*>("(J)V");
+static char* kEncodeName = const_cast<char*>("nativeEncode");
+static char* kEncodeSig =
+    const_cast<char*>("([IJFLjava/nio/Buffer;Ljava/nio/Buffer;)V");
+static char* kWriteOutputName = const_cast<char*>("nativeWriteOutput");
+static char* kWriteOutputSig = const_cast<char*>("([IJLjava/nio/Buffer;)V");
+
+#define JXL_JNI_METHOD(NAME) \
+  (reinterpret_cast<void*>(  \
+      Java_org_jpeg_jpegxl_wrapper_EncoderJni_native##NAME))
+
+static const JNINativeMethod kEncoderMethods[] = {
+    {kCreateEncoderName, kCreateEncoderSig, JXL_JNI_METHOD(CreateEncoder)},
+    {kDestroyEncoderName, kDestroyEncoderSig, JXL_JNI_METHOD(DestroyEncoder)},
+    {kEncodeName, kEncodeSig, JXL_JNI_METHOD(Encode)},
+    {kWriteOutputName, kWriteOutputSig, JXL_JNI_METHOD(WriteOutput)}};
+
+static const size_t kNumEncoderMethods = 4;
+
+#undef JXL_JNI_METHOD
+
+JNIEXPORT jint JNI_OnLoad(JavaVM* vm, void* reserved) {
+  JNIEnv* env;
+  if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK) {
+    return -1;
+  }
+
+  jclass clazz = env->FindClass("org/jpeg/jpegxl/wrapper/EncoderJni");
+  if (clazz == nullptr) {
+    return -1;
+  }
+
+  if (env->RegisterNatives(clazz, kEncoderMethods, kNumEncoderMethods) < 0) {
+    return -1;
+  }
+
+  return JNI_VERSION_1_6;
+}
+
+#ifdef __cplusplus
+}
+#endif
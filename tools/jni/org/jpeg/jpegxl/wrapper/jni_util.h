@@ -0,0 +1,113 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef TOOLS_JNI_ORG_JPEG_JPEGXL_WRAPPER_JNI_UTIL_H_
+#define TOOLS_JNI_ORG_JPEG_JPEGXL_WRAPPER_JNI_UTIL_H_
+
+// Helpers shared by the native parts of the Java wrapper.
+
+#include <jni.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cstdlib>
+
+#include "jxl/types.h"
+#include "lib/jxl/base/status.h"
+
+namespace jxl {
+namespace jni {
+
+template <typename From, typename To>
+bool StaticCast(const From& from, To* to) {
+  To tmp = static_cast<To>(from);
+  // Check sign is preserved.
+  if ((from < 0 && tmp > 0) || (from > 0 && tmp < 0)) return false;
+  // Check value is preserved.
+  if (from != static_cast<From>(tmp)) return false;
+  *to = tmp;
+  return true;
+}
+
+inline bool BufferToSpan(JNIEnv* env, jobject buffer, uint8_t** data,
+                         size_t* size) {
+  if (buffer == nullptr) return true;
+
+  *data = reinterpret_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
+  if (*data == nullptr) return false;
+  return StaticCast(env->GetDirectBufferCapacity(buffer), size);
+}
+
+// Same as BufferToSpan, but for the `length` bytes starting at `offset`,
+// which the Java side takes from the position and limit of the buffer.
+inline bool BufferRangeToSpan(JNIEnv* env, jobject buffer, jint offset,
+                              jint length, uint8_t** data, size_t* size) {
+  uint8_t* all = nullptr;
+  size_t capacity = 0;
+  if (buffer == nullptr || !BufferToSpan(env, buffer, &all, &capacity)) {
+    return false;
+  }
+  size_t begin, num_bytes;
+  if (!StaticCast(offset, &begin) || !StaticCast(length, &num_bytes) ||
+      begin > capacity || num_bytes > capacity - begin) {
+    return false;
+  }
+  *data = all + begin;
+  *size = num_bytes;
+  return true;
+}
+
+// Status codes understood by DecoderJni.makeStatus.
+constexpr jint kStatusOk = 0;
+constexpr jint kStatusInvalidStream = -1;
+constexpr jint kStatusNotEnoughInput = 1;
+constexpr jint kStatusNeedMoreOutput = 2;
+
+inline jint ToStatusCode(const jxl::Status& status) {
+  if (status) return kStatusOk;
+  if (status.IsFatalError()) return kStatusInvalidStream;
+  return kStatusNotEnoughInput;  // Non-fatal -> not enough input.
+}
+
+constexpr const size_t kLastPixelFormat = 3;
+constexpr const size_t kNoPixelFormat = static_cast<size_t>(-1);
+
+// Values of the PixelFormat Java enum.
+inline JxlPixelFormat ToPixelFormat(size_t pixel_format) {
+  if (pixel_format == 0) {
+    // RGBA, 4 x byte per pixel, no scanline padding.
+    return {/*num_channels=*/4, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, /*align=*/0};
+  } else if (pixel_format == 1) {
+    // RGBA, 4 x float16 per pixel, no scanline padding.
+    return {/*num_channels=*/4, JXL_TYPE_FLOAT16, JXL_LITTLE_ENDIAN,
+            /*align=*/0};
+  } else if (pixel_format == 2) {
+    // RGB, 4 x byte per pixel, no scanline padding.
+    return {/*num_channels=*/3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, /*align=*/0};
+  } else if (pixel_format == 3) {
+    // RGB, 4 x float16 per pixel, no scanline padding.
+    return {/*num_channels=*/3, JXL_TYPE_FLOAT16, JXL_LITTLE_ENDIAN,
+            /*align=*/0};
+  } else {
+    abort();
+    return {0, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
+  }
+}
+
+// Native objects owned by Java objects are passed around as jlong handles.
+template <typename T>
+T* FromHandle(jlong handle) {
+  return reinterpret_cast<T*>(static_cast<intptr_t>(handle));
+}
+
+template <typename T>
+jlong ToHandle(T* object) {
+  return static_cast<jlong>(reinterpret_cast<intptr_t>(object));
+}
+
+}  // namespace jni
+}  // namespace jxl
+
+#endif  // TOOLS_JNI_ORG_JPEG_JPEGXL_WRAPPER_JNI_UTIL_H_
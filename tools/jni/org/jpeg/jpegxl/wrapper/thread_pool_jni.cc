@@ -0,0 +1,33 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "tools/jni/org/jpeg/jpegxl/wrapper/thread_pool_jni.h"
+
+#include <jni.h>
+
+#include "jxl/shared_parallel_runner.h"
+#include "tools/jni/org/jpeg/jpegxl/wrapper/jni_util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+JNIEXPORT jlong JNICALL Java_org_jpeg_jpegxl_wrapper_ThreadPool_nativeCreate(
+    JNIEnv* /* env */, jobject /* jobj */, jint num_threads) {
+  size_t num_worker_threads;
+  if (!jxl::jni::StaticCast(num_threads, &num_worker_threads)) return 0;
+  return jxl::jni::ToHandle(
+      JxlSharedThreadPoolCreate(/*memory_manager=*/nullptr,
+                                num_worker_threads));
+}
+
+JNIEXPORT void JNICALL Java_org_jpeg_jpegxl_wrapper_ThreadPool_nativeDestroy(
+    JNIEnv* /* env */, jobject /* jobj */, jlong pool) {
+  JxlSharedThreadPoolDestroy(jxl::jni::FromHandle<void>(pool));
+}
+
+#ifdef __cplusplus
+}
+#endif
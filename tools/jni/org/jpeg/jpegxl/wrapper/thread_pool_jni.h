@@ -0,0 +1,32 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef TOOLS_JNI_ORG_JPEG_JPEGXL_WRAPPER_THREAD_POOL_JNI
+#define TOOLS_JNI_ORG_JPEG_JPEGXL_WRAPPER_THREAD_POOL_JNI
+
+#include <jni.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Create a thread pool shared by decoders and encoders, or return 0 on
+ * failure.
+ *
+ * @param num_threads number of worker threads
+ */
+JNIEXPORT jlong JNICALL Java_org_jpeg_jpegxl_wrapper_ThreadPool_nativeCreate(
+    JNIEnv* env, jobject /*jobj*/, jint num_threads);
+
+/** Destroy a thread pool created by nativeCreate. */
+JNIEXPORT void JNICALL Java_org_jpeg_jpegxl_wrapper_ThreadPool_nativeDestroy(
+    JNIEnv* env, jobject /*jobj*/, jlong pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TOOLS_JNI_ORG_JPEG_JPEGXL_WRAPPER_THREAD_POOL_JNI
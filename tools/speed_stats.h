@@ -32,6 +32,10 @@ class SpeedStats {
   // Non-const, may sort elapsed_.
   bool GetSummary(Summary* summary);
 
+  // Elapsed times of all the reps, in the order they were notified unless
+  // GetSummary was called.
+  const std::vector<double>& Elapsed() const { return elapsed_; }
+
   // Sets the image size to allow computing MP/s values.
   void SetImageSize(size_t xsize, size_t ysize) {
     xsize_ = xsize;